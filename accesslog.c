@@ -0,0 +1,253 @@
+//
+// Created by User on 14/10/2026.
+//
+#include "accesslog.h"
+
+// Everything the writer thread needs. Rings are only ever added, at the front of the list, so the writer can walk the
+// list from whatever head it sees without holding the lock.
+static struct {
+    bool enabled;
+    char *path;
+    int format;
+    off_t rotate_size;
+    int fd;
+    off_t file_size;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    access_log_ring_t *rings;
+    // Drops already marked in the log.
+    uint64_t dropped_logged;
+} access_log = {false, NULL, ACCESS_LOG_TEXT, 0, -1, 0, 0, PTHREAD_MUTEX_INITIALIZER, NULL, 0};
+
+// Opens the log file for appending, and starts a binary log with its header if the file is new. Returns false (after
+// printing the reason) if it could not be opened.
+static bool open_log_file(void) {
+    int fd = open(access_log.path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, ACCESS_LOG_FILE_MODE);
+    struct stat file_stat;
+    if(fd < 0 || fstat(fd, &file_stat) < 0) {
+        perror(access_log.path);
+        if(fd >= 0) {
+            close(fd);
+        }
+        return false;
+    }
+    access_log.fd = fd;
+    access_log.file_size = file_stat.st_size;
+    if(access_log.format == ACCESS_LOG_BINARY && file_stat.st_size == 0) {
+        access_log_file_header_t header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, ACCESS_LOG_MAGIC, ACCESS_LOG_MAGIC_SIZE);
+        header.record_size = sizeof(access_log_record_t);
+        if(write(fd, &header, sizeof(header)) == (ssize_t) sizeof(header)) {
+            access_log.file_size = sizeof(header);
+        }
+    }
+    return true;
+}
+
+// Moves the log to path.1 (and each older one to the next number up, dropping the oldest) and starts a new one. If
+// the new one cannot be opened the old file is kept on being appended to instead.
+static void rotate_log_file(void) {
+    char from[PATH_MAX];
+    char to[PATH_MAX];
+    for(int i = ACCESS_LOG_ROTATED_FILES - 1; i >= 1; i--) {
+        snprintf(from, sizeof(from), "%s.%d", access_log.path, i);
+        snprintf(to, sizeof(to), "%s.%d", access_log.path, i + 1);
+        rename(from, to);
+    }
+    snprintf(to, sizeof(to), "%s.1", access_log.path);
+    if(rename(access_log.path, to) < 0) {
+        perror("rename");
+        return;
+    }
+    int old_fd = access_log.fd;
+    if(!open_log_file()) {
+        access_log.fd = old_fd;
+        return;
+    }
+    close(old_fd);
+}
+
+// Writes out the length bytes of batch, and rotates the log if that took it past the rotation size.
+static void flush_batch(const char *batch, size_t length) {
+    size_t written = 0;
+    while(written < length) {
+        ssize_t n = write(access_log.fd, batch + written, length - written);
+        if(n < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            perror("write");
+            return;
+        }
+        written += n;
+    }
+    access_log.file_size += length;
+    if(access_log.rotate_size > 0 && access_log.file_size >= access_log.rotate_size) {
+        rotate_log_file();
+    }
+}
+
+// Writes time (CLOCK_REALTIME nanoseconds) in UTC as an ISO 8601 timestamp with microseconds into buffer, which has
+// size bytes of room.
+static void format_time(char *buffer, size_t size, int64_t time) {
+    time_t seconds = (time_t) (time / NANOSECONDS_PER_SECOND);
+    long microseconds = (long) (time % NANOSECONDS_PER_SECOND) / NANOSECONDS_PER_MICROSECOND;
+    struct tm utc;
+    gmtime_r(&seconds, &utc);
+    size_t length = strftime(buffer, size, "%Y-%m-%dT%H:%M:%S", &utc);
+    snprintf(buffer + length, size - length, ".%06ldZ", microseconds);
+}
+
+// Formats record as one line of the text log into line, which has ACCESS_LOG_LINE_MAX_SIZE bytes of room, and returns
+// its length: the time, method, path, status, bytes sent and seconds taken, with "aborted" after responses that were
+// not sent in full. The parser only lets printable bytes other than space into a method or path, so neither needs
+// quoting. A request that could not be parsed has "-" for both.
+static size_t format_text_record(char *line, const access_log_record_t *record) {
+    char time[64];
+    format_time(time, sizeof(time), record->time);
+    if(record->status == ACCESS_LOG_DROPPED_STATUS) {
+        return snprintf(line, ACCESS_LOG_LINE_MAX_SIZE, "# %s dropped %llu records\n", time,
+                        (unsigned long long) record->bytes);
+    }
+    int method_length = record->method_length > 0 ? record->method_length : 1;
+    int path_length = record->path_length > 0 ? record->path_length : 1;
+    return snprintf(line, ACCESS_LOG_LINE_MAX_SIZE, "%s %.*s %.*s %d %llu %.6f%s\n", time, method_length,
+                    record->method_length > 0 ? record->method : "-", path_length,
+                    record->path_length > 0 ? record->path : "-", record->status, (unsigned long long) record->bytes,
+                    (double) record->duration / NANOSECONDS_PER_SECOND, record->completed ? "" : " aborted");
+}
+
+// Adds record to the batch in the log's format, writing the batch out first if there is no room left for it.
+static void add_to_batch(char *batch, size_t *length, const access_log_record_t *record) {
+    if(*length + ACCESS_LOG_LINE_MAX_SIZE > ACCESS_LOG_BATCH_SIZE) {
+        flush_batch(batch, *length);
+        *length = 0;
+    }
+    if(access_log.format == ACCESS_LOG_BINARY) {
+        memcpy(batch + *length, record, sizeof(access_log_record_t));
+        *length += sizeof(access_log_record_t);
+    } else {
+        *length += format_text_record(batch + *length, record);
+    }
+}
+
+// Takes every record the workers have added since the last time out of their rings, and writes them out in as few
+// write()s as the batch allows. Drops since the last time are marked with a record of their own. The records of each
+// worker come out in order, but those of different workers are only as close to it as the flush interval.
+static void drain_rings(char *batch) {
+    size_t length = 0;
+    uint64_t dropped = 0;
+    access_log_ring_t *ring = __atomic_load_n(&access_log.rings, __ATOMIC_ACQUIRE);
+    for(; ring != NULL; ring = ring->next) {
+        // The acquire load of tail pairs with the release store in access_log_append, so the records before it are
+        // all there. head is only ever written here.
+        uint64_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+        for(uint64_t position = ring->head; position != tail; position++) {
+            add_to_batch(batch, &length, &ring->records[position & (ACCESS_LOG_RING_RECORDS - 1)]);
+        }
+        // The slots go back to the worker only once they have been copied out.
+        __atomic_store_n(&ring->head, tail, __ATOMIC_RELEASE);
+        dropped += __atomic_load_n(&ring->dropped, __ATOMIC_RELAXED);
+    }
+
+    if(dropped > access_log.dropped_logged) {
+        access_log_record_t marker;
+        memset(&marker, 0, sizeof(marker));
+        struct timespec now;
+        clock_gettime(CLOCK_REALTIME, &now);
+        marker.time = now.tv_sec * NANOSECONDS_PER_SECOND + now.tv_nsec;
+        marker.status = ACCESS_LOG_DROPPED_STATUS;
+        marker.bytes = dropped - access_log.dropped_logged;
+        add_to_batch(batch, &length, &marker);
+        access_log.dropped_logged = dropped;
+    }
+    if(length > 0) {
+        flush_batch(batch, length);
+    }
+}
+
+// The body of the writer thread. Waking up on a timer rather than being woken by the workers keeps them from ever
+// making a system call to log, at the cost of the log running up to ACCESS_LOG_FLUSH_INTERVAL_MS behind.
+static void *write_access_log(void *batch) {
+    struct timespec interval = {0, ACCESS_LOG_FLUSH_INTERVAL_MS * 1000000L};
+    while(true) {
+        nanosleep(&interval, NULL);
+        drain_rings((char *) batch);
+    }
+    return NULL;
+}
+
+// Opens the access log if config has one, and starts the thread that writes it. Has to be called before any worker or
+// loop starts, and after SIGUSR1 is blocked, as with metrics_init. Returns false if the log could not be opened.
+bool access_log_init(server_config_t *config) {
+    if(config->access_log_path == NULL) {
+        return true;
+    }
+    access_log.path = config->access_log_path;
+    access_log.format = config->access_log_format;
+    access_log.rotate_size = (off_t) config->access_log_rotate_mb * BYTES_PER_MB;
+    if(!open_log_file()) {
+        return false;
+    }
+    char *batch = (char *) malloc(ACCESS_LOG_BATCH_SIZE);
+    if(batch == NULL) {
+        perror("malloc");
+        return false;
+    }
+    access_log.enabled = true;
+    int error = pthread_create(&access_log.thread, NULL, write_access_log, (void *) batch);
+    if(error != 0) {
+        fprintf(stderr, "pthread_create: %s\n", strerror(error));
+        return false;
+    }
+    return true;
+}
+
+bool access_log_enabled(void) {
+    return access_log.enabled;
+}
+
+// Gives the calling worker a ring of its own. Returns NULL if there is no access log (or the memory could not be
+// allocated), in which case the worker's responses are not logged.
+access_log_ring_t *access_log_register_ring(void) {
+    if(!access_log.enabled) {
+        return NULL;
+    }
+    void *memory;
+    if(posix_memalign(&memory, ACCESS_LOG_CACHE_LINE_SIZE, sizeof(access_log_ring_t)) != 0) {
+        fprintf(stderr, "ERROR, could not allocate the access log ring of a worker.\n");
+        return NULL;
+    }
+    access_log_ring_t *ring = (access_log_ring_t *) memory;
+    ring->head = ring->tail = ring->dropped = 0;
+    pthread_mutex_lock(&access_log.lock);
+    ring->next = access_log.rings;
+    // Released so the writer never sees the ring before its fields are set.
+    __atomic_store_n(&access_log.rings, ring, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&access_log.lock);
+    return ring;
+}
+
+// Adds record to the calling worker's ring, or counts it as dropped if the writer has fallen a whole ring behind.
+// Only the used part of the path is copied.
+void access_log_append(access_log_ring_t *ring, const access_log_record_t *record) {
+    uint64_t tail = ring->tail;
+    if(tail - __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == ACCESS_LOG_RING_RECORDS) {
+        __atomic_store_n(&ring->dropped, ring->dropped + 1, __ATOMIC_RELAXED);
+        return;
+    }
+    memcpy(&ring->records[tail & (ACCESS_LOG_RING_RECORDS - 1)], record,
+           offsetof(access_log_record_t, path) + record->path_length);
+    __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+// The number of records dropped so far because a ring was full.
+uint64_t access_log_dropped(void) {
+    uint64_t dropped = 0;
+    for(access_log_ring_t *ring = __atomic_load_n(&access_log.rings, __ATOMIC_ACQUIRE); ring != NULL;
+        ring = ring->next) {
+        dropped += __atomic_load_n(&ring->dropped, __ATOMIC_RELAXED);
+    }
+    return dropped;
+}
@@ -0,0 +1,99 @@
+//
+// Created by User on 14/10/2026.
+//
+
+#ifndef COMP30023_2022_PROJECT_2_ACCESSLOG_H
+#define COMP30023_2022_PROJECT_2_ACCESSLOG_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <time.h>
+
+#include <sys/stat.h>
+
+#include "config.h"
+
+// Records each worker's ring holds. A power of two, so a position is turned into a slot with a mask.
+#define ACCESS_LOG_RING_RECORDS 2048
+// Longest method and path kept in a record. Longer ones are cut short.
+#define ACCESS_LOG_METHOD_MAX 8
+#define ACCESS_LOG_PATH_MAX 216
+// The writer thread wakes up this often to drain the rings, and writes to the file whenever its batch fills up.
+#define ACCESS_LOG_FLUSH_INTERVAL_MS 10
+#define ACCESS_LOG_BATCH_SIZE (64 * 1024)
+// Longest text line a record becomes, which is how much room the batch must have left before one is added.
+#define ACCESS_LOG_LINE_MAX_SIZE 512
+// A rotated log is renamed to path.1, the one before it to path.2, and so on up to this many.
+#define ACCESS_LOG_ROTATED_FILES 4
+#define ACCESS_LOG_FILE_MODE 0644
+#define ACCESS_LOG_CACHE_LINE_SIZE 64
+#define NANOSECONDS_PER_SECOND 1000000000LL
+#define NANOSECONDS_PER_MICROSECOND 1000
+
+// Binary logs start with this header, followed by nothing but access_log_record_t, in the byte order of the server.
+#define ACCESS_LOG_MAGIC "ACCLOG01"
+#define ACCESS_LOG_MAGIC_SIZE 8
+
+// A record with this status is not a response: it marks that bytes records were dropped because a ring was full.
+#define ACCESS_LOG_DROPPED_STATUS 0
+
+// One response, in the fixed format both the rings and binary logs hold. 256 bytes with no padding, so it has the same
+// layout whatever compiles the tool that reads it. The bytes of path after path_length are left over from whatever
+// was in the slot before.
+typedef struct access_log_record access_log_record_t;
+struct access_log_record {
+    // CLOCK_REALTIME in nanoseconds when the response was done with.
+    int64_t time;
+    // Nanoseconds from the request's first byte (or the connection being accepted) until then.
+    uint64_t duration;
+    uint64_t bytes;
+    uint16_t status;
+    // 1 if the response was sent in full, 0 if the connection failed first.
+    uint8_t completed;
+    uint8_t method_length;
+    uint16_t path_length;
+    uint16_t reserved;
+    char method[ACCESS_LOG_METHOD_MAX];
+    char path[ACCESS_LOG_PATH_MAX];
+};
+
+typedef struct access_log_file_header access_log_file_header_t;
+struct access_log_file_header {
+    char magic[ACCESS_LOG_MAGIC_SIZE];
+    uint32_t record_size;
+    uint32_t reserved;
+};
+
+// A single producer, single consumer ring of records. Only the worker that owns it moves tail (and counts drops), and
+// only the writer thread moves head, so neither ever waits for the other: a worker that finds the ring full drops the
+// record instead. head and tail are on cache lines of their own so the two threads do not keep taking the same line
+// away from each other.
+typedef struct access_log_ring access_log_ring_t;
+struct access_log_ring {
+    uint64_t tail;
+    uint64_t dropped;
+    uint64_t head __attribute__((aligned(ACCESS_LOG_CACHE_LINE_SIZE)));
+    access_log_ring_t *next;
+    access_log_record_t records[ACCESS_LOG_RING_RECORDS] __attribute__((aligned(ACCESS_LOG_CACHE_LINE_SIZE)));
+};
+
+bool access_log_init(server_config_t *config);
+
+bool access_log_enabled(void);
+
+access_log_ring_t *access_log_register_ring(void);
+
+void access_log_append(access_log_ring_t *ring, const access_log_record_t *record);
+
+uint64_t access_log_dropped(void);
+
+#endif //COMP30023_2022_PROJECT_2_ACCESSLOG_H
@@ -0,0 +1,179 @@
+//
+// Created by User on 14/10/2026.
+//
+#include "admission.h"
+
+typedef struct admission_shard admission_shard_t;
+struct admission_shard {
+    pthread_mutex_t lock;
+    address_count_t *buckets[ADMISSION_BUCKETS_PER_SHARD];
+};
+
+// Every connection the server has open, against --max-connections and --max-connections-per-ip, and what was done
+// about the ones over them. A connection is counted from being admitted on the acceptor (or loop) that accepted it
+// until whichever thread served it releases it.
+static struct {
+    int max_connections;
+    int pressure_connections;
+    int max_per_address;
+    int open_connections;
+    admission_shard_t *shards;
+    uint64_t counters[ADMISSION_NUM_COUNTERS];
+} admission = {0, 0, 0, 0, NULL, {0}};
+
+// Reads the limits from config, and sets up the table of addresses if there is a limit per address. Returns false if
+// it could not be allocated.
+bool admission_init(server_config_t *config) {
+    admission.max_connections = config->max_connections;
+    admission.pressure_connections = (int) ((long long) config->max_connections * ADMISSION_PRESSURE_PERCENT / 100);
+    admission.max_per_address = config->max_connections_per_ip;
+    if(admission.max_per_address == 0) {
+        return true;
+    }
+    admission.shards = (admission_shard_t *) calloc(ADMISSION_SHARDS, sizeof(admission_shard_t));
+    if(admission.shards == NULL) {
+        perror("calloc");
+        return false;
+    }
+    for(int i = 0; i < ADMISSION_SHARDS; i++) {
+        pthread_mutex_init(&admission.shards[i].lock, NULL);
+    }
+    return true;
+}
+
+// Turns the address a connection came from into the form it is counted under. Anything that is neither IPv4 nor IPv6
+// (a Unix socket, say) is counted as the unspecified address.
+static void address_of(const struct sockaddr_storage *client_address, struct in6_addr *address) {
+    memset(address, 0, sizeof(*address));
+    if(client_address->ss_family == AF_INET6) {
+        *address = ((const struct sockaddr_in6 *) client_address)->sin6_addr;
+    } else if(client_address->ss_family == AF_INET) {
+        address->s6_addr[10] = address->s6_addr[11] = 0xff;
+        memcpy(&address->s6_addr[12], &((const struct sockaddr_in *) client_address)->sin_addr, 4);
+    }
+}
+
+// FNV-1a over the 16 bytes of the address. http://www.isthe.com/chongo/tech/comp/fnv/
+static uint64_t hash_address(const struct in6_addr *address) {
+    uint64_t hash = 14695981039346656037ULL;
+    for(int i = 0; i < 16; i++) {
+        hash = (hash ^ address->s6_addr[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+static admission_shard_t *shard_of(uint64_t hash) {
+    return &admission.shards[hash % ADMISSION_SHARDS];
+}
+
+// Counts a connection from client_address against the limit per address. Returns false if the address already has
+// as many as it may, and otherwise stores what admission_release needs in address.
+static bool admit_address(const struct sockaddr_storage *client_address, address_count_t **address) {
+    struct in6_addr key;
+    address_of(client_address, &key);
+    uint64_t hash = hash_address(&key);
+    admission_shard_t *shard = shard_of(hash);
+    address_count_t **bucket = &shard->buckets[(hash / ADMISSION_SHARDS) % ADMISSION_BUCKETS_PER_SHARD];
+
+    pthread_mutex_lock(&shard->lock);
+    address_count_t *count = *bucket;
+    while(count != NULL && !(count->hash == hash && memcmp(&count->address, &key, sizeof(key)) == 0)) {
+        count = count->next;
+    }
+    if(count == NULL) {
+        if((count = (address_count_t *) malloc(sizeof(address_count_t))) == NULL) {
+            pthread_mutex_unlock(&shard->lock);
+            perror("malloc");
+            return false;
+        }
+        count->address = key;
+        count->hash = hash;
+        count->connections = 0;
+        count->next = *bucket;
+        *bucket = count;
+    }
+    bool admitted = count->connections < admission.max_per_address;
+    if(admitted) {
+        count->connections++;
+        *address = count;
+    }
+    pthread_mutex_unlock(&shard->lock);
+    return admitted;
+}
+
+// Decides whether a connection just accepted on sockfd from client_address may be served. client_address may be NULL
+// if accept() did not say, and is then only asked for (getpeername()) when there is a limit per address. Returns
+// ADMISSION_ACCEPTED, in which case the connection counts until it is handed to admission_release along with what
+// was stored in address (NULL when there is no limit per address), or the reason it may not, in which case it should
+// go to admission_reject.
+int admission_admit(int sockfd, const struct sockaddr_storage *client_address, address_count_t **address) {
+    *address = NULL;
+    int open_connections = __atomic_add_fetch(&admission.open_connections, 1, __ATOMIC_RELAXED);
+    if(admission.max_connections > 0 && open_connections > admission.max_connections) {
+        __atomic_sub_fetch(&admission.open_connections, 1, __ATOMIC_RELAXED);
+        return ADMISSION_SERVER_FULL;
+    }
+    struct sockaddr_storage peer_address;
+    if(admission.max_per_address > 0 && client_address == NULL) {
+        socklen_t peer_address_size = sizeof(peer_address);
+        if(getpeername(sockfd, (struct sockaddr *) &peer_address, &peer_address_size) < 0) {
+            peer_address.ss_family = AF_UNSPEC;
+        }
+        client_address = &peer_address;
+    }
+    if(admission.max_per_address > 0 && !admit_address(client_address, address)) {
+        __atomic_sub_fetch(&admission.open_connections, 1, __ATOMIC_RELAXED);
+        return ADMISSION_ADDRESS_FULL;
+    }
+    return ADMISSION_ACCEPTED;
+}
+
+// Stops counting a connection admitted by admission_admit, once it has been closed. An address is forgotten along
+// with its last connection, so the table only ever holds the addresses with connections open.
+void admission_release(address_count_t *address) {
+    __atomic_sub_fetch(&admission.open_connections, 1, __ATOMIC_RELAXED);
+    if(address == NULL) {
+        return;
+    }
+    admission_shard_t *shard = shard_of(address->hash);
+    pthread_mutex_lock(&shard->lock);
+    if(--address->connections == 0) {
+        address_count_t **link = &shard->buckets[(address->hash / ADMISSION_SHARDS) % ADMISSION_BUCKETS_PER_SHARD];
+        while(*link != address) {
+            link = &(*link)->next;
+        }
+        *link = address->next;
+        free(address);
+    }
+    pthread_mutex_unlock(&shard->lock);
+}
+
+// Returns true if the server is close enough to --max-connections that idle connections should make way for new ones.
+bool admission_under_pressure(void) {
+    return admission.max_connections > 0 &&
+           __atomic_load_n(&admission.open_connections, __ATOMIC_RELAXED) >= admission.pressure_connections;
+}
+
+// Turns away a connection admission_admit did not accept, with a 503 unless it is HTTPS, and closes it. The socket
+// was only just accepted, so its send buffer is empty and the response never has to wait (MSG_DONTWAIT makes sure).
+void admission_reject(int sockfd, int verdict, bool tls) {
+    admission_record(verdict);
+    if(!tls) {
+        send(sockfd, SERVICE_UNAVAILABLE_RESPONSE, strlen(SERVICE_UNAVAILABLE_RESPONSE), MSG_DONTWAIT | MSG_NOSIGNAL);
+    }
+    close(sockfd);
+}
+
+// Counts a connection refused or closed early for the reason counter. These are rare enough that every thread adding
+// to the same counter costs nothing worth splitting them up for.
+void admission_record(int counter) {
+    __atomic_add_fetch(&admission.counters[counter], 1, __ATOMIC_RELAXED);
+}
+
+uint64_t admission_count(int counter) {
+    return __atomic_load_n(&admission.counters[counter], __ATOMIC_RELAXED);
+}
+
+int admission_open_connections(void) {
+    return __atomic_load_n(&admission.open_connections, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,79 @@
+//
+// Created by User on 14/10/2026.
+//
+
+#ifndef COMP30023_2022_PROJECT_2_ADMISSION_H
+#define COMP30023_2022_PROJECT_2_ADMISSION_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "config.h"
+
+// The addresses with connections open are kept in a hash table split into shards, each with a lock of its own, so
+// accepts on different loops (or by different acceptors) rarely wait for each other.
+#define ADMISSION_SHARDS 64
+#define ADMISSION_BUCKETS_PER_SHARD 64
+// Past this share of --max-connections the server is under pressure: the event and io_uring loops evict their
+// slowest connection for every one they accept, and workers stop keeping connections alive.
+#define ADMISSION_PRESSURE_PERCENT 90
+// Only a connection that has made no progress for at least this many seconds is evicted under pressure, so a
+// connection that is busy being served is never cut off.
+#define ADMISSION_EVICT_MIN_IDLE 1
+
+// What admission_admit decided.
+#define ADMISSION_ACCEPTED 0
+#define ADMISSION_SERVER_FULL 1
+#define ADMISSION_ADDRESS_FULL 2
+
+// Why a connection was closed by the server before the client was done with it, which is also what its deadline is
+// for while the connection has one: the whole request has to arrive before the header timeout, a response has to
+// make progress at least every send timeout, and the next request has to start within the keep-alive timeout.
+// Connections refused by admission_admit are counted with the verdict's number, after these.
+#define ADMISSION_HEADER_TIMEOUT 3
+#define ADMISSION_SEND_TIMEOUT 4
+#define ADMISSION_IDLE_TIMEOUT 5
+#define ADMISSION_EVICTED 6
+#define ADMISSION_NUM_COUNTERS 7
+
+// Sent to a plain HTTP client turned away because the server (or its address) is full. HTTPS clients are simply
+// disconnected, as they would not read anything before a handshake.
+#define SERVICE_UNAVAILABLE_RESPONSE \
+    "HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\nRetry-After: 1\r\nConnection: close\r\n\r\n"
+
+// The number of connections open from one address. IPv4 addresses are kept as IPv4-mapped IPv6 ones so both are
+// compared the same way.
+typedef struct address_count address_count_t;
+struct address_count {
+    struct in6_addr address;
+    uint64_t hash;
+    int connections;
+    address_count_t *next;
+};
+
+bool admission_init(server_config_t *config);
+
+int admission_admit(int sockfd, const struct sockaddr_storage *client_address, address_count_t **address);
+
+void admission_release(address_count_t *address);
+
+bool admission_under_pressure(void);
+
+void admission_reject(int sockfd, int verdict, bool tls);
+
+void admission_record(int counter);
+
+uint64_t admission_count(int counter);
+
+int admission_open_connections(void);
+
+#endif //COMP30023_2022_PROJECT_2_ADMISSION_H
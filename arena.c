@@ -0,0 +1,119 @@
+//
+// Created by User on 14/10/2026.
+//
+#include "arena.h"
+
+allocation_counters_t allocation_counters;
+
+// Adds one to one of the allocation counters.
+void count_allocation_event(percpu_counter_t *counter) {
+    percpu_add(counter, 1);
+}
+
+// malloc() that is counted in allocation_counters.heap_allocations. Used for every allocation made while serving
+// requests, so the counter shows whether the steady state really is free of heap allocations.
+void *counted_malloc(size_t size) {
+    count_allocation_event(&allocation_counters.heap_allocations);
+    return malloc(size);
+}
+
+char *counted_strdup(const char *string) {
+    count_allocation_event(&allocation_counters.heap_allocations);
+    return strdup(string);
+}
+
+// Rounds size up to the next multiple of ARENA_ALIGNMENT.
+static size_t align_size(size_t size) {
+    return (size + ARENA_ALIGNMENT - 1) / ARENA_ALIGNMENT * ARENA_ALIGNMENT;
+}
+
+// Sets up an empty arena of capacity bytes. Returns false if the memory could not be allocated.
+bool arena_init(arena_t *arena, size_t capacity) {
+    arena->memory = (char *) malloc(capacity);
+    if(arena->memory == NULL) {
+        perror("malloc");
+        return false;
+    }
+    arena->capacity = capacity;
+    arena->used = 0;
+    arena->overflow = NULL;
+    return true;
+}
+
+// Allocates size bytes that stay valid until the next arena_reset. Returns NULL only if an overflow block was needed
+// and could not be allocated.
+void *arena_alloc(arena_t *arena, size_t size) {
+    size = align_size(size);
+    if(size <= arena->capacity - arena->used) {
+        void *memory = arena->memory + arena->used;
+        arena->used += size;
+        return memory;
+    }
+    count_allocation_event(&allocation_counters.arena_overflows);
+    arena_block_t *block = (arena_block_t *) counted_malloc(sizeof(arena_block_t) + size);
+    if(block == NULL) {
+        return NULL;
+    }
+    block->next = arena->overflow;
+    arena->overflow = block;
+    return block->memory;
+}
+
+// Throws away everything allocated from the arena since the last reset.
+void arena_reset(arena_t *arena) {
+    arena->used = 0;
+    while(arena->overflow != NULL) {
+        arena_block_t *next = arena->overflow->next;
+        free(arena->overflow);
+        arena->overflow = next;
+    }
+}
+
+// Sets up an empty pool that keeps up to capacity unused buffers of buffer_size bytes. Returns false if the memory
+// could not be allocated.
+bool buffer_pool_init(buffer_pool_t *pool, int capacity, size_t buffer_size) {
+    pool->free_buffers = (char **) malloc(capacity * sizeof(char *));
+    if(pool->free_buffers == NULL) {
+        perror("malloc");
+        return false;
+    }
+    pool->num_free = 0;
+    pool->capacity = capacity;
+    pool->buffer_size = buffer_size;
+    return true;
+}
+
+// Returns a buffer of pool->buffer_size bytes, reusing one that was released earlier if there is one. Returns NULL if
+// a new buffer was needed and could not be allocated.
+char *buffer_pool_acquire(buffer_pool_t *pool) {
+    if(pool->num_free > 0) {
+        count_allocation_event(&allocation_counters.buffer_reuses);
+        return pool->free_buffers[--pool->num_free];
+    }
+    return (char *) counted_malloc(pool->buffer_size);
+}
+
+// Hands a buffer from buffer_pool_acquire back for reuse. Buffers beyond the pool's capacity are freed, so a burst of
+// connections does not pin its memory forever.
+void buffer_pool_release(buffer_pool_t *pool, char *buffer) {
+    if(pool->num_free < pool->capacity) {
+        pool->free_buffers[pool->num_free++] = buffer;
+    } else {
+        free(buffer);
+    }
+}
+
+// Sets up a worker's arena and a pool of read buffers of buffer_size bytes. Called from the worker's own thread.
+bool worker_memory_init(worker_memory_t *memory, size_t buffer_size) {
+    return arena_init(&memory->arena, ARENA_SIZE) &&
+           buffer_pool_init(&memory->buffers, BUFFER_POOL_CAPACITY, buffer_size);
+}
+
+// Writes the current allocation counters to stream on one line.
+void print_allocation_counters(FILE *stream) {
+    fprintf(stream, "allocations: requests=%lu heap_allocations=%lu arena_overflows=%lu buffer_reuses=%lu\n",
+            percpu_sum(&allocation_counters.requests),
+            percpu_sum(&allocation_counters.heap_allocations),
+            percpu_sum(&allocation_counters.arena_overflows),
+            percpu_sum(&allocation_counters.buffer_reuses));
+}
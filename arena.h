@@ -0,0 +1,96 @@
+//
+// Created by User on 14/10/2026.
+//
+
+#ifndef COMP30023_2022_PROJECT_2_ARENA_H
+#define COMP30023_2022_PROJECT_2_ARENA_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "percpu.h"
+
+// Big enough for everything a request allocates (at the moment, its file path) unless the web root itself is huge.
+#define ARENA_SIZE 8192
+// Every allocation is aligned as malloc() would align it.
+#define ARENA_ALIGNMENT (sizeof(max_align_t))
+
+// Number of unused read buffers a worker keeps around for the next connection.
+#define BUFFER_POOL_CAPACITY 1024
+
+// A bump allocator for memory that only lives as long as one request. Allocating is just moving used along, and
+// everything is thrown away at once with arena_reset, so a worker never calls malloc() or free() for it. Allocations
+// that don't fit go into overflow blocks taken from the heap, which are freed again by arena_reset.
+typedef struct arena_block arena_block_t;
+struct arena_block {
+    arena_block_t *next;
+    max_align_t memory[];
+};
+
+typedef struct arena arena_t;
+struct arena {
+    char *memory;
+    size_t capacity;
+    size_t used;
+    arena_block_t *overflow;
+};
+
+// Read buffers of a fixed size that are handed back here when a connection no longer needs one, so the next
+// connection reuses them instead of allocating a new one. Each pool belongs to one worker or event loop and is only
+// used from its thread, so it needs no lock.
+typedef struct buffer_pool buffer_pool_t;
+struct buffer_pool {
+    char **free_buffers;
+    int num_free;
+    int capacity;
+    size_t buffer_size;
+};
+
+// Process wide counts that show whether the request path allocates. In the steady state only requests and
+// buffer_reuses should go up. Every worker adds to them on every request but they are only ever read to be reported,
+// so each one is split per CPU.
+typedef struct allocation_counters allocation_counters_t;
+struct allocation_counters {
+    percpu_counter_t requests;
+    // Every malloc() made while serving requests: new read buffers and connections, arena overflow blocks and
+    // files loaded into the caches.
+    percpu_counter_t heap_allocations;
+    percpu_counter_t arena_overflows;
+    percpu_counter_t buffer_reuses;
+};
+
+// Everything a worker (or event loop) allocates requests from.
+typedef struct worker_memory worker_memory_t;
+struct worker_memory {
+    arena_t arena;
+    buffer_pool_t buffers;
+};
+
+extern allocation_counters_t allocation_counters;
+
+void count_allocation_event(percpu_counter_t *counter);
+
+void *counted_malloc(size_t size);
+
+char *counted_strdup(const char *string);
+
+bool arena_init(arena_t *arena, size_t capacity);
+
+void *arena_alloc(arena_t *arena, size_t size);
+
+void arena_reset(arena_t *arena);
+
+bool buffer_pool_init(buffer_pool_t *pool, int capacity, size_t buffer_size);
+
+char *buffer_pool_acquire(buffer_pool_t *pool);
+
+void buffer_pool_release(buffer_pool_t *pool, char *buffer);
+
+bool worker_memory_init(worker_memory_t *memory, size_t buffer_size);
+
+void print_allocation_counters(FILE *stream);
+
+#endif //COMP30023_2022_PROJECT_2_ARENA_H
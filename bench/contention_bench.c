@@ -0,0 +1,400 @@
+//
+// Created by User on 14/10/2026.
+//
+// Measures how the structures every worker shares scale as more threads use them at once, against the locked
+// versions they replaced: lookups in the read-mostly hash map (rcumap.c with ebr.c) against the same map behind
+// per-shard mutexes, per-CPU counters (percpu.c) against a single atomic counter and a counter behind a mutex, and the
+// lock-free connection queue (mpmc.c) against a ring behind a mutex. Built with "make contention_bench" and run as
+//
+//     ./contention_bench [max_threads]
+//
+// Each structure is run with 1, 2, 4 and so on up to max_threads (64 by default) threads for BENCH_DURATION_MS each,
+// and the table gives millions of operations per second across all threads. On a machine with fewer CPUs than
+// threads the extra threads only take turns, so the numbers stop showing anything past the number of CPUs.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "../ebr.h"
+#include "../rcumap.h"
+#include "../percpu.h"
+#include "../mpmc.h"
+
+#define DEFAULT_MAX_THREADS 64
+#define BENCH_DURATION_MS 250
+#define NANOSECONDS_PER_MILLISECOND 1000000L
+#define OPERATIONS_PER_MILLION 1e6
+
+// The map has as many shards and buckets as the file cache, and MAP_KEYS entries in it. A writer replaces one entry
+// every WRITER_INTERVAL_NS the whole time, so readers keep running into entries that are being retired.
+#define MAP_SHARDS 16
+#define MAP_BUCKETS_PER_SHARD 1024
+#define MAP_KEYS 4096
+#define WRITER_INTERVAL_NS 100000L
+// Written into an entry while it can be found, and over it just before it is freed, so a reader that gets to an
+// entry after it has been freed notices.
+#define ENTRY_LIVE 0x4c495645ULL
+#define ENTRY_DEAD 0x44454144ULL
+
+#define QUEUE_CAPACITY 1024
+
+typedef struct bench_entry bench_entry_t;
+struct bench_entry {
+    rcu_map_node_t node;
+    uint64_t key;
+    uint64_t hash;
+    uint64_t magic;
+    ebr_retired_t retired;
+};
+
+typedef struct bench_shard bench_shard_t;
+struct bench_shard {
+    pthread_mutex_t lock;
+    rcu_map_t map;
+    rcu_map_node_t *buckets[MAP_BUCKETS_PER_SHARD];
+};
+
+// A queue of ints behind a mutex, as the worker pool's queue was.
+typedef struct locked_queue locked_queue_t;
+struct locked_queue {
+    pthread_mutex_t lock;
+    int items[QUEUE_CAPACITY];
+    int head;
+    int count;
+};
+
+typedef struct bench_thread bench_thread_t;
+struct bench_thread {
+    pthread_t thread;
+    int index;
+    int num_threads;
+    unsigned long operations;
+};
+
+static bench_shard_t shards[MAP_SHARDS];
+static percpu_counter_t percpu_counter;
+static unsigned long atomic_counter __attribute__((aligned(PERCPU_CACHE_LINE)));
+static unsigned long locked_counter;
+static pthread_mutex_t counter_lock = PTHREAD_MUTEX_INITIALIZER;
+static mpmc_queue_t mpmc_queue;
+static locked_queue_t locked_queue;
+
+static pthread_barrier_t start_barrier;
+static volatile bool running;
+static volatile bool writer_running;
+static bool locked_map;
+static unsigned long reclamation_errors;
+
+// A xorshift generator per thread, so picking keys costs next to nothing and shares nothing.
+static uint64_t next_random(uint64_t *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+// Spreads the keys over shards and buckets the way hash_string spreads paths.
+static uint64_t hash_key(uint64_t key) {
+    return (key + 1) * 0x9e3779b97f4a7c15ULL;
+}
+
+static bench_shard_t *shard_of(uint64_t hash) {
+    return &shards[hash % MAP_SHARDS];
+}
+
+static bench_entry_t *new_entry(uint64_t key) {
+    bench_entry_t *entry = (bench_entry_t *) malloc(sizeof(bench_entry_t));
+    if(entry == NULL) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    entry->key = key;
+    entry->hash = hash_key(key);
+    entry->magic = ENTRY_LIVE;
+    entry->node.next = NULL;
+    return entry;
+}
+
+static void free_entry(bench_entry_t *entry) {
+    __atomic_store_n(&entry->magic, ENTRY_DEAD, __ATOMIC_RELAXED);
+    free(entry);
+}
+
+static void reclaim_entry(ebr_retired_t *retired) {
+    free_entry((bench_entry_t *) ((char *) retired - offsetof(bench_entry_t, retired)));
+}
+
+static bench_entry_t *find_entry(bench_shard_t *shard, uint64_t key, uint64_t hash) {
+    for(rcu_map_node_t *node = rcu_map_first(&shard->map, hash / MAP_SHARDS); node != NULL; node = rcu_map_next(node)) {
+        bench_entry_t *entry = (bench_entry_t *) node;
+        if(entry->key == key) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+static void map_init(void) {
+    for(int i = 0; i < MAP_SHARDS; i++) {
+        pthread_mutex_init(&shards[i].lock, NULL);
+        rcu_map_init(&shards[i].map, shards[i].buckets, MAP_BUCKETS_PER_SHARD);
+    }
+    for(uint64_t key = 0; key < MAP_KEYS; key++) {
+        bench_entry_t *entry = new_entry(key);
+        rcu_map_insert(&shard_of(entry->hash)->map, &entry->node, entry->hash / MAP_SHARDS);
+    }
+}
+
+// Replaces one entry after another with a copy, the way a file cache entry is replaced when its file changes. With
+// the lock-free map the old entry is retired; with the locked one nobody can be reading it once the lock is let go.
+static void *replace_entries(void *argument) {
+    uint64_t random = 88172645463325252ULL;
+    struct timespec interval = {0, WRITER_INTERVAL_NS};
+    while(writer_running) {
+        uint64_t key = next_random(&random) % MAP_KEYS;
+        bench_entry_t *replacement = new_entry(key);
+        bench_shard_t *shard = shard_of(replacement->hash);
+        pthread_mutex_lock(&shard->lock);
+        bench_entry_t *entry = find_entry(shard, key, replacement->hash);
+        rcu_map_remove(&shard->map, &entry->node, entry->hash / MAP_SHARDS);
+        rcu_map_insert(&shard->map, &replacement->node, replacement->hash / MAP_SHARDS);
+        pthread_mutex_unlock(&shard->lock);
+        if(locked_map) {
+            free_entry(entry);
+        } else {
+            ebr_retire(&entry->retired, reclaim_entry);
+        }
+        nanosleep(&interval, NULL);
+    }
+    return NULL;
+}
+
+// Looks up random keys until the run is over. An entry can be missing for a moment while the writer replaces it,
+// but one that is found must never have been freed.
+static void *look_up_entries(void *bench_thread) {
+    bench_thread_t *thread = (bench_thread_t *) bench_thread;
+    uint64_t random = 2463534242ULL + thread->index;
+    unsigned long operations = 0;
+    unsigned long errors = 0;
+    pthread_barrier_wait(&start_barrier);
+    while(running) {
+        uint64_t key = next_random(&random) % MAP_KEYS;
+        uint64_t hash = hash_key(key);
+        bench_shard_t *shard = shard_of(hash);
+        if(locked_map) {
+            pthread_mutex_lock(&shard->lock);
+        } else {
+            ebr_enter();
+        }
+        bench_entry_t *entry = find_entry(shard, key, hash);
+        if(entry != NULL && __atomic_load_n(&entry->magic, __ATOMIC_RELAXED) != ENTRY_LIVE) {
+            errors++;
+        }
+        if(locked_map) {
+            pthread_mutex_unlock(&shard->lock);
+        } else {
+            ebr_exit();
+        }
+        operations++;
+    }
+    thread->operations = operations;
+    __atomic_add_fetch(&reclamation_errors, errors, __ATOMIC_RELAXED);
+    return NULL;
+}
+
+static void *add_percpu(void *bench_thread) {
+    bench_thread_t *thread = (bench_thread_t *) bench_thread;
+    unsigned long operations = 0;
+    pthread_barrier_wait(&start_barrier);
+    while(running) {
+        percpu_add(&percpu_counter, 1);
+        operations++;
+    }
+    thread->operations = operations;
+    return NULL;
+}
+
+static void *add_atomic(void *bench_thread) {
+    bench_thread_t *thread = (bench_thread_t *) bench_thread;
+    unsigned long operations = 0;
+    pthread_barrier_wait(&start_barrier);
+    while(running) {
+        __atomic_fetch_add(&atomic_counter, 1, __ATOMIC_RELAXED);
+        operations++;
+    }
+    thread->operations = operations;
+    return NULL;
+}
+
+static void *add_locked(void *bench_thread) {
+    bench_thread_t *thread = (bench_thread_t *) bench_thread;
+    unsigned long operations = 0;
+    pthread_barrier_wait(&start_barrier);
+    while(running) {
+        pthread_mutex_lock(&counter_lock);
+        locked_counter++;
+        pthread_mutex_unlock(&counter_lock);
+        operations++;
+    }
+    thread->operations = operations;
+    return NULL;
+}
+
+static bool locked_queue_push(locked_queue_t *queue, int item) {
+    pthread_mutex_lock(&queue->lock);
+    bool pushed = queue->count < QUEUE_CAPACITY;
+    if(pushed) {
+        queue->items[(queue->head + queue->count) % QUEUE_CAPACITY] = item;
+        queue->count++;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return pushed;
+}
+
+static bool locked_queue_pop(locked_queue_t *queue, int *item) {
+    pthread_mutex_lock(&queue->lock);
+    bool popped = queue->count > 0;
+    if(popped) {
+        *item = queue->items[queue->head];
+        queue->head = (queue->head + 1) % QUEUE_CAPACITY;
+        queue->count--;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return popped;
+}
+
+// Even threads produce and odd ones consume, and a run with a single thread does both in turn. Only elements that
+// made it all the way through are counted. The non-blocking calls are used so every thread stops when the run does;
+// the blocking ones the server uses only add a semaphore on either side.
+static void *pass_mpmc(void *bench_thread) {
+    bench_thread_t *thread = (bench_thread_t *) bench_thread;
+    bool produce = thread->index % 2 == 0;
+    bool consume = thread->index % 2 == 1 || thread->num_threads == 1;
+    unsigned long operations = 0;
+    int item = thread->index;
+    pthread_barrier_wait(&start_barrier);
+    while(running) {
+        if(produce) {
+            mpmc_try_push(&mpmc_queue, &item);
+        }
+        if(consume && mpmc_try_pop(&mpmc_queue, &item)) {
+            operations++;
+        }
+    }
+    thread->operations = operations;
+    return NULL;
+}
+
+static void *pass_locked(void *bench_thread) {
+    bench_thread_t *thread = (bench_thread_t *) bench_thread;
+    bool produce = thread->index % 2 == 0;
+    bool consume = thread->index % 2 == 1 || thread->num_threads == 1;
+    unsigned long operations = 0;
+    int item = thread->index;
+    pthread_barrier_wait(&start_barrier);
+    while(running) {
+        if(produce) {
+            locked_queue_push(&locked_queue, item);
+        }
+        if(consume && locked_queue_pop(&locked_queue, &item)) {
+            operations++;
+        }
+    }
+    thread->operations = operations;
+    return NULL;
+}
+
+// Empties both queues between runs, so every run starts from the same state.
+static void drain_queues(void) {
+    int item;
+    while(mpmc_try_pop(&mpmc_queue, &item)) {
+    }
+    while(locked_queue_pop(&locked_queue, &item)) {
+    }
+}
+
+// Runs body on num_threads threads for BENCH_DURATION_MS, all starting at once, and returns the millions of
+// operations they made per second between them.
+static double run_threads(int num_threads, void *(*body)(void *)) {
+    bench_thread_t *threads = (bench_thread_t *) calloc(num_threads, sizeof(bench_thread_t));
+    if(threads == NULL) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+    pthread_barrier_init(&start_barrier, NULL, num_threads + 1);
+    running = true;
+    for(int i = 0; i < num_threads; i++) {
+        threads[i].index = i;
+        threads[i].num_threads = num_threads;
+        int error = pthread_create(&threads[i].thread, NULL, body, (void *) &threads[i]);
+        if(error != 0) {
+            fprintf(stderr, "pthread_create: %s\n", strerror(error));
+            exit(EXIT_FAILURE);
+        }
+    }
+    pthread_barrier_wait(&start_barrier);
+    struct timespec duration = {0, BENCH_DURATION_MS * NANOSECONDS_PER_MILLISECOND};
+    nanosleep(&duration, NULL);
+    running = false;
+    unsigned long operations = 0;
+    for(int i = 0; i < num_threads; i++) {
+        pthread_join(threads[i].thread, NULL);
+        operations += threads[i].operations;
+    }
+    pthread_barrier_destroy(&start_barrier);
+    free(threads);
+    return operations / OPERATIONS_PER_MILLION / (BENCH_DURATION_MS / 1000.0);
+}
+
+// Runs the map lookups with the writer going the whole time.
+static double run_map(int num_threads, bool locked) {
+    pthread_t writer;
+    locked_map = locked;
+    writer_running = true;
+    if(pthread_create(&writer, NULL, replace_entries, NULL) != 0) {
+        fprintf(stderr, "ERROR, could not start the writer.\n");
+        exit(EXIT_FAILURE);
+    }
+    double result = run_threads(num_threads, look_up_entries);
+    writer_running = false;
+    pthread_join(writer, NULL);
+    return result;
+}
+
+int main(int argc, char **argv) {
+    int max_threads = argc > 1 ? atoi(argv[1]) : DEFAULT_MAX_THREADS;
+    if(max_threads < 1) {
+        fprintf(stderr, "Usage: %s [max_threads]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    map_init();
+    pthread_mutex_init(&locked_queue.lock, NULL);
+    if(!mpmc_init(&mpmc_queue, QUEUE_CAPACITY, sizeof(int))) {
+        return EXIT_FAILURE;
+    }
+
+    printf("%ld CPUs online, millions of operations per second\n", sysconf(_SC_NPROCESSORS_ONLN));
+    printf("%8s %12s %12s %12s %12s %12s %12s %12s\n", "threads", "map_rcu", "map_mutex", "count_cpu",
+           "count_atomic", "count_mutex", "queue_mpmc", "queue_mutex");
+    for(int num_threads = 1; num_threads <= max_threads; num_threads *= 2) {
+        double map_rcu = run_map(num_threads, false);
+        double map_mutex = run_map(num_threads, true);
+        double count_cpu = run_threads(num_threads, add_percpu);
+        double count_atomic = run_threads(num_threads, add_atomic);
+        double count_mutex = run_threads(num_threads, add_locked);
+        drain_queues();
+        double queue_mpmc = run_threads(num_threads, pass_mpmc);
+        drain_queues();
+        double queue_mutex = run_threads(num_threads, pass_locked);
+        printf("%8d %12.2f %12.2f %12.2f %12.2f %12.2f %12.2f %12.2f\n", num_threads, map_rcu, map_mutex, count_cpu,
+               count_atomic, count_mutex, queue_mpmc, queue_mutex);
+        fflush(stdout);
+    }
+    printf("reclamation errors: %lu\n", reclamation_errors);
+    return reclamation_errors == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
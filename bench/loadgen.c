@@ -0,0 +1,749 @@
+//
+// Created by User on 14/10/2026.
+//
+// A load generator for the server. Threads each drive their share of the connections from an epoll loop, and report
+// requests per second and the latency percentiles of the responses. Built with "make loadgen" and run as
+//
+//     ./loadgen [--connections=N] [--threads=N] [--duration=S] [--warmup=S] [--rate=R] [--no-keepalive]
+//               [--summary=LABEL] host port path[@weight]...
+//
+// By default the load is a closed loop: every connection sends its next request as soon as the last response has
+// arrived, which measures the most the server can do at that concurrency. --rate=R makes it an open loop instead,
+// sending R requests per second in total whether or not the server keeps up. The latency of a request is then
+// measured from when it should have been sent, so requests that had to wait for a free connection count the wait as
+// well, as they would for real clients, rather than the load generator slowing down along with the server (the
+// "coordinated omission" of closed-loop tools). https://www.scylladb.com/2021/04/22/on-coordinated-omission/
+//
+// Each path is requested in proportion to its weight (1 if left out), so a mix of file sizes is
+// "/small.html@9 /large.jpg@1". host can be an IPv4 or an IPv6 address or a name.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <limits.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+
+#define DEFAULT_CONNECTIONS 64
+#define DEFAULT_THREADS 4
+#define DEFAULT_DURATION 10
+#define MAX_PATHS 64
+#define MAX_REQUEST_SIZE 1024
+// Bytes of response headers a connection can hold, which is far more than the server ever sends.
+#define MAX_HEADER_SIZE 8192
+// Bytes read at a time from a response body, which is only counted and then thrown away.
+#define BODY_BUFFER_SIZE (64 * 1024)
+#define EPOLL_EVENTS 256
+// Requests an open-loop thread lets queue up for a free connection before it counts the rest as missed instead.
+#define MAX_PENDING 65536
+
+#define NANOSECONDS_PER_SECOND 1000000000LL
+#define NANOSECONDS_PER_MILLISECOND 1000000LL
+#define NANOSECONDS_PER_MICROSECOND 1000.0
+
+// Latencies are counted in a log-linear histogram in the manner of HdrHistogram: values below 2^HISTOGRAM_BITS
+// nanoseconds each have a bucket, and every power of two above that is split into 2^(HISTOGRAM_BITS - 1) buckets, so
+// a percentile is never out by more than 1/2^(HISTOGRAM_BITS - 1) of its value.
+// https://hdrhistogram.github.io/HdrHistogram/
+#define HISTOGRAM_BITS 7
+#define HISTOGRAM_BUCKETS ((64 - HISTOGRAM_BITS + 2) << (HISTOGRAM_BITS - 1))
+
+#define CONNECTION_CLOSED 0
+#define CONNECTION_CONNECTING 1
+#define CONNECTION_WRITING 2
+#define CONNECTION_READING 3
+#define CONNECTION_IDLE 4
+
+enum loadgen_option {
+    OPTION_CONNECTIONS = 1,
+    OPTION_THREADS,
+    OPTION_DURATION,
+    OPTION_WARMUP,
+    OPTION_RATE,
+    OPTION_NO_KEEPALIVE,
+    OPTION_SUMMARY
+};
+
+static struct option long_options[] = {
+    {"connections", required_argument, NULL, OPTION_CONNECTIONS},
+    {"threads", required_argument, NULL, OPTION_THREADS},
+    {"duration", required_argument, NULL, OPTION_DURATION},
+    {"warmup", required_argument, NULL, OPTION_WARMUP},
+    {"rate", required_argument, NULL, OPTION_RATE},
+    {"no-keepalive", no_argument, NULL, OPTION_NO_KEEPALIVE},
+    {"summary", required_argument, NULL, OPTION_SUMMARY},
+    {NULL, 0, NULL, 0}
+};
+
+typedef struct histogram histogram_t;
+struct histogram {
+    uint64_t counts[HISTOGRAM_BUCKETS];
+    uint64_t total;
+    uint64_t max;
+};
+
+// One path to request. Every path's request is formatted once, up front.
+typedef struct target target_t;
+struct target {
+    char request[MAX_REQUEST_SIZE];
+    int request_length;
+    int weight;
+};
+
+typedef struct loadgen_config loadgen_config_t;
+struct loadgen_config {
+    struct addrinfo *address;
+    target_t targets[MAX_PATHS];
+    int num_targets;
+    int total_weight;
+    int connections;
+    int threads;
+    int duration;
+    int warmup;
+    double rate;
+    bool keep_alive;
+    char *summary;
+};
+
+typedef struct connection connection_t;
+struct connection {
+    int fd;
+    int state;
+    // The connection has had a complete response on it, so the server closing it before the next response starts is
+    // the end of a keep-alive connection rather than an error.
+    bool reused;
+    target_t *target;
+    int request_sent;
+    long long start;
+
+    char headers[MAX_HEADER_SIZE];
+    int header_length;
+    bool headers_done;
+    int status;
+    // -1 if the response has no Content-Length, and so ends when the server closes the connection.
+    long long body_remaining;
+    bool server_closes;
+};
+
+// Counts kept by each thread and added together at the end.
+typedef struct results results_t;
+struct results {
+    histogram_t latency;
+    uint64_t responses;
+    uint64_t not_ok;
+    uint64_t bytes;
+    uint64_t connect_errors;
+    uint64_t read_errors;
+    uint64_t missed;
+};
+
+typedef struct worker worker_t;
+struct worker {
+    loadgen_config_t *config;
+    pthread_t thread;
+    int epollfd;
+    connection_t *connections;
+    int num_connections;
+    unsigned int seed;
+    // Responses that arrive before this are not counted, so the server's caches can fill first.
+    long long measure_from;
+    long long stop_at;
+
+    // Open-loop requests, by the time they should have been sent, waiting for a free connection.
+    long long *pending;
+    int pending_head;
+    int num_pending;
+    long long next_send;
+    long long interval;
+
+    results_t results;
+    char body_buffer[BODY_BUFFER_SIZE];
+};
+
+static long long now_nanoseconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * NANOSECONDS_PER_SECOND + now.tv_nsec;
+}
+
+static int histogram_index(uint64_t value) {
+    if(value < (1ULL << HISTOGRAM_BITS)) {
+        return (int) value;
+    }
+    int shift = (63 - __builtin_clzll(value)) - (HISTOGRAM_BITS - 1);
+    return (shift << (HISTOGRAM_BITS - 1)) + (int) (value >> shift);
+}
+
+// The smallest value counted in the bucket at index.
+static uint64_t histogram_value(int index) {
+    if(index < (1 << HISTOGRAM_BITS)) {
+        return index;
+    }
+    int shift = (index >> (HISTOGRAM_BITS - 1)) - 1;
+    return (uint64_t) (index - (shift << (HISTOGRAM_BITS - 1))) << shift;
+}
+
+static void histogram_record(histogram_t *histogram, uint64_t value) {
+    histogram->counts[histogram_index(value)]++;
+    histogram->total++;
+    if(value > histogram->max) {
+        histogram->max = value;
+    }
+}
+
+static void histogram_add(histogram_t *into, histogram_t *from) {
+    for(int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        into->counts[i] += from->counts[i];
+    }
+    into->total += from->total;
+    if(from->max > into->max) {
+        into->max = from->max;
+    }
+}
+
+// The value below which the given fraction of the values fall, to within a bucket.
+static uint64_t histogram_percentile(histogram_t *histogram, double fraction) {
+    if(histogram->total == 0) {
+        return 0;
+    }
+    uint64_t wanted = (uint64_t) (fraction * histogram->total + 0.5);
+    if(wanted == 0) {
+        wanted = 1;
+    }
+    uint64_t seen = 0;
+    for(int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        seen += histogram->counts[i];
+        if(seen >= wanted) {
+            uint64_t value = histogram_value(i + 1) - 1;
+            return value < histogram->max ? value : histogram->max;
+        }
+    }
+    return histogram->max;
+}
+
+static bool parse_positive(char *value, int *result, bool allow_zero) {
+    char *end;
+    long converted = strtol(value, &end, 10);
+    if(end == value || *end != '\0' || converted < (allow_zero ? 0 : 1) || converted > INT_MAX) {
+        return false;
+    }
+    *result = (int) converted;
+    return true;
+}
+
+static void print_usage(char *program) {
+    fprintf(stderr, "Usage: %s [--connections=N] [--threads=N] [--duration=S] [--warmup=S] [--rate=R] "
+                    "[--no-keepalive] [--summary=LABEL] host port path[@weight]...\n", program);
+}
+
+// Formats the request for "path[@weight]" into target. HTTP/1.1 requests are kept alive by default and HTTP/1.0
+// requests without a Connection header are not, which is how --no-keepalive is done.
+static bool add_target(loadgen_config_t *config, char *argument, char *host, char *port) {
+    if(config->num_targets == MAX_PATHS) {
+        fprintf(stderr, "ERROR, at most %d paths can be requested.\n", MAX_PATHS);
+        return false;
+    }
+    target_t *target = &config->targets[config->num_targets];
+    target->weight = 1;
+    char *at = strrchr(argument, '@');
+    if(at != NULL) {
+        *at = '\0';
+        if(!parse_positive(at + 1, &target->weight, false)) {
+            fprintf(stderr, "ERROR, invalid weight for %s: %s\n", argument, at + 1);
+            return false;
+        }
+    }
+    bool ipv6 = strchr(host, ':') != NULL;
+    target->request_length = snprintf(target->request, MAX_REQUEST_SIZE,
+                                      "GET %s HTTP/1.%d\r\nHost: %s%s%s:%s\r\nUser-Agent: loadgen\r\n\r\n", argument,
+                                      config->keep_alive ? 1 : 0, ipv6 ? "[" : "", host, ipv6 ? "]" : "", port);
+    if(target->request_length >= MAX_REQUEST_SIZE) {
+        fprintf(stderr, "ERROR, path too long: %s\n", argument);
+        return false;
+    }
+    config->total_weight += target->weight;
+    config->num_targets++;
+    return true;
+}
+
+static bool parse_loadgen_config(int argc, char **argv, loadgen_config_t *config) {
+    memset(config, 0, sizeof(*config));
+    config->connections = DEFAULT_CONNECTIONS;
+    config->threads = DEFAULT_THREADS;
+    config->duration = DEFAULT_DURATION;
+    config->keep_alive = true;
+
+    int option;
+    while((option = getopt_long(argc, argv, "", long_options, NULL)) != -1) {
+        bool valid = true;
+        switch(option) {
+            case OPTION_CONNECTIONS:
+                valid = parse_positive(optarg, &config->connections, false);
+                break;
+            case OPTION_THREADS:
+                valid = parse_positive(optarg, &config->threads, false);
+                break;
+            case OPTION_DURATION:
+                valid = parse_positive(optarg, &config->duration, false);
+                break;
+            case OPTION_WARMUP:
+                valid = parse_positive(optarg, &config->warmup, true);
+                break;
+            case OPTION_RATE: {
+                char *end;
+                config->rate = strtod(optarg, &end);
+                valid = end != optarg && *end == '\0' && config->rate > 0;
+                break;
+            }
+            case OPTION_NO_KEEPALIVE:
+                config->keep_alive = false;
+                break;
+            case OPTION_SUMMARY:
+                config->summary = optarg;
+                break;
+            default:
+                print_usage(argv[0]);
+                return false;
+        }
+        if(!valid) {
+            fprintf(stderr, "ERROR, invalid value for option %s: %s\n", argv[optind - 1], optarg);
+            return false;
+        }
+    }
+    if(argc - optind < 3) {
+        print_usage(argv[0]);
+        return false;
+    }
+    if(config->threads > config->connections) {
+        config->threads = config->connections;
+    }
+
+    char *host = argv[optind];
+    char *port = argv[optind + 1];
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    int error = getaddrinfo(host, port, &hints, &config->address);
+    if(error != 0) {
+        fprintf(stderr, "ERROR, could not resolve %s port %s: %s\n", host, port, gai_strerror(error));
+        return false;
+    }
+    for(int i = optind + 2; i < argc; i++) {
+        if(!add_target(config, argv[i], host, port)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void close_connection(worker_t *worker, connection_t *connection) {
+    if(connection->fd >= 0) {
+        close(connection->fd);
+    }
+    connection->fd = -1;
+    connection->state = CONNECTION_CLOSED;
+    connection->reused = false;
+}
+
+// Starts a non-blocking connect. The connection becomes writable once it has been made.
+static bool open_connection(worker_t *worker, connection_t *connection) {
+    struct addrinfo *address = worker->config->address;
+    int fd = socket(address->ai_family, address->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, address->ai_protocol);
+    if(fd < 0) {
+        perror("socket");
+        return false;
+    }
+    int enable = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+    if(connect(fd, address->ai_addr, address->ai_addrlen) < 0 && errno != EINPROGRESS) {
+        close(fd);
+        return false;
+    }
+    struct epoll_event event;
+    event.events = EPOLLIN | EPOLLOUT | EPOLLET | EPOLLRDHUP;
+    event.data.ptr = connection;
+    if(epoll_ctl(worker->epollfd, EPOLL_CTL_ADD, fd, &event) < 0) {
+        perror("epoll_ctl");
+        close(fd);
+        return false;
+    }
+    connection->fd = fd;
+    connection->state = CONNECTION_CONNECTING;
+    return true;
+}
+
+static target_t *pick_target(worker_t *worker) {
+    loadgen_config_t *config = worker->config;
+    int pick = rand_r(&worker->seed) % config->total_weight;
+    for(int i = 0; i < config->num_targets; i++) {
+        pick -= config->targets[i].weight;
+        if(pick < 0) {
+            return &config->targets[i];
+        }
+    }
+    return &config->targets[0];
+}
+
+static bool send_request(worker_t *worker, connection_t *connection);
+
+// Starts a request that should have been sent at start, on a new connection if the last one was closed.
+static void start_request(worker_t *worker, connection_t *connection, long long start) {
+    connection->target = pick_target(worker);
+    connection->request_sent = 0;
+    connection->start = start;
+    connection->header_length = 0;
+    connection->headers_done = false;
+    if(connection->state == CONNECTION_CLOSED) {
+        if(!open_connection(worker, connection)) {
+            worker->results.connect_errors++;
+        }
+        return;
+    }
+    connection->state = CONNECTION_WRITING;
+    send_request(worker, connection);
+}
+
+// Hands the connection its next request: straight away in a closed loop, or the oldest one waiting in an open loop.
+static void next_request(worker_t *worker, connection_t *connection) {
+    if(worker->interval == 0) {
+        start_request(worker, connection, now_nanoseconds());
+    } else if(worker->num_pending > 0) {
+        long long start = worker->pending[worker->pending_head];
+        worker->pending_head = (worker->pending_head + 1) % MAX_PENDING;
+        worker->num_pending--;
+        start_request(worker, connection, start);
+    } else if(connection->state != CONNECTION_CLOSED) {
+        connection->state = CONNECTION_IDLE;
+    }
+}
+
+// Called when a request could not be completed. The connection is made again for the next request.
+static void fail_request(worker_t *worker, connection_t *connection, bool connect_failed) {
+    if(connect_failed) {
+        worker->results.connect_errors++;
+    } else {
+        worker->results.read_errors++;
+    }
+    close_connection(worker, connection);
+    next_request(worker, connection);
+}
+
+static void finish_response(worker_t *worker, connection_t *connection) {
+    long long now = now_nanoseconds();
+    if(now >= worker->measure_from && now < worker->stop_at) {
+        histogram_record(&worker->results.latency, now - connection->start);
+        worker->results.responses++;
+        if(connection->status < 200 || connection->status > 299) {
+            worker->results.not_ok++;
+        }
+    }
+    if(connection->server_closes || !worker->config->keep_alive) {
+        close_connection(worker, connection);
+    } else {
+        connection->reused = true;
+        connection->state = CONNECTION_IDLE;
+    }
+    next_request(worker, connection);
+}
+
+static bool send_request(worker_t *worker, connection_t *connection) {
+    target_t *target = connection->target;
+    while(connection->request_sent < target->request_length) {
+        ssize_t n = send(connection->fd, target->request + connection->request_sent,
+                         target->request_length - connection->request_sent, MSG_NOSIGNAL);
+        if(n < 0) {
+            if(errno == EAGAIN || errno == EWOULDBLOCK) {
+                return true;
+            }
+            fail_request(worker, connection, false);
+            return false;
+        }
+        connection->request_sent += (int) n;
+    }
+    connection->state = CONNECTION_READING;
+    return true;
+}
+
+// Finds the status, Content-Length and Connection of the response once its headers have all arrived.
+static void parse_headers(connection_t *connection, char *end) {
+    *end = '\0';
+    connection->status = 0;
+    char *space = strchr(connection->headers, ' ');
+    if(space != NULL) {
+        connection->status = atoi(space + 1);
+    }
+    connection->body_remaining = -1;
+    // HTTP/1.0 responses are closed by the server unless they say otherwise.
+    connection->server_closes = strncmp(connection->headers, "HTTP/1.0", 8) == 0;
+    for(char *line = strstr(connection->headers, "\r\n"); line != NULL; line = strstr(line, "\r\n")) {
+        line += 2;
+        if(strncasecmp(line, "Content-Length:", 15) == 0) {
+            connection->body_remaining = atoll(line + 15);
+        } else if(strncasecmp(line, "Connection:", 11) == 0) {
+            char *value = line + 11;
+            while(*value == ' ') {
+                value++;
+            }
+            connection->server_closes = strncasecmp(value, "close", 5) == 0;
+        }
+    }
+}
+
+static void read_response(worker_t *worker, connection_t *connection) {
+    while(true) {
+        ssize_t n;
+        if(!connection->headers_done) {
+            if(connection->header_length == MAX_HEADER_SIZE - 1) {
+                fail_request(worker, connection, false);
+                return;
+            }
+            n = recv(connection->fd, connection->headers + connection->header_length,
+                     MAX_HEADER_SIZE - 1 - connection->header_length, 0);
+        } else {
+            size_t wanted = BODY_BUFFER_SIZE;
+            if(connection->body_remaining >= 0 && connection->body_remaining < BODY_BUFFER_SIZE) {
+                wanted = connection->body_remaining;
+            }
+            n = recv(connection->fd, worker->body_buffer, wanted, 0);
+        }
+        if(n < 0) {
+            if(errno == EAGAIN || errno == EWOULDBLOCK) {
+                return;
+            }
+            fail_request(worker, connection, false);
+            return;
+        }
+        if(n == 0) {
+            if(connection->headers_done && connection->body_remaining < 0) {
+                finish_response(worker, connection);
+            } else if(!connection->headers_done && connection->header_length == 0 && connection->reused) {
+                // The server closed an idle keep-alive connection just as the request went out, so it is sent again
+                // on a new one.
+                close_connection(worker, connection);
+                start_request(worker, connection, connection->start);
+            } else {
+                fail_request(worker, connection, false);
+            }
+            return;
+        }
+        worker->results.bytes += n;
+        if(!connection->headers_done) {
+            int searched_from = connection->header_length > 3 ? connection->header_length - 3 : 0;
+            connection->header_length += (int) n;
+            connection->headers[connection->header_length] = '\0';
+            char *end = strstr(connection->headers + searched_from, "\r\n\r\n");
+            if(end == NULL) {
+                continue;
+            }
+            connection->headers_done = true;
+            long long body_received = connection->header_length - (end + 4 - connection->headers);
+            parse_headers(connection, end);
+            if(connection->body_remaining >= 0) {
+                connection->body_remaining -= body_received;
+            }
+        } else if(connection->body_remaining >= 0) {
+            connection->body_remaining -= n;
+        }
+        if(connection->body_remaining == 0) {
+            finish_response(worker, connection);
+            return;
+        }
+    }
+}
+
+static void handle_event(worker_t *worker, connection_t *connection, uint32_t events) {
+    if(connection->state == CONNECTION_CONNECTING) {
+        int error = 0;
+        socklen_t length = sizeof(error);
+        getsockopt(connection->fd, SOL_SOCKET, SO_ERROR, &error, &length);
+        if(error != 0 || (events & EPOLLERR)) {
+            fail_request(worker, connection, true);
+            return;
+        }
+        connection->state = CONNECTION_WRITING;
+    }
+    if(connection->state == CONNECTION_WRITING && !send_request(worker, connection)) {
+        return;
+    }
+    if(connection->state == CONNECTION_READING && (events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))) {
+        read_response(worker, connection);
+    } else if(connection->state == CONNECTION_IDLE && (events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR))) {
+        // The server closed the idle connection, so it is made again for the next request.
+        close_connection(worker, connection);
+    }
+}
+
+// Queues the open-loop requests that have become due, and gives them to connections that are free. Returns the
+// milliseconds until the next one is due.
+static int schedule_requests(worker_t *worker, long long now) {
+    while(worker->next_send <= now) {
+        if(worker->num_pending == MAX_PENDING) {
+            worker->results.missed++;
+        } else {
+            worker->pending[(worker->pending_head + worker->num_pending) % MAX_PENDING] = worker->next_send;
+            worker->num_pending++;
+        }
+        worker->next_send += worker->interval;
+    }
+    for(int i = 0; i < worker->num_connections && worker->num_pending > 0; i++) {
+        connection_t *connection = &worker->connections[i];
+        if(connection->state == CONNECTION_IDLE || connection->state == CONNECTION_CLOSED) {
+            next_request(worker, connection);
+        }
+    }
+    long long wait = (worker->next_send - now + NANOSECONDS_PER_MILLISECOND - 1) / NANOSECONDS_PER_MILLISECOND;
+    return wait > 0 ? (int) wait : 0;
+}
+
+static void *run_worker(void *argument) {
+    worker_t *worker = argument;
+    struct epoll_event events[EPOLL_EVENTS];
+    long long now = now_nanoseconds();
+    worker->next_send = now;
+    if(worker->interval == 0) {
+        for(int i = 0; i < worker->num_connections; i++) {
+            start_request(worker, &worker->connections[i], now);
+        }
+    }
+    while((now = now_nanoseconds()) < worker->stop_at) {
+        int timeout = (int) ((worker->stop_at - now) / NANOSECONDS_PER_MILLISECOND) + 1;
+        if(worker->interval != 0) {
+            int until_next = schedule_requests(worker, now);
+            if(until_next < timeout) {
+                timeout = until_next;
+            }
+        } else {
+            // Connections whose connect() failed straight away are tried again, so the concurrency stays the same.
+            for(int i = 0; i < worker->num_connections; i++) {
+                if(worker->connections[i].state == CONNECTION_CLOSED) {
+                    start_request(worker, &worker->connections[i], now);
+                }
+            }
+        }
+        int num_events = epoll_wait(worker->epollfd, events, EPOLL_EVENTS, timeout);
+        if(num_events < 0 && errno != EINTR) {
+            perror("epoll_wait");
+            break;
+        }
+        for(int i = 0; i < num_events; i++) {
+            handle_event(worker, events[i].data.ptr, events[i].events);
+        }
+    }
+    for(int i = 0; i < worker->num_connections; i++) {
+        close_connection(worker, &worker->connections[i]);
+    }
+    return NULL;
+}
+
+static void print_results(loadgen_config_t *config, results_t *results) {
+    double seconds = config->duration;
+    double requests_per_second = results->responses / seconds;
+    double megabytes_per_second = results->bytes / seconds / (1024 * 1024);
+    double p50 = histogram_percentile(&results->latency, 0.50) / NANOSECONDS_PER_MICROSECOND;
+    double p99 = histogram_percentile(&results->latency, 0.99) / NANOSECONDS_PER_MICROSECOND;
+    double p999 = histogram_percentile(&results->latency, 0.999) / NANOSECONDS_PER_MICROSECOND;
+    double max = results->latency.max / NANOSECONDS_PER_MICROSECOND;
+    uint64_t errors = results->connect_errors + results->read_errors + results->missed;
+
+    if(config->summary != NULL) {
+        printf("%-28s %12.1f %10.1f %10.1f %10.1f %10.1f %8llu %8llu\n", config->summary, requests_per_second, p50,
+               p99, p999, max, (unsigned long long) errors, (unsigned long long) results->not_ok);
+        return;
+    }
+    printf("%llu responses in %d s (%d connections, %d threads, %s, %s): %.1f requests/s, %.2f MiB/s\n",
+           (unsigned long long) results->responses, config->duration, config->connections, config->threads,
+           config->rate > 0 ? "open loop" : "closed loop", config->keep_alive ? "keep-alive" : "no keep-alive",
+           requests_per_second, megabytes_per_second);
+    printf("latency (us): p50 %.1f, p99 %.1f, p99.9 %.1f, max %.1f\n", p50, p99, p999, max);
+    printf("non-2xx responses: %llu\n", (unsigned long long) results->not_ok);
+    printf("errors: %llu connect, %llu read/write, %llu requests missed\n",
+           (unsigned long long) results->connect_errors, (unsigned long long) results->read_errors,
+           (unsigned long long) results->missed);
+}
+
+int main(int argc, char **argv) {
+    loadgen_config_t config;
+    if(!parse_loadgen_config(argc, argv, &config)) {
+        exit(EXIT_FAILURE);
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    worker_t *workers = calloc(config.threads, sizeof(worker_t));
+    connection_t *connections = calloc(config.connections, sizeof(connection_t));
+    if(workers == NULL || connections == NULL) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+    long long start = now_nanoseconds();
+    int assigned = 0;
+    for(int i = 0; i < config.threads; i++) {
+        worker_t *worker = &workers[i];
+        worker->config = &config;
+        worker->connections = &connections[assigned];
+        worker->num_connections = config.connections / config.threads + (i < config.connections % config.threads);
+        assigned += worker->num_connections;
+        for(int j = 0; j < worker->num_connections; j++) {
+            worker->connections[j].fd = -1;
+        }
+        worker->seed = (unsigned int) (start + i);
+        worker->measure_from = start + config.warmup * NANOSECONDS_PER_SECOND;
+        worker->stop_at = worker->measure_from + config.duration * NANOSECONDS_PER_SECOND;
+        if(config.rate > 0) {
+            worker->interval = (long long) (NANOSECONDS_PER_SECOND * config.threads / config.rate);
+            if(worker->interval == 0) {
+                worker->interval = 1;
+            }
+            worker->pending = malloc(MAX_PENDING * sizeof(long long));
+            if(worker->pending == NULL) {
+                perror("malloc");
+                exit(EXIT_FAILURE);
+            }
+        }
+        worker->epollfd = epoll_create1(EPOLL_CLOEXEC);
+        if(worker->epollfd < 0) {
+            perror("epoll_create1");
+            exit(EXIT_FAILURE);
+        }
+        if(pthread_create(&worker->thread, NULL, run_worker, worker) != 0) {
+            perror("pthread_create");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    results_t total;
+    memset(&total, 0, sizeof(total));
+    for(int i = 0; i < config.threads; i++) {
+        worker_t *worker = &workers[i];
+        pthread_join(worker->thread, NULL);
+        histogram_add(&total.latency, &worker->results.latency);
+        total.responses += worker->results.responses;
+        total.not_ok += worker->results.not_ok;
+        total.bytes += worker->results.bytes;
+        total.connect_errors += worker->results.connect_errors;
+        total.read_errors += worker->results.read_errors;
+        total.missed += worker->results.missed;
+        close(worker->epollfd);
+        free(worker->pending);
+    }
+    print_results(&config, &total);
+
+    free(connections);
+    free(workers);
+    freeaddrinfo(config.address);
+    return 0;
+}
@@ -0,0 +1,86 @@
+#!/bin/sh
+# Runs the standard benchmark matrix against a freshly started server: IPv4 and IPv6, a small file, a large file, a
+# mix of the two and the 404 path, each with and without keep-alive, and then the small file as an open loop at a fixed
+# rate so the tail latency is measured without coordinated omission. Run by "make bench" from the repository root.
+#
+# Everything can be overridden from the environment, e.g. "DURATION=30 MODE=uring make bench".
+#   MODE         the server's --mode (threads, epoll or uring)        default epoll
+#   SERVER_ARGS  any more arguments for the server                    default none
+#   PORT         the port the server listens on                       default 8080
+#   CONNECTIONS  connections held open by the load generator          default 64
+#   THREADS      load generator threads                               default 4
+#   DURATION     seconds each run is measured for                     default 5
+#   WARMUP       seconds before each run is measured                  default 1
+#   RATE         requests per second for the open-loop run            default 20000
+set -e
+
+MODE=${MODE:-epoll}
+PORT=${PORT:-8080}
+CONNECTIONS=${CONNECTIONS:-64}
+THREADS=${THREADS:-4}
+DURATION=${DURATION:-5}
+WARMUP=${WARMUP:-1}
+RATE=${RATE:-20000}
+
+ROOT=$(mktemp -d)
+SERVER_PID=
+cleanup() {
+    if [ -n "$SERVER_PID" ]; then
+        kill "$SERVER_PID" 2>/dev/null || true
+        wait "$SERVER_PID" 2>/dev/null || true
+    fi
+    rm -rf "$ROOT" "$ROOT.log"
+}
+trap cleanup EXIT INT TERM
+
+# 1 KiB and 1 MiB files, the sizes of a typical page and a typical image.
+head -c 1024 /dev/urandom | base64 -w 76 | head -c 1024 > "$ROOT/small.html"
+head -c 1048576 /dev/urandom > "$ROOT/large.jpg"
+
+start_server() {
+    # Connections the load generator drops at the end of a run make the server print errors such as EPIPE, which are
+    # expected, so its output goes to a log only looked at if it does not start.
+    ./server "$1" "$PORT" "$ROOT" --mode="$MODE" --backlog=1024 $SERVER_ARGS > "$ROOT.log" 2>&1 &
+    SERVER_PID=$!
+    # Wait for the server to be listening before the first run starts.
+    for _ in 1 2 3 4 5 6 7 8 9 10; do
+        if ./loadgen --connections=1 --threads=1 --duration=1 "$2" "$PORT" /small.html > /dev/null 2>&1; then
+            return
+        fi
+        sleep 0.2
+    done
+    echo "ERROR, the server did not start:" >&2
+    cat "$ROOT.log" >&2
+    exit 1
+}
+
+stop_server() {
+    kill "$SERVER_PID"
+    wait "$SERVER_PID" 2>/dev/null || true
+    SERVER_PID=
+}
+
+run() {
+    label=$1
+    host=$2
+    shift 2
+    ./loadgen --connections="$CONNECTIONS" --threads="$THREADS" --duration="$DURATION" --warmup="$WARMUP" \
+        --summary="$label" "$@" "$host" "$PORT" $PATHS
+}
+
+echo "mode=$MODE connections=$CONNECTIONS threads=$THREADS duration=${DURATION}s"
+printf "%-28s %12s %10s %10s %10s %10s %8s %8s\n" "run" "requests/s" "p50 us" "p99 us" "p99.9 us" "max us" \
+    "errors" "non-2xx"
+for protocol in 4 6; do
+    if [ "$protocol" = 4 ]; then host=127.0.0.1; else host=::1; fi
+    start_server "$protocol" "$host"
+    for keepalive in on off; do
+        if [ "$keepalive" = on ]; then flags=; else flags=--no-keepalive; fi
+        PATHS=/small.html run "ipv$protocol small ka=$keepalive" "$host" $flags
+        PATHS=/large.jpg run "ipv$protocol large ka=$keepalive" "$host" $flags
+        PATHS="/small.html@9 /large.jpg@1" run "ipv$protocol mix ka=$keepalive" "$host" $flags
+        PATHS=/missing.html run "ipv$protocol 404 ka=$keepalive" "$host" $flags
+    done
+    PATHS=/small.html run "ipv$protocol small open@$RATE" "$host" --rate="$RATE"
+    stop_server
+done
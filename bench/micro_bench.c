@@ -0,0 +1,354 @@
+//
+// Created by User on 14/10/2026.
+//
+// Times the functions every request goes through, one at a time and without a network in the way, over corpora of
+// recorded requests, and counts the heap allocations each of them makes. Built with "make micro_bench" and run as
+//
+//     ./micro_bench bench/corpus/*.http
+//
+// A corpus file is requests exactly as a client sent them, one after the other, as saved by "nc -l 8080 > file" or
+// from a packet capture. The parser splits them up itself, so any number of requests can go in one file.
+//
+// Allocations are counted by linking with "-Wl,--wrap=malloc" (and calloc, realloc and strdup), which makes every call
+// to malloc() from the server's code go to __wrap_malloc below instead. https://sourceware.org/binutils/docs/ld.html
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+
+#include "../parse.h"
+#include "../respond.h"
+#include "../mime.h"
+#include "../arena.h"
+#include "../scan.h"
+#include "../config.h"
+#include "../context.h"
+#include "../resolve.h"
+
+#define ITERATIONS 200000
+#define MAX_CORPUS_REQUESTS 4096
+#define MAX_CORPUS_FILE_SIZE (1024 * 1024)
+#define WEB_ROOT_TEMPLATE "/tmp/micro_bench.XXXXXX"
+#define SMALL_FILE_SIZE 1024
+#define NO_SINK (-1)
+
+// One request of a corpus, parsed once up front so the functions that work on a parsed request can be timed alone.
+typedef struct corpus_request corpus_request_t;
+struct corpus_request {
+    char buffer[REQUEST_MAX_BUFFER_SIZE + NULL_TERMINATOR_SPACE];
+    size_t length;
+    http_request_t request;
+    // The path of the request as a string, for mime_lookup and format_file_headers.
+    char path[REQUEST_MAX_BUFFER_SIZE + NULL_TERMINATOR_SPACE];
+};
+
+static corpus_request_t corpus[MAX_CORPUS_REQUESTS];
+static int corpus_size;
+
+static unsigned long allocations;
+static unsigned long allocated_bytes;
+static volatile size_t sink;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *memory, size_t size);
+char *__real_strdup(const char *string);
+
+void *__wrap_malloc(size_t size) {
+    __atomic_fetch_add(&allocations, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&allocated_bytes, size, __ATOMIC_RELAXED);
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size) {
+    __atomic_fetch_add(&allocations, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&allocated_bytes, count * size, __ATOMIC_RELAXED);
+    return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *memory, size_t size) {
+    __atomic_fetch_add(&allocations, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&allocated_bytes, size, __ATOMIC_RELAXED);
+    return __real_realloc(memory, size);
+}
+
+char *__wrap_strdup(const char *string) {
+    __atomic_fetch_add(&allocations, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&allocated_bytes, strlen(string) + NULL_TERMINATOR_SPACE, __ATOMIC_RELAXED);
+    return __real_strdup(string);
+}
+
+static double now_seconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + (double) now.tv_nsec / NANOSECONDS_PER_SECOND;
+}
+
+// What one benchmark measured, per call of the function under test.
+typedef struct measurement measurement_t;
+struct measurement {
+    double start;
+    unsigned long allocations;
+    unsigned long allocated_bytes;
+};
+
+static void start_measurement(measurement_t *measurement) {
+    measurement->allocations = __atomic_load_n(&allocations, __ATOMIC_RELAXED);
+    measurement->allocated_bytes = __atomic_load_n(&allocated_bytes, __ATOMIC_RELAXED);
+    measurement->start = now_seconds();
+}
+
+static void print_measurement(const char *name, measurement_t *measurement) {
+    double elapsed = now_seconds() - measurement->start;
+    unsigned long made = __atomic_load_n(&allocations, __ATOMIC_RELAXED) - measurement->allocations;
+    unsigned long bytes = __atomic_load_n(&allocated_bytes, __ATOMIC_RELAXED) - measurement->allocated_bytes;
+    printf("%-32s %12.1f %12.3f %12.1f\n", name, elapsed * NANOSECONDS_PER_SECOND / ITERATIONS,
+           (double) made / ITERATIONS, (double) bytes / ITERATIONS);
+}
+
+// Splits a corpus file into its requests and adds them to the corpus. Returns false if the file could not be read
+// or ends part of the way through a request.
+static bool load_corpus(const char *corpus_path) {
+    FILE *file = fopen(corpus_path, "rb");
+    if(file == NULL) {
+        perror(corpus_path);
+        return false;
+    }
+    static char contents[MAX_CORPUS_FILE_SIZE];
+    size_t length = fread(contents, 1, MAX_CORPUS_FILE_SIZE, file);
+    fclose(file);
+
+    size_t offset = 0;
+    while(offset < length) {
+        if(corpus_size == MAX_CORPUS_REQUESTS) {
+            fprintf(stderr, "ERROR, more than %d requests in the corpus.\n", MAX_CORPUS_REQUESTS);
+            return false;
+        }
+        corpus_request_t *entry = &corpus[corpus_size];
+        size_t available = length - offset;
+        if(available > REQUEST_MAX_BUFFER_SIZE) {
+            available = REQUEST_MAX_BUFFER_SIZE;
+        }
+        memcpy(entry->buffer, contents + offset, available);
+        http_parser_t parser;
+        http_parser_init(&parser);
+        if(http_parser_execute(&parser, entry->buffer, available) != PARSE_COMPLETE) {
+            fprintf(stderr, "ERROR, %s has an incomplete or invalid request at byte %zu.\n", corpus_path, offset);
+            return false;
+        }
+        entry->length = parser.request_length;
+        entry->request = parser.request;
+        memcpy(entry->path, entry->buffer + entry->request.path.offset, entry->request.path.length);
+        entry->path[entry->request.path.length] = '\0';
+        offset += entry->length;
+        corpus_size++;
+    }
+    return true;
+}
+
+// http_parser_execute on each request as it would arrive in a single read().
+static void bench_parse(void) {
+    http_parser_t parser;
+    measurement_t measurement;
+    start_measurement(&measurement);
+    for(int iteration = 0; iteration < ITERATIONS; iteration++) {
+        corpus_request_t *entry = &corpus[iteration % corpus_size];
+        http_parser_init(&parser);
+        sink += http_parser_execute(&parser, entry->buffer, entry->length);
+    }
+    print_measurement("http_parser_execute", &measurement);
+}
+
+static void bench_get_file_path(arena_t *arena) {
+    char *file_path;
+    measurement_t measurement;
+    start_measurement(&measurement);
+    for(int iteration = 0; iteration < ITERATIONS; iteration++) {
+        corpus_request_t *entry = &corpus[iteration % corpus_size];
+        sink += get_file_path(&file_path, entry->buffer, &entry->request, arena);
+        arena_reset(arena);
+    }
+    print_measurement("get_file_path", &measurement);
+}
+
+static void bench_mime_lookup(void) {
+    measurement_t measurement;
+    start_measurement(&measurement);
+    for(int iteration = 0; iteration < ITERATIONS; iteration++) {
+        sink += mime_lookup(corpus[iteration % corpus_size].path)->header_length;
+    }
+    print_measurement("mime_lookup", &measurement);
+}
+
+// What the server used to do with write_content_type: format the headers that depend on the file and write them to
+// the socket. Here they are written to /dev/null, so the write() is still paid for but nothing waits on a reader.
+static void bench_file_headers(int sinkfd) {
+    file_validators_t validators;
+    struct stat file_stat;
+    memset(&file_stat, 0, sizeof(file_stat));
+    file_stat.st_size = SMALL_FILE_SIZE;
+    file_stat.st_mtime = time(NULL);
+    file_validators_init(&validators, &file_stat);
+
+    char headers[RESPONSE_HEADER_MAX_SIZE];
+    measurement_t measurement;
+    start_measurement(&measurement);
+    for(int iteration = 0; iteration < ITERATIONS; iteration++) {
+        format_file_headers(headers, RESPONSE_HEADER_MAX_SIZE, corpus[iteration % corpus_size].path,
+                            SMALL_FILE_SIZE, &validators);
+        sink += write_message(sinkfd, headers);
+    }
+    print_measurement("format_file_headers + write", &measurement);
+}
+
+// Reads and throws away everything sent to the other end of the socket pair a response benchmark writes to.
+static void *drain_socket(void *argument) {
+    int sockfd = *(int *) argument;
+    static char buffer[64 * 1024];
+    while(read(sockfd, buffer, sizeof(buffer)) > 0) {
+    }
+    return NULL;
+}
+
+// A response from prepare_http_response to release_http_response for each request of the corpus, against a web root
+// with one small file in it that every request is given, so its body comes from the file cache. Requests whose path
+// escapes the web root, and every request if missing is set, get a 404 instead. The response is only sent, to the
+// socket sockfd, if sockfd is not NO_SINK; otherwise only building and releasing it is timed.
+static void bench_response(server_context_t *context, arena_t *arena, int sockfd, const char *name, bool missing) {
+    http_response_t response;
+    char *file_path;
+    char index_path[] = "index.html";
+    char missing_path[] = "missing.html";
+    measurement_t measurement;
+    start_measurement(&measurement);
+    for(int iteration = 0; iteration < ITERATIONS; iteration++) {
+        corpus_request_t *entry = &corpus[iteration % corpus_size];
+        if(missing) {
+            file_path = missing_path;
+        } else if(get_file_path(&file_path, entry->buffer, &entry->request, arena) && !path_escapes_root(file_path)) {
+            file_path = index_path;
+        }
+        prepare_http_response(&response, context, file_path, entry->request.minor_version, true, entry->buffer,
+                              &entry->request);
+        if(sockfd != NO_SINK) {
+            sink += continue_http_response(sockfd, &response, NO_QUANTUM);
+        }
+        release_http_response(&response);
+        arena_reset(arena);
+    }
+    print_measurement(name, &measurement);
+}
+
+// Sets up the caches as the server would with its default configuration, over a temporary web root with one small
+// file in it.
+static bool init_context(server_context_t *context, server_config_t *config, char *web_root) {
+    char *argv[] = {"micro_bench", "4", "8080", web_root, NULL};
+    if(!parse_server_config(4, argv, config)) {
+        return false;
+    }
+    context->config = config;
+    if(!resolve_init(web_root)) {
+        return false;
+    }
+    file_cache_init(&context->file_cache, (size_t) config->cache_size_mb * BYTES_PER_MB,
+                    (size_t) config->cache_max_file_kb * BYTES_PER_KB, config->cache_revalidate);
+    fd_cache_init(&context->fd_cache, config->fd_cache_entries, config->fd_cache_ttl,
+                  config->negative_cache_ttl);
+    if(!compress_cache_init(&context->compress_cache, (size_t) config->compress_cache_size_mb * BYTES_PER_MB,
+                            (size_t) config->compress_max_file_kb * BYTES_PER_KB, config->compress_threads)) {
+        return false;
+    }
+    if(!preload_init(&context->preload, config)) {
+        return false;
+    }
+
+    char file_path[PATH_MAX];
+    snprintf(file_path, sizeof(file_path), "%s/index.html", web_root);
+    FILE *file = fopen(file_path, "w");
+    if(file == NULL) {
+        perror(file_path);
+        return false;
+    }
+    for(int i = 0; i < SMALL_FILE_SIZE; i++) {
+        fputc('a' + i % 26, file);
+    }
+    fclose(file);
+    return true;
+}
+
+int main(int argc, char **argv) {
+    if(argc < 2) {
+        fprintf(stderr, "Usage: %s corpus.http...\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    for(int i = 1; i < argc; i++) {
+        if(!load_corpus(argv[i])) {
+            return EXIT_FAILURE;
+        }
+    }
+    if(corpus_size == 0) {
+        fprintf(stderr, "ERROR, the corpus is empty.\n");
+        return EXIT_FAILURE;
+    }
+    signal(SIGPIPE, SIG_IGN);
+    scan_init();
+    if(!mime_init(NULL)) {
+        return EXIT_FAILURE;
+    }
+
+    arena_t arena;
+    if(!arena_init(&arena, ARENA_SIZE)) {
+        return EXIT_FAILURE;
+    }
+    int sinkfd = open("/dev/null", O_WRONLY);
+    if(sinkfd < 0) {
+        perror("/dev/null");
+        return EXIT_FAILURE;
+    }
+
+    char web_root[] = WEB_ROOT_TEMPLATE;
+    if(mkdtemp(web_root) == NULL) {
+        perror("mkdtemp");
+        return EXIT_FAILURE;
+    }
+    server_config_t config;
+    server_context_t context;
+    int sockets[2];
+    pthread_t drainer;
+    if(!init_context(&context, &config, web_root)) {
+        return EXIT_FAILURE;
+    }
+    if(socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) < 0 ||
+       pthread_create(&drainer, NULL, drain_socket, &sockets[1]) != 0) {
+        perror("socketpair");
+        return EXIT_FAILURE;
+    }
+
+    printf("%d requests in the corpus, %s scanning\n", corpus_size, scan_implementation_name());
+    printf("%-32s %12s %12s %12s\n", "", "ns/op", "allocs/op", "bytes/op");
+    bench_parse();
+    bench_get_file_path(&arena);
+    bench_mime_lookup();
+    bench_file_headers(sinkfd);
+    bench_response(&context, &arena, NO_SINK, "prepare_http_response (cached)", false);
+    bench_response(&context, &arena, NO_SINK, "prepare_http_response (404)", true);
+    bench_response(&context, &arena, sockets[0], "response sent (cached)", false);
+
+    shutdown(sockets[0], SHUT_WR);
+    pthread_join(drainer, NULL);
+    char file_path[PATH_MAX];
+    snprintf(file_path, sizeof(file_path), "%s/index.html", web_root);
+    unlink(file_path);
+    rmdir(web_root);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,103 @@
+//
+// Created by User on 14/10/2026.
+//
+#include "bundle.h"
+
+// Returns where contents of size bytes go in a bundle whose contents so far end at offset.
+uint64_t bundle_align(uint64_t offset, uint64_t size) {
+    uint64_t alignment = size >= BUNDLE_PAGE_ALIGNMENT ? BUNDLE_PAGE_ALIGNMENT : BUNDLE_SMALL_ALIGNMENT;
+    return (offset + alignment - 1) / alignment * alignment;
+}
+
+// Returns true if length bytes at offset lie inside a bundle of size bytes, without the sum overflowing.
+static bool in_bundle(uint64_t offset, uint64_t length, size_t size) {
+    return offset <= size && length <= size - offset;
+}
+
+// Checks that every part of a mapped bundle lies inside it and that every path ends where its record says, so the
+// server can use the records without checking them again, and finds its paths and records. Returns the reason the
+// bundle is not valid, or NULL.
+static const char *check_bundle(bundle_t *bundle) {
+    if(bundle->size < sizeof(bundle_header_t)) {
+        return "too short";
+    }
+    bundle_header_t *header = bundle->header;
+    if(memcmp(header->magic, BUNDLE_MAGIC, BUNDLE_MAGIC_SIZE) != SAME_STRING) {
+        return "not a bundle";
+    }
+    if(header->version != BUNDLE_VERSION) {
+        return "made by a different version of mkbundle";
+    }
+    if(header->file_size != bundle->size) {
+        return "not completely written";
+    }
+    if(!in_bundle(header->strings_offset, header->strings_size, bundle->size) ||
+       header->records_offset % sizeof(uint64_t) != 0 ||
+       !in_bundle(header->records_offset, (uint64_t) header->num_records * sizeof(bundle_record_t), bundle->size)) {
+        return "index out of bounds";
+    }
+    bundle->strings = bundle->data + header->strings_offset;
+    bundle->records = (bundle_record_t *) (bundle->data + header->records_offset);
+    for(uint32_t i = 0; i < header->num_records; i++) {
+        bundle_record_t *record = &bundle->records[i];
+        if(!in_bundle(record->data_offset, record->size, bundle->size) ||
+           record->path_offset >= header->strings_size ||
+           record->path_length >= header->strings_size - record->path_offset ||
+           bundle->strings[record->path_offset + record->path_length] != '\0') {
+            return "record out of bounds";
+        }
+    }
+    return NULL;
+}
+
+// Maps the bundle at path read-only and checks it. The mapping stays valid after a new bundle is renamed over path,
+// which is how mkbundle replaces one, but a bundle truncated in place would make reading the mapping raise SIGBUS.
+// https://man7.org/linux/man-pages/man2/mmap.2.html Returns false (after printing the reason) if it could not be
+// opened or is not a valid bundle.
+bool bundle_open(bundle_t *bundle, const char *path) {
+    struct stat file_stat;
+    bundle->fd = open(path, O_RDONLY | O_CLOEXEC);
+    if(bundle->fd < 0 || fstat(bundle->fd, &file_stat) < 0) {
+        perror(path);
+        if(bundle->fd >= 0) {
+            close(bundle->fd);
+        }
+        return false;
+    }
+    bundle->size = file_stat.st_size;
+    bundle->data = bundle->size > 0 ? (const char *) mmap(NULL, bundle->size, PROT_READ, MAP_SHARED, bundle->fd, 0)
+                                    : (const char *) MAP_FAILED;
+    if(bundle->data == MAP_FAILED) {
+        fprintf(stderr, "ERROR, could not map %s: %s\n", path, bundle->size > 0 ? strerror(errno) : "empty file");
+        close(bundle->fd);
+        return false;
+    }
+    bundle->header = (bundle_header_t *) bundle->data;
+    const char *problem = check_bundle(bundle);
+    if(problem != NULL) {
+        fprintf(stderr, "ERROR, %s is not a valid bundle: %s\n", path, problem);
+        bundle_close(bundle);
+        return false;
+    }
+    return true;
+}
+
+void bundle_close(bundle_t *bundle) {
+    munmap((void *) bundle->data, bundle->size);
+    close(bundle->fd);
+}
+
+const char *bundle_record_path(bundle_t *bundle, bundle_record_t *record) {
+    return bundle->strings + record->path_offset;
+}
+
+// Fills in the parts of a stat() the validators of a file are made from, as they were for the file the record was
+// packed from.
+void bundle_record_stat(bundle_record_t *record, struct stat *file_stat) {
+    memset(file_stat, 0, sizeof(*file_stat));
+    file_stat->st_mode = S_IFREG;
+    file_stat->st_ino = (ino_t) record->inode;
+    file_stat->st_size = (off_t) record->size;
+    file_stat->st_mtim.tv_sec = (time_t) record->modified_seconds;
+    file_stat->st_mtim.tv_nsec = (long) record->modified_nanoseconds;
+}
@@ -0,0 +1,92 @@
+//
+// Created by User on 14/10/2026.
+//
+
+#ifndef COMP30023_2022_PROJECT_2_BUNDLE_H
+#define COMP30023_2022_PROJECT_2_BUNDLE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+// A bundle is a whole web root packed into one read-only file by mkbundle, which the server maps and serves from with
+// --bundle. It is laid out as:
+//
+//     bundle_header_t
+//     the contents of every file, each starting at a multiple of its alignment
+//     the path of every file, each ending with a '\0'
+//     bundle_record_t for every file, sorted by path (strcmp order)
+//
+// The paths and records come last so mkbundle can write the contents out as it goes, before it knows how big they
+// (and any compressed copies) turn out. Every number is in the byte order of the machine that built the bundle.
+#define BUNDLE_MAGIC "WEBBNDL1"
+#define BUNDLE_MAGIC_SIZE 8
+#define BUNDLE_VERSION 1
+// Contents a page or longer start on a page boundary, so sending them reads whole pages of the page cache; anything
+// smaller only on a cache line.
+#define BUNDLE_PAGE_ALIGNMENT 4096
+#define BUNDLE_SMALL_ALIGNMENT 64
+
+// The record is of a copy mkbundle compressed itself (path is the original's with ".gz" or ".br" added), which only
+// differs from a precompressed file that was already in the web root in where it came from.
+#define BUNDLE_GENERATED 1
+
+#define SAME_STRING 0
+
+typedef struct bundle_header bundle_header_t;
+struct bundle_header {
+    char magic[BUNDLE_MAGIC_SIZE];
+    uint32_t version;
+    uint32_t num_records;
+    uint64_t strings_offset;
+    uint64_t strings_size;
+    uint64_t records_offset;
+    // The size of the whole bundle, which tells a bundle that was cut short from a complete one.
+    uint64_t file_size;
+};
+
+// One file. The inode, size and modification time are those of the file mkbundle packed, so its validators come out
+// exactly as they would have if the file were served from the web root.
+typedef struct bundle_record bundle_record_t;
+struct bundle_record {
+    uint64_t path_offset;
+    uint64_t data_offset;
+    uint64_t size;
+    uint64_t inode;
+    int64_t modified_seconds;
+    int64_t modified_nanoseconds;
+    uint32_t path_length;
+    uint32_t flags;
+};
+
+// A bundle mapped into memory.
+typedef struct bundle bundle_t;
+struct bundle {
+    int fd;
+    const char *data;
+    size_t size;
+    bundle_header_t *header;
+    const char *strings;
+    bundle_record_t *records;
+};
+
+uint64_t bundle_align(uint64_t offset, uint64_t size);
+
+bool bundle_open(bundle_t *bundle, const char *path);
+
+void bundle_close(bundle_t *bundle);
+
+const char *bundle_record_path(bundle_t *bundle, bundle_record_t *record);
+
+void bundle_record_stat(bundle_record_t *record, struct stat *file_stat);
+
+#endif //COMP30023_2022_PROJECT_2_BUNDLE_H
@@ -0,0 +1,294 @@
+//
+// Created by User on 14/10/2026.
+//
+#include "cache.h"
+#include "respond.h"
+
+// 64 bit FNV-1a hash of a null-terminated string. Used to pick a shard and a bucket for a path.
+// http://www.isthe.com/chongo/tech/comp/fnv/index.html
+uint64_t hash_string(const char *string) {
+    uint64_t hash = FNV_OFFSET_BASIS;
+    for(const unsigned char *c = (const unsigned char *) string; *c != '\0'; c++) {
+        hash ^= *c;
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+static cache_shard_t *shard_of(file_cache_t *cache, uint64_t hash) {
+    return &cache->shards[hash % CACHE_SHARDS];
+}
+
+// Which bucket of its shard's map a path goes in. The low bits already picked the shard.
+static uint64_t map_hash(uint64_t hash) {
+    return hash / CACHE_SHARDS;
+}
+
+// Number of bytes an entry counts against its shard's budget.
+static size_t entry_cost(cache_entry_t *entry) {
+    return sizeof(cache_entry_t) + entry->size;
+}
+
+static void free_entry(cache_entry_t *entry) {
+    free(entry->data);
+    free(entry->path);
+    free(entry);
+}
+
+static void reclaim_entry(ebr_retired_t *retired) {
+    free_entry((cache_entry_t *) ((char *) retired - offsetof(cache_entry_t, retired)));
+}
+
+// Takes a reference to an entry a lookup found in the map, unless its last reference has already been dropped and it
+// is waiting to be freed. Returns false in that case, and the lookup treats it as not being there.
+static bool try_reference(cache_entry_t *entry) {
+    int references = __atomic_load_n(&entry->references, __ATOMIC_RELAXED);
+    while(references > 0) {
+        if(__atomic_compare_exchange_n(&entry->references, &references, references + 1, true, __ATOMIC_ACQUIRE,
+                                       __ATOMIC_RELAXED)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Drops one reference to an entry. The last one retires it, by which time it is no longer in the map (the cache's
+// own reference is only dropped once it has been removed), so it is freed as soon as no lookup can still be on it.
+static void unreference_entry(cache_entry_t *entry) {
+    if(__atomic_sub_fetch(&entry->references, 1, __ATOMIC_ACQ_REL) == 0) {
+        ebr_retire(&entry->retired, reclaim_entry);
+    }
+}
+
+static void lru_unlink(cache_shard_t *shard, cache_entry_t *entry) {
+    if(entry->lru_prev != NULL) {
+        entry->lru_prev->lru_next = entry->lru_next;
+    } else {
+        shard->lru_head = entry->lru_next;
+    }
+    if(entry->lru_next != NULL) {
+        entry->lru_next->lru_prev = entry->lru_prev;
+    } else {
+        shard->lru_tail = entry->lru_prev;
+    }
+    entry->lru_prev = entry->lru_next = NULL;
+}
+
+static void lru_append(cache_shard_t *shard, cache_entry_t *entry) {
+    entry->lru_prev = shard->lru_tail;
+    entry->lru_next = NULL;
+    if(shard->lru_tail != NULL) {
+        shard->lru_tail->lru_next = entry;
+    } else {
+        shard->lru_head = entry;
+    }
+    shard->lru_tail = entry;
+}
+
+// Finds the entry for file_path in a shard. Must be called between ebr_enter and ebr_exit or with the shard lock held.
+static cache_entry_t *find_entry(cache_shard_t *shard, uint64_t hash, char *file_path) {
+    for(rcu_map_node_t *node = rcu_map_first(&shard->map, map_hash(hash)); node != NULL; node = rcu_map_next(node)) {
+        cache_entry_t *entry = (cache_entry_t *) node;
+        if(entry->hash == hash && strcmp(entry->path, file_path) == SAME_STRING) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+// Takes an entry out of the hash table and LRU list and drops the reference the cache held on it. Responses that are
+// still sending it keep it alive. Must be called with the shard lock held.
+static void remove_entry(cache_shard_t *shard, cache_entry_t *entry) {
+    rcu_map_remove(&shard->map, &entry->node, map_hash(entry->hash));
+    lru_unlink(shard, entry);
+    shard->bytes_used -= entry_cost(entry);
+    unreference_entry(entry);
+}
+
+// Evicts entries, oldest first, until cost more bytes fit in the shard's budget or the shard is empty. An entry found
+// by a lookup since eviction last passed it is moved to the back instead, once, and once eviction has come round to
+// the first entry it spared every entry gets evicted in turn, so a shard that is hit all the time still makes room.
+// Must be called with the shard lock held.
+static void make_room(file_cache_t *cache, cache_shard_t *shard, size_t cost) {
+    cache_entry_t *first_spared = NULL;
+    bool second_chances = true;
+    while(shard->bytes_used + cost > cache->shard_capacity && shard->lru_head != NULL) {
+        cache_entry_t *entry = shard->lru_head;
+        if(entry == first_spared) {
+            second_chances = false;
+        }
+        if(second_chances && __atomic_load_n(&entry->referenced, __ATOMIC_RELAXED)) {
+            __atomic_store_n(&entry->referenced, false, __ATOMIC_RELAXED);
+            if(first_spared == NULL) {
+                first_spared = entry;
+            }
+            lru_unlink(shard, entry);
+            lru_append(shard, entry);
+        } else {
+            remove_entry(shard, entry);
+        }
+    }
+}
+
+// Returns true if the file described by file_stat is still the one the entry was loaded from.
+static bool entry_matches(cache_entry_t *entry, struct stat *file_stat) {
+    return entry->inode == file_stat->st_ino && (size_t) file_stat->st_size == entry->size &&
+           entry->mtime.tv_sec == file_stat->st_mtim.tv_sec && entry->mtime.tv_nsec == file_stat->st_mtim.tv_nsec;
+}
+
+// Reads the contents of an already opened file into a new entry. file_stat is the fstat() of file_path_fd. Returns NULL
+// if the file could not be read in full, its headers do not fit in the entry or memory ran out.
+static cache_entry_t *load_entry(char *file_path, uint64_t hash, int file_path_fd, struct stat *file_stat) {
+    cache_entry_t *entry = (cache_entry_t *) counted_malloc(sizeof(cache_entry_t));
+    if(entry == NULL) {
+        return NULL;
+    }
+    entry->size = file_stat->st_size;
+    // The contents are copied rather than mmap()ed: if the file were truncated while it is mapped (for example by
+    // rewriting it in place during a deploy), touching the mapping before the next revalidation would raise SIGBUS and
+    // bring the whole server down. https://man7.org/linux/man-pages/man2/mmap.2.html
+    // pread() is used since the descriptor may be shared with other workers through the fd cache.
+    entry->data = (char *) counted_malloc(entry->size > 0 ? entry->size : 1);
+    size_t bytes_loaded = 0;
+    while(entry->data != NULL && bytes_loaded < entry->size) {
+        ssize_t n = pread(file_path_fd, entry->data + bytes_loaded, entry->size - bytes_loaded, bytes_loaded);
+        // The file shrank while it was being read. Leave it to the uncached path rather than caching half a file.
+        if(n <= 0) {
+            free(entry->data);
+            entry->data = NULL;
+            break;
+        }
+        bytes_loaded += n;
+    }
+    if(entry->data == NULL) {
+        free(entry);
+        return NULL;
+    }
+
+    if((entry->path = counted_strdup(file_path)) == NULL) {
+        free_entry(entry);
+        return NULL;
+    }
+    entry->hash = hash;
+    entry->inode = file_stat->st_ino;
+    entry->mtime = file_stat->st_mtim;
+    entry->validated_at = time(NULL);
+    file_validators_init(&entry->validators, file_stat);
+    entry->headers_length = format_file_headers(entry->headers, CACHE_HEADER_MAX_SIZE, file_path, entry->size,
+                                                &entry->validators);
+    // Headers that were cut short would be sent as they are, so the file is left to the uncached path instead.
+    if(entry->headers_length >= CACHE_HEADER_MAX_SIZE) {
+        free_entry(entry);
+        return NULL;
+    }
+    entry->references = 0;
+    entry->referenced = false;
+    entry->node.next = NULL;
+    entry->lru_prev = entry->lru_next = NULL;
+    return entry;
+}
+
+// Sets up an empty cache which holds at most capacity bytes of files no bigger than max_file_size each. A capacity of
+// 0 disables the cache, and every lookup then misses.
+void file_cache_init(file_cache_t *cache, size_t capacity, size_t max_file_size, int revalidate_interval) {
+    cache->enabled = capacity > 0;
+    cache->shard_capacity = capacity / CACHE_SHARDS;
+    // A file that does not fit in its shard would just evict everything else and then itself.
+    cache->max_file_size = max_file_size < cache->shard_capacity ? max_file_size : cache->shard_capacity;
+    cache->revalidate_interval = revalidate_interval;
+    for(int i = 0; i < CACHE_SHARDS; i++) {
+        cache_shard_t *shard = &cache->shards[i];
+        pthread_mutex_init(&shard->lock, NULL);
+        rcu_map_init(&shard->map, shard->buckets, CACHE_BUCKETS_PER_SHARD);
+        shard->lru_head = shard->lru_tail = NULL;
+        shard->bytes_used = 0;
+    }
+}
+
+// Returns the cache entry for file_path if there is one. An entry older than the revalidation interval is compared
+// against a fresh stat() first and dropped if the file changed. The caller owns a reference to the returned entry and
+// must hand it back with file_cache_release. Returns NULL on a miss, after which the caller opens the file itself and
+// may offer it to file_cache_insert.
+cache_entry_t *file_cache_lookup(file_cache_t *cache, char *file_path) {
+    if(!cache->enabled) {
+        return NULL;
+    }
+    uint64_t hash = hash_string(file_path);
+    cache_shard_t *shard = shard_of(cache, hash);
+    time_t now = time(NULL);
+
+    ebr_enter();
+    cache_entry_t *entry = find_entry(shard, hash, file_path);
+    if(entry != NULL && !try_reference(entry)) {
+        entry = NULL;
+    }
+    ebr_exit();
+    if(entry == NULL) {
+        return NULL;
+    }
+    // Only written when it changes, so lookups of a popular file do not keep taking its cache line from each other.
+    if(!__atomic_load_n(&entry->referenced, __ATOMIC_RELAXED)) {
+        __atomic_store_n(&entry->referenced, true, __ATOMIC_RELAXED);
+    }
+    if(now - __atomic_load_n(&entry->validated_at, __ATOMIC_RELAXED) < cache->revalidate_interval) {
+        return entry;
+    }
+
+    struct stat file_stat;
+    if(resolve_stat(file_path, &file_stat) == 0 && entry_matches(entry, &file_stat)) {
+        __atomic_store_n(&entry->validated_at, now, __ATOMIC_RELAXED);
+        return entry;
+    }
+    // The file changed or disappeared. Another thread may have noticed at the same time and removed it already.
+    pthread_mutex_lock(&shard->lock);
+    if(find_entry(shard, hash, file_path) == entry) {
+        remove_entry(shard, entry);
+    }
+    pthread_mutex_unlock(&shard->lock);
+    unreference_entry(entry);
+    return NULL;
+}
+
+// Offers a file the caller has just opened (after a file_cache_lookup miss) to the cache. file_stat is the fstat() of
+// file_path_fd. Files that are not regular or are too big are turned away with NULL, in which case the caller sends
+// the file from file_path_fd itself. Otherwise returns the entry, with a reference owned by the caller as for
+// file_cache_lookup.
+cache_entry_t *file_cache_insert(file_cache_t *cache, char *file_path, int file_path_fd, struct stat *file_stat) {
+    if(!cache->enabled || !S_ISREG(file_stat->st_mode) || (size_t) file_stat->st_size > cache->max_file_size) {
+        return NULL;
+    }
+    uint64_t hash = hash_string(file_path);
+    cache_shard_t *shard = shard_of(cache, hash);
+
+    // Load the file without the lock held. If another thread loaded the same file in the meantime, its entry wins
+    // and ours is thrown away.
+    cache_entry_t *loaded = load_entry(file_path, hash, file_path_fd, file_stat);
+    if(loaded == NULL) {
+        return NULL;
+    }
+    pthread_mutex_lock(&shard->lock);
+    cache_entry_t *entry = find_entry(shard, hash, file_path);
+    if(entry != NULL) {
+        // Entries in the map always hold the cache's reference, so this one cannot be on its way out.
+        __atomic_add_fetch(&entry->references, 1, __ATOMIC_RELAXED);
+        pthread_mutex_unlock(&shard->lock);
+        // Never published, so nobody else can have seen it.
+        free_entry(loaded);
+        return entry;
+    }
+
+    make_room(cache, shard, entry_cost(loaded));
+    // One reference for the cache and one for the caller, set before the entry is published.
+    loaded->references = 2;
+    rcu_map_insert(&shard->map, &loaded->node, map_hash(hash));
+    lru_append(shard, loaded);
+    shard->bytes_used += entry_cost(loaded);
+    pthread_mutex_unlock(&shard->lock);
+    return loaded;
+}
+
+// Hands back a reference obtained from file_cache_lookup or file_cache_insert once the response using it has been sent.
+// No lock is needed, so releasing never waits for a shard that is being changed.
+void file_cache_release(file_cache_t *cache, cache_entry_t *entry) {
+    unreference_entry(entry);
+}
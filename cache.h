@@ -0,0 +1,106 @@
+//
+// Created by User on 14/10/2026.
+//
+
+#ifndef COMP30023_2022_PROJECT_2_CACHE_H
+#define COMP30023_2022_PROJECT_2_CACHE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <time.h>
+#include <fcntl.h>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "arena.h"
+#include "validators.h"
+#include "resolve.h"
+#include "ebr.h"
+#include "rcumap.h"
+
+#define CACHE_SHARDS 16
+#define CACHE_BUCKETS_PER_SHARD 1024
+// Enough for the file headers of a type of MIME_TYPE_MAX_LENGTH with the longest ETag and Content-Length. Entries
+// whose headers do not fit all the same are left out of the file cache and the preload index.
+#define CACHE_HEADER_MAX_SIZE 384
+
+#define FNV_OFFSET_BASIS 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
+
+// One cached file. The contents are kept in memory so serving a hit is a single writev() with no file system access at
+// all. headers holds the part of the response headers that only depends on the file (Content-Type, Content-Length and
+// the validators); the status line and Connection header are added per request.
+typedef struct cache_entry cache_entry_t;
+struct cache_entry {
+    // The entry's link in its shard's map, which lookups follow without taking the shard lock.
+    rcu_map_node_t node;
+    char *path;
+    uint64_t hash;
+    char *data;
+    size_t size;
+    char headers[CACHE_HEADER_MAX_SIZE];
+    size_t headers_length;
+
+    // What the file looked like when it was loaded, compared against a fresh stat() to detect changes.
+    ino_t inode;
+    struct timespec mtime;
+    file_validators_t validators;
+    // Read and written with relaxed atomics, since lookups that revalidate the entry update it without the lock.
+    time_t validated_at;
+
+    // Number of responses still using data, plus one while the entry is in the cache. Once this drops to zero the
+    // entry is retired and freed when no lookup can still be looking at it, so an entry evicted or invalidated in the
+    // middle of a transfer stays valid until it finishes. Only changed with atomic operations.
+    int references;
+    ebr_retired_t retired;
+    // Set by every lookup that finds the entry and cleared by eviction, which passes over an entry that has been
+    // found since its last pass once before evicting it (the CLOCK approximation of LRU). A lookup cannot move the
+    // entry in the LRU list itself without taking the lock.
+    bool referenced;
+    cache_entry_t *lru_prev;
+    cache_entry_t *lru_next;
+};
+
+// The cache is split into shards by hash of the path, each with its own hash table and LRU list. Lookups read the
+// hash table without any lock (see rcumap.h), so workers hitting the same file never wait on each other; lock is only
+// taken to change the shard, which inserting, evicting and invalidating entries do.
+typedef struct cache_shard cache_shard_t;
+struct cache_shard {
+    pthread_mutex_t lock;
+    rcu_map_t map;
+    rcu_map_node_t *buckets[CACHE_BUCKETS_PER_SHARD];
+    // Least recently inserted first, apart from entries that eviction gave a second chance.
+    cache_entry_t *lru_head;
+    cache_entry_t *lru_tail;
+    size_t bytes_used;
+};
+
+typedef struct file_cache file_cache_t;
+struct file_cache {
+    cache_shard_t shards[CACHE_SHARDS];
+    // Byte budget of each shard.
+    size_t shard_capacity;
+    // Files bigger than this are never cached and keep being sent with sendfile().
+    size_t max_file_size;
+    // Seconds an entry is trusted before its file is stat()ed again to check that it has not changed.
+    int revalidate_interval;
+    bool enabled;
+};
+
+uint64_t hash_string(const char *string);
+
+void file_cache_init(file_cache_t *cache, size_t capacity, size_t max_file_size, int revalidate_interval);
+
+cache_entry_t *file_cache_lookup(file_cache_t *cache, char *file_path);
+
+cache_entry_t *file_cache_insert(file_cache_t *cache, char *file_path, int file_path_fd, struct stat *file_stat);
+
+void file_cache_release(file_cache_t *cache, cache_entry_t *entry);
+
+#endif //COMP30023_2022_PROJECT_2_CACHE_H
@@ -0,0 +1,379 @@
+//
+// Created by User on 14/10/2026.
+//
+#include "compress.h"
+
+// Returns the encodings this build can compress with, as a mask of ENCODING_GZIP and ENCODING_BROTLI. Precompressed
+// siblings are served whatever this says, since sending them needs no library at all.
+int supported_encodings(void) {
+    int encodings = 0;
+#ifdef WITH_ZLIB
+    encodings |= ENCODING_GZIP;
+#endif
+#ifdef WITH_BROTLI
+    encodings |= ENCODING_BROTLI;
+#endif
+    return encodings;
+}
+
+// Entries are found by path and encoding together, so the two encodings of a file usually land in different buckets.
+static uint64_t hash_entry(char *file_path, int encoding) {
+    return hash_string(file_path) * FNV_PRIME + encoding;
+}
+
+static compress_shard_t *shard_of(compress_cache_t *cache, uint64_t hash) {
+    return &cache->shards[hash % COMPRESS_SHARDS];
+}
+
+static compressed_entry_t **bucket_of(compress_shard_t *shard, uint64_t hash) {
+    return &shard->buckets[(hash / COMPRESS_SHARDS) % COMPRESS_BUCKETS_PER_SHARD];
+}
+
+// Number of bytes an entry counts against its shard's budget.
+static size_t entry_cost(compressed_entry_t *entry) {
+    return sizeof(compressed_entry_t) + entry->size;
+}
+
+static void free_entry(compressed_entry_t *entry) {
+    free(entry->data);
+    free(entry->path);
+    free(entry);
+}
+
+// Drops one reference to an entry and frees it once nobody uses it. Must be called with the shard lock held.
+static void unreference_entry(compressed_entry_t *entry) {
+    entry->references--;
+    if(entry->references == 0) {
+        free_entry(entry);
+    }
+}
+
+static void lru_unlink(compress_shard_t *shard, compressed_entry_t *entry) {
+    if(entry->lru_prev != NULL) {
+        entry->lru_prev->lru_next = entry->lru_next;
+    } else {
+        shard->lru_head = entry->lru_next;
+    }
+    if(entry->lru_next != NULL) {
+        entry->lru_next->lru_prev = entry->lru_prev;
+    } else {
+        shard->lru_tail = entry->lru_prev;
+    }
+    entry->lru_prev = entry->lru_next = NULL;
+}
+
+static void lru_append(compress_shard_t *shard, compressed_entry_t *entry) {
+    entry->lru_prev = shard->lru_tail;
+    entry->lru_next = NULL;
+    if(shard->lru_tail != NULL) {
+        shard->lru_tail->lru_next = entry;
+    } else {
+        shard->lru_head = entry;
+    }
+    shard->lru_tail = entry;
+}
+
+// Finds the entry for file_path and encoding in a shard. Must be called with the shard lock held.
+static compressed_entry_t *find_entry(compress_shard_t *shard, uint64_t hash, char *file_path, int encoding) {
+    for(compressed_entry_t *entry = *bucket_of(shard, hash); entry != NULL; entry = entry->hash_next) {
+        if(entry->hash == hash && entry->encoding == encoding && strcmp(entry->path, file_path) == SAME_STRING) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+// Takes an entry out of the hash table and LRU list and drops the reference the cache held on it. Must be called with
+// the shard lock held.
+static void remove_entry(compress_shard_t *shard, compressed_entry_t *entry) {
+    compressed_entry_t **link = bucket_of(shard, entry->hash);
+    while(*link != entry) {
+        link = &(*link)->hash_next;
+    }
+    *link = entry->hash_next;
+    lru_unlink(shard, entry);
+    shard->bytes_used -= entry_cost(entry);
+    unreference_entry(entry);
+}
+
+// Compresses length bytes of data with encoding into a new block, stored in *compressed and *compressed_size. Returns
+// false if the encoding is not built in or the result would not be smaller than the original. mkbundle uses it too.
+bool compress_data(int encoding, const char *data, size_t length, char **compressed, size_t *compressed_size) {
+    *compressed = NULL;
+#ifdef WITH_ZLIB
+    if(encoding == ENCODING_GZIP) {
+        // deflateBound gives the most a single deflate() with Z_FINISH can produce.
+        // https://www.zlib.net/manual.html#Advanced
+        z_stream stream;
+        memset(&stream, 0, sizeof(stream));
+        if(deflateInit2(&stream, GZIP_LEVEL, Z_DEFLATED, GZIP_WINDOW_BITS, GZIP_MEMORY_LEVEL,
+                        Z_DEFAULT_STRATEGY) != Z_OK) {
+            return false;
+        }
+        size_t bound = deflateBound(&stream, length);
+        *compressed = (char *) counted_malloc(bound);
+        if(*compressed != NULL) {
+            stream.next_in = (Bytef *) data;
+            stream.avail_in = length;
+            stream.next_out = (Bytef *) *compressed;
+            stream.avail_out = bound;
+            if(deflate(&stream, Z_FINISH) == Z_STREAM_END) {
+                *compressed_size = stream.total_out;
+            } else {
+                free(*compressed);
+                *compressed = NULL;
+            }
+        }
+        deflateEnd(&stream);
+    }
+#endif
+#ifdef WITH_BROTLI
+    if(encoding == ENCODING_BROTLI) {
+        // https://github.com/google/brotli/blob/master/c/include/brotli/encode.h
+        size_t bound = BrotliEncoderMaxCompressedSize(length);
+        *compressed = bound > 0 ? (char *) counted_malloc(bound) : NULL;
+        *compressed_size = bound;
+        if(*compressed != NULL &&
+           !BrotliEncoderCompress(BROTLI_QUALITY, BROTLI_DEFAULT_WINDOW, BROTLI_MODE_TEXT, length,
+                                  (const uint8_t *) data, compressed_size, (uint8_t *) *compressed)) {
+            free(*compressed);
+            *compressed = NULL;
+        }
+    }
+#endif
+    if(*compressed != NULL && *compressed_size >= length) {
+        free(*compressed);
+        *compressed = NULL;
+    }
+    return *compressed != NULL;
+}
+
+// Reads the whole of the file at file_path into a new block, stored in *data and *length, provided it is still the
+// version whose entity tag is etag. Returns false otherwise, or if it cannot be read; *validators is then left alone.
+static bool read_source(char *file_path, const char *etag, char **data, size_t *length,
+                        file_validators_t *validators) {
+    int fd = resolve_open(file_path);
+    if(fd < 0) {
+        return false;
+    }
+    struct stat file_stat;
+    file_validators_t current;
+    if(fstat(fd, &file_stat) < 0 || !S_ISREG(file_stat.st_mode)) {
+        close(fd);
+        return false;
+    }
+    file_validators_init(&current, &file_stat);
+    if(strcmp(current.etag, etag) != SAME_STRING) {
+        close(fd);
+        return false;
+    }
+    *length = file_stat.st_size;
+    *data = (char *) counted_malloc(*length > 0 ? *length : 1);
+    size_t bytes_read = 0;
+    while(*data != NULL && bytes_read < *length) {
+        ssize_t n = pread(fd, *data + bytes_read, *length - bytes_read, bytes_read);
+        if(n <= 0) {
+            free(*data);
+            *data = NULL;
+        } else {
+            bytes_read += n;
+        }
+    }
+    close(fd);
+    if(*data != NULL) {
+        *validators = current;
+    }
+    return *data != NULL;
+}
+
+// Marks the entity tag in validators as belonging to a copy compressed with encoding, by putting a suffix in front of
+// the closing quote.
+static void mark_etag(file_validators_t *validators, int encoding) {
+    size_t length = strlen(validators->etag);
+    const char *suffix = encoding == ENCODING_BROTLI ? BROTLI_ETAG_SUFFIX : GZIP_ETAG_SUFFIX;
+    if(length >= 2 && length + strlen(suffix) < ETAG_MAX_SIZE) {
+        snprintf(validators->etag + length - 1, ETAG_MAX_SIZE - length + 1, "%s\"", suffix);
+    }
+}
+
+// Compresses the file of a pending entry and stores the result in it. A file that changed since it was queued, or
+// that does not get any smaller, makes the entry COMPRESSED_USELESS; the response that finds such an entry with an
+// out of date source_etag queues the file again.
+static void compress_entry(compress_cache_t *cache, compressed_entry_t *entry) {
+    char *source = NULL;
+    size_t source_length = 0;
+    char *compressed = NULL;
+    size_t compressed_size = 0;
+    file_validators_t validators;
+    bool compressed_ok = read_source(entry->path, entry->source_etag, &source, &source_length, &validators) &&
+                         compress_data(entry->encoding, source, source_length, &compressed, &compressed_size);
+    free(source);
+
+    compress_shard_t *shard = shard_of(cache, entry->hash);
+    pthread_mutex_lock(&shard->lock);
+    bool in_cache = find_entry(shard, entry->hash, entry->path, entry->encoding) == entry;
+    if(compressed_ok) {
+        entry->data = compressed;
+        entry->size = compressed_size;
+        entry->validators = validators;
+        mark_etag(&entry->validators, entry->encoding);
+        if(in_cache) {
+            shard->bytes_used += compressed_size;
+        }
+    }
+    entry->state = compressed_ok ? COMPRESSED_READY : COMPRESSED_USELESS;
+
+    // Evict least recently used entries until the shard is back within its budget, leaving pending ones alone since
+    // they are still waiting in the queue.
+    compressed_entry_t *victim = shard->lru_head;
+    while(shard->bytes_used > cache->shard_capacity && victim != NULL) {
+        compressed_entry_t *next = victim->lru_next;
+        if(victim != entry && victim->state != COMPRESSED_PENDING) {
+            remove_entry(shard, victim);
+        }
+        victim = next;
+    }
+    if(in_cache && shard->bytes_used > cache->shard_capacity) {
+        remove_entry(shard, entry);
+    }
+    // The reference the queue held.
+    unreference_entry(entry);
+    pthread_mutex_unlock(&shard->lock);
+}
+
+// Body of every compression thread: takes pending entries off the queue forever.
+static void *compression_main(void *arg) {
+    compress_cache_t *cache = (compress_cache_t *) arg;
+    while(true) {
+        pthread_mutex_lock(&cache->queue_lock);
+        while(cache->queue_length == 0) {
+            pthread_cond_wait(&cache->queue_not_empty, &cache->queue_lock);
+        }
+        compressed_entry_t *entry = cache->queue[cache->queue_head];
+        cache->queue_head = (cache->queue_head + 1) % COMPRESS_QUEUE_CAPACITY;
+        cache->queue_length--;
+        pthread_mutex_unlock(&cache->queue_lock);
+        compress_entry(cache, entry);
+    }
+    return NULL;
+}
+
+// Sets up an empty cache holding at most capacity bytes of compressed files, made from files no bigger than
+// max_file_size, and starts num_threads compression threads. A capacity of 0 disables compressing files on the fly,
+// as does a build with neither zlib nor brotli. Returns false if a thread could not be created.
+bool compress_cache_init(compress_cache_t *cache, size_t capacity, size_t max_file_size, int num_threads) {
+    cache->enabled = capacity > 0 && supported_encodings() != 0;
+    cache->shard_capacity = capacity / COMPRESS_SHARDS;
+    // A file whose compressed copy might not fit in its shard would just evict everything else and then itself.
+    cache->max_file_size = max_file_size < cache->shard_capacity ? max_file_size : cache->shard_capacity;
+    for(int i = 0; i < COMPRESS_SHARDS; i++) {
+        compress_shard_t *shard = &cache->shards[i];
+        pthread_mutex_init(&shard->lock, NULL);
+        memset(shard->buckets, 0, sizeof(shard->buckets));
+        shard->lru_head = shard->lru_tail = NULL;
+        shard->bytes_used = 0;
+    }
+    pthread_mutex_init(&cache->queue_lock, NULL);
+    pthread_cond_init(&cache->queue_not_empty, NULL);
+    cache->queue_head = 0;
+    cache->queue_length = 0;
+    if(!cache->enabled) {
+        return true;
+    }
+
+    for(int i = 0; i < num_threads; i++) {
+        pthread_t thread;
+        int error = pthread_create(&thread, NULL, compression_main, cache);
+        if(error != 0) {
+            fprintf(stderr, "ERROR, could not create compression thread: %s\n", strerror(error));
+            return false;
+        }
+        pthread_detach(thread);
+    }
+    return true;
+}
+
+// Creates a pending entry for file_path and puts it on the queue for a compression thread. Must be called with the
+// shard lock held. Returns false if the queue is full or the entry could not be allocated.
+static bool queue_entry(compress_cache_t *cache, compress_shard_t *shard, uint64_t hash, char *file_path,
+                        int encoding, file_validators_t *validators) {
+    compressed_entry_t *entry = (compressed_entry_t *) counted_malloc(sizeof(compressed_entry_t));
+    if(entry == NULL) {
+        return false;
+    }
+    entry->path = counted_strdup(file_path);
+    if(entry->path == NULL) {
+        free(entry);
+        return false;
+    }
+    entry->hash = hash;
+    entry->encoding = encoding;
+    snprintf(entry->source_etag, ETAG_MAX_SIZE, "%s", validators->etag);
+    entry->state = COMPRESSED_PENDING;
+    entry->data = NULL;
+    entry->size = 0;
+
+    pthread_mutex_lock(&cache->queue_lock);
+    if(cache->queue_length == COMPRESS_QUEUE_CAPACITY) {
+        pthread_mutex_unlock(&cache->queue_lock);
+        free_entry(entry);
+        return false;
+    }
+    // One reference for the cache and one for the queue.
+    entry->references = 2;
+    cache->queue[(cache->queue_head + cache->queue_length) % COMPRESS_QUEUE_CAPACITY] = entry;
+    cache->queue_length++;
+    pthread_cond_signal(&cache->queue_not_empty);
+    pthread_mutex_unlock(&cache->queue_lock);
+
+    compressed_entry_t **bucket = bucket_of(shard, hash);
+    entry->hash_next = *bucket;
+    *bucket = entry;
+    lru_append(shard, entry);
+    shard->bytes_used += entry_cost(entry);
+    return true;
+}
+
+// Returns the copy of file_path compressed with encoding, if the cache has one made from the version of the file
+// validators describe. The caller owns a reference to it and must hand it back with compress_cache_release. Returns
+// NULL if there is none yet, after queuing the file to be compressed unless that is already under way, or if the file
+// is not worth compressing.
+compressed_entry_t *compress_cache_lookup(compress_cache_t *cache, char *file_path, int encoding,
+                                          file_validators_t *validators, off_t file_size) {
+    if(!cache->enabled || (supported_encodings() & encoding) == 0 || (size_t) file_size > cache->max_file_size) {
+        return NULL;
+    }
+    uint64_t hash = hash_entry(file_path, encoding);
+    compress_shard_t *shard = shard_of(cache, hash);
+
+    pthread_mutex_lock(&shard->lock);
+    compressed_entry_t *entry = find_entry(shard, hash, file_path, encoding);
+    if(entry != NULL && strcmp(entry->source_etag, validators->etag) != SAME_STRING &&
+       entry->state != COMPRESSED_PENDING) {
+        // Made from an older version of the file, so it has to be made again.
+        remove_entry(shard, entry);
+        entry = NULL;
+    }
+    if(entry == NULL) {
+        queue_entry(cache, shard, hash, file_path, encoding, validators);
+        pthread_mutex_unlock(&shard->lock);
+        return NULL;
+    }
+    lru_unlink(shard, entry);
+    lru_append(shard, entry);
+    if(entry->state != COMPRESSED_READY) {
+        pthread_mutex_unlock(&shard->lock);
+        return NULL;
+    }
+    entry->references++;
+    pthread_mutex_unlock(&shard->lock);
+    return entry;
+}
+
+// Hands back a reference obtained from compress_cache_lookup once the response using it has been sent.
+void compress_cache_release(compress_cache_t *cache, compressed_entry_t *entry) {
+    compress_shard_t *shard = shard_of(cache, entry->hash);
+    pthread_mutex_lock(&shard->lock);
+    unreference_entry(entry);
+    pthread_mutex_unlock(&shard->lock);
+}
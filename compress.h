@@ -0,0 +1,125 @@
+//
+// Created by User on 14/10/2026.
+//
+
+#ifndef COMP30023_2022_PROJECT_2_COMPRESS_H
+#define COMP30023_2022_PROJECT_2_COMPRESS_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <fcntl.h>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#ifdef WITH_ZLIB
+#include <zlib.h>
+#endif
+#ifdef WITH_BROTLI
+#include <brotli/encode.h>
+#endif
+
+#include "arena.h"
+#include "cache.h"
+#include "parse.h"
+#include "validators.h"
+
+#define COMPRESS_SHARDS 16
+#define COMPRESS_BUCKETS_PER_SHARD 256
+// Number of files that may be waiting to be compressed. Requests that find the queue full are sent uncompressed, and
+// the file is queued again by a later request.
+#define COMPRESS_QUEUE_CAPACITY 256
+
+// Files are compressed once and then served many times, so the result is worth the slower settings.
+#define GZIP_LEVEL 9
+// gzip rather than zlib framing. https://www.zlib.net/manual.html#Advanced
+#define GZIP_WINDOW_BITS (15 + 16)
+#define GZIP_MEMORY_LEVEL 8
+#define BROTLI_QUALITY 9
+
+// File name suffixes of precompressed siblings, such as app.js.br next to app.js.
+#define BROTLI_SUFFIX ".br"
+#define GZIP_SUFFIX ".gz"
+// Appended to a file's entity tag (inside the quotes) for a copy the server compressed itself, since every encoding of
+// a file is a different representation and needs a tag of its own.
+#define BROTLI_ETAG_SUFFIX "-br"
+#define GZIP_ETAG_SUFFIX "-gz"
+
+// What is known about compressing one file with one encoding.
+enum compressed_state {
+    // Queued for, or in the hands of, a compression thread.
+    COMPRESSED_PENDING = 0,
+    COMPRESSED_READY,
+    // Compressing the file did not make it any smaller (or did not work), so it is sent as it is.
+    COMPRESSED_USELESS
+};
+
+// The compressed copy of a file, made from the version of it whose entity tag is source_etag. An entry that no longer
+// matches the file is dropped and made again. The entry goes into the cache as soon as the file is queued, so a file
+// is only ever queued once per change. Entries are refcounted in the same way as file cache entries, so one
+// that is evicted in the middle of a transfer stays valid until it finishes.
+typedef struct compressed_entry compressed_entry_t;
+struct compressed_entry {
+    char *path;
+    uint64_t hash;
+    // ENCODING_GZIP or ENCODING_BROTLI.
+    int encoding;
+    char source_etag[ETAG_MAX_SIZE];
+    enum compressed_state state;
+    char *data;
+    size_t size;
+    // The original file's validators with the entity tag marked with the encoding.
+    file_validators_t validators;
+
+    int references;
+    compressed_entry_t *hash_next;
+    compressed_entry_t *lru_prev;
+    compressed_entry_t *lru_next;
+};
+
+typedef struct compress_shard compress_shard_t;
+struct compress_shard {
+    pthread_mutex_t lock;
+    compressed_entry_t *buckets[COMPRESS_BUCKETS_PER_SHARD];
+    // Least recently used first.
+    compressed_entry_t *lru_head;
+    compressed_entry_t *lru_tail;
+    size_t bytes_used;
+};
+
+// Compressed copies of files, made by background threads so no request ever waits for one: the request that finds a
+// file not compressed yet queues it and is sent the file as it is. The entries are kept within a byte budget in the
+// same way as the file cache.
+typedef struct compress_cache compress_cache_t;
+struct compress_cache {
+    compress_shard_t shards[COMPRESS_SHARDS];
+    size_t shard_capacity;
+    // Files bigger than this are never compressed by the server itself.
+    size_t max_file_size;
+    bool enabled;
+
+    // Pending entries waiting for a compression thread, as a ring buffer.
+    pthread_mutex_t queue_lock;
+    pthread_cond_t queue_not_empty;
+    compressed_entry_t *queue[COMPRESS_QUEUE_CAPACITY];
+    int queue_head;
+    int queue_length;
+};
+
+int supported_encodings(void);
+
+bool compress_data(int encoding, const char *data, size_t length, char **compressed, size_t *compressed_size);
+
+bool compress_cache_init(compress_cache_t *cache, size_t capacity, size_t max_file_size, int num_threads);
+
+compressed_entry_t *compress_cache_lookup(compress_cache_t *cache, char *file_path, int encoding,
+                                          file_validators_t *validators, off_t file_size);
+
+void compress_cache_release(compress_cache_t *cache, compressed_entry_t *entry);
+
+#endif //COMP30023_2022_PROJECT_2_COMPRESS_H
@@ -0,0 +1,484 @@
+//
+// Created by User on 14/10/2026.
+//
+#include "config.h"
+
+// Identifiers returned by getopt_long for each of the long options below.
+enum config_option {
+    OPTION_WORKERS = 1,
+    OPTION_QUEUE_CAPACITY,
+    OPTION_MODE,
+    OPTION_EVENT_LOOPS,
+    OPTION_LISTENERS,
+    OPTION_LISTEN_BACKLOG,
+    OPTION_PIN_LISTENERS,
+    OPTION_PIN_WORKERS,
+    OPTION_STEER_CONNECTIONS,
+    OPTION_KEEPALIVE_TIMEOUT,
+    OPTION_MAX_REQUESTS,
+    OPTION_HEADER_TIMEOUT,
+    OPTION_SEND_TIMEOUT,
+    OPTION_MAX_CONNECTIONS,
+    OPTION_MAX_CONNECTIONS_PER_IP,
+    OPTION_LARGE_RESPONSE,
+    OPTION_LARGE_TRANSFERS,
+    OPTION_SEND_QUANTUM,
+    OPTION_CACHE_SIZE,
+    OPTION_CACHE_MAX_FILE,
+    OPTION_CACHE_REVALIDATE,
+    OPTION_FD_CACHE_ENTRIES,
+    OPTION_FD_CACHE_TTL,
+    OPTION_NEGATIVE_CACHE_TTL,
+    OPTION_COMPRESS_CACHE_SIZE,
+    OPTION_COMPRESS_MAX_FILE,
+    OPTION_COMPRESS_THREADS,
+    OPTION_MIME_TYPES,
+    OPTION_TLS_CERT,
+    OPTION_TLS_KEY,
+    OPTION_TLS_SESSION_CACHE,
+    OPTION_METRICS_PORT,
+    OPTION_ACCESS_LOG,
+    OPTION_ACCESS_LOG_FORMAT,
+    OPTION_ACCESS_LOG_ROTATE,
+    OPTION_TRACE_SAMPLE,
+    OPTION_TRACE_SLOW,
+    OPTION_TRACE_FILE,
+    OPTION_PRELOAD,
+    OPTION_PRELOAD_THREADS,
+    OPTION_PRELOAD_MEMORY,
+    OPTION_PRELOAD_MLOCK,
+    OPTION_BUNDLE,
+    OPTION_DRAIN_TIMEOUT,
+    OPTION_HANDOFF
+};
+
+static struct option long_options[] = {
+    {"workers", required_argument, NULL, OPTION_WORKERS},
+    {"queue", required_argument, NULL, OPTION_QUEUE_CAPACITY},
+    {"mode", required_argument, NULL, OPTION_MODE},
+    {"event-loops", required_argument, NULL, OPTION_EVENT_LOOPS},
+    {"listeners", required_argument, NULL, OPTION_LISTENERS},
+    {"backlog", required_argument, NULL, OPTION_LISTEN_BACKLOG},
+    {"pin-listeners", no_argument, NULL, OPTION_PIN_LISTENERS},
+    {"pin-workers", no_argument, NULL, OPTION_PIN_WORKERS},
+    {"steer-connections", no_argument, NULL, OPTION_STEER_CONNECTIONS},
+    {"keepalive-timeout", required_argument, NULL, OPTION_KEEPALIVE_TIMEOUT},
+    {"max-requests", required_argument, NULL, OPTION_MAX_REQUESTS},
+    {"header-timeout", required_argument, NULL, OPTION_HEADER_TIMEOUT},
+    {"send-timeout", required_argument, NULL, OPTION_SEND_TIMEOUT},
+    {"max-connections", required_argument, NULL, OPTION_MAX_CONNECTIONS},
+    {"max-connections-per-ip", required_argument, NULL, OPTION_MAX_CONNECTIONS_PER_IP},
+    {"large-response", required_argument, NULL, OPTION_LARGE_RESPONSE},
+    {"large-transfers", required_argument, NULL, OPTION_LARGE_TRANSFERS},
+    {"send-quantum", required_argument, NULL, OPTION_SEND_QUANTUM},
+    {"cache-size", required_argument, NULL, OPTION_CACHE_SIZE},
+    {"cache-max-file", required_argument, NULL, OPTION_CACHE_MAX_FILE},
+    {"cache-revalidate", required_argument, NULL, OPTION_CACHE_REVALIDATE},
+    {"fd-cache-entries", required_argument, NULL, OPTION_FD_CACHE_ENTRIES},
+    {"fd-cache-ttl", required_argument, NULL, OPTION_FD_CACHE_TTL},
+    {"negative-cache-ttl", required_argument, NULL, OPTION_NEGATIVE_CACHE_TTL},
+    {"compress-cache-size", required_argument, NULL, OPTION_COMPRESS_CACHE_SIZE},
+    {"compress-max-file", required_argument, NULL, OPTION_COMPRESS_MAX_FILE},
+    {"compress-threads", required_argument, NULL, OPTION_COMPRESS_THREADS},
+    {"mime-types", required_argument, NULL, OPTION_MIME_TYPES},
+    {"tls-cert", required_argument, NULL, OPTION_TLS_CERT},
+    {"tls-key", required_argument, NULL, OPTION_TLS_KEY},
+    {"tls-session-cache", required_argument, NULL, OPTION_TLS_SESSION_CACHE},
+    {"metrics-port", required_argument, NULL, OPTION_METRICS_PORT},
+    {"access-log", required_argument, NULL, OPTION_ACCESS_LOG},
+    {"access-log-format", required_argument, NULL, OPTION_ACCESS_LOG_FORMAT},
+    {"access-log-rotate", required_argument, NULL, OPTION_ACCESS_LOG_ROTATE},
+    {"trace-sample", required_argument, NULL, OPTION_TRACE_SAMPLE},
+    {"trace-slow", required_argument, NULL, OPTION_TRACE_SLOW},
+    {"trace-file", required_argument, NULL, OPTION_TRACE_FILE},
+    {"preload", no_argument, NULL, OPTION_PRELOAD},
+    {"preload-threads", required_argument, NULL, OPTION_PRELOAD_THREADS},
+    {"preload-memory", required_argument, NULL, OPTION_PRELOAD_MEMORY},
+    {"preload-mlock", no_argument, NULL, OPTION_PRELOAD_MLOCK},
+    {"bundle", required_argument, NULL, OPTION_BUNDLE},
+    {"drain-timeout", required_argument, NULL, OPTION_DRAIN_TIMEOUT},
+    {"handoff", required_argument, NULL, OPTION_HANDOFF},
+    {NULL, 0, NULL, 0}
+};
+
+// Converts an option value to a positive integer using strtol so that trailing garbage such as "8x" is rejected.
+// Returns true and stores the value if the conversion succeeded; false otherwise.
+static bool parse_positive_int(char *value, int *result) {
+    char *end;
+    long converted = strtol(value, &end, 10);
+    if(end == value || *end != '\0' || converted <= 0 || converted > INT_MAX) {
+        return false;
+    }
+    *result = (int) converted;
+    return true;
+}
+
+// Same as parse_positive_int but also accepts 0, for options where 0 turns a feature off.
+static bool parse_non_negative_int(char *value, int *result) {
+    if(strcmp(value, "0") == SAME_STRING) {
+        *result = 0;
+        return true;
+    }
+    return parse_positive_int(value, result);
+}
+
+// Fills config with the defaults and then overrides them with the command line arguments. The first three arguments
+// keep the meaning they always had ("protocol port web_root"), everything after them is an optional "--name=value"
+// argument. Returns false (after printing the reason) if the arguments are unusable.
+bool parse_server_config(int argc, char **argv, server_config_t *config) {
+    if(argc < NUM_POSITIONAL_ARGS + 1) {
+        fprintf(stderr, "ERROR, not enough arguments provided.\n");
+        return false;
+    }
+
+    config->protocol = argv[1];
+    config->port_number = argv[2];
+    config->web_root_path = argv[3];
+    config->worker_threads = DEFAULT_WORKER_THREADS;
+    config->queue_capacity = DEFAULT_QUEUE_CAPACITY;
+    config->mode = MODE_THREADS;
+    config->event_loops = DEFAULT_EVENT_LOOPS;
+    config->listeners = DEFAULT_LISTENERS;
+    config->listen_backlog = DEFAULT_LISTEN_BACKLOG;
+    config->pin_listeners = false;
+    config->pin_workers = false;
+    config->steer_connections = false;
+    config->keepalive_timeout = DEFAULT_KEEPALIVE_TIMEOUT;
+    config->max_requests = DEFAULT_MAX_REQUESTS;
+    config->header_timeout = DEFAULT_HEADER_TIMEOUT;
+    config->send_timeout = DEFAULT_SEND_TIMEOUT;
+    config->max_connections = DEFAULT_MAX_CONNECTIONS;
+    config->max_connections_per_ip = DEFAULT_MAX_CONNECTIONS_PER_IP;
+    config->large_response_kb = DEFAULT_LARGE_RESPONSE_KB;
+    config->large_transfers = DEFAULT_LARGE_TRANSFERS;
+    config->send_quantum_kb = DEFAULT_SEND_QUANTUM_KB;
+    config->cache_size_mb = DEFAULT_CACHE_SIZE_MB;
+    config->cache_max_file_kb = DEFAULT_CACHE_MAX_FILE_KB;
+    config->cache_revalidate = DEFAULT_CACHE_REVALIDATE;
+    config->fd_cache_entries = DEFAULT_FD_CACHE_ENTRIES;
+    config->fd_cache_ttl = DEFAULT_FD_CACHE_TTL;
+    config->negative_cache_ttl = DEFAULT_NEGATIVE_CACHE_TTL;
+    config->compress_cache_size_mb = DEFAULT_COMPRESS_CACHE_SIZE_MB;
+    config->compress_max_file_kb = DEFAULT_COMPRESS_MAX_FILE_KB;
+    config->compress_threads = DEFAULT_COMPRESS_THREADS;
+    config->mime_types_path = NULL;
+    config->tls_cert_path = NULL;
+    config->tls_key_path = NULL;
+    config->tls_session_cache = DEFAULT_TLS_SESSION_CACHE;
+    config->metrics_port = NULL;
+    config->access_log_path = NULL;
+    config->access_log_format = ACCESS_LOG_TEXT;
+    config->access_log_rotate_mb = DEFAULT_ACCESS_LOG_ROTATE_MB;
+    config->trace_sample = DEFAULT_TRACE_SAMPLE;
+    config->trace_slow_us = DEFAULT_TRACE_SLOW_US;
+    config->trace_path = NULL;
+    config->preload = false;
+    config->preload_threads = DEFAULT_PRELOAD_THREADS;
+    config->preload_memory_kb = DEFAULT_PRELOAD_MEMORY_KB;
+    config->preload_mlock = false;
+    config->bundle_path = NULL;
+    config->drain_timeout = DEFAULT_DRAIN_TIMEOUT;
+    config->handoff_path = NULL;
+
+    // getopt_long treats the first element of the array it is given as the program name, so handing it argv shifted
+    // by the positional arguments makes it start scanning right after the web root.
+    // https://man7.org/linux/man-pages/man3/getopt.3.html
+    int option_argc = argc - NUM_POSITIONAL_ARGS;
+    char **option_argv = argv + NUM_POSITIONAL_ARGS;
+    int option;
+    optind = 1;
+    // Report unrecognised options ourselves, since getopt_long would print the web root as the program name.
+    opterr = 0;
+    while((option = getopt_long(option_argc, option_argv, "", long_options, NULL)) != -1) {
+        switch(option) {
+            case OPTION_WORKERS:
+                if(!parse_positive_int(optarg, &config->worker_threads)) {
+                    fprintf(stderr, "ERROR, invalid number of workers: %s\n", optarg);
+                    return false;
+                }
+                break;
+            case OPTION_QUEUE_CAPACITY:
+                if(!parse_positive_int(optarg, &config->queue_capacity)) {
+                    fprintf(stderr, "ERROR, invalid queue capacity: %s\n", optarg);
+                    return false;
+                }
+                break;
+            case OPTION_MODE:
+                if(strcmp(optarg, MODE_THREADS_ARG) == SAME_STRING) {
+                    config->mode = MODE_THREADS;
+                } else if(strcmp(optarg, MODE_EPOLL_ARG) == SAME_STRING) {
+                    config->mode = MODE_EPOLL;
+                } else if(strcmp(optarg, MODE_URING_ARG) == SAME_STRING) {
+                    config->mode = MODE_URING;
+                } else {
+                    fprintf(stderr, "ERROR, unknown mode: %s\n", optarg);
+                    return false;
+                }
+                break;
+            case OPTION_EVENT_LOOPS:
+                if(!parse_positive_int(optarg, &config->event_loops)) {
+                    fprintf(stderr, "ERROR, invalid number of event loops: %s\n", optarg);
+                    return false;
+                }
+                break;
+            case OPTION_LISTENERS:
+                if(!parse_positive_int(optarg, &config->listeners)) {
+                    fprintf(stderr, "ERROR, invalid number of listeners: %s\n", optarg);
+                    return false;
+                }
+                break;
+            case OPTION_LISTEN_BACKLOG:
+                if(!parse_positive_int(optarg, &config->listen_backlog)) {
+                    fprintf(stderr, "ERROR, invalid listen backlog: %s\n", optarg);
+                    return false;
+                }
+                break;
+            case OPTION_PIN_LISTENERS:
+                config->pin_listeners = true;
+                break;
+            case OPTION_PIN_WORKERS:
+                config->pin_workers = true;
+                break;
+            case OPTION_STEER_CONNECTIONS:
+                config->steer_connections = true;
+                config->pin_listeners = true;
+                break;
+            case OPTION_KEEPALIVE_TIMEOUT:
+                if(!parse_positive_int(optarg, &config->keepalive_timeout)) {
+                    fprintf(stderr, "ERROR, invalid keep-alive timeout: %s\n", optarg);
+                    return false;
+                }
+                break;
+            case OPTION_MAX_REQUESTS:
+                if(!parse_positive_int(optarg, &config->max_requests)) {
+                    fprintf(stderr, "ERROR, invalid maximum requests per connection: %s\n", optarg);
+                    return false;
+                }
+                break;
+            case OPTION_HEADER_TIMEOUT:
+                if(!parse_positive_int(optarg, &config->header_timeout)) {
+                    fprintf(stderr, "ERROR, invalid header timeout: %s\n", optarg);
+                    return false;
+                }
+                break;
+            case OPTION_SEND_TIMEOUT:
+                if(!parse_positive_int(optarg, &config->send_timeout)) {
+                    fprintf(stderr, "ERROR, invalid send timeout: %s\n", optarg);
+                    return false;
+                }
+                break;
+            case OPTION_MAX_CONNECTIONS:
+                if(!parse_non_negative_int(optarg, &config->max_connections)) {
+                    fprintf(stderr, "ERROR, invalid maximum number of connections: %s\n", optarg);
+                    return false;
+                }
+                break;
+            case OPTION_MAX_CONNECTIONS_PER_IP:
+                if(!parse_non_negative_int(optarg, &config->max_connections_per_ip)) {
+                    fprintf(stderr, "ERROR, invalid maximum number of connections per address: %s\n", optarg);
+                    return false;
+                }
+                break;
+            case OPTION_LARGE_RESPONSE:
+                if(!parse_positive_int(optarg, &config->large_response_kb)) {
+                    fprintf(stderr, "ERROR, invalid large response size: %s\n", optarg);
+                    return false;
+                }
+                break;
+            case OPTION_LARGE_TRANSFERS:
+                if(!parse_non_negative_int(optarg, &config->large_transfers)) {
+                    fprintf(stderr, "ERROR, invalid number of large transfers: %s\n", optarg);
+                    return false;
+                }
+                break;
+            case OPTION_SEND_QUANTUM:
+                if(!parse_positive_int(optarg, &config->send_quantum_kb)) {
+                    fprintf(stderr, "ERROR, invalid send quantum: %s\n", optarg);
+                    return false;
+                }
+                break;
+            case OPTION_CACHE_SIZE:
+                if(!parse_non_negative_int(optarg, &config->cache_size_mb)) {
+                    fprintf(stderr, "ERROR, invalid cache size: %s\n", optarg);
+                    return false;
+                }
+                break;
+            case OPTION_CACHE_MAX_FILE:
+                if(!parse_positive_int(optarg, &config->cache_max_file_kb)) {
+                    fprintf(stderr, "ERROR, invalid maximum cached file size: %s\n", optarg);
+                    return false;
+                }
+                break;
+            case OPTION_CACHE_REVALIDATE:
+                if(!parse_non_negative_int(optarg, &config->cache_revalidate)) {
+                    fprintf(stderr, "ERROR, invalid cache revalidation interval: %s\n", optarg);
+                    return false;
+                }
+                break;
+            case OPTION_FD_CACHE_ENTRIES:
+                if(!parse_non_negative_int(optarg, &config->fd_cache_entries)) {
+                    fprintf(stderr, "ERROR, invalid fd cache size: %s\n", optarg);
+                    return false;
+                }
+                break;
+            case OPTION_FD_CACHE_TTL:
+                if(!parse_non_negative_int(optarg, &config->fd_cache_ttl)) {
+                    fprintf(stderr, "ERROR, invalid fd cache TTL: %s\n", optarg);
+                    return false;
+                }
+                break;
+            case OPTION_NEGATIVE_CACHE_TTL:
+                if(!parse_non_negative_int(optarg, &config->negative_cache_ttl)) {
+                    fprintf(stderr, "ERROR, invalid negative cache TTL: %s\n", optarg);
+                    return false;
+                }
+                break;
+            case OPTION_COMPRESS_CACHE_SIZE:
+                if(!parse_non_negative_int(optarg, &config->compress_cache_size_mb)) {
+                    fprintf(stderr, "ERROR, invalid compress cache size: %s\n", optarg);
+                    return false;
+                }
+                break;
+            case OPTION_COMPRESS_MAX_FILE:
+                if(!parse_positive_int(optarg, &config->compress_max_file_kb)) {
+                    fprintf(stderr, "ERROR, invalid maximum compressed file size: %s\n", optarg);
+                    return false;
+                }
+                break;
+            case OPTION_COMPRESS_THREADS:
+                if(!parse_positive_int(optarg, &config->compress_threads)) {
+                    fprintf(stderr, "ERROR, invalid number of compression threads: %s\n", optarg);
+                    return false;
+                }
+                break;
+            case OPTION_MIME_TYPES:
+                config->mime_types_path = optarg;
+                break;
+            case OPTION_TLS_CERT:
+                config->tls_cert_path = optarg;
+                break;
+            case OPTION_TLS_KEY:
+                config->tls_key_path = optarg;
+                break;
+            case OPTION_TLS_SESSION_CACHE:
+                if(!parse_non_negative_int(optarg, &config->tls_session_cache)) {
+                    fprintf(stderr, "ERROR, invalid TLS session cache size: %s\n", optarg);
+                    return false;
+                }
+                break;
+            case OPTION_METRICS_PORT: {
+                int metrics_port;
+                if(!parse_positive_int(optarg, &metrics_port) || metrics_port > MAX_PORT_NUMBER) {
+                    fprintf(stderr, "ERROR, invalid metrics port: %s\n", optarg);
+                    return false;
+                }
+                config->metrics_port = optarg;
+                break;
+            }
+            case OPTION_ACCESS_LOG:
+                config->access_log_path = optarg;
+                break;
+            case OPTION_ACCESS_LOG_FORMAT:
+                if(strcmp(optarg, ACCESS_LOG_TEXT_ARG) == SAME_STRING) {
+                    config->access_log_format = ACCESS_LOG_TEXT;
+                } else if(strcmp(optarg, ACCESS_LOG_BINARY_ARG) == SAME_STRING) {
+                    config->access_log_format = ACCESS_LOG_BINARY;
+                } else {
+                    fprintf(stderr, "ERROR, unknown access log format: %s\n", optarg);
+                    return false;
+                }
+                break;
+            case OPTION_ACCESS_LOG_ROTATE:
+                if(!parse_non_negative_int(optarg, &config->access_log_rotate_mb)) {
+                    fprintf(stderr, "ERROR, invalid access log rotation size: %s\n", optarg);
+                    return false;
+                }
+                break;
+            case OPTION_TRACE_SAMPLE:
+                if(!parse_non_negative_int(optarg, &config->trace_sample)) {
+                    fprintf(stderr, "ERROR, invalid trace sampling rate: %s\n", optarg);
+                    return false;
+                }
+                break;
+            case OPTION_TRACE_SLOW:
+                if(!parse_non_negative_int(optarg, &config->trace_slow_us)) {
+                    fprintf(stderr, "ERROR, invalid slow trace threshold: %s\n", optarg);
+                    return false;
+                }
+                break;
+            case OPTION_TRACE_FILE:
+                config->trace_path = optarg;
+                break;
+            case OPTION_PRELOAD:
+                config->preload = true;
+                break;
+            case OPTION_PRELOAD_THREADS:
+                if(!parse_positive_int(optarg, &config->preload_threads)) {
+                    fprintf(stderr, "ERROR, invalid preload thread count: %s\n", optarg);
+                    return false;
+                }
+                break;
+            case OPTION_PRELOAD_MEMORY:
+                if(!parse_non_negative_int(optarg, &config->preload_memory_kb)) {
+                    fprintf(stderr, "ERROR, invalid preload memory file size: %s\n", optarg);
+                    return false;
+                }
+                break;
+            case OPTION_PRELOAD_MLOCK:
+                config->preload_mlock = true;
+                break;
+            case OPTION_BUNDLE:
+                config->bundle_path = optarg;
+                break;
+            case OPTION_DRAIN_TIMEOUT:
+                if(!parse_positive_int(optarg, &config->drain_timeout)) {
+                    fprintf(stderr, "ERROR, invalid drain timeout: %s\n", optarg);
+                    return false;
+                }
+                break;
+            case OPTION_HANDOFF:
+                config->handoff_path = optarg;
+                break;
+            default:
+                fprintf(stderr, "ERROR, unrecognised or incomplete option: %s\n", option_argv[optind - 1]);
+                return false;
+        }
+    }
+
+    if(optind < option_argc) {
+        fprintf(stderr, "ERROR, unexpected argument: %s\n", option_argv[optind]);
+        return false;
+    }
+
+    if(config->trace_sample == 0 && (config->trace_slow_us != DEFAULT_TRACE_SLOW_US || config->trace_path != NULL)) {
+        fprintf(stderr, "ERROR, --trace-slow and --trace-file need --trace-sample.\n");
+        return false;
+    }
+
+    if((config->tls_cert_path == NULL) != (config->tls_key_path == NULL)) {
+        fprintf(stderr, "ERROR, --tls-cert and --tls-key have to be given together.\n");
+        return false;
+    }
+
+    // The files of a bundle may not be in the web root at all, which is where compressing on the fly reads them from,
+    // so a bundle carries its compressed copies itself (mkbundle --compress) instead.
+    if(config->bundle_path != NULL) {
+        config->compress_cache_size_mb = 0;
+    }
+
+    if(config->event_loops == DEFAULT_EVENT_LOOPS) {
+        long online_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        config->event_loops = online_cpus > 0 ? (int) online_cpus : 1;
+    }
+    // Connections are steered between listening sockets, of which there have to be several.
+    if(config->steer_connections && config->listeners < 2) {
+        fprintf(stderr, "ERROR, --steer-connections needs at least 2 --listeners.\n");
+        return false;
+    }
+    // Each event loop waits on exactly one listening socket, so extra listeners would never be accepted from.
+    if(config->mode != MODE_THREADS && config->listeners > config->event_loops) {
+        fprintf(stderr, "ERROR, --listeners cannot exceed the number of event loops in epoll or uring mode.\n");
+        return false;
+    }
+    return true;
+}
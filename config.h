@@ -0,0 +1,195 @@
+//
+// Created by User on 14/10/2026.
+//
+
+#ifndef COMP30023_2022_PROJECT_2_CONFIG_H
+#define COMP30023_2022_PROJECT_2_CONFIG_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include <limits.h>
+#include <getopt.h>
+
+#define DEFAULT_WORKER_THREADS 32
+#define DEFAULT_QUEUE_CAPACITY 1024
+// An event loop count of 0 means one loop per online CPU.
+#define DEFAULT_EVENT_LOOPS 0
+#define DEFAULT_LISTENERS 1
+#define DEFAULT_LISTEN_BACKLOG 5
+#define DEFAULT_KEEPALIVE_TIMEOUT 5
+#define DEFAULT_MAX_REQUESTS 100
+#define DEFAULT_HEADER_TIMEOUT 10
+#define DEFAULT_SEND_TIMEOUT 30
+#define DEFAULT_MAX_CONNECTIONS 16384
+#define DEFAULT_MAX_CONNECTIONS_PER_IP 0
+#define DEFAULT_LARGE_RESPONSE_KB 1024
+#define DEFAULT_LARGE_TRANSFERS 4
+#define DEFAULT_SEND_QUANTUM_KB 256
+#define DEFAULT_CACHE_SIZE_MB 64
+#define DEFAULT_CACHE_MAX_FILE_KB 256
+#define DEFAULT_CACHE_REVALIDATE 1
+#define DEFAULT_FD_CACHE_ENTRIES 1024
+#define DEFAULT_FD_CACHE_TTL 2
+#define DEFAULT_NEGATIVE_CACHE_TTL 60
+#define DEFAULT_COMPRESS_CACHE_SIZE_MB 16
+#define DEFAULT_COMPRESS_MAX_FILE_KB 1024
+#define DEFAULT_COMPRESS_THREADS 1
+#define DEFAULT_TLS_SESSION_CACHE 20480
+#define DEFAULT_ACCESS_LOG_ROTATE_MB 0
+#define DEFAULT_TRACE_SAMPLE 0
+#define DEFAULT_TRACE_SLOW_US 0
+#define DEFAULT_PRELOAD_THREADS 4
+#define DEFAULT_PRELOAD_MEMORY_KB 256
+#define DEFAULT_DRAIN_TIMEOUT 30
+
+#define MAX_PORT_NUMBER 65535
+
+#define BYTES_PER_KB 1024
+#define BYTES_PER_MB (1024 * 1024)
+
+// The connection engines that can be selected with --mode.
+#define MODE_THREADS_ARG "threads"
+#define MODE_EPOLL_ARG "epoll"
+#define MODE_URING_ARG "uring"
+#define MODE_THREADS 0
+#define MODE_EPOLL 1
+#define MODE_URING 2
+
+// The formats of the access log that can be selected with --access-log-format.
+#define ACCESS_LOG_TEXT_ARG "text"
+#define ACCESS_LOG_BINARY_ARG "binary"
+#define ACCESS_LOG_TEXT 0
+#define ACCESS_LOG_BINARY 1
+
+#define SAME_STRING 0
+
+// The three positional arguments (protocol, port and web root) come before any of the optional "--name=value"
+// arguments.
+#define NUM_POSITIONAL_ARGS 3
+
+// Holds every tunable that used to be hardcoded in main(). The positional arguments are stored here as well so the
+// rest of the program only has to look in one place.
+typedef struct server_config server_config_t;
+struct server_config {
+    char *protocol;
+    char *port_number;
+    char *web_root_path;
+
+    // Number of pre-spawned worker threads which serve connections.
+    int worker_threads;
+    // Number of accepted sockets that may wait for a free worker before the acceptor stops calling accept().
+    int queue_capacity;
+
+    // MODE_THREADS serves each connection on a blocking worker thread; MODE_EPOLL drives all connections from
+    // non-blocking event loops; MODE_URING drives them from io_uring loops instead, and falls back to MODE_EPOLL on
+    // kernels without io_uring.
+    int mode;
+    // Number of event loops (threads) used in MODE_EPOLL and MODE_URING.
+    int event_loops;
+
+    // Number of listening sockets bound to the port. More than one turns on SO_REUSEPORT and gives each socket its
+    // own acceptor thread (or its own share of the event loops in MODE_EPOLL).
+    int listeners;
+    // Backlog passed to listen() for every listening socket.
+    int listen_backlog;
+    // Whether acceptor threads (or event loops) are pinned to a CPU each.
+    bool pin_listeners;
+    // Whether MODE_THREADS workers (and the large lane's senders) are pinned to a CPU each. They are pinned before they
+    // allocate their memory, so it comes from their own NUMA node.
+    bool pin_workers;
+    // Whether the kernel hands each new connection to the listening socket whose acceptor (or event loop) is pinned
+    // to the CPU that received it, rather than to one picked by a hash. Turns on pin_listeners.
+    bool steer_connections;
+
+    // Seconds a connection may sit idle waiting for its next request (or, in MODE_THREADS, between any two reads)
+    // before the server closes it.
+    int keepalive_timeout;
+    // Number of requests served on one connection before the server closes it.
+    int max_requests;
+    // Seconds a request may take to arrive in full from its first byte (or the connection being accepted), however
+    // often bytes of it trickle in, and seconds a response may go without the client taking any more of it.
+    int header_timeout;
+    int send_timeout;
+    // Connections the server keeps open at once, altogether and from any one address (0 for no limit). Connections
+    // over either are turned away with a 503, and close to the first the slowest ones are closed to make room.
+    int max_connections;
+    int max_connections_per_ip;
+    // In MODE_THREADS, responses of at least large_response_kb kilobytes are handed from the workers to
+    // large_transfers threads of their own (0 keeps them on the workers), which take turns sending send_quantum_kb
+    // kilobytes of each, so big downloads neither hold up small requests nor each other.
+    int large_response_kb;
+    int large_transfers;
+    int send_quantum_kb;
+
+    // Total size of the in-memory file cache in megabytes (0 disables it), the biggest file it holds in kilobytes,
+    // and how many seconds a cached file is trusted before it is checked for changes.
+    int cache_size_mb;
+    int cache_max_file_kb;
+    int cache_revalidate;
+
+    // Number of open file descriptors (with their stat()) kept for reuse across requests (0 disables the fd cache),
+    // and how many seconds one is trusted before its path is checked for a replaced or modified file.
+    int fd_cache_entries;
+    int fd_cache_ttl;
+    // Seconds a path that could not be opened is answered with a 404 without trying it again (0 always tries again).
+    // Files created under the web root end that early, unless the web root could not be watched, in which case no
+    // more than fd_cache_ttl is used.
+    int negative_cache_ttl;
+
+    // Total size of the cache of text files the server compressed itself in megabytes (0 turns compressing files on
+    // the fly off; precompressed .br and .gz files are still served), the biggest file it compresses in kilobytes, and
+    // the number of background threads that do the compressing.
+    int compress_cache_size_mb;
+    int compress_max_file_kb;
+    int compress_threads;
+
+    // A mime.types file whose types are added to (and override) the built in ones, or NULL for only the built in
+    // types.
+    char *mime_types_path;
+
+    // The PEM certificate chain and private key of the server. When both are given every connection is HTTPS.
+    char *tls_cert_path;
+    char *tls_key_path;
+    // Number of TLS 1.2 sessions kept for resumption (0 turns the cache off; TLS 1.3 tickets still work).
+    int tls_session_cache;
+
+    // The admin port the metrics are served on in the Prometheus text format, or NULL to not record any.
+    char *metrics_port;
+
+    // The file every response is logged to, or NULL for no access log, whether it is written as text lines or as
+    // fixed size binary records, and the size in megabytes it is rotated at (0 never rotates it).
+    char *access_log_path;
+    int access_log_format;
+    int access_log_rotate_mb;
+
+    // One request in trace_sample has the time of each of its stages traced (0 traces none), and is written out if it
+    // took at least trace_slow_us microseconds: into trace_path in the Chrome trace format, or to stderr as a line of
+    // text if trace_path is NULL.
+    int trace_sample;
+    int trace_slow_us;
+    char *trace_path;
+
+    // Whether every file under the web root is indexed at startup (and again on SIGHUP) so requests never look at the
+    // filesystem, the number of threads that open and read the files, the biggest file in kilobytes that is held in
+    // memory instead of being kept open for sendfile(), and whether that memory is mlock()ed.
+    bool preload;
+    int preload_threads;
+    int preload_memory_kb;
+    bool preload_mlock;
+    // A bundle made by mkbundle that every file is served from instead of the web root, or NULL. It is indexed like
+    // --preload, and mapped again on SIGHUP.
+    char *bundle_path;
+
+    // Seconds a server that was sent SIGTERM (or whose listening sockets were taken over) waits for its connections
+    // to finish before it exits regardless, and the Unix socket a server started with the same --handoff takes the
+    // listening sockets over through, or NULL.
+    int drain_timeout;
+    char *handoff_path;
+};
+
+bool parse_server_config(int argc, char **argv, server_config_t *config);
+
+#endif //COMP30023_2022_PROJECT_2_CONFIG_H
@@ -0,0 +1,30 @@
+//
+// Created by User on 14/10/2026.
+//
+
+#ifndef COMP30023_2022_PROJECT_2_CONTEXT_H
+#define COMP30023_2022_PROJECT_2_CONTEXT_H
+
+#include "config.h"
+#include "cache.h"
+#include "fdcache.h"
+#include "compress.h"
+#include "tls.h"
+#include "preload.h"
+
+// State shared by every worker and event loop for the lifetime of the server: the configuration it was started with
+// and the caches built up while serving requests, the index of the web root if it was preloaded, and the TLS setup
+// every HTTPS connection is made from.
+typedef struct server_context server_context_t;
+struct server_context {
+    server_config_t *config;
+    file_cache_t file_cache;
+    fd_cache_t fd_cache;
+    compress_cache_t compress_cache;
+    preload_t preload;
+    tls_server_t tls;
+    // The lane large responses are handed to in MODE_THREADS, or NULL to send every response where it was prepared.
+    struct large_lane *large_lane;
+};
+
+#endif //COMP30023_2022_PROJECT_2_CONTEXT_H
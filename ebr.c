@@ -0,0 +1,114 @@
+//
+// Created by User on 14/10/2026.
+//
+#include "ebr.h"
+
+// Epoch based reclamation (Fraser, "Practical lock-freedom", section 5.2.3). Readers of a shared structure announce
+// the epoch they entered at. Whatever a writer unlinks is retired in the current epoch, and the epoch only moves on
+// once every thread that is reading has announced the current one, so by the time it has moved on twice nobody can
+// still be looking at what was retired. Readers never write to anything but their own record, so many threads can
+// read the same structure without the cache line holding it bouncing between them.
+static uint64_t global_epoch = 1;
+static ebr_thread_t *threads = NULL;
+static __thread ebr_thread_t *self = NULL;
+static __thread int depth = 0;
+
+// The record of the calling thread, added to the list of records the first time the thread needs one.
+static ebr_thread_t *this_thread(void) {
+    if(self != NULL) {
+        return self;
+    }
+    // Each record gets a cache line of its own, so announcing an epoch never disturbs another thread's.
+    void *record;
+    int error = posix_memalign(&record, EBR_CACHE_LINE, sizeof(ebr_thread_t));
+    if(error != 0) {
+        fprintf(stderr, "posix_memalign: %s\n", strerror(error));
+        exit(EXIT_FAILURE);
+    }
+    self = (ebr_thread_t *) memset(record, 0, sizeof(ebr_thread_t));
+    self->next = __atomic_load_n(&threads, __ATOMIC_RELAXED);
+    while(!__atomic_compare_exchange_n(&threads, &self->next, self, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+    }
+    return self;
+}
+
+// Frees everything the thread retired at least two epochs before epoch.
+static void collect(ebr_thread_t *thread, uint64_t epoch) {
+    for(int i = 0; i < EBR_EPOCHS; i++) {
+        if(thread->retired[i] == NULL || thread->retired_epoch[i] + 2 > epoch) {
+            continue;
+        }
+        ebr_retired_t *retired = thread->retired[i];
+        thread->retired[i] = NULL;
+        while(retired != NULL) {
+            ebr_retired_t *next = retired->next;
+            retired->reclaim(retired);
+            retired = next;
+        }
+    }
+}
+
+// Starts reading shared structures. Anything found in them stays allocated until the matching ebr_exit, even if it is
+// unlinked and retired in the meantime. Calls may be nested.
+void ebr_enter(void) {
+    if(depth++ > 0) {
+        return;
+    }
+    ebr_thread_t *thread = this_thread();
+    uint64_t epoch = __atomic_load_n(&global_epoch, __ATOMIC_RELAXED);
+    while(true) {
+        __atomic_store_n(&thread->state, epoch << 1 | EBR_ACTIVE, __ATOMIC_RELAXED);
+        // The announcement has to be visible before anything shared is read, which only a full fence orders. If the
+        // epoch moved on before it was, the thread announces the new one instead.
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        uint64_t current = __atomic_load_n(&global_epoch, __ATOMIC_RELAXED);
+        if(current == epoch) {
+            break;
+        }
+        epoch = current;
+    }
+}
+
+// Moves the epoch on from epoch if every thread that is reading has announced it. Returns the epoch afterwards.
+static uint64_t try_advance(uint64_t epoch) {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    for(ebr_thread_t *thread = __atomic_load_n(&threads, __ATOMIC_ACQUIRE); thread != NULL; thread = thread->next) {
+        uint64_t state = __atomic_load_n(&thread->state, __ATOMIC_ACQUIRE);
+        if((state & EBR_ACTIVE) != 0 && state >> 1 != epoch) {
+            return epoch;
+        }
+    }
+    if(__atomic_compare_exchange_n(&global_epoch, &epoch, epoch + 1, false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+        return epoch + 1;
+    }
+    // Another thread moved it on first, and epoch now holds where it got to.
+    return epoch;
+}
+
+// Stops reading shared structures. Nothing found since ebr_enter may be used afterwards (unless a reference to it was
+// taken some other way, such as a reference count). A thread that still has something retired frees whatever has
+// become safe to, since a thread that stops retiring would otherwise hold on to the last things it retired for good.
+void ebr_exit(void) {
+    if(--depth > 0) {
+        return;
+    }
+    __atomic_store_n(&self->state, 0, __ATOMIC_RELEASE);
+    if(self->retired[0] != NULL || self->retired[1] != NULL || self->retired[2] != NULL) {
+        collect(self, try_advance(__atomic_load_n(&global_epoch, __ATOMIC_ACQUIRE)));
+    }
+}
+
+// Hands something that has just been unlinked from a shared structure over to be freed with reclaim, once no reader
+// can still have found it. Frees whatever the calling thread retired earlier that is now safe to free. Retiring is rare
+// (it follows an eviction or a file changing), so every call tries to move the epoch on.
+void ebr_retire(ebr_retired_t *retired, void (*reclaim)(ebr_retired_t *retired)) {
+    ebr_thread_t *thread = this_thread();
+    uint64_t epoch = __atomic_load_n(&global_epoch, __ATOMIC_ACQUIRE);
+    collect(thread, epoch);
+    int list = (int) (epoch % EBR_EPOCHS);
+    retired->reclaim = reclaim;
+    retired->next = thread->retired[list];
+    thread->retired[list] = retired;
+    thread->retired_epoch[list] = epoch;
+    collect(thread, try_advance(epoch));
+}
@@ -0,0 +1,48 @@
+//
+// Created by User on 14/10/2026.
+//
+
+#ifndef COMP30023_2022_PROJECT_2_EBR_H
+#define COMP30023_2022_PROJECT_2_EBR_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+
+// Objects retired in epoch e may still be in use by threads that entered in epoch e - 1, so the epoch has to move on
+// twice before they are freed, and each thread keeps one list of retired objects per epoch that can be current.
+#define EBR_EPOCHS 3
+#define EBR_CACHE_LINE 64
+// Set in a thread's epoch while it is between ebr_enter and ebr_exit.
+#define EBR_ACTIVE 1
+
+// Something unlinked from a shared structure, waiting for every reader that might still see it to move on. Embedded in
+// the object itself, so retiring never allocates.
+typedef struct ebr_retired ebr_retired_t;
+struct ebr_retired {
+    ebr_retired_t *next;
+    void (*reclaim)(ebr_retired_t *retired);
+};
+
+// What one thread has announced: 0 while it is not reading anything shared, or the global epoch it entered at (shifted
+// left by one) with EBR_ACTIVE set. Records are only ever added, since the threads that read shared structures live as
+// long as the server. A thread that exits is simply never active again.
+typedef struct ebr_thread ebr_thread_t;
+struct ebr_thread {
+    uint64_t state __attribute__((aligned(EBR_CACHE_LINE)));
+    // What this thread retired in each epoch, on the lists by epoch % EBR_EPOCHS.
+    ebr_retired_t *retired[EBR_EPOCHS];
+    uint64_t retired_epoch[EBR_EPOCHS];
+    ebr_thread_t *next;
+};
+
+void ebr_enter(void);
+
+void ebr_exit(void);
+
+void ebr_retire(ebr_retired_t *retired, void (*reclaim)(ebr_retired_t *retired));
+
+#endif //COMP30023_2022_PROJECT_2_EBR_H
@@ -0,0 +1,427 @@
+//
+// Created by User on 14/10/2026.
+//
+#include "event.h"
+
+// Returns the current time in seconds from a clock that never jumps backwards, used for the deadlines.
+static time_t monotonic_seconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec;
+}
+
+// Removes a connection from its loop's idle list.
+static void unlink_idle_connection(event_loop_t *loop, event_connection_t *connection) {
+    if(connection->idle_prev != NULL) {
+        connection->idle_prev->idle_next = connection->idle_next;
+    } else {
+        loop->idle_head = connection->idle_next;
+    }
+    if(connection->idle_next != NULL) {
+        connection->idle_next->idle_prev = connection->idle_prev;
+    } else {
+        loop->idle_tail = connection->idle_prev;
+    }
+    connection->idle_prev = connection->idle_next = NULL;
+}
+
+// Records that a connection just made progress by moving it to the back of the idle list. The list is therefore
+// always ordered from least to most recently active, so expiring idle connections only has to look at the front.
+static void touch_connection(event_loop_t *loop, event_connection_t *connection) {
+    if(loop->idle_tail != connection) {
+        if(connection->idle_prev != NULL || loop->idle_head == connection) {
+            unlink_idle_connection(loop, connection);
+        }
+        connection->idle_prev = loop->idle_tail;
+        if(loop->idle_tail != NULL) {
+            loop->idle_tail->idle_next = connection;
+        } else {
+            loop->idle_head = connection;
+        }
+        loop->idle_tail = connection;
+    }
+    connection->last_active = monotonic_seconds();
+}
+
+// Gives a connection the deadline of the ADMISSION_*_TIMEOUT kind deadline, timeout seconds after it last made
+// progress, in place of the one it had.
+static void set_deadline(event_loop_t *loop, event_connection_t *connection, int deadline, int timeout) {
+    connection->deadline = deadline;
+    wheel_schedule(&loop->timers, &connection->timer, connection->last_active + timeout);
+}
+
+// Closes a connection and frees everything that belongs to it. Closing the socket also removes it from the epoll
+// instance, so no epoll_ctl(EPOLL_CTL_DEL) is needed. https://man7.org/linux/man-pages/man7/epoll.7.html
+static void close_event_connection(event_loop_t *loop, event_connection_t *connection) {
+    // A response still being written when the connection is closed was never sent in full.
+    if(connection->state == CONNECTION_WRITING) {
+        metrics_record_response(&connection->metrics, &connection->response, false);
+        release_http_response(&connection->response);
+    }
+    if(connection->buffer != NULL) {
+        buffer_pool_release(&loop->memory.buffers, connection->buffer);
+    }
+    unlink_idle_connection(loop, connection);
+    wheel_cancel(&connection->timer);
+    admission_release(connection->address);
+    if(connection->ssl != NULL) {
+        tls_close_session(connection->ssl);
+        connection->ssl = NULL;
+    }
+    close(connection->sockfd);
+    // Keep the connection for the next accept() unless the loop already has plenty spare.
+    if(loop->num_free_connections < CONNECTION_POOL_CAPACITY) {
+        connection->idle_next = loop->free_connections;
+        loop->free_connections = connection;
+        loop->num_free_connections++;
+    } else {
+        free(connection);
+    }
+}
+
+// Returns an unused connection, reusing a closed one if the loop has any. Returns NULL if a new one was needed and
+// could not be allocated.
+static event_connection_t *new_event_connection(event_loop_t *loop) {
+    if(loop->free_connections == NULL) {
+        return (event_connection_t *) counted_malloc(sizeof(event_connection_t));
+    }
+    event_connection_t *connection = loop->free_connections;
+    loop->free_connections = connection->idle_next;
+    loop->num_free_connections--;
+    return connection;
+}
+
+// Takes the request the parser has just completed (or rejected) at the front of the connection's buffer, goes through
+// the same get_file_path() / response steps as serve_connection and moves the connection to the WRITING state.
+static void start_response(event_loop_t *loop, event_connection_t *connection, int status) {
+    char *file_path;
+    http_request_t *request = &connection->parser.request;
+
+    connection->requests_served++;
+    count_allocation_event(&allocation_counters.requests);
+    metrics_start_request(&connection->metrics, connection->buffer, status == PARSE_COMPLETE ? request : NULL);
+    // Everything the previous request on this loop allocated is thrown away in one go.
+    arena_reset(&loop->memory.arena);
+    // A NULL file_path tells prepare_http_response that the request was invalid, which becomes a 404 as in
+    // serve_connection, followed by closing the connection. The rest of the buffer is not looked at again then.
+    if(status == PARSE_COMPLETE && metrics_get_file_path(&connection->metrics, &file_path, connection->buffer, request,
+                                                         &loop->memory.arena)) {
+        connection->keep_alive = request->keep_alive && connection->requests_served < loop->config->max_requests &&
+                                 !restart_draining();
+        prepare_http_response(&connection->response, loop->context, file_path, request->minor_version,
+                              connection->keep_alive, connection->buffer, request);
+        consume_request(connection->buffer, &connection->bytes_read_so_far, &connection->parser);
+    } else {
+        connection->keep_alive = false;
+        prepare_http_response(&connection->response, loop->context, NULL, 0, false, NULL, NULL);
+    }
+    metrics_start_response(&connection->metrics);
+    connection->state = CONNECTION_WRITING;
+    connection->sent_at_deadline = 0;
+    set_deadline(loop, connection, ADMISSION_SEND_TIMEOUT, loop->config->send_timeout);
+}
+
+// Moves a connection forward as far as it can go without blocking. The socket is registered edge triggered, so every
+// direction has to be driven until read() or the response reports that it would block, otherwise we would not be
+// told about the bytes we left behind. A persistent connection goes from writing back to reading, and a request that
+// was pipelined behind the previous one is picked up from the buffer straight away.
+static void process_connection(event_loop_t *loop, event_connection_t *connection) {
+    touch_connection(loop, connection);
+    while(true) {
+        if(connection->state == CONNECTION_HANDSHAKE) {
+            int result = tls_handshake(connection->ssl);
+            if(result == TLS_HANDSHAKE_WANT_IO) {
+                return;
+            }
+            if(result == TLS_HANDSHAKE_FAILED) {
+                close_event_connection(loop, connection);
+                return;
+            }
+            connection->state = CONNECTION_READING;
+        }
+        if(connection->state == CONNECTION_WRITING) {
+            int progress = continue_response(connection->sockfd, connection->ssl, &connection->response);
+            if(progress == RESPONSE_WOULD_BLOCK) {
+                // Only a response the client has taken more of since the deadline was set gets more time, so a
+                // client that stops reading cannot hold on to the connection (and the file) forever.
+                if(connection->response.bytes_sent != connection->sent_at_deadline) {
+                    connection->sent_at_deadline = connection->response.bytes_sent;
+                    set_deadline(loop, connection, ADMISSION_SEND_TIMEOUT, loop->config->send_timeout);
+                }
+                return;
+            }
+            metrics_record_response(&connection->metrics, &connection->response, progress == RESPONSE_COMPLETE);
+            release_http_response(&connection->response);
+            connection->state = CONNECTION_READING;
+            // A loop that is draining closes every connection it has nothing more to do for.
+            if(progress == RESPONSE_FAILED || !connection->keep_alive ||
+               (loop->draining && connection->bytes_read_so_far == 0)) {
+                close_event_connection(loop, connection);
+                return;
+            }
+            // Nothing was pipelined behind the request, so the buffer can go to another connection while this one
+            // waits for its next request. Part of one that was has to arrive in full by the header timeout.
+            if(connection->bytes_read_so_far == 0) {
+                buffer_pool_release(&loop->memory.buffers, connection->buffer);
+                connection->buffer = NULL;
+                set_deadline(loop, connection, ADMISSION_IDLE_TIMEOUT, loop->config->keepalive_timeout);
+            } else {
+                set_deadline(loop, connection, ADMISSION_HEADER_TIMEOUT, loop->config->header_timeout);
+            }
+        }
+
+        int status = metrics_parse_request(&connection->metrics, &connection->parser, connection->buffer,
+                                           connection->bytes_read_so_far);
+        if(status != PARSE_INCOMPLETE) {
+            start_response(loop, connection, status);
+            continue;
+        }
+
+        if(connection->buffer == NULL && (connection->buffer = buffer_pool_acquire(&loop->memory.buffers)) == NULL) {
+            perror("malloc");
+            close_event_connection(loop, connection);
+            return;
+        }
+        char *destination = connection->buffer + connection->bytes_read_so_far;
+        size_t space = REQUEST_MAX_BUFFER_SIZE - connection->bytes_read_so_far;
+        int n = connection->ssl != NULL ? tls_read(connection->ssl, destination, space)
+                                        : read(connection->sockfd, destination, space);
+        if(n < 0) {
+            if(errno == EAGAIN || errno == EWOULDBLOCK) {
+                return;
+            }
+            perror("read");
+            close_event_connection(loop, connection);
+            return;
+        }
+        // The client went away (or the buffer filled up) before sending a complete request.
+        if(n == 0) {
+            close_event_connection(loop, connection);
+            return;
+        }
+        connection->bytes_read_so_far += n;
+        // The first bytes of the next request start the clock on the rest of it, which bytes trickling in one at a
+        // time do not wind back.
+        if(connection->deadline == ADMISSION_IDLE_TIMEOUT) {
+            set_deadline(loop, connection, ADMISSION_HEADER_TIMEOUT, loop->config->header_timeout);
+        }
+    }
+}
+
+// Closes every connection whose deadline has passed, counting which deadline it missed.
+static void expire_connections(event_loop_t *loop) {
+    time_t now = monotonic_seconds();
+    wheel_timer_t *timer;
+    while((timer = wheel_expire(&loop->timers, now)) != NULL) {
+        event_connection_t *connection = (event_connection_t *) ((char *) timer - offsetof(event_connection_t, timer));
+        admission_record(connection->deadline);
+        close_event_connection(loop, connection);
+    }
+}
+
+// Makes room for the connections accepted in the last batch of events, when the server is close to --max-connections,
+// by closing as many of the connections of the loop that have gone longest without making progress. One that did
+// anything in the last ADMISSION_EVICT_MIN_IDLE seconds is being served, not holding a place, so it is left alone.
+static void evict_slowest_connections(event_loop_t *loop) {
+    time_t now = monotonic_seconds();
+    for(; loop->pending_evictions > 0; loop->pending_evictions--) {
+        event_connection_t *slowest = loop->idle_head;
+        if(slowest == NULL || now - slowest->last_active < ADMISSION_EVICT_MIN_IDLE) {
+            loop->pending_evictions = 0;
+            return;
+        }
+        admission_record(ADMISSION_EVICTED);
+        close_event_connection(loop, slowest);
+    }
+}
+
+// Stops the loop accepting connections once the server has started draining, and closes the connections that are
+// waiting for their next request. The others are closed once they have been sent their response, and connections
+// that have yet to send their first request are still served. The listening socket itself is left open, since a
+// successor may be accepting on it.
+static void start_draining(event_loop_t *loop) {
+    loop->draining = true;
+    epoll_ctl(loop->epollfd, EPOLL_CTL_DEL, loop->listenfd, NULL);
+    epoll_ctl(loop->epollfd, EPOLL_CTL_DEL, restart_drain_fd(), NULL);
+    event_connection_t *connection = loop->idle_head;
+    while(connection != NULL) {
+        event_connection_t *next = connection->idle_next;
+        if(connection->state == CONNECTION_READING && connection->requests_served > 0 &&
+           connection->bytes_read_so_far == 0) {
+            close_event_connection(loop, connection);
+        }
+        connection = next;
+    }
+}
+
+// Accepts every pending connection on the listening socket. Several loops may share the listening socket, so it is
+// normal for another loop to have taken the connection first, in which case accept4() simply reports EAGAIN.
+static void accept_connections(event_loop_t *loop) {
+    struct sockaddr_storage client_address;
+    socklen_t client_address_size;
+    while(true) {
+        client_address_size = sizeof(client_address);
+        int newsockfd = accept4(loop->listenfd, (struct sockaddr *) &client_address, &client_address_size,
+                                SOCK_NONBLOCK);
+        if(newsockfd < 0) {
+            if(errno != EAGAIN && errno != EWOULDBLOCK) {
+                perror("accept");
+            }
+            return;
+        }
+        address_count_t *address;
+        int verdict = admission_admit(newsockfd, &client_address, &address);
+        if(verdict != ADMISSION_ACCEPTED) {
+            admission_reject(newsockfd, verdict, loop->context->tls.enabled);
+            continue;
+        }
+        // The eviction waits until the rest of the batch of events has been handled, since one of them may be for
+        // the connection it closes.
+        if(admission_under_pressure()) {
+            loop->pending_evictions++;
+        }
+
+        event_connection_t *connection = new_event_connection(loop);
+        if(connection == NULL) {
+            perror("malloc");
+            admission_release(address);
+            close(newsockfd);
+            continue;
+        }
+        connection->sockfd = newsockfd;
+        connection->ssl = NULL;
+        connection->state = CONNECTION_READING;
+        connection->bytes_read_so_far = 0;
+        connection->buffer = NULL;
+        http_parser_init(&connection->parser);
+        metrics_start_connection(&connection->metrics, loop->metrics, metrics_now());
+        connection->requests_served = 0;
+        connection->keep_alive = false;
+        connection->idle_prev = connection->idle_next = NULL;
+        connection->address = address;
+        wheel_timer_init(&connection->timer);
+        touch_connection(loop, connection);
+        // The TLS handshake and the first request both have to be done by the header timeout.
+        set_deadline(loop, connection, ADMISSION_HEADER_TIMEOUT, loop->config->header_timeout);
+        // HTTPS connections do the TLS handshake before reading the first request.
+        if(loop->context->tls.enabled) {
+            if((connection->ssl = tls_new_session(&loop->context->tls, newsockfd)) == NULL) {
+                close_event_connection(loop, connection);
+                continue;
+            }
+            connection->state = CONNECTION_HANDSHAKE;
+        }
+
+        // Register interest in both directions once, edge triggered, so the connection never needs an
+        // EPOLL_CTL_MOD when it switches between reading and writing.
+        struct epoll_event event;
+        event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        event.data.ptr = connection;
+        if(epoll_ctl(loop->epollfd, EPOLL_CTL_ADD, newsockfd, &event) < 0) {
+            perror("epoll_ctl");
+            close_event_connection(loop, connection);
+        }
+    }
+}
+
+// The body of every event loop thread. The listening socket is registered with a NULL data pointer and the drain
+// eventfd with the loop's own, so they can be told apart from connections. A loop starts draining only once it has
+// handled the rest of the events that came with the eventfd's, since some of them may be for connections that draining
+// closes. epoll_wait wakes up at least once a second, even when nothing happens, so connections are
+// closed on time when they miss their deadline.
+static void *event_loop_main(void *event_loop) {
+    event_loop_t *loop = (event_loop_t *) event_loop;
+    struct epoll_event events[MAX_EPOLL_EVENTS];
+
+    if(loop->cpu != NO_CPU) {
+        pin_thread_to_cpu(loop->cpu);
+    }
+    // Set up from the loop's own thread, as the workers do theirs in init_worker_state.
+    if(!worker_memory_init(&loop->memory, REQUEST_MAX_BUFFER_SIZE + NULL_TERMINATOR_SPACE)) {
+        exit(EXIT_FAILURE);
+    }
+    loop->metrics = metrics_register_worker();
+
+    while(true) {
+        int num_events = epoll_wait(loop->epollfd, events, MAX_EPOLL_EVENTS, IDLE_CHECK_INTERVAL_MS);
+        if(num_events < 0) {
+            if(errno != EINTR) {
+                perror("epoll_wait");
+            }
+            continue;
+        }
+        bool drain = false;
+        for(int i = 0; i < num_events; i++) {
+            event_connection_t *connection = (event_connection_t *) events[i].data.ptr;
+            if(connection == NULL) {
+                accept_connections(loop);
+            } else if(events[i].data.ptr == (void *) loop) {
+                drain = true;
+            } else {
+                // Errors and hang ups are picked up by read(), write() or sendfile() failing.
+                process_connection(loop, connection);
+            }
+        }
+        evict_slowest_connections(loop);
+        if(drain && !loop->draining) {
+            start_draining(loop);
+        }
+        expire_connections(loop);
+    }
+    return NULL;
+}
+
+// Puts the listening sockets into non-blocking mode and runs config->event_loops event loops over them, one per
+// thread. Loop i waits on listening socket i % config->listeners, and registers it with EPOLLEXCLUSIVE so a new
+// connection only wakes one of the loops sharing that socket. When there is one listening socket per loop, the
+// kernel's SO_REUSEPORT balancing picks the loop instead. Returns false if the loops could not be set up.
+bool run_event_loops(int *listenfds, server_context_t *context) {
+    server_config_t *config = context->config;
+    if(!make_listening_sockets_nonblocking(listenfds, config->listeners)) {
+        return false;
+    }
+
+    event_loop_t *loops = (event_loop_t *) malloc(config->event_loops * sizeof(event_loop_t));
+    if(loops == NULL) {
+        perror("malloc");
+        return false;
+    }
+
+    for(int i = 0; i < config->event_loops; i++) {
+        loops[i].listenfd = listenfds[i % config->listeners];
+        loops[i].context = context;
+        loops[i].config = config;
+        loops[i].cpu = listener_cpu(config, i);
+        loops[i].idle_head = loops[i].idle_tail = NULL;
+        wheel_init(&loops[i].timers, monotonic_seconds());
+        loops[i].free_connections = NULL;
+        loops[i].num_free_connections = 0;
+        loops[i].draining = false;
+        loops[i].pending_evictions = 0;
+        if((loops[i].epollfd = epoll_create1(0)) < 0) {
+            perror("epoll_create1");
+            return false;
+        }
+        struct epoll_event event;
+        event.events = EPOLLIN | EPOLLEXCLUSIVE;
+        event.data.ptr = NULL;
+        if(epoll_ctl(loops[i].epollfd, EPOLL_CTL_ADD, loops[i].listenfd, &event) < 0) {
+            perror("epoll_ctl");
+            return false;
+        }
+        // Level triggered, and never read, so every loop sees it.
+        event.events = EPOLLIN;
+        event.data.ptr = &loops[i];
+        if(epoll_ctl(loops[i].epollfd, EPOLL_CTL_ADD, restart_drain_fd(), &event) < 0) {
+            perror("epoll_ctl");
+            return false;
+        }
+        int error = pthread_create(&loops[i].thread, NULL, event_loop_main, (void *) &loops[i]);
+        if(error != 0) {
+            fprintf(stderr, "pthread_create: %s\n", strerror(error));
+            return false;
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,111 @@
+//
+// Created by User on 14/10/2026.
+//
+
+#ifndef COMP30023_2022_PROJECT_2_EVENT_H
+#define COMP30023_2022_PROJECT_2_EVENT_H
+
+// accept4() and EPOLLEXCLUSIVE are Linux extensions.
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+#include "parse.h"
+#include "respond.h"
+#include "listener.h"
+#include "config.h"
+#include "context.h"
+#include "arena.h"
+#include "admission.h"
+#include "wheel.h"
+#include "restart.h"
+
+#define MAX_EPOLL_EVENTS 256
+#define IDLE_CHECK_INTERVAL_MS 1000
+// Number of closed connections a loop keeps around to reuse for the next ones it accepts.
+#define CONNECTION_POOL_CAPACITY 1024
+
+// The two states a connection goes through in the event loop. A connection starts off reading its request and moves
+// to writing once the parser has seen the whole request (or found it to be malformed) and the response has been
+// prepared. Persistent connections go back to reading once the response has been sent.
+#define CONNECTION_READING 0
+#define CONNECTION_WRITING 1
+// HTTPS connections start off here, until the TLS handshake has finished.
+#define CONNECTION_HANDSHAKE 2
+
+// Everything serve_connection keeps on its stack, kept on the heap instead so the loop can put a connection aside
+// whenever the socket would block and carry on with it later.
+typedef struct event_connection event_connection_t;
+struct event_connection {
+    int sockfd;
+    // The connection's TLS session, or NULL for plain HTTP.
+    SSL *ssl;
+    int state;
+    int bytes_read_so_far;
+    // Taken from the loop's buffer pool when there is something to read, and handed back whenever the connection is
+    // idle with nothing buffered, so idle keep-alive connections hold no buffer at all.
+    char *buffer;
+    http_parser_t parser;
+    http_response_t response;
+    request_metrics_t metrics;
+    int requests_served;
+    // Whether the connection stays open after the response currently being written.
+    bool keep_alive;
+    // When the connection has to have made its next bit of progress by, and which of the ADMISSION_*_TIMEOUT
+    // deadlines that is, and the bytes of the response that had been sent when it was last moved on.
+    wheel_timer_t timer;
+    int deadline;
+    size_t sent_at_deadline;
+    // What the connection counts against in admission_admit.
+    address_count_t *address;
+    // Position in the loop's idle list, which is ordered by last_active. idle_next also links the loop's unused
+    // connections together.
+    time_t last_active;
+    event_connection_t *idle_prev;
+    event_connection_t *idle_next;
+};
+
+// One epoll instance and the thread that waits on it. Every loop watches one of the listening sockets (possibly shared
+// with other loops) and accepts its own connections, which then stay on that loop until they are closed.
+typedef struct event_loop event_loop_t;
+struct event_loop {
+    int epollfd;
+    int listenfd;
+    server_context_t *context;
+    server_config_t *config;
+    // CPU the loop is pinned to, or NO_CPU if it may run anywhere.
+    int cpu;
+    pthread_t thread;
+    // Every connection of the loop, least recently active first, so the one at the front is the first to go when the
+    // server is under pressure, and the deadlines of all of them.
+    event_connection_t *idle_head;
+    event_connection_t *idle_tail;
+    timer_wheel_t timers;
+    // Closed connections kept for reuse, and the arena and read buffers the loop's requests use.
+    event_connection_t *free_connections;
+    int num_free_connections;
+    worker_memory_t memory;
+    // The loop's metrics counters, or NULL if metrics are turned off.
+    worker_metrics_t *metrics;
+    // Set once the server has started draining and the loop has stopped accepting.
+    bool draining;
+    // Connections accepted under pressure in the current batch of events, each of which has the slowest connection
+    // closed to make room for it once the batch has been handled.
+    int pending_evictions;
+};
+
+bool run_event_loops(int *listenfds, server_context_t *context);
+
+#endif //COMP30023_2022_PROJECT_2_EVENT_H
@@ -0,0 +1,352 @@
+//
+// Created by User on 14/10/2026.
+//
+#include "fdcache.h"
+
+static fd_cache_shard_t *shard_of(fd_cache_t *cache, uint64_t hash) {
+    return &cache->shards[hash % FD_CACHE_SHARDS];
+}
+
+// Which bucket of its shard's map a path goes in. The low bits already picked the shard.
+static uint64_t map_hash(uint64_t hash) {
+    return hash / FD_CACHE_SHARDS;
+}
+
+static void free_entry(fd_cache_entry_t *entry) {
+    if(entry->fd != FD_CACHE_NO_FILE) {
+        close(entry->fd);
+    }
+    free(entry->path);
+    free(entry);
+}
+
+static void reclaim_entry(ebr_retired_t *retired) {
+    free_entry((fd_cache_entry_t *) ((char *) retired - offsetof(fd_cache_entry_t, retired)));
+}
+
+// Takes a reference to an entry a lookup found in the map, unless its last reference has already been dropped and it
+// is waiting to be closed. Returns false in that case, and the lookup treats it as not being there.
+static bool try_reference(fd_cache_entry_t *entry) {
+    int references = __atomic_load_n(&entry->references, __ATOMIC_RELAXED);
+    while(references > 0) {
+        if(__atomic_compare_exchange_n(&entry->references, &references, references + 1, true, __ATOMIC_ACQUIRE,
+                                       __ATOMIC_RELAXED)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Drops one reference to an entry. The last one retires it, which happens only once it is out of the map, and its
+// file is closed as soon as no lookup can still be on it.
+static void unreference_entry(fd_cache_entry_t *entry) {
+    if(__atomic_sub_fetch(&entry->references, 1, __ATOMIC_ACQ_REL) == 0) {
+        ebr_retire(&entry->retired, reclaim_entry);
+    }
+}
+
+// Marks an entry as found since eviction last passed it. Only written when it changes, so lookups of a popular path
+// do not keep taking its cache line from each other.
+static void mark_referenced(fd_cache_entry_t *entry) {
+    if(!__atomic_load_n(&entry->referenced, __ATOMIC_RELAXED)) {
+        __atomic_store_n(&entry->referenced, true, __ATOMIC_RELAXED);
+    }
+}
+
+// The list of the shard an entry is on, which depends on whether it has a file open.
+static fd_cache_lru_t *lru_of(fd_cache_shard_t *shard, fd_cache_entry_t *entry) {
+    return entry->fd != FD_CACHE_NO_FILE ? &shard->files : &shard->missing;
+}
+
+static void lru_unlink(fd_cache_lru_t *lru, fd_cache_entry_t *entry) {
+    if(entry->lru_prev != NULL) {
+        entry->lru_prev->lru_next = entry->lru_next;
+    } else {
+        lru->head = entry->lru_next;
+    }
+    if(entry->lru_next != NULL) {
+        entry->lru_next->lru_prev = entry->lru_prev;
+    } else {
+        lru->tail = entry->lru_prev;
+    }
+    entry->lru_prev = entry->lru_next = NULL;
+    lru->num_entries--;
+}
+
+static void lru_append(fd_cache_lru_t *lru, fd_cache_entry_t *entry) {
+    entry->lru_prev = lru->tail;
+    entry->lru_next = NULL;
+    if(lru->tail != NULL) {
+        lru->tail->lru_next = entry;
+    } else {
+        lru->head = entry;
+    }
+    lru->tail = entry;
+    lru->num_entries++;
+}
+
+// Finds the entry for file_path in a shard. Must be called between ebr_enter and ebr_exit or with the shard lock held.
+static fd_cache_entry_t *find_entry(fd_cache_shard_t *shard, uint64_t hash, char *file_path) {
+    for(rcu_map_node_t *node = rcu_map_first(&shard->map, map_hash(hash)); node != NULL; node = rcu_map_next(node)) {
+        fd_cache_entry_t *entry = (fd_cache_entry_t *) node;
+        if(entry->hash == hash && strcmp(entry->path, file_path) == SAME_STRING) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+// Takes an entry out of the hash table and LRU list and drops the cache's reference to it. Must be called with the
+// shard lock held.
+static void remove_entry(fd_cache_shard_t *shard, fd_cache_entry_t *entry) {
+    rcu_map_remove(&shard->map, &entry->node, map_hash(entry->hash));
+    lru_unlink(lru_of(shard, entry), entry);
+    unreference_entry(entry);
+}
+
+// Returns true if the file described by file_stat is still the one the entry has open. A file replaced by a new one
+// (a deploy renaming over it) has a different inode, one modified in place a different size or mtime.
+static bool entry_matches(fd_cache_entry_t *entry, struct stat *file_stat) {
+    return entry->file_stat.st_dev == file_stat->st_dev && entry->file_stat.st_ino == file_stat->st_ino &&
+           entry->file_stat.st_size == file_stat->st_size &&
+           entry->file_stat.st_mtim.tv_sec == file_stat->st_mtim.tv_sec &&
+           entry->file_stat.st_mtim.tv_nsec == file_stat->st_mtim.tv_nsec;
+}
+
+// Opens a file (relative to the web root) and fstat()s it into a new entry. Returns NULL if the file cannot be
+// opened, with errno saying why.
+static fd_cache_entry_t *open_entry(char *file_path, uint64_t hash) {
+    // The open comes first so a request for a file that does not exist costs no allocation.
+    int fd = resolve_open(file_path);
+    if(fd < 0) {
+        return NULL;
+    }
+    fd_cache_entry_t *entry = (fd_cache_entry_t *) counted_malloc(sizeof(fd_cache_entry_t));
+    if(entry == NULL) {
+        close(fd);
+        return NULL;
+    }
+    entry->fd = fd;
+    if(fstat(entry->fd, &entry->file_stat) < 0) {
+        close(entry->fd);
+        free(entry);
+        return NULL;
+    }
+    file_validators_init(&entry->validators, &entry->file_stat);
+    if((entry->path = counted_strdup(file_path)) == NULL) {
+        close(entry->fd);
+        free(entry);
+        return NULL;
+    }
+    entry->hash = hash;
+    entry->validated_at = time(NULL);
+    entry->references = 0;
+    entry->referenced = false;
+    entry->node.next = NULL;
+    entry->lru_prev = entry->lru_next = NULL;
+    return entry;
+}
+
+// Sets up an empty cache which keeps at most max_entries files open. A max_entries of 0 disables the cache, in which
+// case fd_cache_acquire hands out entries that are closed as soon as they are released.
+void fd_cache_init(fd_cache_t *cache, int max_entries, int ttl, int negative_ttl) {
+    cache->enabled = max_entries > 0;
+    cache->shard_capacity = max_entries / FD_CACHE_SHARDS > 0 ? max_entries / FD_CACHE_SHARDS : 1;
+    cache->missing_capacity = cache->shard_capacity / FD_CACHE_MISSING_SHARE > 0 ?
+                              cache->shard_capacity / FD_CACHE_MISSING_SHARE : 1;
+    cache->ttl = ttl;
+    cache->negative_ttl = negative_ttl;
+    for(int i = 0; i < FD_CACHE_SHARDS; i++) {
+        fd_cache_shard_t *shard = &cache->shards[i];
+        pthread_mutex_init(&shard->lock, NULL);
+        rcu_map_init(&shard->map, shard->buckets, FD_CACHE_BUCKETS_PER_SHARD);
+        memset(&shard->files, 0, sizeof(shard->files));
+        memset(&shard->missing, 0, sizeof(shard->missing));
+    }
+}
+
+// Returns true if a failed open with error means there is nothing at the path that could be opened, which is worth
+// remembering, rather than that the server ran short of something (descriptors, memory) and should try again.
+static bool is_missing_error(int error) {
+    return error == ENOENT || error == ENOTDIR || error == EXDEV || error == ELOOP || error == EACCES ||
+           error == ENAMETOOLONG;
+}
+
+// Evicts entries of the list an entry is about to join, oldest first, until it has room for one more. Entries found
+// since eviction last passed them are spared once, the way the file cache's make_room spares them. Files still being
+// sent stay open until their last response releases them. Must be called with the shard lock held.
+static void make_room(fd_cache_shard_t *shard, fd_cache_lru_t *lru, int capacity) {
+    fd_cache_entry_t *first_spared = NULL;
+    bool second_chances = true;
+    while(lru->num_entries >= capacity && lru->head != NULL) {
+        fd_cache_entry_t *entry = lru->head;
+        if(entry == first_spared) {
+            second_chances = false;
+        }
+        if(second_chances && __atomic_load_n(&entry->referenced, __ATOMIC_RELAXED)) {
+            __atomic_store_n(&entry->referenced, false, __ATOMIC_RELAXED);
+            if(first_spared == NULL) {
+                first_spared = entry;
+            }
+            lru_unlink(lru, entry);
+            lru_append(lru, entry);
+        } else {
+            remove_entry(shard, entry);
+        }
+    }
+}
+
+// Makes room for an entry on its list, then publishes it in the hash table and adds it to the end of the list. Must
+// be called with the shard lock held, and with the entry's references already set.
+static void insert_entry(fd_cache_t *cache, fd_cache_shard_t *shard, fd_cache_entry_t *entry) {
+    fd_cache_lru_t *lru = lru_of(shard, entry);
+    make_room(shard, lru, entry->fd != FD_CACHE_NO_FILE ? cache->shard_capacity : cache->missing_capacity);
+    rcu_map_insert(&shard->map, &entry->node, map_hash(entry->hash));
+    lru_append(lru, entry);
+}
+
+// Returns true if an entry for a path that could not be opened still holds. Nothing can have been created at the
+// path unless the generation moved on, as long as the whole web root is watched; otherwise the entry is only trusted
+// for as long as an open file would be before it is checked.
+static bool missing_entry_holds(fd_cache_t *cache, fd_cache_entry_t *entry, time_t now, uint64_t generation) {
+    int ttl = cache->negative_ttl;
+    if(!watch_complete() && cache->ttl < ttl) {
+        ttl = cache->ttl;
+    }
+    return now - __atomic_load_n(&entry->validated_at, __ATOMIC_RELAXED) < ttl && entry->generation == generation;
+}
+
+// Remembers that file_path could not be opened, so the next requests for it do not go to the filesystem at all.
+// generation is what watch_generation was before the open was tried.
+static void remember_missing(fd_cache_t *cache, fd_cache_shard_t *shard, char *file_path, uint64_t hash,
+                             time_t now, uint64_t generation) {
+    fd_cache_entry_t *entry = (fd_cache_entry_t *) counted_malloc(sizeof(fd_cache_entry_t));
+    if(entry == NULL) {
+        return;
+    }
+    if((entry->path = counted_strdup(file_path)) == NULL) {
+        free(entry);
+        return;
+    }
+    entry->hash = hash;
+    entry->fd = FD_CACHE_NO_FILE;
+    entry->validated_at = now;
+    entry->generation = generation;
+    // Only the cache's own, since the entry is never handed out.
+    entry->references = 1;
+    entry->referenced = false;
+    entry->node.next = NULL;
+    entry->lru_prev = entry->lru_next = NULL;
+
+    pthread_mutex_lock(&shard->lock);
+    if(find_entry(shard, hash, file_path) != NULL) {
+        // Never published, so nobody else can have seen it.
+        free_entry(entry);
+    } else {
+        insert_entry(cache, shard, entry);
+    }
+    pthread_mutex_unlock(&shard->lock);
+}
+
+// Returns an open descriptor and the stat() of the file at file_path (relative to the web root), reusing the ones
+// already in the cache where possible. An entry older than the TTL is checked against a fresh stat() of the path and
+// reopened if the path now names a different or modified file. A path that could not be opened is not tried again
+// until the negative TTL has passed or something was created under the web root. The caller owns a reference to the
+// returned entry and must hand it back with fd_cache_release. Returns NULL if the file could not be opened.
+fd_cache_entry_t *fd_cache_acquire(fd_cache_t *cache, char *file_path) {
+    uint64_t hash = hash_string(file_path);
+    if(!cache->enabled) {
+        fd_cache_entry_t *entry = open_entry(file_path, hash);
+        if(entry != NULL) {
+            entry->references = 1;
+        }
+        return entry;
+    }
+    fd_cache_shard_t *shard = shard_of(cache, hash);
+    time_t now = time(NULL);
+    // Read before anything is opened, so that a file created after the open fails moves the generation past the one
+    // the missing path is remembered with.
+    uint64_t generation = watch_generation();
+
+    // An entry for a missing path is never handed out, so it is only looked at while the lookup is reading the map.
+    ebr_enter();
+    fd_cache_entry_t *entry = find_entry(shard, hash, file_path);
+    bool missing = entry != NULL && entry->fd == FD_CACHE_NO_FILE;
+    bool still_missing = missing && missing_entry_holds(cache, entry, now, generation);
+    if(still_missing) {
+        mark_referenced(entry);
+    } else if(entry != NULL && !missing && !try_reference(entry)) {
+        entry = NULL;
+    }
+    ebr_exit();
+    if(still_missing) {
+        return NULL;
+    }
+    if(missing) {
+        // The entry may have been replaced since it was found, so it is looked for again under the lock.
+        pthread_mutex_lock(&shard->lock);
+        entry = find_entry(shard, hash, file_path);
+        if(entry != NULL && entry->fd == FD_CACHE_NO_FILE && !missing_entry_holds(cache, entry, now, generation)) {
+            remove_entry(shard, entry);
+        }
+        pthread_mutex_unlock(&shard->lock);
+    } else if(entry != NULL) {
+        mark_referenced(entry);
+        if(now - __atomic_load_n(&entry->validated_at, __ATOMIC_RELAXED) < cache->ttl) {
+            return entry;
+        }
+
+        struct stat file_stat;
+        if(resolve_stat(file_path, &file_stat) == 0 && entry_matches(entry, &file_stat)) {
+            __atomic_store_n(&entry->validated_at, now, __ATOMIC_RELAXED);
+            return entry;
+        }
+        // Another thread may have noticed the change at the same time and removed the entry already.
+        pthread_mutex_lock(&shard->lock);
+        if(find_entry(shard, hash, file_path) == entry) {
+            remove_entry(shard, entry);
+        }
+        pthread_mutex_unlock(&shard->lock);
+        unreference_entry(entry);
+    }
+
+    // Open the file without the lock held. If another thread opened the same file in the meantime, its entry wins and
+    // ours is closed again.
+    fd_cache_entry_t *opened = open_entry(file_path, hash);
+    if(opened == NULL) {
+        if(cache->negative_ttl > 0 && is_missing_error(errno)) {
+            remember_missing(cache, shard, file_path, hash, now, generation);
+        }
+        return NULL;
+    }
+    pthread_mutex_lock(&shard->lock);
+    entry = find_entry(shard, hash, file_path);
+    if(entry != NULL && entry->fd != FD_CACHE_NO_FILE) {
+        // Entries in the map always hold the cache's reference, so this one cannot be on its way out.
+        __atomic_add_fetch(&entry->references, 1, __ATOMIC_RELAXED);
+        pthread_mutex_unlock(&shard->lock);
+        free_entry(opened);
+        return entry;
+    }
+    // Another thread found the path missing just before the file appeared.
+    if(entry != NULL) {
+        remove_entry(shard, entry);
+    }
+
+    // One reference for the cache and one for the caller.
+    opened->references = 2;
+    insert_entry(cache, shard, opened);
+    pthread_mutex_unlock(&shard->lock);
+    return opened;
+}
+
+// Hands back a reference obtained from fd_cache_acquire once the response using it has been sent. No lock is needed,
+// so releasing never waits for a shard that is being changed.
+void fd_cache_release(fd_cache_t *cache, fd_cache_entry_t *entry) {
+    if(!cache->enabled) {
+        // The entry was never in a map, so nothing else can be looking at it.
+        free_entry(entry);
+        return;
+    }
+    unreference_entry(entry);
+}
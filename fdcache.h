@@ -0,0 +1,111 @@
+//
+// Created by User on 14/10/2026.
+//
+
+#ifndef COMP30023_2022_PROJECT_2_FDCACHE_H
+#define COMP30023_2022_PROJECT_2_FDCACHE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <time.h>
+#include <fcntl.h>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "arena.h"
+
+#include "cache.h"
+#include "validators.h"
+#include "resolve.h"
+#include "watch.h"
+#include "ebr.h"
+#include "rcumap.h"
+
+#define FD_CACHE_SHARDS 16
+#define FD_CACHE_BUCKETS_PER_SHARD 256
+// Paths that could not be opened are remembered as well, but only up to 1/FD_CACHE_MISSING_SHARE of a shard's
+// capacity, on a list of their own, so a scan of paths that do not exist never pushes open files out of the cache.
+#define FD_CACHE_MISSING_SHARE 2
+#define FD_CACHE_NO_FILE (-1)
+
+#define SAME_STRING 0
+
+// An open file shared by every response that sends it. sendfile() is always given an explicit offset, which leaves
+// the descriptor's own file position alone, so any number of workers can send from the same descriptor at once.
+// https://man7.org/linux/man-pages/man2/sendfile.2.html An entry whose fd is FD_CACHE_NO_FILE records instead that
+// path could not be opened, until the negative TTL runs out or something is created under the web root; it is never
+// handed out, and file_stat and validators are unused.
+typedef struct fd_cache_entry fd_cache_entry_t;
+struct fd_cache_entry {
+    // The entry's link in its shard's map, which lookups follow without taking the shard lock.
+    rcu_map_node_t node;
+    // Relative to the web root.
+    char *path;
+    uint64_t hash;
+    int fd;
+    struct stat file_stat;
+    // Worked out from file_stat when the file is opened. A file that changes gets a new entry, and so new validators.
+    file_validators_t validators;
+    // When file_stat was last confirmed to still describe the file at path, or when path was found missing. Read and
+    // written with relaxed atomics, since lookups that revalidate the entry update it without the lock.
+    time_t validated_at;
+    // The watch_generation read before path was found missing.
+    uint64_t generation;
+
+    // Number of responses still sending from fd, plus one while the entry is in the cache. Once this drops to zero the
+    // entry is retired, and fd is closed when no lookup can still be looking at it. Only changed with atomic
+    // operations.
+    int references;
+    ebr_retired_t retired;
+    // Set by lookups that find the entry and cleared by eviction, which spares the entry once if it is set, as in the
+    // file cache.
+    bool referenced;
+    fd_cache_entry_t *lru_prev;
+    fd_cache_entry_t *lru_next;
+};
+
+// A list of entries, least recently inserted first apart from the entries eviction spared.
+typedef struct fd_cache_lru fd_cache_lru_t;
+struct fd_cache_lru {
+    fd_cache_entry_t *head;
+    fd_cache_entry_t *tail;
+    int num_entries;
+};
+
+// Like the file cache's shards, read without any lock and locked to be changed.
+typedef struct fd_cache_shard fd_cache_shard_t;
+struct fd_cache_shard {
+    pthread_mutex_t lock;
+    rcu_map_t map;
+    rcu_map_node_t *buckets[FD_CACHE_BUCKETS_PER_SHARD];
+    // Entries with an open file, and entries for paths that could not be opened.
+    fd_cache_lru_t files;
+    fd_cache_lru_t missing;
+};
+
+typedef struct fd_cache fd_cache_t;
+struct fd_cache {
+    fd_cache_shard_t shards[FD_CACHE_SHARDS];
+    // Number of open files each shard may keep, and number of paths that could not be opened.
+    int shard_capacity;
+    int missing_capacity;
+    // Seconds an entry is trusted before its path is stat()ed again to check that it still names the same file, and
+    // seconds a path that could not be opened is not tried again.
+    int ttl;
+    int negative_ttl;
+    bool enabled;
+};
+
+void fd_cache_init(fd_cache_t *cache, int max_entries, int ttl, int negative_ttl);
+
+fd_cache_entry_t *fd_cache_acquire(fd_cache_t *cache, char *file_path);
+
+void fd_cache_release(fd_cache_t *cache, fd_cache_entry_t *entry);
+
+#endif //COMP30023_2022_PROJECT_2_FDCACHE_H
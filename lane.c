@@ -0,0 +1,113 @@
+//
+// Created by User on 14/10/2026.
+//
+#include "lane.h"
+
+// Allocates the transfer a worker prepares its responses in. Returns NULL if there is no memory left.
+large_transfer_t *large_transfer_new(void) {
+    large_transfer_t *transfer = (large_transfer_t *) malloc(sizeof(large_transfer_t));
+    if(transfer == NULL) {
+        perror("malloc");
+    }
+    return transfer;
+}
+
+// Adds a transfer to the tail of the lane. Never blocks: every connection has at most one transfer, so the lane can
+// never hold more than --max-connections of them.
+void large_lane_submit(large_lane_t *lane, large_transfer_t *transfer) {
+    transfer->next = NULL;
+    pthread_mutex_lock(&lane->lock);
+    if(lane->tail == NULL) {
+        lane->head = transfer;
+    } else {
+        lane->tail->next = transfer;
+    }
+    lane->tail = transfer;
+    pthread_cond_signal(&lane->not_empty);
+    pthread_mutex_unlock(&lane->lock);
+}
+
+// Removes the transfer at the head of the lane, waiting until there is one.
+static large_transfer_t *large_lane_take(large_lane_t *lane) {
+    pthread_mutex_lock(&lane->lock);
+    while(lane->head == NULL) {
+        pthread_cond_wait(&lane->not_empty, &lane->lock);
+    }
+    large_transfer_t *transfer = lane->head;
+    lane->head = transfer->next;
+    if(lane->head == NULL) {
+        lane->tail = NULL;
+    }
+    pthread_mutex_unlock(&lane->lock);
+    return transfer;
+}
+
+// Records a transfer that has been sent (or given up on) and passes its connection on: back to the workers for its
+// next request if it is kept alive and the server is not draining, closed otherwise.
+static void finish_transfer(large_lane_t *lane, large_transfer_t *transfer, int progress,
+                            worker_metrics_t *sender_metrics) {
+    // The request was timed by the worker that read it, but only the thread recording it may write to the counters
+    // it is recorded in.
+    if(transfer->metrics.worker != NULL) {
+        transfer->metrics.worker = sender_metrics;
+    }
+    if(progress == RESPONSE_WOULD_BLOCK) {
+        admission_record(ADMISSION_SEND_TIMEOUT);
+    }
+    metrics_record_response(&transfer->metrics, &transfer->response, progress == RESPONSE_COMPLETE);
+    release_http_response(&transfer->response);
+    if(progress == RESPONSE_COMPLETE && transfer->keep_alive && !restart_draining()) {
+        transfer->connection.accepted_at = metrics_now();
+        worker_pool_submit_connection(lane->pool, &transfer->connection);
+    } else {
+        close(transfer->connection.sockfd);
+        admission_release(transfer->connection.address);
+    }
+    free(transfer);
+}
+
+// The body of every sender thread. The sockets are still blocking, with the send timeout the worker gave them, so a
+// quantum to a client that is not reading holds the sender for no longer than that, and each sendfile() of a quantum
+// is one system call moving up to quantum bytes.
+static void *send_large_transfers(void *large_lane) {
+    large_lane_t *lane = (large_lane_t *) large_lane;
+    if(lane->config->pin_workers) {
+        pin_worker_thread(lane->config);
+    }
+    worker_metrics_t *sender_metrics = metrics_register_worker();
+    while(true) {
+        large_transfer_t *transfer = large_lane_take(lane);
+        int progress = continue_http_response(transfer->connection.sockfd, &transfer->response, lane->quantum);
+        if(progress == RESPONSE_QUANTUM_USED) {
+            large_lane_submit(lane, transfer);
+        } else {
+            finish_transfer(lane, transfer, progress, sender_metrics);
+        }
+    }
+    return NULL;
+}
+
+// Sets up the lane from --large-response, --large-transfers and --send-quantum and starts its senders, which give
+// kept-alive connections back to pool. Returns false if memory or threads could not be allocated.
+bool large_lane_init(large_lane_t *lane, server_config_t *config, worker_pool_t *pool) {
+    pthread_mutex_init(&lane->lock, NULL);
+    pthread_cond_init(&lane->not_empty, NULL);
+    lane->head = lane->tail = NULL;
+    lane->threshold = (size_t) config->large_response_kb * BYTES_PER_KB;
+    lane->quantum = (size_t) config->send_quantum_kb * BYTES_PER_KB;
+    lane->num_senders = config->large_transfers;
+    lane->config = config;
+    lane->pool = pool;
+    if((lane->senders = (pthread_t *) malloc(lane->num_senders * sizeof(pthread_t))) == NULL) {
+        perror("malloc");
+        return false;
+    }
+    for(int i = 0; i < lane->num_senders; i++) {
+        int error = pthread_create(&lane->senders[i], NULL, send_large_transfers, (void *) lane);
+        if(error != 0) {
+            fprintf(stderr, "pthread_create: %s\n", strerror(error));
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,66 @@
+//
+// Created by User on 14/10/2026.
+//
+
+#ifndef COMP30023_2022_PROJECT_2_LANE_H
+#define COMP30023_2022_PROJECT_2_LANE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "config.h"
+#include "pool.h"
+#include "respond.h"
+#include "metrics.h"
+#include "admission.h"
+#include "listener.h"
+#include "restart.h"
+
+// A large response on its way out, together with the connection it is for, from the moment a worker hands it to the
+// large lane until the lane has sent it and handed the connection back to the workers (or closed it). The response is
+// prepared in place, so a worker always has one of these to prepare its next response in.
+typedef struct large_transfer large_transfer_t;
+struct large_transfer {
+    http_response_t response;
+    // The socket, what it counts against in admission_admit and how many requests it has been through, for when it
+    // goes back to the workers.
+    queued_connection_t connection;
+    bool keep_alive;
+    // The timestamps of the request, recorded once it is sent by the lane's own metrics counters.
+    request_metrics_t metrics;
+    large_transfer_t *next;
+};
+
+// The lane large responses are sent on in MODE_THREADS, so a burst of big downloads cannot take every worker away from
+// the small requests queued behind it. Transfers wait in a FIFO, and each of a fixed number of sender threads takes
+// the one at its head, sends a quantum of it and puts it back at the tail if there is more, so only that many big
+// transfers are ever in flight and they share the lane turn by turn however big each of them is.
+typedef struct large_lane large_lane_t;
+struct large_lane {
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    large_transfer_t *head;
+    large_transfer_t *tail;
+    // Responses of at least threshold bytes go to the lane, which sends at most quantum bytes of one at a time.
+    size_t threshold;
+    size_t quantum;
+    pthread_t *senders;
+    int num_senders;
+    // Whether the senders pin themselves (--pin-workers), and the configuration that places them.
+    server_config_t *config;
+    // The workers kept-alive connections go back to once their large response has been sent.
+    worker_pool_t *pool;
+};
+
+bool large_lane_init(large_lane_t *lane, server_config_t *config, worker_pool_t *pool);
+
+large_transfer_t *large_transfer_new(void);
+
+void large_lane_submit(large_lane_t *lane, large_transfer_t *transfer);
+
+#endif //COMP30023_2022_PROJECT_2_LANE_H
@@ -0,0 +1,248 @@
+//
+// Created by User on 14/10/2026.
+//
+#include "listener.h"
+
+// Creates, binds and starts listening on a socket for the protocol in config and port_number. When reuse_port is true
+// the socket also gets SO_REUSEPORT, which lets several sockets bind to the same port and have the kernel spread new
+// connections across them. Returns the socket, or NO_SOCKET (after printing the reason) if any step failed.
+int create_listening_socket_on_port(server_config_t *config, const char *port_number, bool reuse_port) {
+    int sockfd = NO_SOCKET, s;
+    struct addrinfo hints, *res, *p;
+
+    // Create address we're going to listen on (with given port number)
+    memset(&hints, 0, sizeof hints);
+
+    if(strcmp(config->protocol, IPV4_ARG) == SAME_STRING) {
+        hints.ai_family = AF_INET; // IPv4
+    } else if (strcmp(config->protocol, IPV6_ARG) == SAME_STRING) {
+        hints.ai_family = AF_INET6; // IPv6
+    }
+    hints.ai_socktype = SOCK_STREAM; // TCP
+    hints.ai_flags = AI_PASSIVE;     // for bind, listen, accept
+
+    // node (NULL means any interface), service (port), hints, res.
+    s = getaddrinfo(NULL, port_number, &hints, &res);
+    if (s != 0) {
+        fprintf(stderr, "getaddrinfo: %s\n", gai_strerror(s));
+        return NO_SOCKET;
+    }
+
+    // The code used in the if statement was referenced and modified from COMP30023 Week 8 Lecture 2 Lecture Slide 13
+    // "Create IPv6 Socket". getaddrinfo returns multiple addresses in a linked list as mentioned in COMP30023
+    // Week 8 Lecture 2. Hence, if we want a IPv6 address, we need to use a for loop to step through the
+    // linked list returned (res) and find a valid IPv6 address to use to create a socket.
+    for (p = res; p != NULL; p = p->ai_next) {
+        // hints.ai_family contains the IP address type that we want (AF_INET or AF_INET6). Check that the current
+        // address in this node of the linked list corresponds to the address family stored in hints.ai_family.
+        if (p->ai_family == hints.ai_family) {
+            // We attempt to create a socket from this address. If socket creation was successful, we can use
+            // this socket, so we break out of the loop. Otherwise, we keep trying with remaining addresses until
+            // we run out.
+            if ((sockfd = socket(p->ai_family, p->ai_socktype, p->ai_protocol)) >= 0) {
+                break;
+            }
+        }
+    }
+
+    // If no sockets were successfully created (either IPv6 or IPv4)
+    if (sockfd < 0) {
+        perror("socket");
+        freeaddrinfo(res);
+        return NO_SOCKET;
+    }
+
+    // Reuse port if possible. This piece of code was provided in COMP30023 Project 2 Spec. Similar code was included
+    // in server.c from COMP30023 Week 9 Practicals but was replaced with this.
+    int enable = 1;
+    if (setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(int)) < 0) {
+        perror("setsockopt");
+        freeaddrinfo(res);
+        close(sockfd);
+        return NO_SOCKET;
+    }
+
+    // Every socket bound to the same port needs SO_REUSEPORT set before bind(), including the first one.
+    // https://man7.org/linux/man-pages/man7/socket.7.html
+    if (reuse_port && setsockopt(sockfd, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(int)) < 0) {
+        perror("setsockopt");
+        freeaddrinfo(res);
+        close(sockfd);
+        return NO_SOCKET;
+    }
+
+    // Bind the address the socket was created from to the socket
+    if (bind(sockfd, p->ai_addr, p->ai_addrlen) < 0) {
+        perror("bind");
+        freeaddrinfo(res);
+        close(sockfd);
+        return NO_SOCKET;
+    }
+    freeaddrinfo(res);
+
+    // Listen on socket - means we're ready to accept connections,
+    // incoming connection requests will be queued, man 3 listen
+    if (listen(sockfd, config->listen_backlog) < 0) {
+        perror("listen");
+        close(sockfd);
+        return NO_SOCKET;
+    }
+    return sockfd;
+}
+
+// A listening socket on the port the server serves requests on.
+int create_listening_socket(server_config_t *config, bool reuse_port) {
+    return create_listening_socket_on_port(config, config->port_number, reuse_port);
+}
+
+// Creates config->listeners listening sockets on the same port and stores them in listenfds. With a single listener
+// this is the same socket the server always had; with more than one, each of them gets SO_REUSEPORT so the kernel
+// balances incoming connections between them. Returns false if any of them could not be created.
+bool create_listening_sockets(server_config_t *config, int *listenfds) {
+    bool reuse_port = config->listeners > 1;
+    for(int i = 0; i < config->listeners; i++) {
+        if((listenfds[i] = create_listening_socket(config, reuse_port)) == NO_SOCKET) {
+            return false;
+        }
+    }
+    return !config->steer_connections || steer_listening_sockets(listenfds, config->listeners);
+}
+
+// Puts the listening sockets into non-blocking mode, so whoever accepts on them finds out there is nothing to accept
+// instead of waiting for it. The mode belongs to the socket rather than the descriptor, so it is shared with any
+// other process the sockets were handed to (see restart.c). Returns false if any of them could not be changed.
+bool make_listening_sockets_nonblocking(int *listenfds, int num_listeners) {
+    for(int i = 0; i < num_listeners; i++) {
+        int flags = fcntl(listenfds[i], F_GETFL, 0);
+        if(flags < 0 || fcntl(listenfds[i], F_SETFL, flags | O_NONBLOCK) < 0) {
+            perror("fcntl");
+            return false;
+        }
+    }
+    return true;
+}
+
+// Returns the index-th of the CPUs the process may run on (its sched_getaffinity() mask, which taskset or a cgroup
+// may have narrowed to fewer CPUs than are online, not necessarily numbered from 0), wrapped around their number, and
+// stores that number in *num_allowed if it is not NULL. Falls back to CPU index modulo the online CPUs if the mask
+// cannot be read. https://man7.org/linux/man-pages/man2/sched_getaffinity.2.html
+static int allowed_cpu(int index, int *num_allowed) {
+    cpu_set_t allowed;
+    int count = 0;
+    if(sched_getaffinity(0, sizeof(allowed), &allowed) == 0) {
+        count = CPU_COUNT(&allowed);
+    }
+    if(count == 0) {
+        long online_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        count = online_cpus > 0 ? (int) online_cpus : 1;
+        CPU_ZERO(&allowed);
+        for(int cpu = 0; cpu < count && cpu < CPU_SETSIZE; cpu++) {
+            CPU_SET(cpu, &allowed);
+        }
+    }
+    if(num_allowed != NULL) {
+        *num_allowed = count;
+    }
+    int wanted = index % count;
+    for(int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if(CPU_ISSET(cpu, &allowed) && wanted-- == 0) {
+            return cpu;
+        }
+    }
+    return 0;
+}
+
+// Makes the kernel hand every new connection to the listening socket whose acceptor or event loop runs on the CPU
+// that received the connection's packets, so they are still warm in its cache and the connection is served on the
+// NUMA node of its NIC queue. Listener i is pinned to the i-th CPU the process may run on (see pin_thread_to_cpu),
+// and SO_INCOMING_CPU on each socket asks for the connections received on that CPU, which recent kernels honour
+// within a SO_REUSEPORT group. That only covers every CPU when there is one listener per allowed CPU, and only then is
+// the classic BPF program attached to the group with SO_ATTACH_REUSEPORT_CBPF as well: it compares the receiving CPU
+// with each listener's and returns the index of the socket that matches (the listeners are in the group in the order
+// they were created). Packets received on a CPU the process may not run on fall through to the CPU modulo the number
+// of listeners. With any other number of listeners the kernel's own hash spreads the connections, with the
+// SO_INCOMING_CPU hints on top. Returns false if SO_INCOMING_CPU could not be set.
+// https://man7.org/linux/man-pages/man7/socket.7.html https://docs.kernel.org/networking/filter.html
+bool steer_listening_sockets(int *listenfds, int num_listeners) {
+    int num_allowed = 0;
+    for(int i = 0; i < num_listeners; i++) {
+        int cpu = allowed_cpu(i, &num_allowed);
+        if(setsockopt(listenfds[i], SOL_SOCKET, SO_INCOMING_CPU, &cpu, sizeof(cpu)) < 0) {
+            perror("setsockopt");
+            return false;
+        }
+    }
+    if(num_listeners != num_allowed) {
+        return true;
+    }
+
+    // The load of the CPU, a comparison and a return per listener, and the two instructions of the fallback.
+    int num_instructions = 1 + 2 * num_listeners + 2;
+    struct sock_filter *code = (struct sock_filter *) malloc(num_instructions * sizeof(struct sock_filter));
+    if(code == NULL) {
+        perror("malloc");
+        return true;
+    }
+    int n = 0;
+    // A = the CPU the packet is being processed on
+    code[n++] = (struct sock_filter) BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_AD_OFF + SKF_AD_CPU);
+    for(int i = 0; i < num_listeners; i++) {
+        // if A == the CPU of listener i, return i, otherwise go on to the next listener
+        code[n++] = (struct sock_filter) BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, (uint32_t) allowed_cpu(i, NULL), 0, 1);
+        code[n++] = (struct sock_filter) BPF_STMT(BPF_RET | BPF_K, (uint32_t) i);
+    }
+    // A = A % num_listeners, return A
+    code[n++] = (struct sock_filter) BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, (uint32_t) num_listeners);
+    code[n++] = (struct sock_filter) BPF_STMT(BPF_RET | BPF_A, 0);
+    struct sock_fprog program = {(unsigned short) n, code};
+    if(setsockopt(listenfds[0], SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &program, sizeof(program)) < 0) {
+        perror("setsockopt SO_ATTACH_REUSEPORT_CBPF");
+    }
+    free(code);
+    return true;
+}
+
+// Returns the index of the CPU listener thread index (an acceptor or an event loop) is pinned to, or NO_CPU without
+// --pin-listeners. With --steer-connections the event loops that share a listening socket are all pinned to its CPU,
+// the one its connections are steered from, so a connection is never served on a CPU other than the one that received
+// it. Otherwise each gets a CPU of its own.
+int listener_cpu(server_config_t *config, int index) {
+    if(!config->pin_listeners) {
+        return NO_CPU;
+    }
+    return config->steer_connections ? index % config->listeners : index;
+}
+
+// The number of CPUs listener_cpu hands out, which workers and senders are pinned past.
+static int listener_cpus(server_config_t *config) {
+    if(!config->pin_listeners) {
+        return 0;
+    }
+    return config->mode == MODE_THREADS || config->steer_connections ? config->listeners : config->event_loops;
+}
+
+// The number of workers and senders pinned so far, with --pin-workers.
+static int next_worker_cpu = 0;
+
+// Pins the calling MODE_THREADS worker or large lane sender to a CPU of its own. Workers and senders share one round
+// robin, which starts after the CPUs the listeners are pinned to, so no two threads share a CPU until every allowed
+// CPU has one. Returns false if the affinity could not be set.
+bool pin_worker_thread(server_config_t *config) {
+    return pin_thread_to_cpu(listener_cpus(config) + __atomic_fetch_add(&next_worker_cpu, 1, __ATOMIC_RELAXED));
+}
+
+// Restricts the calling thread to run on a single CPU: the cpu-th of the CPUs the process may run on, wrapped around
+// their number, so callers can simply pass the index of their thread. Has to be called before the thread is pinned,
+// since it reads the allowed CPUs from the thread's own mask. Returns false if the affinity could not be set.
+// https://man7.org/linux/man-pages/man3/pthread_setaffinity_np.3.html
+bool pin_thread_to_cpu(int cpu) {
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    CPU_SET(allowed_cpu(cpu, NULL), &cpu_set);
+    int error = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpu_set);
+    if(error != 0) {
+        fprintf(stderr, "pthread_setaffinity_np: %s\n", strerror(error));
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,51 @@
+//
+// Created by User on 14/10/2026.
+//
+
+#ifndef COMP30023_2022_PROJECT_2_LISTENER_H
+#define COMP30023_2022_PROJECT_2_LISTENER_H
+
+// SO_REUSEPORT, CPU_SET and pthread_setaffinity_np are Linux extensions.
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <netdb.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <sched.h>
+#include <fcntl.h>
+
+#include <stdint.h>
+
+#include <sys/socket.h>
+#include <linux/filter.h>
+
+#include "config.h"
+
+#define IPV4_ARG "4"
+#define IPV6_ARG "6"
+
+#define NO_SOCKET (-1)
+#define NO_CPU (-1)
+
+int create_listening_socket_on_port(server_config_t *config, const char *port_number, bool reuse_port);
+
+int create_listening_socket(server_config_t *config, bool reuse_port);
+
+bool create_listening_sockets(server_config_t *config, int *listenfds);
+
+bool make_listening_sockets_nonblocking(int *listenfds, int num_listeners);
+
+bool steer_listening_sockets(int *listenfds, int num_listeners);
+
+int listener_cpu(server_config_t *config, int index);
+
+bool pin_worker_thread(server_config_t *config);
+
+bool pin_thread_to_cpu(int cpu);
+
+#endif //COMP30023_2022_PROJECT_2_LISTENER_H
@@ -0,0 +1,501 @@
+//
+// Created by User on 14/10/2026.
+//
+#include "metrics.h"
+#include "respond.h"
+
+// The status codes counted one by one, in the order of worker_metrics_t.statuses.
+static const int counted_statuses[METRICS_NUM_STATUSES - 1] = {
+    HTTP_STATUS_OK, HTTP_STATUS_PARTIAL_CONTENT, HTTP_STATUS_NOT_MODIFIED, HTTP_STATUS_NOT_FOUND,
+    HTTP_STATUS_RANGE_NOT_SATISFIABLE
+};
+
+static const char *stage_names[METRICS_NUM_STAGES] = {"first_byte", "parse", "open", "send"};
+
+// The admission counters exported, and the reason label of each.
+static const int rejection_counters[] = {ADMISSION_SERVER_FULL, ADMISSION_ADDRESS_FULL};
+static const char *rejection_reasons[] = {"max_connections", "max_connections_per_ip"};
+static const int eviction_counters[] = {
+    ADMISSION_HEADER_TIMEOUT, ADMISSION_SEND_TIMEOUT, ADMISSION_IDLE_TIMEOUT, ADMISSION_EVICTED
+};
+static const char *eviction_reasons[] = {"header_timeout", "send_timeout", "idle_timeout", "pressure"};
+#define NUM_REJECTION_COUNTERS (sizeof(rejection_counters) / sizeof(rejection_counters[0]))
+#define NUM_EVICTION_COUNTERS (sizeof(eviction_counters) / sizeof(eviction_counters[0]))
+
+// The upper bounds of the buckets of the Prometheus histograms, in seconds. Each of the finer buckets the workers
+// count in is added to the first of these that all of its values are below.
+static const double exposed_buckets[] = {
+    0.000001, 0.0000025, 0.000005, 0.00001, 0.000025, 0.00005, 0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01,
+    0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10
+};
+#define NUM_EXPOSED_BUCKETS (sizeof(exposed_buckets) / sizeof(exposed_buckets[0]))
+
+static const double exposed_quantiles[] = {0.5, 0.99, 0.999};
+#define NUM_EXPOSED_QUANTILES (sizeof(exposed_quantiles) / sizeof(exposed_quantiles[0]))
+
+// Every worker's counters, linked through next. The lock is only taken to add a worker, when it starts, and to read
+// them all on a scrape, never while a request is being recorded.
+static struct {
+    bool enabled;
+    int listenfd;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    worker_metrics_t *workers;
+    int num_workers;
+} metrics = {false, NO_SOCKET, 0, PTHREAD_MUTEX_INITIALIZER, NULL, 0};
+
+// Adds value to a counter that only the calling thread writes to. The relaxed atomic load and store compile to plain
+// moves, and only make sure the admin thread never sees half of one. https://gcc.gnu.org/wiki/Atomic/GCCMM/AtomicSync
+static void add_to_counter(uint64_t *counter, uint64_t value) {
+    __atomic_store_n(counter, __atomic_load_n(counter, __ATOMIC_RELAXED) + value, __ATOMIC_RELAXED);
+}
+
+static uint64_t read_counter(uint64_t *counter) {
+    return __atomic_load_n(counter, __ATOMIC_RELAXED);
+}
+
+static int histogram_index(uint64_t value) {
+    if(value >= (1ULL << METRICS_HISTOGRAM_MAX_BITS)) {
+        value = (1ULL << METRICS_HISTOGRAM_MAX_BITS) - 1;
+    }
+    if(value < (1ULL << METRICS_HISTOGRAM_BITS)) {
+        return (int) value;
+    }
+    int shift = (63 - __builtin_clzll(value)) - (METRICS_HISTOGRAM_BITS - 1);
+    return (shift << (METRICS_HISTOGRAM_BITS - 1)) + (int) (value >> shift);
+}
+
+// The smallest value counted in the bucket at index.
+static uint64_t histogram_bucket_start(int index) {
+    if(index < (1 << METRICS_HISTOGRAM_BITS)) {
+        return index;
+    }
+    int shift = (index >> (METRICS_HISTOGRAM_BITS - 1)) - 1;
+    return (uint64_t) (index - (shift << (METRICS_HISTOGRAM_BITS - 1))) << shift;
+}
+
+static void histogram_record(metrics_histogram_t *histogram, long long value) {
+    if(value < 0) {
+        value = 0;
+    }
+    add_to_counter(&histogram->counts[histogram_index(value)], 1);
+    add_to_counter(&histogram->sum, value);
+}
+
+// Returns the current time in nanoseconds, or 0 if metrics are turned off so that timing costs nothing then either.
+// CLOCK_MONOTONIC is read through the vDSO without a system call. https://man7.org/linux/man-pages/man7/vdso.7.html
+long long metrics_now(void) {
+    if(!metrics.enabled) {
+        return 0;
+    }
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * NANOSECONDS_PER_SECOND + now.tv_nsec;
+}
+
+// Gives the calling worker counters (and an access log ring and a trace ring) of its own. Returns NULL if metrics, the
+// access log and tracing are all turned off (or the memory could not be allocated), which every other function takes
+// to mean there is nothing to record.
+worker_metrics_t *metrics_register_worker(void) {
+    if(!metrics.enabled) {
+        return NULL;
+    }
+    void *memory;
+    if(posix_memalign(&memory, METRICS_CACHE_LINE_SIZE, sizeof(worker_metrics_t)) != 0) {
+        fprintf(stderr, "ERROR, could not allocate the metrics of a worker.\n");
+        return NULL;
+    }
+    worker_metrics_t *worker = (worker_metrics_t *) memory;
+    memset(worker, 0, sizeof(worker_metrics_t));
+    worker->log = access_log_register_ring();
+    worker->traces = trace_register_ring();
+    pthread_mutex_lock(&metrics.lock);
+    worker->next = metrics.workers;
+    metrics.workers = worker;
+    metrics.num_workers++;
+    pthread_mutex_unlock(&metrics.lock);
+    return worker;
+}
+
+// Sets up the request metrics of a connection accepted at accepted_at (a metrics_now() time) by a worker whose
+// counters are worker.
+void metrics_start_connection(request_metrics_t *metrics, worker_metrics_t *worker, long long accepted_at) {
+    metrics_resume_connection(metrics, worker);
+    metrics->started = accepted_at;
+    if(worker != NULL) {
+        add_to_counter(&worker->connections, 1);
+    }
+    if(metrics->trace.sampled) {
+        trace_add_span(&metrics->trace, TRACE_STAGE_QUEUE, accepted_at, metrics_now());
+    }
+}
+
+// Sets up the request metrics of a connection that was already counted and is picked up again by a worker whose
+// counters are worker, between two requests. The next one starts when its first byte arrives.
+void metrics_resume_connection(request_metrics_t *metrics, worker_metrics_t *worker) {
+    metrics->worker = worker;
+    metrics->started = 0;
+    metrics->parse_time = 0;
+    metrics->send_started = 0;
+    metrics->record.method_length = 0;
+    metrics->record.path_length = 0;
+    trace_sample(worker != NULL ? worker->traces : NULL, &metrics->trace);
+}
+
+// http_parser_execute, timed. The first time a later request on the connection has bytes in the buffer counts as
+// when it arrived.
+int metrics_parse_request(request_metrics_t *metrics, http_parser_t *parser, const char *buffer, size_t length) {
+    if(metrics->worker == NULL) {
+        return http_parser_execute(parser, buffer, length);
+    }
+    long long parse_started = metrics_now();
+    if(metrics->started == 0 && length > 0) {
+        metrics->started = parse_started;
+    }
+    int status = http_parser_execute(parser, buffer, length);
+    long long parse_ended = metrics_now();
+    metrics->parse_time += parse_ended - parse_started;
+    // Looking at an empty buffer, before the request has started, is not part of parsing it.
+    if(metrics->trace.sampled && length > 0) {
+        trace_add_span(&metrics->trace, TRACE_STAGE_PARSE, parse_started, parse_ended);
+    }
+    return status;
+}
+
+// Copies at most max_length bytes of what span covers in buffer into destination and returns how many that was.
+static size_t copy_span(char *destination, size_t max_length, const char *buffer, http_span_t span) {
+    size_t length = span.length < max_length ? span.length : max_length;
+    memcpy(destination, buffer + span.offset, length);
+    return length;
+}
+
+// Called as soon as the request has been parsed, while it is still at the front of buffer, to keep its method and
+// path for the access log and the trace. request is NULL if the request could not be parsed.
+void metrics_start_request(request_metrics_t *metrics, const char *buffer, http_request_t *request) {
+    if(metrics->trace.sampled) {
+        // Reading the first request on a connection starts once a worker has taken it off the queue.
+        trace_span_t *queue = &metrics->trace.spans[TRACE_STAGE_QUEUE];
+        long long read_started = queue->start != 0 ? queue->start + queue->duration : metrics->started;
+        trace_add_span(&metrics->trace, TRACE_STAGE_READ, read_started, metrics_now());
+    } else if(metrics->worker == NULL || metrics->worker->log == NULL) {
+        return;
+    }
+    access_log_record_t *record = &metrics->record;
+    if(request == NULL) {
+        record->method_length = 0;
+        record->path_length = 0;
+        return;
+    }
+    record->method_length = copy_span(record->method, ACCESS_LOG_METHOD_MAX, buffer, request->method);
+    record->path_length = copy_span(record->path, ACCESS_LOG_PATH_MAX, buffer, request->path);
+}
+
+// get_file_path, timed when the request is traced.
+bool metrics_get_file_path(request_metrics_t *metrics, char **file_path, const char *buffer, http_request_t *request,
+                           arena_t *arena) {
+    if(!metrics->trace.sampled) {
+        return get_file_path(file_path, buffer, request, arena);
+    }
+    long long started = metrics_now();
+    bool built = get_file_path(file_path, buffer, request, arena);
+    trace_add_span(&metrics->trace, TRACE_STAGE_PATH, started, metrics_now());
+    return built;
+}
+
+// Called once the response has been prepared, just before its first byte is sent.
+void metrics_start_response(request_metrics_t *metrics) {
+    if(metrics->worker != NULL) {
+        metrics->send_started = metrics_now();
+    }
+}
+
+// Fills in the rest of the access log record of the request metrics is on, which finished at now and whose status is
+// already in it, and hands it to the worker's ring.
+static void log_response(request_metrics_t *metrics, size_t length, long long now) {
+    access_log_record_t *record = &metrics->record;
+    struct timespec wall_clock;
+    clock_gettime(CLOCK_REALTIME, &wall_clock);
+    record->time = wall_clock.tv_sec * NANOSECONDS_PER_SECOND + wall_clock.tv_nsec;
+    long long started = metrics->started != 0 ? metrics->started : metrics->send_started;
+    record->duration = now - started;
+    record->bytes = length;
+    record->reserved = 0;
+    access_log_append(metrics->worker->log, record);
+}
+
+// Adds a response with status that is length bytes long, whose file took open_time to find from open_started, to the
+// counters. Responses that could not be sent in full are only counted as failed, since how long they took says
+// nothing about the server.
+static void record_response(request_metrics_t *metrics, int status, size_t length, long long open_started,
+                            long long open_time, bool completed) {
+    worker_metrics_t *worker = metrics->worker;
+    long long now = metrics_now();
+    add_to_counter(&worker->requests, 1);
+    add_to_counter(&worker->bytes_sent, length);
+    if(completed) {
+        int index = 0;
+        while(index < METRICS_STATUS_OTHER && counted_statuses[index] != status) {
+            index++;
+        }
+        add_to_counter(&worker->statuses[index], 1);
+        if(metrics->started != 0) {
+            histogram_record(&worker->stages[METRICS_STAGE_FIRST_BYTE], metrics->send_started - metrics->started);
+        }
+        histogram_record(&worker->stages[METRICS_STAGE_PARSE], metrics->parse_time);
+        histogram_record(&worker->stages[METRICS_STAGE_OPEN], open_time);
+        histogram_record(&worker->stages[METRICS_STAGE_SEND], now - metrics->send_started);
+    } else {
+        add_to_counter(&worker->failed_responses, 1);
+    }
+    metrics->record.status = status;
+    metrics->record.completed = completed;
+    if(metrics->trace.sampled) {
+        if(open_started != 0) {
+            trace_add_span(&metrics->trace, TRACE_STAGE_OPEN, open_started, open_started + open_time);
+        }
+        trace_add_span(&metrics->trace, TRACE_STAGE_SEND, metrics->send_started, now);
+        trace_finish(worker->traces, &metrics->trace, &metrics->record, now);
+    }
+    if(worker->log != NULL) {
+        log_response(metrics, length, now);
+    }
+    // The next request on the connection starts when its first byte arrives.
+    metrics->record.method_length = 0;
+    metrics->record.path_length = 0;
+    metrics->started = 0;
+    metrics->parse_time = 0;
+    metrics->send_started = 0;
+    trace_sample(worker->traces, &metrics->trace);
+}
+
+// Records a response once it has been sent (completed) or given up on.
+void metrics_record_response(request_metrics_t *metrics, http_response_t *response, bool completed) {
+    if(metrics->worker != NULL) {
+        record_response(metrics, response->status, response->bytes_sent, response->lookup_started,
+                        response->lookup_time, completed);
+    }
+}
+
+// Records a response that was a fixed message of length bytes rather than an http_response_t, such as the 404
+// serve_connection sends for a request it could not parse.
+void metrics_record_message(request_metrics_t *metrics, int status, size_t length, bool completed) {
+    if(metrics->worker != NULL) {
+        record_response(metrics, status, completed ? length : 0, 0, 0, completed);
+    }
+}
+
+// Adds one worker's counters to the running totals in into.
+static void add_worker_metrics(worker_metrics_t *into, worker_metrics_t *from) {
+    into->connections += read_counter(&from->connections);
+    into->requests += read_counter(&from->requests);
+    into->failed_responses += read_counter(&from->failed_responses);
+    into->bytes_sent += read_counter(&from->bytes_sent);
+    for(int i = 0; i < METRICS_NUM_STATUSES; i++) {
+        into->statuses[i] += read_counter(&from->statuses[i]);
+    }
+    for(int stage = 0; stage < METRICS_NUM_STAGES; stage++) {
+        for(int i = 0; i < METRICS_HISTOGRAM_BUCKETS; i++) {
+            into->stages[stage].counts[i] += read_counter(&from->stages[stage].counts[i]);
+        }
+        into->stages[stage].sum += read_counter(&from->stages[stage].sum);
+    }
+}
+
+// The value in seconds below which fraction of the values of histogram fall, to within a fine bucket.
+static double histogram_quantile(metrics_histogram_t *histogram, uint64_t total, double fraction) {
+    uint64_t wanted = (uint64_t) (fraction * total + 0.5);
+    uint64_t seen = 0;
+    for(int i = 0; i < METRICS_HISTOGRAM_BUCKETS; i++) {
+        seen += histogram->counts[i];
+        if(seen >= wanted && seen > 0) {
+            return (double) histogram_bucket_start(i + 1) / NANOSECONDS_PER_SECOND;
+        }
+    }
+    return 0;
+}
+
+// Writes every counter in the Prometheus text format.
+// https://prometheus.io/docs/instrumenting/exposition_formats/#text-based-format
+static void write_metrics(FILE *stream, worker_metrics_t *sum, int num_workers) {
+    fprintf(stream, "# HELP http_workers Threads recording metrics (workers, event loops or io_uring loops).\n"
+                    "# TYPE http_workers gauge\nhttp_workers %d\n", num_workers);
+    fprintf(stream, "# HELP http_connections_total Connections accepted.\n"
+                    "# TYPE http_connections_total counter\nhttp_connections_total %llu\n",
+            (unsigned long long) sum->connections);
+    fprintf(stream, "# HELP http_requests_total Requests responded to.\n"
+                    "# TYPE http_requests_total counter\nhttp_requests_total %llu\n",
+            (unsigned long long) sum->requests);
+    fprintf(stream, "# HELP http_failed_responses_total Responses that could not be sent in full.\n"
+                    "# TYPE http_failed_responses_total counter\nhttp_failed_responses_total %llu\n",
+            (unsigned long long) sum->failed_responses);
+    fprintf(stream, "# HELP http_response_bytes_total Bytes of responses sent, headers included.\n"
+                    "# TYPE http_response_bytes_total counter\nhttp_response_bytes_total %llu\n",
+            (unsigned long long) sum->bytes_sent);
+    fprintf(stream, "# HELP http_access_log_dropped_total Access log records dropped because a ring was full.\n"
+                    "# TYPE http_access_log_dropped_total counter\nhttp_access_log_dropped_total %llu\n",
+            (unsigned long long) access_log_dropped());
+
+    // The connection limits are counted by admission.c for the whole server rather than by each worker.
+    fprintf(stream, "# HELP http_open_connections Connections open.\n"
+                    "# TYPE http_open_connections gauge\nhttp_open_connections %d\n", admission_open_connections());
+    fprintf(stream, "# HELP http_connections_rejected_total Connections turned away, by the limit they were over.\n"
+                    "# TYPE http_connections_rejected_total counter\n");
+    for(size_t i = 0; i < NUM_REJECTION_COUNTERS; i++) {
+        fprintf(stream, "http_connections_rejected_total{reason=\"%s\"} %llu\n", rejection_reasons[i],
+                (unsigned long long) admission_count(rejection_counters[i]));
+    }
+    fprintf(stream, "# HELP http_connections_evicted_total Connections the server closed before the client was done, "
+                    "by the deadline they missed, or under pressure.\n"
+                    "# TYPE http_connections_evicted_total counter\n");
+    for(size_t i = 0; i < NUM_EVICTION_COUNTERS; i++) {
+        fprintf(stream, "http_connections_evicted_total{reason=\"%s\"} %llu\n", eviction_reasons[i],
+                (unsigned long long) admission_count(eviction_counters[i]));
+    }
+
+    fprintf(stream, "# HELP http_responses_total Responses sent in full, by status code.\n"
+                    "# TYPE http_responses_total counter\n");
+    for(int i = 0; i < METRICS_STATUS_OTHER; i++) {
+        fprintf(stream, "http_responses_total{code=\"%d\"} %llu\n", counted_statuses[i],
+                (unsigned long long) sum->statuses[i]);
+    }
+    fprintf(stream, "http_responses_total{code=\"other\"} %llu\n",
+            (unsigned long long) sum->statuses[METRICS_STATUS_OTHER]);
+
+    fprintf(stream, "# HELP http_request_stage_seconds Time spent in each stage of a request.\n"
+                    "# TYPE http_request_stage_seconds histogram\n");
+    for(int stage = 0; stage < METRICS_NUM_STAGES; stage++) {
+        metrics_histogram_t *histogram = &sum->stages[stage];
+        uint64_t cumulative = 0;
+        int fine = 0;
+        for(size_t i = 0; i < NUM_EXPOSED_BUCKETS; i++) {
+            uint64_t bound = (uint64_t) (exposed_buckets[i] * NANOSECONDS_PER_SECOND);
+            while(fine < METRICS_HISTOGRAM_BUCKETS && histogram_bucket_start(fine + 1) <= bound + 1) {
+                cumulative += histogram->counts[fine++];
+            }
+            fprintf(stream, "http_request_stage_seconds_bucket{stage=\"%s\",le=\"%g\"} %llu\n", stage_names[stage],
+                    exposed_buckets[i], (unsigned long long) cumulative);
+        }
+        while(fine < METRICS_HISTOGRAM_BUCKETS) {
+            cumulative += histogram->counts[fine++];
+        }
+        fprintf(stream, "http_request_stage_seconds_bucket{stage=\"%s\",le=\"+Inf\"} %llu\n", stage_names[stage],
+                (unsigned long long) cumulative);
+        fprintf(stream, "http_request_stage_seconds_sum{stage=\"%s\"} %.9f\n", stage_names[stage],
+                (double) histogram->sum / NANOSECONDS_PER_SECOND);
+        fprintf(stream, "http_request_stage_seconds_count{stage=\"%s\"} %llu\n", stage_names[stage],
+                (unsigned long long) cumulative);
+    }
+
+    // The fine buckets give far better quantiles than the Prometheus buckets can, so they are exported as well.
+    fprintf(stream, "# HELP http_request_stage_quantile_seconds Quantiles of each stage since the server started.\n"
+                    "# TYPE http_request_stage_quantile_seconds gauge\n");
+    for(int stage = 0; stage < METRICS_NUM_STAGES; stage++) {
+        uint64_t total = 0;
+        for(int i = 0; i < METRICS_HISTOGRAM_BUCKETS; i++) {
+            total += sum->stages[stage].counts[i];
+        }
+        for(size_t q = 0; q < NUM_EXPOSED_QUANTILES; q++) {
+            fprintf(stream, "http_request_stage_quantile_seconds{stage=\"%s\",quantile=\"%g\"} %.9f\n",
+                    stage_names[stage], exposed_quantiles[q],
+                    histogram_quantile(&sum->stages[stage], total, exposed_quantiles[q]));
+        }
+    }
+}
+
+// Answers one scrape on the admin port: GET /metrics gets every worker's counters added together, anything else a
+// 404. The connection is closed afterwards, as Prometheus opens one per scrape anyway.
+static void serve_scrape(int sockfd) {
+    struct timeval timeout = {METRICS_REQUEST_TIMEOUT, 0};
+    setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    char buffer[METRICS_REQUEST_MAX_SIZE];
+    size_t length = 0;
+    http_parser_t parser;
+    http_parser_init(&parser);
+    int status = PARSE_INCOMPLETE;
+    while(status == PARSE_INCOMPLETE && length < sizeof(buffer)) {
+        ssize_t n = read(sockfd, buffer + length, sizeof(buffer) - length);
+        if(n <= 0) {
+            return;
+        }
+        length += n;
+        status = http_parser_execute(&parser, buffer, length);
+    }
+    if(status != PARSE_COMPLETE || parser.request.path.length != strlen(METRICS_PATH) ||
+       memcmp(buffer + parser.request.path.offset, METRICS_PATH, strlen(METRICS_PATH)) != SAME_STRING) {
+        write_message(sockfd, NOT_FOUND_RESPONSE);
+        return;
+    }
+
+    // The sum is far too big for the admin thread's stack.
+    worker_metrics_t *sum = (worker_metrics_t *) calloc(1, sizeof(worker_metrics_t));
+    if(sum == NULL) {
+        perror("calloc");
+        return;
+    }
+    pthread_mutex_lock(&metrics.lock);
+    for(worker_metrics_t *worker = metrics.workers; worker != NULL; worker = worker->next) {
+        add_worker_metrics(sum, worker);
+    }
+    int num_workers = metrics.num_workers;
+    pthread_mutex_unlock(&metrics.lock);
+
+    char *body = NULL;
+    size_t body_length = 0;
+    FILE *stream = open_memstream(&body, &body_length);
+    if(stream == NULL) {
+        perror("open_memstream");
+        free(sum);
+        return;
+    }
+    write_metrics(stream, sum, num_workers);
+    fclose(stream);
+    free(sum);
+
+    char headers[RESPONSE_HEADER_MAX_SIZE];
+    snprintf(headers, sizeof(headers), "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\n"
+                                       "Content-Length: %zu\r\n\r\n", body_length);
+    if(write_message(sockfd, headers)) {
+        write_message(sockfd, body);
+    }
+    free(body);
+}
+
+// The body of the admin thread. Scrapes come a few times a minute, so they are simply served one at a time.
+static void *serve_metrics(void *unused) {
+    while(true) {
+        int sockfd = accept(metrics.listenfd, NULL, NULL);
+        if(sockfd < 0) {
+            perror("accept");
+            continue;
+        }
+        serve_scrape(sockfd);
+        close(sockfd);
+    }
+    return NULL;
+}
+
+// Opens the access log if config has one and turns tracing on if config samples requests, and turns metrics on if
+// config has a metrics port, an access log or tracing (which need the same timings), starting the thread that serves
+// them on the port. Has to be called before any worker or loop starts, so they all see metrics turned on, and after
+// SIGUSR1 is blocked, so the admin thread never takes it.
+// Returns false if the access log or trace file could not be opened or the admin port could not be listened on.
+bool metrics_init(server_config_t *config) {
+    if(!access_log_init(config) || !trace_init(config)) {
+        return false;
+    }
+    metrics.enabled = access_log_enabled() || trace_enabled();
+    if(config->metrics_port == NULL) {
+        return true;
+    }
+    if((metrics.listenfd = create_listening_socket_on_port(config, config->metrics_port, false)) == NO_SOCKET) {
+        return false;
+    }
+    metrics.enabled = true;
+    int error = pthread_create(&metrics.thread, NULL, serve_metrics, NULL);
+    if(error != 0) {
+        fprintf(stderr, "pthread_create: %s\n", strerror(error));
+        return false;
+    }
+    return true;
+}
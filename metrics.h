@@ -0,0 +1,123 @@
+//
+// Created by User on 14/10/2026.
+//
+
+#ifndef COMP30023_2022_PROJECT_2_METRICS_H
+#define COMP30023_2022_PROJECT_2_METRICS_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+
+#include <sys/socket.h>
+#include <sys/time.h>
+
+#include "config.h"
+#include "parse.h"
+#include "listener.h"
+#include "accesslog.h"
+#include "admission.h"
+#include "trace.h"
+
+// Latencies are counted in nanoseconds in log-linear buckets in the manner of HdrHistogram: values below
+// 2^METRICS_HISTOGRAM_BITS each have a bucket of their own, and every power of two above that is split into
+// 2^(METRICS_HISTOGRAM_BITS - 1) buckets, so a value is known to within 1/16 of itself. Values from
+// 2^METRICS_HISTOGRAM_MAX_BITS nanoseconds (about 69 seconds) up all go in the last bucket.
+// https://hdrhistogram.github.io/HdrHistogram/
+#define METRICS_HISTOGRAM_BITS 5
+#define METRICS_HISTOGRAM_MAX_BITS 36
+#define METRICS_HISTOGRAM_BUCKETS \
+    ((METRICS_HISTOGRAM_MAX_BITS - METRICS_HISTOGRAM_BITS + 2) << (METRICS_HISTOGRAM_BITS - 1))
+
+// The stages of a request that each have a latency histogram: from the connection being accepted (or the first byte
+// of a later request on it arriving) to the response starting to go out, parsing the request, finding the file
+// (the caches, open() and fstat()), and sending the response.
+#define METRICS_STAGE_FIRST_BYTE 0
+#define METRICS_STAGE_PARSE 1
+#define METRICS_STAGE_OPEN 2
+#define METRICS_STAGE_SEND 3
+#define METRICS_NUM_STAGES 4
+
+// The status codes the server sends are counted one by one, anything else together.
+#define METRICS_NUM_STATUSES 6
+#define METRICS_STATUS_OTHER (METRICS_NUM_STATUSES - 1)
+
+// Each worker's counters get cache lines of their own, so workers never write to a line another one is writing to.
+#define METRICS_CACHE_LINE_SIZE 64
+
+// Bytes of a scrape request the admin port reads, and the seconds it waits for one.
+#define METRICS_REQUEST_MAX_SIZE 2048
+#define METRICS_REQUEST_TIMEOUT 5
+#define METRICS_PATH "/metrics"
+
+typedef struct metrics_histogram metrics_histogram_t;
+struct metrics_histogram {
+    uint64_t counts[METRICS_HISTOGRAM_BUCKETS];
+    uint64_t sum;
+};
+
+// The counters of one worker thread, event loop or io_uring loop. Only that thread ever writes to them, so recording
+// is a plain load and store with no lock and no atomic read-modify-write, and the admin thread adds every worker's
+// counters together whenever it is scraped.
+typedef struct worker_metrics worker_metrics_t;
+struct worker_metrics {
+    uint64_t connections;
+    uint64_t requests;
+    // Responses that could not be sent in full, because the client went away or the file could not be read.
+    uint64_t failed_responses;
+    uint64_t bytes_sent;
+    uint64_t statuses[METRICS_NUM_STATUSES];
+    metrics_histogram_t stages[METRICS_NUM_STAGES];
+    // The worker's access log ring, or NULL if there is no access log, and its trace ring, or NULL if tracing is off.
+    access_log_ring_t *log;
+    trace_ring_t *traces;
+    worker_metrics_t *next;
+};
+
+// The timestamps of the request a connection is on. worker is NULL when metrics, the access log and tracing are all
+// turned off, in which case nothing is timed at all.
+typedef struct request_metrics request_metrics_t;
+struct request_metrics {
+    worker_metrics_t *worker;
+    // When the connection was accepted or, for later requests on it, when their first byte had arrived. 0 until then.
+    long long started;
+    long long parse_time;
+    long long send_started;
+    // The access log record of the request, with its method and path copied in before the request is taken out of
+    // the buffer. Only filled in if the worker has an access log ring or the request is traced.
+    access_log_record_t record;
+    request_trace_t trace;
+};
+
+struct http_response;
+
+bool metrics_init(server_config_t *config);
+
+long long metrics_now(void);
+
+worker_metrics_t *metrics_register_worker(void);
+
+void metrics_start_connection(request_metrics_t *metrics, worker_metrics_t *worker, long long accepted_at);
+
+void metrics_resume_connection(request_metrics_t *metrics, worker_metrics_t *worker);
+
+int metrics_parse_request(request_metrics_t *metrics, http_parser_t *parser, const char *buffer, size_t length);
+
+void metrics_start_request(request_metrics_t *metrics, const char *buffer, http_request_t *request);
+
+bool metrics_get_file_path(request_metrics_t *metrics, char **file_path, const char *buffer, http_request_t *request,
+                           arena_t *arena);
+
+void metrics_start_response(request_metrics_t *metrics);
+
+void metrics_record_response(request_metrics_t *metrics, struct http_response *response, bool completed);
+
+void metrics_record_message(request_metrics_t *metrics, int status, size_t length, bool completed);
+
+#endif //COMP30023_2022_PROJECT_2_METRICS_H
@@ -0,0 +1,355 @@
+//
+// Created by User on 14/10/2026.
+//
+#include "mime.h"
+
+// Until mime_init has built the table every file is DEFAULT_CONTENT_TYPE.
+static mime_table_t mime_table = {
+    .default_type = {(char *) DEFAULT_CONTENT_TYPE, (char *) "Content-Type: " DEFAULT_CONTENT_TYPE "\r\n",
+                     sizeof("Content-Type: " DEFAULT_CONTENT_TYPE "\r\n") - NULL_TERMINATOR_SPACE, false}
+};
+
+// The types known without a mime.types file, written in the same "type extension..." format so they are read by the
+// same code. The first four are the ones the server has always recognised, with the types it has always sent for
+// them. https://developer.mozilla.org/en-US/docs/Web/HTTP/Basics_of_HTTP/MIME_types/Common_types
+static const char *builtin_mime_types[] = {
+    "text/html html htm",
+    "image/jpeg jpg jpeg",
+    "text/javascript js mjs",
+    "text/css css",
+    "text/plain txt",
+    "text/csv csv",
+    "text/markdown md",
+    "application/json json map",
+    "application/manifest+json webmanifest",
+    "application/xml xml",
+    "application/wasm wasm",
+    "application/pdf pdf",
+    "application/zip zip",
+    "application/gzip gz",
+    "application/x-tar tar",
+    "image/png png",
+    "image/gif gif",
+    "image/webp webp",
+    "image/avif avif",
+    "image/svg+xml svg",
+    "image/x-icon ico",
+    "image/bmp bmp",
+    "font/woff woff",
+    "font/woff2 woff2",
+    "font/ttf ttf",
+    "font/otf otf",
+    "application/vnd.ms-fontobject eot",
+    "video/mp4 mp4",
+    "video/webm webm",
+    "video/ogg ogv",
+    "audio/mpeg mp3",
+    "audio/ogg ogg oga",
+    "audio/wav wav",
+    "audio/mp4 m4a"
+};
+
+// Types besides text/* that are worth compressing. Everything else is either compressed already (images, fonts,
+// video, archives) or rarely served.
+static const char *compressible_types[] = {"application/javascript", "application/json", "application/manifest+json",
+                                           "application/xml", "application/wasm", "image/svg+xml"};
+
+static bool is_compressible_type(const char *name) {
+    if(strncmp(name, TEXT_TYPE_PREFIX, strlen(TEXT_TYPE_PREFIX)) == SAME_STRING) {
+        return true;
+    }
+    for(size_t i = 0; i < sizeof(compressible_types) / sizeof(compressible_types[0]); i++) {
+        if(strcmp(name, compressible_types[i]) == SAME_STRING) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Returns the type called name, adding it (with its header line) if this is the first time it is seen. Returns NULL
+// if the memory for it could not be allocated.
+static mime_type_t *find_or_add_type(const char *name) {
+    for(int i = 0; i < mime_table.num_types; i++) {
+        if(strcmp(mime_table.types[i]->name, name) == SAME_STRING) {
+            return mime_table.types[i];
+        }
+    }
+    mime_type_t **types = (mime_type_t **) realloc(mime_table.types,
+                                                   (mime_table.num_types + 1) * sizeof(mime_type_t *));
+    if(types == NULL) {
+        perror("realloc");
+        return NULL;
+    }
+    mime_table.types = types;
+
+    mime_type_t *type = (mime_type_t *) malloc(sizeof(mime_type_t));
+    size_t header_length = snprintf(NULL, 0, CONTENT_TYPE_HEADER_FORMAT, name);
+    char *header = (char *) malloc(header_length + NULL_TERMINATOR_SPACE);
+    char *copy = strdup(name);
+    if(type == NULL || header == NULL || copy == NULL) {
+        perror("malloc");
+        free(type);
+        free(header);
+        free(copy);
+        return NULL;
+    }
+    snprintf(header, header_length + NULL_TERMINATOR_SPACE, CONTENT_TYPE_HEADER_FORMAT, name);
+    type->name = copy;
+    type->header = header;
+    type->header_length = header_length;
+    type->compressible = is_compressible_type(name);
+    types[mime_table.num_types++] = type;
+    return type;
+}
+
+// Maps extension to type, replacing whatever it was mapped to before, so a mime.types file overrides the built in
+// types and later lines override earlier ones. Extensions are compared without case, since "photo.JPG" is as much a
+// JPEG as "photo.jpg". Returns false if the memory for the extension could not be allocated.
+static bool add_extension(mime_slot_t **keys, int *num_keys, int *capacity, const char *extension,
+                          mime_type_t *type) {
+    size_t length = strlen(extension);
+    if(length > MIME_EXTENSION_MAX_LENGTH) {
+        return true;
+    }
+    char lowered[MIME_EXTENSION_MAX_LENGTH + NULL_TERMINATOR_SPACE];
+    for(size_t i = 0; i <= length; i++) {
+        lowered[i] = (char) tolower((unsigned char) extension[i]);
+    }
+    for(int i = 0; i < *num_keys; i++) {
+        if(strcmp((*keys)[i].extension, lowered) == SAME_STRING) {
+            (*keys)[i].type = type;
+            return true;
+        }
+    }
+    if(*num_keys == *capacity) {
+        int new_capacity = *capacity == 0 ? 64 : *capacity * 2;
+        mime_slot_t *grown = (mime_slot_t *) realloc(*keys, new_capacity * sizeof(mime_slot_t));
+        if(grown == NULL) {
+            perror("realloc");
+            return false;
+        }
+        *keys = grown;
+        *capacity = new_capacity;
+    }
+    if(((*keys)[*num_keys].extension = strdup(lowered)) == NULL) {
+        perror("strdup");
+        return false;
+    }
+    (*keys)[(*num_keys)++].type = type;
+    return true;
+}
+
+// Adds the extensions on one line of a mime.types file, a type followed by any number of extensions separated by
+// whitespace, in the format Apache and the mailcap package use. Anything after a '#' is a comment. The line is
+// modified. Returns false if the type is longer than MIME_TYPE_MAX_LENGTH or memory ran out.
+static bool add_mime_line(mime_slot_t **keys, int *num_keys, int *capacity, char *line) {
+    char *comment = strchr(line, '#');
+    if(comment != NULL) {
+        *comment = '\0';
+    }
+    char *saved;
+    char *name = strtok_r(line, " \t\r\n", &saved);
+    if(name == NULL) {
+        return true;
+    }
+    mime_type_t *type = NULL;
+    char *extension;
+    while((extension = strtok_r(NULL, " \t\r\n", &saved)) != NULL) {
+        // A type is only created once there is an extension for it, since the usual mime.types lists many types
+        // with none.
+        if(type == NULL && strlen(name) > MIME_TYPE_MAX_LENGTH) {
+            fprintf(stderr, "ERROR, the MIME type %s is longer than %d characters.\n", name, MIME_TYPE_MAX_LENGTH);
+            return false;
+        }
+        if(type == NULL && (type = find_or_add_type(name)) == NULL) {
+            return false;
+        }
+        if(!add_extension(keys, num_keys, capacity, extension, type)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Reads every line of the mime.types file at path. Returns false if it could not be read.
+static bool load_mime_types_file(const char *path, mime_slot_t **keys, int *num_keys, int *capacity) {
+    FILE *file = fopen(path, "r");
+    if(file == NULL) {
+        perror(path);
+        return false;
+    }
+    char *line = NULL;
+    size_t line_capacity = 0;
+    bool loaded = true;
+    while(loaded && getline(&line, &line_capacity, file) != -1) {
+        loaded = add_mime_line(keys, num_keys, capacity, line);
+    }
+    if(ferror(file)) {
+        perror(path);
+        loaded = false;
+    }
+    free(line);
+    fclose(file);
+    return loaded;
+}
+
+// FNV-1a of a lowercase extension, started from a different state for each seed. The bucket and slot come from the
+// low bits, which FNV mixes poorly for keys as short as extensions, so the high half is folded into them.
+static uint64_t hash_extension(const char *extension, uint64_t seed) {
+    uint64_t hash = FNV_OFFSET_BASIS ^ (seed * MIME_SEED_MULTIPLIER);
+    for(; *extension != '\0'; extension++) {
+        hash ^= (unsigned char) *extension;
+        hash *= FNV_PRIME;
+    }
+    return hash ^ (hash >> 32);
+}
+
+// Bucket 0 is hashed with seed 0, and a displacement d with seed d + 1, so the two never coincide.
+static uint32_t bucket_of(const char *extension, uint32_t num_buckets) {
+    return (uint32_t) (hash_extension(extension, 0) % num_buckets);
+}
+
+static uint32_t slot_of(const char *extension, uint32_t displacement, uint32_t num_slots) {
+    return (uint32_t) (hash_extension(extension, (uint64_t) displacement + 1) & (num_slots - 1));
+}
+
+// Tries to place the num_keys extensions in keys into num_slots slots. Buckets are placed biggest first, since they
+// are the hardest to find a free set of slots for, by trying displacements until one sends every extension in the
+// bucket to a slot that is free and not used by another extension of the same bucket. Returns false if some bucket
+// could not be placed (or memory ran out), in which case the caller tries again with more slots.
+static bool build_perfect_hash(mime_slot_t *keys, int num_keys, uint32_t num_slots) {
+    uint32_t num_buckets = num_keys / MIME_KEYS_PER_BUCKET + 1;
+    mime_slot_t *slots = (mime_slot_t *) calloc(num_slots, sizeof(mime_slot_t));
+    uint32_t *displacements = (uint32_t *) calloc(num_buckets, sizeof(uint32_t));
+    uint32_t *key_buckets = (uint32_t *) malloc((num_keys + 1) * sizeof(uint32_t));
+    int *bucket_sizes = (int *) calloc(num_buckets, sizeof(int));
+    int *members = (int *) malloc((num_keys + 1) * sizeof(int));
+    uint32_t *member_slots = (uint32_t *) malloc((num_keys + 1) * sizeof(uint32_t));
+    bool built = slots != NULL && displacements != NULL && key_buckets != NULL && bucket_sizes != NULL &&
+                 members != NULL && member_slots != NULL;
+    if(!built) {
+        perror("malloc");
+    }
+
+    int largest_bucket = 0;
+    for(int i = 0; built && i < num_keys; i++) {
+        key_buckets[i] = bucket_of(keys[i].extension, num_buckets);
+        if(++bucket_sizes[key_buckets[i]] > largest_bucket) {
+            largest_bucket = bucket_sizes[key_buckets[i]];
+        }
+    }
+    // The table is only built once, so finding the buckets of each size by scanning them all is fast enough.
+    for(int size = largest_bucket; built && size > 0; size--) {
+        for(uint32_t bucket = 0; built && bucket < num_buckets; bucket++) {
+            if(bucket_sizes[bucket] != size) {
+                continue;
+            }
+            int num_members = 0;
+            for(int i = 0; i < num_keys; i++) {
+                if(key_buckets[i] == bucket) {
+                    members[num_members++] = i;
+                }
+            }
+            bool placed = false;
+            for(uint32_t displacement = 0; !placed && displacement < MIME_MAX_DISPLACEMENT; displacement++) {
+                placed = true;
+                for(int i = 0; placed && i < num_members; i++) {
+                    member_slots[i] = slot_of(keys[members[i]].extension, displacement, num_slots);
+                    placed = slots[member_slots[i]].extension == NULL;
+                    for(int j = 0; placed && j < i; j++) {
+                        placed = member_slots[j] != member_slots[i];
+                    }
+                }
+                if(placed) {
+                    displacements[bucket] = displacement;
+                    for(int i = 0; i < num_members; i++) {
+                        slots[member_slots[i]] = keys[members[i]];
+                    }
+                }
+            }
+            built = placed;
+        }
+    }
+
+    free(key_buckets);
+    free(bucket_sizes);
+    free(members);
+    free(member_slots);
+    if(!built) {
+        free(slots);
+        free(displacements);
+        return false;
+    }
+    mime_table.slots = slots;
+    mime_table.num_slots = num_slots;
+    mime_table.displacements = displacements;
+    mime_table.num_buckets = num_buckets;
+    return true;
+}
+
+// Builds the MIME table from the built in types and then, if mime_types_path is not NULL, the mime.types file at
+// that path. Must be called before any thread looks up a type. Returns false (after printing the reason) if the
+// file could not be read or memory ran out.
+bool mime_init(const char *mime_types_path) {
+    mime_slot_t *keys = NULL;
+    int num_keys = 0;
+    int capacity = 0;
+    for(size_t i = 0; i < sizeof(builtin_mime_types) / sizeof(builtin_mime_types[0]); i++) {
+        char *line = strdup(builtin_mime_types[i]);
+        if(line == NULL || !add_mime_line(&keys, &num_keys, &capacity, line)) {
+            free(line);
+            return false;
+        }
+        free(line);
+    }
+    if(mime_types_path != NULL && !load_mime_types_file(mime_types_path, &keys, &num_keys, &capacity)) {
+        fprintf(stderr, "ERROR, could not load MIME types from %s\n", mime_types_path);
+        return false;
+    }
+
+    // At most half the slots are used, which lets the buckets be placed with small displacements. A table that
+    // still cannot be built is retried with twice as many slots.
+    uint32_t num_slots = 1;
+    while(num_slots < (uint32_t) num_keys * 2) {
+        num_slots *= 2;
+    }
+    while(!build_perfect_hash(keys, num_keys, num_slots)) {
+        if(num_slots >= (UINT32_MAX >> 1)) {
+            fprintf(stderr, "ERROR, could not build the MIME type table.\n");
+            return false;
+        }
+        num_slots *= 2;
+    }
+    // The slots point at the extensions, so only the array that held them is freed.
+    free(keys);
+    return true;
+}
+
+// Returns the MIME type of the file at file_path from the extension after its last '.', or the default type
+// (application/octet-stream) if it has none or one the table does not know. Never returns NULL, and the type is
+// never freed.
+const mime_type_t *mime_lookup(const char *file_path) {
+    const char *extension = strrchr(file_path, FILE_EXTENSION_DELIMITER);
+    if(extension == NULL || mime_table.num_slots == 0) {
+        return &mime_table.default_type;
+    }
+    extension++;
+
+    char lowered[MIME_EXTENSION_MAX_LENGTH + NULL_TERMINATOR_SPACE];
+    size_t length = 0;
+    for(; extension[length] != '\0'; length++) {
+        if(length == MIME_EXTENSION_MAX_LENGTH) {
+            return &mime_table.default_type;
+        }
+        lowered[length] = (char) tolower((unsigned char) extension[length]);
+    }
+    lowered[length] = '\0';
+
+    uint32_t displacement = mime_table.displacements[bucket_of(lowered, mime_table.num_buckets)];
+    mime_slot_t *slot = &mime_table.slots[slot_of(lowered, displacement, mime_table.num_slots)];
+    // An extension the table was not built with still lands in some slot, so the key has to be compared.
+    if(slot->extension != NULL && strcmp(slot->extension, lowered) == SAME_STRING) {
+        return slot->type;
+    }
+    return &mime_table.default_type;
+}
@@ -0,0 +1,80 @@
+//
+// Created by User on 14/10/2026.
+//
+
+#ifndef COMP30023_2022_PROJECT_2_MIME_H
+#define COMP30023_2022_PROJECT_2_MIME_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <ctype.h>
+
+#define FILE_EXTENSION_DELIMITER '.'
+#define DEFAULT_CONTENT_TYPE "application/octet-stream"
+#define TEXT_TYPE_PREFIX "text/"
+#define CONTENT_TYPE_HEADER_FORMAT "Content-Type: %s\r\n"
+
+// Extensions longer than this are never looked up, so a lookup can lowercase the extension on the stack.
+#define MIME_EXTENSION_MAX_LENGTH 31
+// Longer types are refused when the table is loaded, so the Content-Type header always fits in the buffers the cache
+// and the preload index format file headers into. RFC 6838 limits the type and subtype names to 127 characters each,
+// and no registered type comes close to 127 for the two together. https://www.rfc-editor.org/rfc/rfc6838#section-4.2
+#define MIME_TYPE_MAX_LENGTH 127
+// The average number of extensions that share a bucket of the perfect hash. Bigger buckets mean a smaller
+// displacement table but a longer search for displacements that work when the table is built.
+#define MIME_KEYS_PER_BUCKET 4
+// Displacements tried for one bucket before the table is rebuilt with twice as many slots.
+#define MIME_MAX_DISPLACEMENT 65536
+
+#define FNV_OFFSET_BASIS 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
+// Mixed into the hash with a displacement, so each displacement gives a different slot for the same extension.
+#define MIME_SEED_MULTIPLIER 0x9E3779B97F4A7C15ULL
+
+#define SAME_STRING 0
+#define NULL_TERMINATOR_SPACE 1
+
+// One MIME type and the Content-Type header line for it, formatted once when the table is built so responses only
+// copy it.
+typedef struct mime_type mime_type_t;
+struct mime_type {
+    char *name;
+    char *header;
+    size_t header_length;
+    // Whether files of this type are worth compressing: text, and the text based formats browsers fetch.
+    bool compressible;
+};
+
+// A slot of the perfect hash. Slots no extension hashes to have a NULL extension.
+typedef struct mime_slot mime_slot_t;
+struct mime_slot {
+    char *extension;
+    mime_type_t *type;
+};
+
+// Maps lowercase file extensions to MIME types with a hash and displace perfect hash: every extension falls into a
+// bucket by one hash, and each bucket has a displacement, found when the table is built, that sends all of its
+// extensions to distinct free slots by a second hash. A lookup is then two hashes and one comparison however many
+// extensions there are. The table is built once at startup and only read afterwards, so it needs no locking.
+// http://cmph.sourceforge.net/papers/esa09.pdf
+typedef struct mime_table mime_table_t;
+struct mime_table {
+    mime_slot_t *slots;
+    // A power of two, so a hash is reduced to a slot with a mask.
+    uint32_t num_slots;
+    uint32_t *displacements;
+    uint32_t num_buckets;
+
+    mime_type_t **types;
+    int num_types;
+    mime_type_t default_type;
+};
+
+bool mime_init(const char *mime_types_path);
+
+const mime_type_t *mime_lookup(const char *file_path);
+
+#endif //COMP30023_2022_PROJECT_2_MIME_H
@@ -0,0 +1,116 @@
+//
+// Created by User on 14/10/2026.
+//
+#include "mpmc.h"
+
+static mpmc_cell_t *cell_at(mpmc_queue_t *queue, uint64_t position) {
+    return (mpmc_cell_t *) (queue->cells + (position & queue->mask) * queue->cell_size);
+}
+
+// Sets up an empty queue for capacity elements of element_size bytes. The ring is rounded up to a power of two cells
+// so a position maps to its cell with a mask, but the blocking calls never let more than capacity elements in.
+// Returns false if there is no memory for it.
+bool mpmc_init(mpmc_queue_t *queue, size_t capacity, size_t element_size) {
+    size_t num_cells = 2;
+    while(num_cells < capacity) {
+        num_cells *= 2;
+    }
+    // Every cell starts on a boundary any element can be copied to.
+    queue->cell_size = (sizeof(mpmc_cell_t) + element_size + sizeof(max_align_t) - 1) / sizeof(max_align_t) *
+                       sizeof(max_align_t);
+    if((queue->cells = (char *) malloc(num_cells * queue->cell_size)) == NULL) {
+        perror("malloc");
+        return false;
+    }
+    queue->mask = num_cells - 1;
+    queue->element_size = element_size;
+    for(uint64_t i = 0; i < num_cells; i++) {
+        cell_at(queue, i)->sequence = i;
+    }
+    queue->enqueue_position = 0;
+    queue->dequeue_position = 0;
+    sem_init(&queue->slots, 0, (unsigned int) capacity);
+    sem_init(&queue->items, 0, 0);
+    return true;
+}
+
+// Copies element into the queue. Returns false straight away if the ring is full.
+bool mpmc_try_push(mpmc_queue_t *queue, const void *element) {
+    uint64_t position = __atomic_load_n(&queue->enqueue_position, __ATOMIC_RELAXED);
+    mpmc_cell_t *cell;
+    while(true) {
+        cell = cell_at(queue, position);
+        uint64_t sequence = __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE);
+        int64_t difference = (int64_t) (sequence - position);
+        if(difference == 0) {
+            // The cell is free: claim the position. On failure position is reloaded and the claim is tried again.
+            if(__atomic_compare_exchange_n(&queue->enqueue_position, &position, position + 1, true,
+                                           __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if(difference < 0) {
+            // The cell still holds the element from one lap ago.
+            return false;
+        } else {
+            position = __atomic_load_n(&queue->enqueue_position, __ATOMIC_RELAXED);
+        }
+    }
+    memcpy(cell->element, element, queue->element_size);
+    __atomic_store_n(&cell->sequence, position + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+// Copies the oldest element out of the queue into element. Returns false straight away if the queue is empty.
+bool mpmc_try_pop(mpmc_queue_t *queue, void *element) {
+    uint64_t position = __atomic_load_n(&queue->dequeue_position, __ATOMIC_RELAXED);
+    mpmc_cell_t *cell;
+    while(true) {
+        cell = cell_at(queue, position);
+        uint64_t sequence = __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE);
+        int64_t difference = (int64_t) (sequence - (position + 1));
+        if(difference == 0) {
+            if(__atomic_compare_exchange_n(&queue->dequeue_position, &position, position + 1, true,
+                                           __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if(difference < 0) {
+            // Nothing has been stored at this position yet.
+            return false;
+        } else {
+            position = __atomic_load_n(&queue->dequeue_position, __ATOMIC_RELAXED);
+        }
+    }
+    memcpy(element, cell->element, queue->element_size);
+    // Hand the cell to the producer of the same position one lap on.
+    __atomic_store_n(&cell->sequence, position + queue->mask + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+// sem_wait() that carries on after a signal handler interrupts it.
+// https://man7.org/linux/man-pages/man3/sem_wait.3.html
+static void wait_semaphore(sem_t *semaphore) {
+    while(sem_wait(semaphore) < 0 && errno == EINTR) {
+    }
+}
+
+// Copies element into the queue, waiting while it already holds its capacity. A free slot was counted before the
+// push is tried, so the ring has room for it as soon as the consumer still copying out of the cell it claimed is done,
+// which the producer yields the CPU to.
+void mpmc_push(mpmc_queue_t *queue, const void *element) {
+    wait_semaphore(&queue->slots);
+    while(!mpmc_try_push(queue, element)) {
+        sched_yield();
+    }
+    sem_post(&queue->items);
+}
+
+// Copies the oldest element out of the queue, waiting until there is one. The pop can still fail for a moment if the
+// producer that claimed the position has not stored its element yet, and is tried again (yielding the CPU, in case
+// that producer was preempted) until it has.
+void mpmc_pop(mpmc_queue_t *queue, void *element) {
+    wait_semaphore(&queue->items);
+    while(!mpmc_try_pop(queue, element)) {
+        sched_yield();
+    }
+    sem_post(&queue->slots);
+}
@@ -0,0 +1,58 @@
+//
+// Created by User on 14/10/2026.
+//
+
+#ifndef COMP30023_2022_PROJECT_2_MPMC_H
+#define COMP30023_2022_PROJECT_2_MPMC_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <errno.h>
+#include <sched.h>
+#include <semaphore.h>
+
+#define MPMC_CACHE_LINE 64
+
+// One slot of the ring. sequence says whose turn the slot is: it equals the position a producer may store at when the
+// slot is empty, and that position plus one once the element is in it for the consumer of that position.
+typedef struct mpmc_cell mpmc_cell_t;
+struct mpmc_cell {
+    uint64_t sequence;
+    max_align_t element[];
+};
+
+// Dmitry Vyukov's bounded multi-producer multi-consumer queue
+// (https://www.1024cores.net/home/lock-free-algorithms/queues/bounded-mpmc-queue). Producers claim a position with a
+// compare-and-swap on enqueue_position and consumers on dequeue_position, each kept on a cache line of its own, and
+// the cell's sequence number hands the element from the one to the other, so neither side ever takes a lock or
+// waits for a thread that was preempted half way through. Elements of element_size bytes are copied in and out.
+// The blocking calls wait on two counting semaphores instead (slots free and elements queued), which only enter the
+// kernel when there really is something to wait for.
+typedef struct mpmc_queue mpmc_queue_t;
+struct mpmc_queue {
+    char *cells;
+    size_t cell_size;
+    // The number of cells, a power of two, minus one.
+    uint64_t mask;
+    size_t element_size;
+    uint64_t enqueue_position __attribute__((aligned(MPMC_CACHE_LINE)));
+    uint64_t dequeue_position __attribute__((aligned(MPMC_CACHE_LINE)));
+    sem_t slots __attribute__((aligned(MPMC_CACHE_LINE)));
+    sem_t items;
+};
+
+bool mpmc_init(mpmc_queue_t *queue, size_t capacity, size_t element_size);
+
+bool mpmc_try_push(mpmc_queue_t *queue, const void *element);
+
+bool mpmc_try_pop(mpmc_queue_t *queue, void *element);
+
+void mpmc_push(mpmc_queue_t *queue, const void *element);
+
+void mpmc_pop(mpmc_queue_t *queue, void *element);
+
+#endif //COMP30023_2022_PROJECT_2_MPMC_H
@@ -1,131 +1,471 @@
-#include "parse.h"
-// Takes the request buffer read in from serve_connection and a pointer to the request_path string and then extracts
-// the request_path and places it into the request_path string variable. Also does checks to make sure that the format
-// of the HTTP request is appropriate. Return true if all checks are passed, return false if there is an issue
-// with the request.
-bool parse_request_path(char *request_buffer, char **request_path) {
-    // Note: From https://man7.org/linux/man-pages/man3/strtok_r.3.html, if the delimiter isn't found, then strtok will
-    // scan forward until the null terminator byte, so it will return the whole string. This will then be caught
-    // by the checks below. This function should only accept requests which are in the form "GET path HTTP/1.0\r\n\r\n"
-    // and indicate an error in any other case.
-
-    // Declare pointers used by strtok_r to internally store where to continue from between successive calls
-    // on the same string. https://man7.org/linux/man-pages/man3/strtok_r.3.html
-    char *buffer_saveptr;
-    char *request_line_saveptr;
-
-    // If something has gone wrong with getting the request line, then we return false to indicate unsuccessful
-    // parsing of the request path as well. This also catches the case where a request is an empty string "" as
-    // strtok will give NULL back.
-    char *request_line = strtok_r(request_buffer, "\r\n", &buffer_saveptr);
-    if(request_line == NULL) {
-        return false;
-    }
-    size_t request_line_size = strlen(request_line);
-
-    // Consume the GET which is the first token of strtok_r. If it's not GET then this function returns false.
-    char *HTTP_method = strtok_r(request_line, " ", &request_line_saveptr);
-    if(HTTP_method == NULL) {
-        return false;
-    }
-    if(strcmp(HTTP_method, GET_REQUEST) != SAME_STRING) {
-        return false;
-    }
-
-    // Call strtok_r again using NULL as first argument to get the second token which is the supposed file path from
-    // the request and return it. If this is not a valid file path (like say this was the method or the protocol
-    // version instead), this issue will be caught by the checks later in the program.
-    *request_path = strtok_r(NULL, " ", &request_line_saveptr);
-    if(*request_path == NULL) {
-        return false;
-    }
-
-    // Call strtok_r once again to get the HTTP protocol version of the request. If it's not HTTP/1.0, then this
-    // function returns false as well.
-    char *req_protocol_version = strtok_r(NULL, " ", &request_line_saveptr);
-    if(req_protocol_version == NULL) {
-        return false;
-    }
-    if(strcmp(req_protocol_version, PROTOCOL_VER) != SAME_STRING) {
-        return false;
-    }
-
-    // At this point, we know that the protocol version field is not empty, but we have to make sure that nothing else
-    // comes between the protocol version "HTTP/1.0" and "\r\n", the "\r\n" character was stripped away by the first
-    // strtok_r in order to get the request line. Call strlen on all the 3 tokens and add 2 more spaces
-    // (to count the space delimiters that were disposed of) and compare that to the strlen of request_line saved at
-    // the start. If the combined string length of the tokens is less than that of the request line,
-    // that means there was something between the protocol version and "\r\n" and the request is invalid.
-    size_t combined_token_size = strlen(HTTP_method) + strlen(*request_path) +
-            strlen(req_protocol_version) + TWO_SPACES;
-
-    if(combined_token_size < request_line_size) {
-        return false;
-    }
-
-    // Otherwise, at this point, everything is fine, so we return true
-    return true;
-}
-
-// Function which calls parse_request_path to obtain the request file path and then form the absolute file path
-// using the web root path passed in as a command line argument and the request file path. Returns true if no issues
-// are encountered when doing so; false otherwise.
-bool get_file_path(char **file_path, char *web_path_root, char *request_buffer) {
-    char *request_path;
-
-    // If nothing has gone wrong in parsing the request path, then also check that the request_path does not contain
-    // any escape components before creating the full file path.
-    if (parse_request_path(request_buffer, &request_path) && web_path_root != NULL) {
-        if(check_escape_request_path(request_path)) {
-            return false;
-        }
-        // Nothing is wrong with the request_path, proceed with forming the full file path.
-        size_t file_path_length = strlen(web_path_root) + strlen(request_path) + NULL_TERMINATOR_SPACE;
-
-        *file_path = (char *) malloc (file_path_length * sizeof(char));
-
-        /* Concatenate both the web_path_root and request_path into a new string variable. I was looking for a way
-           concatenate them into a new string variable with enough space instead of just concatenating request_path to
-           web_path_root and came across this code from a stackoverflow post.
-           https://stackoverflow.com/questions/8465006/how-do-i-concatenate-two-strings-in-c
-           and used it as reference. While the rest of the code is fairly similar, I wrote it before coming across the
-           post. */
-
-        // At this point, web_path_root has been verified to not be NULL (through the check above) and request_path
-        // has been checked in parse_request_path.
-        // Copy web_path_root to file_path first since it has enough space to store both strings.
-        strcpy(*file_path, web_path_root);
-        //Then concatenate the request_path to file_path which should already contain web_path_root.
-        strcat(*file_path, request_path);
-        return true;
-    // If something has gone wrong, then we indicate that we were unable to successfully create an
-    // absolute file path.
-    } else {
-        return false;
-    }
-}
-
-// Function which checks whether there is an escape component within the request path. Returns true if there is; false
-// otherwise.
-bool check_escape_request_path(char *request_path) {
-    // Check that the request path is not NULL. It shouldn't be by this point, but nothing wrong with checking again.
-    if(request_path != NULL) {
-        // Check if the request path contains "/../" at any point. strstr() returns NULL when there is no occurrences
-        // of the specified substring in the string. https://man7.org/linux/man-pages/man3/strstr.3.html
-        if(strstr(request_path, "/../") != NULL) {
-            return true;
-        }
-        // Use pointer arithmetic on request_path to get the last 3 characters and check if it's "/.." which means that
-        // it's an escape component. Before that, also check that the length of the file path has more than 3
-        // characters (strlen does not count null terminator character '\0') so the program doesn't access memory
-        // addresses illegally.
-        if(strlen(request_path) >= 3) {
-            char *last_3_char = request_path + strlen(request_path) - 3;
-            if(strcmp(last_3_char, "/..") == SAME_STRING) {
-                return true;
-            }
-        }
-    }
-    return false;
-}
-
+#include "parse.h"
+
+// Resets a parser so it expects the start of a new request at offset 0 of the buffer.
+void http_parser_init(http_parser_t *parser) {
+    parser->state = PARSER_REQUEST_START;
+    parser->position = 0;
+    parser->token_start = 0;
+    parser->value_end = 0;
+    parser->request_length = 0;
+    parser->request.num_headers = 0;
+}
+
+// Returns true if a span of buffer is equal to literal, ignoring case as header names and connection options require.
+static bool span_equals_ignore_case(const char *buffer, size_t offset, size_t length, const char *literal) {
+    return strlen(literal) == length && strncasecmp(buffer + offset, literal, length) == SAME_STRING;
+}
+
+// Bytes that may appear in a header name, the "tchar"s of https://www.rfc-editor.org/rfc/rfc9110#section-5.6.2, as a
+// table so checking a byte is a single load.
+static const bool token_chars[256] = {
+    ['0' ... '9'] = true, ['a' ... 'z'] = true, ['A' ... 'Z'] = true,
+    ['!'] = true, ['#'] = true, ['$'] = true, ['%'] = true, ['&'] = true, ['\''] = true, ['*'] = true, ['+'] = true,
+    ['-'] = true, ['.'] = true, ['^'] = true, ['_'] = true, ['`'] = true, ['|'] = true, ['~'] = true
+};
+
+static bool is_token_char(unsigned char c) {
+    return token_chars[c];
+}
+
+// Control characters other than horizontal tab are never allowed in a request line or header value.
+static bool is_control_char(unsigned char c) {
+    return (c < ' ' && c != '\t') || c == 0x7f;
+}
+
+// Looks through the value of a Connection header, which is a comma separated list of options, and records whether it
+// contains "close" or "keep-alive". Option names are case-insensitive.
+static void parse_connection_header(const char *buffer, http_span_t value, bool *close_requested,
+                                    bool *keep_alive_requested) {
+    size_t end = value.offset + value.length;
+    size_t option_start = value.offset;
+    while(option_start < end) {
+        // Skip the separators in front of the option, then find where it ends.
+        while(option_start < end && strchr(", \t", buffer[option_start]) != NULL) {
+            option_start++;
+        }
+        size_t option_end = option_start;
+        while(option_end < end && strchr(", \t", buffer[option_end]) == NULL) {
+            option_end++;
+        }
+        if(span_equals_ignore_case(buffer, option_start, option_end - option_start, CONNECTION_CLOSE)) {
+            *close_requested = true;
+        } else if(span_equals_ignore_case(buffer, option_start, option_end - option_start, CONNECTION_KEEP_ALIVE)) {
+            *keep_alive_requested = true;
+        }
+        option_start = option_end;
+    }
+}
+
+// Finds the first header called name (ignoring case) in a parsed request and stores its value in *value. Returns
+// false if the request has no such header.
+bool find_request_header(http_request_t *request, const char *buffer, const char *name, http_span_t *value) {
+    for(int i = 0; i < request->num_headers; i++) {
+        http_header_t *header = &request->headers[i];
+        if(span_equals_ignore_case(buffer, header->name.offset, header->name.length, name)) {
+            *value = header->value;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Whitespace that may surround the elements of a list in a header value.
+// https://www.rfc-editor.org/rfc/rfc9110#section-5.6.1
+static bool is_list_whitespace(char c) {
+    return c == ' ' || c == '\t';
+}
+
+// Reads the decimal number starting at buffer[*position], which ends at end at the latest, and moves *position past
+// it. Returns false if there are no digits there or the number is too big for an off_t.
+static bool parse_range_number(const char *buffer, size_t *position, size_t end, off_t *number) {
+    size_t start = *position;
+    long long value = 0;
+    while(*position < end && buffer[*position] >= '0' && buffer[*position] <= '9') {
+        int digit = buffer[*position] - '0';
+        if(value > (LLONG_MAX - digit) / 10) {
+            return false;
+        }
+        value = value * 10 + digit;
+        (*position)++;
+    }
+    *number = (off_t) value;
+    return *position > start;
+}
+
+// Returns true if the qvalue starting at buffer[position] and ending at the next separator (or end) is zero, such as
+// "0" or "0.000", which means the coding it follows is not acceptable.
+// https://www.rfc-editor.org/rfc/rfc9110#section-12.4.2
+static bool is_zero_qvalue(const char *buffer, size_t position, size_t end) {
+    if(position == end || buffer[position] != '0') {
+        return false;
+    }
+    for(position++; position < end && strchr(",; \t", buffer[position]) == NULL; position++) {
+        if(buffer[position] != '0' && buffer[position] != '.') {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Works out which of the codings the server can send a client accepts from the value of its Accept-Encoding header,
+// and returns them as a mask of ENCODING_GZIP and ENCODING_BROTLI. A coding is accepted if it is listed, or covered by
+// "*", without a weight of zero. Other weights are not compared: the server has its own order of preference.
+// https://www.rfc-editor.org/rfc/rfc9110#section-12.5.3
+int parse_accept_encoding(const char *buffer, http_span_t value) {
+    size_t end = value.offset + value.length;
+    size_t position = value.offset;
+    int accepted = 0;
+    int listed = 0;
+    bool any_accepted = false;
+    while(position < end) {
+        if(buffer[position] == ',' || is_list_whitespace(buffer[position])) {
+            position++;
+            continue;
+        }
+        size_t name_start = position;
+        while(position < end && is_token_char(buffer[position])) {
+            position++;
+        }
+        size_t name_length = position - name_start;
+
+        // The only parameter of a coding is its weight, ";q=". Anything else up to the next comma is skipped.
+        bool zero_weight = false;
+        while(position < end && buffer[position] != ',') {
+            if(buffer[position] == ';') {
+                position++;
+                while(position < end && is_list_whitespace(buffer[position])) {
+                    position++;
+                }
+                if(end - position >= 2 && (buffer[position] == 'q' || buffer[position] == 'Q') &&
+                   buffer[position + 1] == '=') {
+                    position += 2;
+                    zero_weight = is_zero_qvalue(buffer, position, end);
+                }
+            } else {
+                position++;
+            }
+        }
+
+        int coding = ENCODING_IDENTITY;
+        if(span_equals_ignore_case(buffer, name_start, name_length, GZIP_CODING)) {
+            coding = ENCODING_GZIP;
+        } else if(span_equals_ignore_case(buffer, name_start, name_length, BROTLI_CODING)) {
+            coding = ENCODING_BROTLI;
+        } else if(span_equals_ignore_case(buffer, name_start, name_length, ANY_CODING)) {
+            any_accepted = !zero_weight;
+        }
+        listed |= coding;
+        if(!zero_weight) {
+            accepted |= coding;
+        }
+    }
+    if(any_accepted) {
+        accepted |= (ENCODING_GZIP | ENCODING_BROTLI) & ~listed;
+    }
+    return accepted;
+}
+
+// Parses the value of a Range header (https://www.rfc-editor.org/rfc/rfc9110#section-14.2) for a file of file_size
+// bytes into ranges, which has room for MAX_BYTE_RANGES of them. Ranges that start past the end of the file are left
+// out and the others are cut off at the end of it. Returns how many ranges are left, which is RANGES_UNSATISFIABLE if
+// none are, so the response is a 416. Returns RANGES_IGNORED if the header should be ignored and the whole file sent
+// instead, as RFC 9110 allows: it uses a unit other than bytes, is malformed, has more than MAX_BYTE_RANGES ranges or
+// asks for more bytes in total than the file has, which only overlapping ranges can do.
+int parse_byte_ranges(const char *buffer, http_span_t value, off_t file_size, byte_range_t *ranges) {
+    size_t end = value.offset + value.length;
+    size_t position = value.offset;
+    size_t prefix_length = strlen(RANGE_UNIT_PREFIX);
+    if(value.length < prefix_length ||
+       strncasecmp(buffer + position, RANGE_UNIT_PREFIX, prefix_length) != SAME_STRING) {
+        return RANGES_IGNORED;
+    }
+    position += prefix_length;
+
+    int num_specs = 0;
+    int num_ranges = 0;
+    off_t total_length = 0;
+    while(position < end) {
+        // Skip the separators in front of the range. As in any list, empty elements are allowed.
+        if(buffer[position] == ',' || is_list_whitespace(buffer[position])) {
+            position++;
+            continue;
+        }
+        if(++num_specs > MAX_BYTE_RANGES) {
+            return RANGES_IGNORED;
+        }
+
+        off_t first;
+        off_t last = file_size - 1;
+        bool satisfiable;
+        if(buffer[position] == '-') {
+            // "-N" is the last N bytes of the file, or all of it if it is shorter than that.
+            off_t suffix_length;
+            position++;
+            if(!parse_range_number(buffer, &position, end, &suffix_length)) {
+                return RANGES_IGNORED;
+            }
+            first = suffix_length < file_size ? file_size - suffix_length : 0;
+            satisfiable = suffix_length > 0 && file_size > 0;
+        } else {
+            // "N-M" is bytes N to M, and "N-" is everything from byte N on.
+            if(!parse_range_number(buffer, &position, end, &first) || position == end || buffer[position] != '-') {
+                return RANGES_IGNORED;
+            }
+            position++;
+            if(position < end && buffer[position] >= '0' && buffer[position] <= '9') {
+                off_t requested_last;
+                if(!parse_range_number(buffer, &position, end, &requested_last) || requested_last < first) {
+                    return RANGES_IGNORED;
+                }
+                if(requested_last < last) {
+                    last = requested_last;
+                }
+            }
+            satisfiable = first < file_size;
+        }
+
+        // Nothing but whitespace may come between the range and the next comma.
+        while(position < end && is_list_whitespace(buffer[position])) {
+            position++;
+        }
+        if(position < end && buffer[position] != ',') {
+            return RANGES_IGNORED;
+        }
+
+        if(satisfiable) {
+            total_length += last - first + 1;
+            if(total_length > file_size) {
+                return RANGES_IGNORED;
+            }
+            ranges[num_ranges].first = first;
+            ranges[num_ranges].last = last;
+            num_ranges++;
+        }
+    }
+    if(num_specs == 0) {
+        return RANGES_IGNORED;
+    }
+    return num_ranges;
+}
+
+// Works out whether the connection stays open once a request is complete. The Connection header can override the
+// protocol version's default: HTTP/1.1 connections stay open unless the client sends "Connection: close", HTTP/1.0
+// ones only if it sends "Connection: keep-alive". https://www.rfc-editor.org/rfc/rfc9112#section-9.3
+static void finish_request(http_request_t *request, const char *buffer) {
+    bool close_requested = false;
+    bool keep_alive_requested = false;
+    for(int i = 0; i < request->num_headers; i++) {
+        http_header_t *header = &request->headers[i];
+        if(span_equals_ignore_case(buffer, header->name.offset, header->name.length, CONNECTION_HEADER)) {
+            parse_connection_header(buffer, header->value, &close_requested, &keep_alive_requested);
+        }
+    }
+    if(request->minor_version == 1) {
+        request->keep_alive = !close_requested;
+    } else {
+        request->keep_alive = keep_alive_requested && !close_requested;
+    }
+}
+
+// Carries on parsing the request at the front of buffer from wherever the last call stopped, looking only at the
+// bytes that arrived since. buffer_length is the number of bytes read into buffer so far; the buffer does not have to
+// be null-terminated. Returns PARSE_COMPLETE once the empty line that ends the request has been seen, with the request
+// in parser->request and its length in parser->request_length; PARSE_INCOMPLETE if more bytes are needed; or
+// PARSE_ERROR as soon as a byte shows that the request is malformed, so a bad request is turned away without waiting
+// for the rest of it. Only requests in the form "GET path HTTP/1.x\r\n", followed by headers and "\r\n", are
+// accepted.
+int http_parser_execute(http_parser_t *parser, const char *buffer, size_t buffer_length) {
+    http_request_t *request = &parser->request;
+
+    for(; parser->position < buffer_length; parser->position++) {
+        // Paths and header values make up most of a request, and almost every byte in them just moves the parser
+        // along. Skip over those many bytes at a time with the vectorised scan, so the state machine below only sees
+        // the byte that ends the run.
+        if(parser->state == PARSER_PATH || parser->state == PARSER_HEADER_VALUE) {
+            size_t run_start = parser->position;
+            unsigned char min_byte = parser->state == PARSER_PATH ? PATH_MIN_BYTE : HEADER_VALUE_MIN_BYTE;
+            parser->position += scan_to_delimiter(buffer + run_start, buffer_length - run_start, min_byte);
+            // The run can only hold spaces (not tabs), so the value ends after its last byte that is not a space.
+            if(parser->state == PARSER_HEADER_VALUE) {
+                for(size_t i = parser->position; i > run_start; i--) {
+                    if(buffer[i - 1] != ' ') {
+                        parser->value_end = i;
+                        break;
+                    }
+                }
+            }
+            if(parser->position == buffer_length) {
+                break;
+            }
+        } else if(parser->state == PARSER_HEADER_NAME) {
+            // Header names are short, so a table lookup per byte beats setting up a vector comparison.
+            while(parser->position < buffer_length && is_token_char(buffer[parser->position])) {
+                parser->position++;
+            }
+            if(parser->position == buffer_length) {
+                break;
+            }
+        }
+        unsigned char c = buffer[parser->position];
+        // Where in the method or version the parser is, for comparing them a byte at a time.
+        size_t token_index = parser->position - parser->token_start;
+
+        switch(parser->state) {
+            // Empty lines in front of a request are ignored. https://www.rfc-editor.org/rfc/rfc9112#section-2.2
+            case PARSER_REQUEST_START:
+                if(c == '\r') {
+                    parser->state = PARSER_LEADING_LF;
+                    break;
+                }
+                parser->token_start = parser->position;
+                parser->state = PARSER_METHOD;
+                token_index = 0;
+                // fall through
+            case PARSER_METHOD:
+                // The only method served is GET, so anything else fails on its first wrong byte.
+                if(token_index < strlen(GET_REQUEST)) {
+                    if(c != GET_REQUEST[token_index]) {
+                        return PARSE_ERROR;
+                    }
+                } else if(c == ' ') {
+                    request->method.offset = parser->token_start;
+                    request->method.length = token_index;
+                    parser->token_start = parser->position + 1;
+                    parser->state = PARSER_PATH;
+                } else {
+                    return PARSE_ERROR;
+                }
+                break;
+            case PARSER_LEADING_LF:
+                if(c != '\n') {
+                    return PARSE_ERROR;
+                }
+                parser->state = PARSER_REQUEST_START;
+                break;
+            case PARSER_PATH:
+                // The path runs up to the next space and has to have at least one byte.
+                if(c == ' ' && token_index > 0) {
+                    request->path.offset = parser->token_start;
+                    request->path.length = token_index;
+                    parser->token_start = parser->position + 1;
+                    parser->state = PARSER_VERSION;
+                } else if(c == ' ' || is_control_char(c) || c == '\t') {
+                    return PARSE_ERROR;
+                }
+                break;
+            case PARSER_VERSION:
+                // "HTTP/1." followed by the minor version, 0 or 1, and then the end of the request line.
+                if(token_index < strlen(PROTOCOL_VER_PREFIX)) {
+                    if(c != PROTOCOL_VER_PREFIX[token_index]) {
+                        return PARSE_ERROR;
+                    }
+                } else if(token_index == strlen(PROTOCOL_VER_PREFIX)) {
+                    if(c != '0' && c != '1') {
+                        return PARSE_ERROR;
+                    }
+                    request->minor_version = c - '0';
+                } else if(c == '\r') {
+                    request->version.offset = parser->token_start;
+                    request->version.length = token_index;
+                    parser->state = PARSER_REQUEST_LINE_LF;
+                } else {
+                    return PARSE_ERROR;
+                }
+                break;
+            case PARSER_REQUEST_LINE_LF:
+            case PARSER_HEADER_LF:
+                if(c != '\n') {
+                    return PARSE_ERROR;
+                }
+                parser->state = PARSER_HEADER_START;
+                break;
+            case PARSER_HEADER_START:
+                // An empty line ends the headers; otherwise a new header name starts here. Lines starting with
+                // whitespace (the obsolete line folding) are rejected. https://www.rfc-editor.org/rfc/rfc9112#section-5.2
+                if(c == '\r') {
+                    parser->state = PARSER_END_LF;
+                } else if(is_token_char(c)) {
+                    if(request->num_headers == MAX_REQUEST_HEADERS) {
+                        return PARSE_ERROR;
+                    }
+                    parser->token_start = parser->position;
+                    parser->state = PARSER_HEADER_NAME;
+                } else {
+                    return PARSE_ERROR;
+                }
+                break;
+            case PARSER_HEADER_NAME:
+                if(c == ':') {
+                    http_header_t *header = &request->headers[request->num_headers];
+                    header->name.offset = parser->token_start;
+                    header->name.length = token_index;
+                    parser->state = PARSER_HEADER_VALUE_START;
+                } else if(!is_token_char(c)) {
+                    return PARSE_ERROR;
+                }
+                break;
+            case PARSER_HEADER_VALUE_START:
+                // Whitespace in front of the value is not part of it.
+                if(c == ' ' || c == '\t') {
+                    break;
+                }
+                parser->token_start = parser->value_end = parser->position;
+                parser->state = PARSER_HEADER_VALUE;
+                // fall through
+            case PARSER_HEADER_VALUE:
+                if(c == '\r') {
+                    http_header_t *header = &request->headers[request->num_headers++];
+                    header->value.offset = parser->token_start;
+                    header->value.length = parser->value_end - parser->token_start;
+                    parser->state = PARSER_HEADER_LF;
+                } else if(is_control_char(c)) {
+                    return PARSE_ERROR;
+                } else if(c != ' ' && c != '\t') {
+                    // Neither is whitespace after the value.
+                    parser->value_end = parser->position + 1;
+                }
+                break;
+            case PARSER_END_LF:
+                if(c != '\n') {
+                    return PARSE_ERROR;
+                }
+                parser->position++;
+                parser->request_length = parser->position;
+                finish_request(request, buffer);
+                return PARSE_COMPLETE;
+        }
+    }
+    return PARSE_INCOMPLETE;
+}
+
+// Function which forms the file path of a parsed request: the request path without its leading slashes, which is
+// relative to the web root that every file is opened from (see resolve.c). The file path is allocated from arena, so
+// it lasts until the arena is reset at the start of the next request and is never freed by the caller. Whether the
+// path stays inside the web root is left to the kernel when the file is opened. Returns true if no issues are
+// encountered when doing so; false otherwise.
+bool get_file_path(char **file_path, const char *request_buffer, http_request_t *request, arena_t *arena) {
+    const char *request_path = request_buffer + request->path.offset;
+    size_t length = request->path.length;
+    while(length > 0 && *request_path == '/') {
+        request_path++;
+        length--;
+    }
+
+    // The request path is only a span of the request buffer, so it is copied out with a null terminator of its own.
+    *file_path = (char *) arena_alloc(arena, (length + NULL_TERMINATOR_SPACE) * sizeof(char));
+    if(*file_path == NULL) {
+        return false;
+    }
+    memcpy(*file_path, request_path, length);
+    (*file_path)[length] = '\0';
+    return true;
+}
+
+// Removes a request the parser has completed from the front of the buffer, moving any bytes of pipelined requests
+// that arrived after it to the front, and resets the parser so it goes on with them without reading again. The spans
+// in parser->request are no longer valid afterwards. *bytes_in_buffer is updated accordingly.
+void consume_request(char *buffer, int *bytes_in_buffer, http_parser_t *parser) {
+    *bytes_in_buffer -= parser->request_length;
+    memmove(buffer, buffer + parser->request_length, *bytes_in_buffer);
+    http_parser_init(parser);
+}
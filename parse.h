@@ -1,26 +1,150 @@
-//
-// Created by User on 14/5/2022.
-//
-
-#ifndef COMP30023_2022_PROJECT_2_PARSE_H
-#define COMP30023_2022_PROJECT_2_PARSE_H
-
-#include <stdlib.h>
-#include <string.h>
-#include <stdbool.h>
-
-#define NULL_TERMINATOR_SPACE 1
-#define TWO_SPACES 2
-
-#define SAME_STRING 0
-
-#define GET_REQUEST "GET"
-#define PROTOCOL_VER "HTTP/1.0"
-
-bool parse_request_path(char *request_buffer, char **request_path);
-
-bool get_file_path(char **file_path, char *web_path_root, char *request_buffer);
-
-bool check_escape_request_path(char *request_path);
-
-#endif //COMP30023_2022_PROJECT_2_PARSE_H
+//
+// Created by User on 14/5/2022.
+//
+
+#ifndef COMP30023_2022_PROJECT_2_PARSE_H
+#define COMP30023_2022_PROJECT_2_PARSE_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <strings.h>
+#include <stddef.h>
+#include <limits.h>
+#include <sys/types.h>
+
+#include "scan.h"
+#include "arena.h"
+
+#define REQUEST_MAX_BUFFER_SIZE 2000
+#define NULL_TERMINATOR_SPACE 1
+
+#define SAME_STRING 0
+
+#define GET_REQUEST "GET"
+#define PROTOCOL_VER_PREFIX "HTTP/1."
+
+#define CONNECTION_HEADER "Connection"
+#define CONNECTION_CLOSE "close"
+#define CONNECTION_KEEP_ALIVE "keep-alive"
+
+#define MAX_REQUEST_HEADERS 64
+
+#define ACCEPT_ENCODING_HEADER "Accept-Encoding"
+#define GZIP_CODING "gzip"
+#define BROTLI_CODING "br"
+#define ANY_CODING "*"
+
+// Content codings the server can send, as bits of the mask parse_accept_encoding returns.
+#define ENCODING_IDENTITY 0
+#define ENCODING_GZIP 1
+#define ENCODING_BROTLI 2
+
+#define RANGE_HEADER "Range"
+#define IF_RANGE_HEADER "If-Range"
+#define IF_NONE_MATCH_HEADER "If-None-Match"
+#define IF_MODIFIED_SINCE_HEADER "If-Modified-Since"
+#define RANGE_UNIT_PREFIX "bytes="
+// More ranges than this in one Range header are ignored and the whole file is sent instead. Real clients ask for one,
+// or a handful at most; anything longer is more likely an attempt to make the server do a lot of small sends.
+#define MAX_BYTE_RANGES 16
+
+// Results of parse_byte_ranges besides the number of satisfiable ranges.
+#define RANGES_IGNORED (-1)
+#define RANGES_UNSATISFIABLE 0
+
+// Bytes below these (and DEL) end a run of ordinary path or header value bytes for scan_to_delimiter.
+#define PATH_MIN_BYTE '!'
+#define HEADER_VALUE_MIN_BYTE ' '
+
+// Results of http_parser_execute.
+#define PARSE_INCOMPLETE 0
+#define PARSE_COMPLETE 1
+#define PARSE_ERROR 2
+
+// Where the parser is inside a request. Every state only needs the byte in front of it, so parsing can stop at the
+// end of whatever has been read so far and pick up from the same place once more bytes arrive.
+enum http_parser_state {
+    PARSER_REQUEST_START = 0,
+    PARSER_LEADING_LF,
+    PARSER_METHOD,
+    PARSER_PATH,
+    PARSER_VERSION,
+    PARSER_REQUEST_LINE_LF,
+    PARSER_HEADER_START,
+    PARSER_HEADER_NAME,
+    PARSER_HEADER_VALUE_START,
+    PARSER_HEADER_VALUE,
+    PARSER_HEADER_LF,
+    PARSER_END_LF
+};
+
+// length bytes starting offset bytes into the request buffer. Parts of a request are recorded as spans rather than
+// pointers or copies, so they stay meaningful however the buffer is later passed around, and nothing is ever copied
+// out of it while parsing.
+typedef struct http_span http_span_t;
+struct http_span {
+    size_t offset;
+    size_t length;
+};
+
+typedef struct http_header http_header_t;
+struct http_header {
+    http_span_t name;
+    // Without the whitespace around it.
+    http_span_t value;
+};
+
+// The parts of a request the server acts on, as spans into the request buffer. They are only valid until the request
+// is removed from the buffer with consume_request.
+typedef struct http_request http_request_t;
+struct http_request {
+    http_span_t method;
+    http_span_t path;
+    http_span_t version;
+    http_header_t headers[MAX_REQUEST_HEADERS];
+    int num_headers;
+    // 0 for HTTP/1.0, 1 for HTTP/1.1.
+    int minor_version;
+    // Whether the client wants the connection kept open after the response, taking the protocol version's default
+    // and any Connection header into account.
+    bool keep_alive;
+};
+
+// The bytes from first to last (both included) of a file, as asked for by one range of a Range header.
+typedef struct byte_range byte_range_t;
+struct byte_range {
+    off_t first;
+    off_t last;
+};
+
+// A resumable request parser. position is how far into the buffer the parser has looked, so every byte that arrives
+// is examined exactly once no matter how many read()s the request takes.
+typedef struct http_parser http_parser_t;
+struct http_parser {
+    enum http_parser_state state;
+    size_t position;
+    // Offset of the method, path, version, header name or header value currently being parsed.
+    size_t token_start;
+    // For header values: the end of the value so far, not counting trailing whitespace.
+    size_t value_end;
+    // Length of the request including the empty line that ends it, once it is complete.
+    size_t request_length;
+    http_request_t request;
+};
+
+void http_parser_init(http_parser_t *parser);
+
+int http_parser_execute(http_parser_t *parser, const char *buffer, size_t buffer_length);
+
+bool find_request_header(http_request_t *request, const char *buffer, const char *name, http_span_t *value);
+
+int parse_accept_encoding(const char *buffer, http_span_t value);
+
+int parse_byte_ranges(const char *buffer, http_span_t value, off_t file_size, byte_range_t *ranges);
+
+bool get_file_path(char **file_path, const char *request_buffer, http_request_t *request, arena_t *arena);
+
+void consume_request(char *buffer, int *bytes_in_buffer, http_parser_t *parser);
+
+#endif //COMP30023_2022_PROJECT_2_PARSE_H
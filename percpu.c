@@ -0,0 +1,23 @@
+//
+// Created by User on 14/10/2026.
+//
+#include "percpu.h"
+
+// Adds amount to the slot of the CPU the caller is running on. sched_getcpu() is answered from the vDSO without
+// entering the kernel, and the thread may have moved on by the time it adds, which only costs that addition its
+// locality. https://man7.org/linux/man-pages/man3/sched_getcpu.3.html
+void percpu_add(percpu_counter_t *counter, unsigned long amount) {
+    int cpu = sched_getcpu();
+    percpu_slot_t *slot = &counter->slots[cpu < 0 ? 0 : cpu & (PERCPU_SLOTS - 1)];
+    __atomic_fetch_add(&slot->value, amount, __ATOMIC_RELAXED);
+}
+
+// Returns the total of every slot. Additions made while the slots are being read may or may not be counted, which is
+// as exact as a counter being added to can be read anyway.
+unsigned long percpu_sum(percpu_counter_t *counter) {
+    unsigned long sum = 0;
+    for(int i = 0; i < PERCPU_SLOTS; i++) {
+        sum += __atomic_load_n(&counter->slots[i].value, __ATOMIC_RELAXED);
+    }
+    return sum;
+}
@@ -0,0 +1,44 @@
+//
+// Created by User on 14/10/2026.
+//
+
+#ifndef COMP30023_2022_PROJECT_2_PERCPU_H
+#define COMP30023_2022_PROJECT_2_PERCPU_H
+
+// sched_getcpu() is a GNU extension.
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <sched.h>
+
+// Number of slots a counter is split into, a power of two. CPUs past the last slot share slots with the ones before
+// them, which is still correct, just no longer free of sharing.
+#define PERCPU_SLOTS 64
+#define PERCPU_CACHE_LINE 64
+
+// One CPU's share of a counter, alone on its cache line.
+typedef struct percpu_slot percpu_slot_t;
+struct percpu_slot {
+    unsigned long value;
+} __attribute__((aligned(PERCPU_CACHE_LINE)));
+
+// A counter that every thread adds to and that is only read now and then, to be reported. Each thread adds to the
+// slot of the CPU it is running on, so threads on different CPUs never write to the same cache line, and a read adds
+// up all the slots. The additions are still atomic, since two threads can run on the same CPU one after the other
+// (and be preempted in the middle of an addition), but an atomic addition to a line that stays in one CPU's cache
+// costs next to nothing compared to one to a line every CPU is fighting over.
+typedef struct percpu_counter percpu_counter_t;
+struct percpu_counter {
+    percpu_slot_t slots[PERCPU_SLOTS];
+};
+
+void percpu_add(percpu_counter_t *counter, unsigned long amount);
+
+unsigned long percpu_sum(percpu_counter_t *counter);
+
+#endif //COMP30023_2022_PROJECT_2_PERCPU_H
@@ -0,0 +1,60 @@
+//
+// Created by User on 14/10/2026.
+//
+#include "pool.h"
+
+// The body of every worker thread. Workers live for the lifetime of the server, so unlike the old thread per
+// connection model there is no thread creation or teardown cost paid per request.
+static void *worker_main(void *worker_pool) {
+    worker_pool_t *pool = (worker_pool_t *) worker_pool;
+    void *worker_state = pool->worker_init(pool->context);
+    while(true) {
+        queued_connection_t connection;
+        mpmc_pop(&pool->queue, &connection);
+        pool->handler(&connection, pool->context, worker_state);
+    }
+    return NULL;
+}
+
+// Sets up the queue and spawns num_workers threads which will each call worker_init once and then handler for every
+// submitted socket. Returns false if memory or threads could not be allocated.
+bool worker_pool_init(worker_pool_t *pool, int num_workers, int queue_capacity, worker_init_t worker_init,
+                      connection_handler_t handler, void *context) {
+    if(!mpmc_init(&pool->queue, queue_capacity, sizeof(queued_connection_t))) {
+        return false;
+    }
+    if((pool->workers = (pthread_t *) malloc(num_workers * sizeof(pthread_t))) == NULL) {
+        perror("malloc");
+        return false;
+    }
+
+    pool->num_workers = num_workers;
+    pool->worker_init = worker_init;
+    pool->handler = handler;
+    pool->context = context;
+
+    for(int i = 0; i < num_workers; i++) {
+        int error = pthread_create(&pool->workers[i], NULL, worker_main, (void *) pool);
+        // pthread_create returns the error number instead of setting errno.
+        // https://man7.org/linux/man-pages/man3/pthread_create.3.html
+        if(error != 0) {
+            fprintf(stderr, "pthread_create: %s\n", strerror(error));
+            return false;
+        }
+    }
+    return true;
+}
+
+// Hands an accepted socket over to the workers. If every worker is busy and the queue is full, this blocks until a
+// slot frees up, which is the backpressure that stops a burst of clients from being accepted faster than they can be
+// served.
+void worker_pool_submit(worker_pool_t *pool, int newsockfd, long long accepted_at, address_count_t *address) {
+    queued_connection_t connection = {newsockfd, accepted_at, address, 0};
+    worker_pool_submit_connection(pool, &connection);
+}
+
+// Hands a connection over to the workers as it is, whether it was just accepted or is coming back to them part way
+// through. Blocks while the queue is full, like worker_pool_submit.
+void worker_pool_submit_connection(worker_pool_t *pool, const queued_connection_t *connection) {
+    mpmc_push(&pool->queue, connection);
+}
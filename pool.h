@@ -0,0 +1,57 @@
+//
+// Created by User on 14/10/2026.
+//
+
+#ifndef COMP30023_2022_PROJECT_2_POOL_H
+#define COMP30023_2022_PROJECT_2_POOL_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#include "admission.h"
+#include "mpmc.h"
+
+// Called once by each worker thread when it starts, from that thread. Whatever it returns is the worker's own state
+// (such as memory that only it uses) and is passed to every call of the connection handler that worker makes.
+typedef void *(*worker_init_t)(void *context);
+
+// A socket waiting for a worker. accepted_at is when it was accepted (or handed back), so the time it spent in the
+// queue can be counted, and address is what the connection counts against in admission_admit, for the handler to
+// release. requests_served is 0 for a connection that was just accepted, and otherwise the number of requests it was
+// served before it was handed back, such as after the large lane sent its last response.
+typedef struct queued_connection queued_connection_t;
+struct queued_connection {
+    int sockfd;
+    long long accepted_at;
+    address_count_t *address;
+    int requests_served;
+};
+
+// The function each worker runs for every socket it takes off the queue. context is whatever was passed to
+// worker_pool_init and is shared by all workers; worker_state is what worker_init returned for this worker.
+typedef void (*connection_handler_t)(queued_connection_t *connection, void *context, void *worker_state);
+
+typedef struct worker_pool worker_pool_t;
+// Accepted sockets wait for a worker in a bounded lock-free queue of queued_connection_t. The acceptor blocks when
+// it is full, which stops it from calling accept() and leaves further clients in the kernel's listen backlog, and
+// workers block when it is empty; neither side ever holds a lock the other needs while the queue is in between.
+struct worker_pool {
+    mpmc_queue_t queue;
+    pthread_t *workers;
+    int num_workers;
+    worker_init_t worker_init;
+    connection_handler_t handler;
+    void *context;
+};
+
+bool worker_pool_init(worker_pool_t *pool, int num_workers, int queue_capacity, worker_init_t worker_init,
+                      connection_handler_t handler, void *context);
+
+void worker_pool_submit(worker_pool_t *pool, int newsockfd, long long accepted_at, address_count_t *address);
+
+void worker_pool_submit_connection(worker_pool_t *pool, const queued_connection_t *connection);
+
+#endif //COMP30023_2022_PROJECT_2_POOL_H
@@ -0,0 +1,547 @@
+//
+// Created by User on 14/10/2026.
+//
+#include "preload.h"
+#include "respond.h"
+
+// The paths of every file found under the web root, relative to it.
+typedef struct path_list path_list_t;
+struct path_list {
+    char **paths;
+    int num_paths;
+    int capacity;
+};
+
+// Everything the threads building an index share. Each thread takes the next entry to work on from next until there
+// are none left.
+typedef struct preload_build preload_build_t;
+struct preload_build {
+    preload_t *preload;
+    preload_entry_t *entries;
+    int num_entries;
+    int next;
+    void (*load)(preload_build_t *build, preload_entry_t *entry);
+};
+
+static bool add_path(path_list_t *list, const char *path) {
+    if(list->num_paths == list->capacity) {
+        int capacity = list->capacity > 0 ? list->capacity * 2 : PRELOAD_INITIAL_PATHS;
+        char **paths = (char **) realloc(list->paths, capacity * sizeof(char *));
+        if(paths == NULL) {
+            perror("realloc");
+            return false;
+        }
+        list->paths = paths;
+        list->capacity = capacity;
+    }
+    if((list->paths[list->num_paths] = counted_strdup(path)) == NULL) {
+        perror("strdup");
+        return false;
+    }
+    list->num_paths++;
+    return true;
+}
+
+// Adds the path (relative to the web root, with prefix as the path of the directory) of everything in the directory
+// dirfd that could be a file to list, and walks the directories in it in turn. Symbolic links are listed as they
+// are, and opening them later follows them as long as they stay under the web root; links to directories are not
+// walked. Takes dirfd over, which stays open until the directory is closed. Returns false if memory ran out.
+static bool walk_directory(int dirfd, const char *prefix, int depth, path_list_t *list) {
+    DIR *dir = fdopendir(dirfd);
+    if(dir == NULL) {
+        perror("fdopendir");
+        close(dirfd);
+        return true;
+    }
+    bool walked = true;
+    struct dirent *entry;
+    while(walked && (entry = readdir(dir)) != NULL) {
+        if(strcmp(entry->d_name, ".") == SAME_STRING || strcmp(entry->d_name, "..") == SAME_STRING) {
+            continue;
+        }
+        char path[PATH_MAX];
+        if(snprintf(path, sizeof(path), "%s%s%s", prefix, prefix[0] != '\0' ? "/" : "", entry->d_name) >=
+           (int) sizeof(path)) {
+            continue;
+        }
+        // Not every filesystem fills in d_type. https://man7.org/linux/man-pages/man3/readdir.3.html
+        unsigned char type = entry->d_type;
+        if(type == DT_UNKNOWN) {
+            struct stat file_stat;
+            if(fstatat(dirfd, entry->d_name, &file_stat, AT_SYMLINK_NOFOLLOW) < 0) {
+                continue;
+            }
+            type = S_ISDIR(file_stat.st_mode) ? DT_DIR : S_ISREG(file_stat.st_mode) ? DT_REG :
+                   S_ISLNK(file_stat.st_mode) ? DT_LNK : DT_UNKNOWN;
+        }
+        if(type == DT_DIR && depth < PRELOAD_MAX_DEPTH) {
+            int subdirfd = openat(dirfd, entry->d_name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+            if(subdirfd >= 0) {
+                walked = walk_directory(subdirfd, path, depth + 1, list);
+            }
+        } else if(type == DT_REG || type == DT_LNK) {
+            walked = add_path(list, path);
+        }
+    }
+    closedir(dir);
+    return walked;
+}
+
+// Marks an entry as not a file after all, so it is left out of the index.
+static void drop_entry(preload_entry_t *entry) {
+    if(entry->fd != PRELOAD_NO_FILE) {
+        close(entry->fd);
+        entry->fd = PRELOAD_NO_FILE;
+    }
+    free(entry->path);
+    entry->path = NULL;
+}
+
+// Formats the headers of an entry whose size and validators are set. Returns false (after printing the reason) if they
+// do not fit, in which case the entry has to be left out rather than served with its headers cut short.
+static bool format_entry_headers(preload_entry_t *entry) {
+    size_t length = format_file_headers(entry->headers, CACHE_HEADER_MAX_SIZE, entry->path, entry->size,
+                                        &entry->validators);
+    if(length >= CACHE_HEADER_MAX_SIZE) {
+        fprintf(stderr, "%s: the response headers are too long, leaving it out.\n", entry->path);
+        return false;
+    }
+    return true;
+}
+
+// First pass over an entry: opens and fstat()s its file and works out its validators and headers. Files that will be
+// held in memory are closed again straight away, so a web root with more files than descriptors can still be indexed.
+static void open_entry(preload_build_t *build, preload_entry_t *entry) {
+    entry->fd = resolve_open(entry->path);
+    struct stat file_stat;
+    if(entry->fd < 0) {
+        entry->fd = PRELOAD_NO_FILE;
+        // Files that are not there (or lead out of the web root) are left out quietly, like any other 404.
+        if(errno != ENOENT && errno != ENOTDIR && errno != EXDEV && errno != ELOOP && errno != EACCES) {
+            perror(entry->path);
+        }
+        drop_entry(entry);
+        return;
+    }
+    if(fstat(entry->fd, &file_stat) < 0 || !S_ISREG(file_stat.st_mode)) {
+        drop_entry(entry);
+        return;
+    }
+    entry->hash = hash_string(entry->path);
+    entry->size = file_stat.st_size;
+    file_validators_init(&entry->validators, &file_stat);
+    if(!format_entry_headers(entry)) {
+        drop_entry(entry);
+        return;
+    }
+    if((size_t) entry->size <= build->preload->memory_max_file_size) {
+        close(entry->fd);
+        entry->fd = PRELOAD_NO_FILE;
+    }
+}
+
+// Second pass over an entry held in memory: reads its file into the place in the index's memory it was given. A file
+// that is no longer the size it was (the web root changed while it was being indexed) is left out.
+static void read_entry(preload_build_t *build, preload_entry_t *entry) {
+    (void) build;
+    if(entry->path == NULL || entry->data == NULL) {
+        return;
+    }
+    int fd = resolve_open(entry->path);
+    if(fd < 0) {
+        drop_entry(entry);
+        return;
+    }
+    off_t bytes_read = 0;
+    while(bytes_read < entry->size) {
+        ssize_t n = pread(fd, entry->data + bytes_read, entry->size - bytes_read, bytes_read);
+        if(n <= 0) {
+            break;
+        }
+        bytes_read += n;
+    }
+    close(fd);
+    if(bytes_read < entry->size) {
+        drop_entry(entry);
+    }
+}
+
+// The body of each thread building an index.
+static void *load_entries(void *build_arg) {
+    preload_build_t *build = (preload_build_t *) build_arg;
+    int i;
+    while((i = __atomic_fetch_add(&build->next, 1, __ATOMIC_RELAXED)) < build->num_entries) {
+        build->load(build, &build->entries[i]);
+    }
+    return NULL;
+}
+
+// Runs load on every entry, spread over the preload threads. The calling thread works as one of them, so every entry
+// is still done, only more slowly, if some of the threads could not be started.
+static void run_in_parallel(preload_build_t *build, void (*load)(preload_build_t *, preload_entry_t *)) {
+    build->load = load;
+    build->next = 0;
+    int num_threads = build->preload->threads < build->num_entries ? build->preload->threads : build->num_entries;
+    pthread_t threads[num_threads > 0 ? num_threads : 1];
+    int started = 0;
+    for(; started < num_threads - 1; started++) {
+        int error = pthread_create(&threads[started], NULL, load_entries, (void *) build);
+        if(error != 0) {
+            fprintf(stderr, "pthread_create: %s\n", strerror(error));
+            break;
+        }
+    }
+    load_entries((void *) build);
+    for(int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+}
+
+static void free_index(preload_index_t *index) {
+    for(int i = 0; i < index->num_entries; i++) {
+        // The entries of a bundle all share its descriptor, which is closed with it.
+        if(index->from_bundle) {
+            index->entries[i].fd = PRELOAD_NO_FILE;
+        }
+        drop_entry(&index->entries[i]);
+    }
+    if(index->memory != NULL) {
+        munmap(index->memory, index->memory_size);
+    }
+    if(index->from_bundle) {
+        bundle_close(&index->bundle);
+    }
+    free(index->entries);
+    free(index->slots);
+    free(index);
+}
+
+// Gives every entry small enough to be held in memory its place in one anonymous mapping. Returns false if the
+// mapping could not be made.
+static bool map_memory(preload_index_t *index) {
+    size_t memory_size = 0;
+    for(int i = 0; i < index->num_entries; i++) {
+        preload_entry_t *entry = &index->entries[i];
+        if(entry->path != NULL && entry->fd == PRELOAD_NO_FILE) {
+            memory_size += entry->size;
+        }
+    }
+    // Never empty, so that even empty files have somewhere for data to point.
+    index->memory_size = memory_size + 1;
+    index->memory = (char *) mmap(NULL, index->memory_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1,
+                                  0);
+    if(index->memory == MAP_FAILED) {
+        index->memory = NULL;
+        perror("mmap");
+        return false;
+    }
+    size_t offset = 0;
+    for(int i = 0; i < index->num_entries; i++) {
+        preload_entry_t *entry = &index->entries[i];
+        if(entry->path != NULL && entry->fd == PRELOAD_NO_FILE) {
+            entry->data = index->memory + offset;
+            offset += entry->size;
+        }
+    }
+    return true;
+}
+
+// Closes the gaps left by entries that were dropped, and builds the hash table over the rest. The table is kept at
+// most half full so probes stay short. Returns false if it could not be allocated.
+static bool build_slots(preload_index_t *index) {
+    int kept = 0;
+    for(int i = 0; i < index->num_entries; i++) {
+        if(index->entries[i].path != NULL) {
+            index->entries[kept++] = index->entries[i];
+        }
+    }
+    index->num_entries = kept;
+
+    uint64_t num_slots = PRELOAD_MIN_SLOTS;
+    while(num_slots < (uint64_t) kept * 2) {
+        num_slots *= 2;
+    }
+    if((index->slots = (int *) malloc(num_slots * sizeof(int))) == NULL) {
+        perror("malloc");
+        return false;
+    }
+    for(uint64_t slot = 0; slot < num_slots; slot++) {
+        index->slots[slot] = PRELOAD_EMPTY_SLOT;
+    }
+    index->mask = num_slots - 1;
+    for(int i = 0; i < kept; i++) {
+        uint64_t slot = index->entries[i].hash & index->mask;
+        while(index->slots[slot] != PRELOAD_EMPTY_SLOT) {
+            slot = (slot + 1) & index->mask;
+        }
+        index->slots[slot] = i;
+    }
+    return true;
+}
+
+// Walks the web root and builds a new index of it. Returns NULL (after printing the reason) if it could not be built.
+static preload_index_t *index_web_root(preload_t *preload) {
+    path_list_t list = {NULL, 0, 0};
+    int dirfd = open(preload->web_root_path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if(dirfd < 0) {
+        perror(preload->web_root_path);
+        return NULL;
+    }
+    preload_index_t *index = (preload_index_t *) calloc(1, sizeof(preload_index_t));
+    if(!walk_directory(dirfd, "", 0, &list) || index == NULL ||
+       (index->entries = (preload_entry_t *) calloc(list.num_paths > 0 ? list.num_paths : 1,
+                                                    sizeof(preload_entry_t))) == NULL) {
+        fprintf(stderr, "ERROR, ran out of memory indexing %s.\n", preload->web_root_path);
+        for(int i = 0; i < list.num_paths; i++) {
+            free(list.paths[i]);
+        }
+        free(list.paths);
+        free(index);
+        return NULL;
+    }
+    // The entries take the paths over.
+    index->num_entries = list.num_paths;
+    for(int i = 0; i < list.num_paths; i++) {
+        index->entries[i].path = list.paths[i];
+        index->entries[i].fd = PRELOAD_NO_FILE;
+    }
+    free(list.paths);
+
+    preload_build_t build = {preload, index->entries, index->num_entries, 0, NULL};
+    run_in_parallel(&build, open_entry);
+    if(!map_memory(index)) {
+        free_index(index);
+        return NULL;
+    }
+    run_in_parallel(&build, read_entry);
+    if(!build_slots(index)) {
+        free_index(index);
+        return NULL;
+    }
+    return index;
+}
+
+// Maps the bundle and builds an index of the files in it. Nothing is read or copied: small files are sent straight
+// out of the mapping, and bigger ones with sendfile() from the bundle's descriptor, starting at their offset in it.
+// Returns NULL (after printing the reason) if the bundle could not be mapped.
+static preload_index_t *index_bundle(preload_t *preload) {
+    preload_index_t *index = (preload_index_t *) calloc(1, sizeof(preload_index_t));
+    if(index == NULL) {
+        perror("calloc");
+        return NULL;
+    }
+    if(!bundle_open(&index->bundle, preload->bundle_path)) {
+        free(index);
+        return NULL;
+    }
+    index->from_bundle = true;
+    // Start reading it in now rather than on each file's first request.
+    madvise((void *) index->bundle.data, index->bundle.size, MADV_WILLNEED);
+
+    int num_records = (int) index->bundle.header->num_records;
+    if((index->entries = (preload_entry_t *) calloc(num_records > 0 ? num_records : 1,
+                                                    sizeof(preload_entry_t))) == NULL) {
+        perror("calloc");
+        free_index(index);
+        return NULL;
+    }
+    for(int i = 0; i < num_records; i++) {
+        bundle_record_t *record = &index->bundle.records[i];
+        preload_entry_t *entry = &index->entries[i];
+        entry->fd = PRELOAD_NO_FILE;
+        if((entry->path = counted_strdup(bundle_record_path(&index->bundle, record))) == NULL) {
+            perror("strdup");
+            free_index(index);
+            return NULL;
+        }
+        index->num_entries++;
+        struct stat file_stat;
+        bundle_record_stat(record, &file_stat);
+        entry->hash = hash_string(entry->path);
+        entry->size = file_stat.st_size;
+        file_validators_init(&entry->validators, &file_stat);
+        if(!format_entry_headers(entry)) {
+            drop_entry(entry);
+            continue;
+        }
+        if((size_t) entry->size <= preload->memory_max_file_size) {
+            entry->data = (char *) index->bundle.data + record->data_offset;
+        } else {
+            entry->fd = index->bundle.fd;
+            entry->offset = (off_t) record->data_offset;
+        }
+    }
+    if(!build_slots(index)) {
+        free_index(index);
+        return NULL;
+    }
+    return index;
+}
+
+// Builds a new index, of the bundle if there is one and of the web root otherwise, and locks what it holds in memory
+// if asked to. Returns NULL (after printing the reason) if it could not be built.
+static preload_index_t *build_index(preload_t *preload) {
+    struct timespec started;
+    clock_gettime(CLOCK_MONOTONIC, &started);
+    preload_index_t *index = preload->bundle_path != NULL ? index_bundle(preload) : index_web_root(preload);
+    if(index == NULL) {
+        return NULL;
+    }
+    const char *memory = index->from_bundle ? index->bundle.data : index->memory;
+    size_t memory_size = index->from_bundle ? index->bundle.size : index->memory_size;
+    if(preload->mlock && mlock(memory, memory_size) < 0) {
+        fprintf(stderr, "ERROR, could not lock the preloaded files in memory (see ulimit -l): %s\n",
+                strerror(errno));
+    }
+    index->references = 1;
+
+    struct timespec finished;
+    clock_gettime(CLOCK_MONOTONIC, &finished);
+    fprintf(stderr, "Preloaded %d files from %s (%zu KB in memory) in %.3f seconds.\n", index->num_entries,
+            preload->bundle_path != NULL ? preload->bundle_path : preload->web_root_path, memory_size / BYTES_PER_KB,
+            (double) (finished.tv_sec - started.tv_sec) + (double) (finished.tv_nsec - started.tv_nsec) / 1e9);
+    return index;
+}
+
+// Raises the soft limit on open descriptors as far as the hard limit allows, since every file too big to be held in
+// memory stays open for as long as its index is used, and a reload briefly has two indexes open.
+static void raise_file_limit(void) {
+    struct rlimit limit;
+    if(getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
+
+// Builds the first index of the web root (or of the bundle) if config asks for preloading. Has to be called before any
+// worker or loop starts, so the very first requests are already served from it. Returns false if it could not be
+// built.
+bool preload_init(preload_t *preload, server_config_t *config) {
+    preload->enabled = config->preload || config->bundle_path != NULL;
+    preload->index = NULL;
+    preload->web_root_path = config->web_root_path;
+    preload->bundle_path = config->bundle_path;
+    preload->threads = config->preload_threads;
+    preload->memory_max_file_size = (size_t) config->preload_memory_kb * BYTES_PER_KB;
+    preload->mlock = config->preload_mlock;
+    pthread_rwlock_init(&preload->lock, NULL);
+    pthread_mutex_init(&preload->reload_lock, NULL);
+    if(!preload->enabled) {
+        return true;
+    }
+    raise_file_limit();
+    return (preload->index = build_index(preload)) != NULL;
+}
+
+// Builds a new index of the web root and swaps it in for the current one, which is freed once the responses still
+// using it are done. The web root is opened again first, so a web root that is a symbolic link switched over to a
+// new deploy is picked up; a bundle is simply mapped again, picking up a new one renamed over it. If anything goes
+// wrong the current index stays. Returns false if it did.
+bool preload_reload(preload_t *preload) {
+    if(!preload->enabled) {
+        return false;
+    }
+    pthread_mutex_lock(&preload->reload_lock);
+    preload_index_t *index = NULL;
+    if(preload->bundle_path != NULL || resolve_reload(preload->web_root_path)) {
+        index = build_index(preload);
+    }
+    if(index == NULL) {
+        fprintf(stderr, "ERROR, could not reload %s, still serving the files it had before.\n",
+                preload->bundle_path != NULL ? preload->bundle_path : preload->web_root_path);
+        pthread_mutex_unlock(&preload->reload_lock);
+        return false;
+    }
+    pthread_rwlock_wrlock(&preload->lock);
+    preload_index_t *old_index = preload->index;
+    preload->index = index;
+    pthread_rwlock_unlock(&preload->lock);
+    preload_release(old_index);
+    pthread_mutex_unlock(&preload->reload_lock);
+    return true;
+}
+
+// Returns the current index with a reference to it held for the caller, who must hand it back with preload_release
+// once the response using it is done. Returns NULL if preloading is off.
+preload_index_t *preload_acquire(preload_t *preload) {
+    if(!preload->enabled) {
+        return NULL;
+    }
+    pthread_rwlock_rdlock(&preload->lock);
+    preload_index_t *index = preload->index;
+    __atomic_add_fetch(&index->references, 1, __ATOMIC_RELAXED);
+    pthread_rwlock_unlock(&preload->lock);
+    return index;
+}
+
+static preload_entry_t *find_entry(preload_index_t *index, const char *file_path) {
+    uint64_t hash = hash_string(file_path);
+    for(uint64_t slot = hash & index->mask; index->slots[slot] != PRELOAD_EMPTY_SLOT; slot = (slot + 1) & index->mask) {
+        preload_entry_t *entry = &index->entries[index->slots[slot]];
+        if(entry->hash == hash && strcmp(entry->path, file_path) == SAME_STRING) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+// Writes file_path into normalized with empty and "." components left out and every ".." taking the component before
+// it away, which is what resolving it from the web root comes to for the directories the index has (it does not walk
+// symbolic links to directories). Returns false if a ".." would leave the web root or the path does not fit.
+static bool normalize_path(const char *file_path, char *normalized) {
+    size_t length = 0;
+    const char *component = file_path;
+    while(*component != '\0') {
+        const char *end = strchr(component, '/');
+        size_t component_length = end != NULL ? (size_t) (end - component) : strlen(component);
+        if(component_length == 2 && component[0] == '.' && component[1] == '.') {
+            if(length == 0) {
+                return false;
+            }
+            while(length > 0 && normalized[length - 1] != '/') {
+                length--;
+            }
+            // Drop the '/' before the component taken away as well.
+            if(length > 0) {
+                length--;
+            }
+        } else if(component_length > 0 && !(component_length == 1 && component[0] == '.')) {
+            if(length + component_length + 2 > PATH_MAX) {
+                return false;
+            }
+            if(length > 0) {
+                normalized[length++] = '/';
+            }
+            memcpy(normalized + length, component, component_length);
+            length += component_length;
+        }
+        component += component_length;
+        if(*component == '/') {
+            component++;
+        }
+    }
+    normalized[length] = '\0';
+    return true;
+}
+
+// Returns the entry for file_path (relative to the web root) in index, or NULL if there was no regular file there when
+// the index was built. A path with "." or ".." components or doubled slashes, which the kernel would have resolved, is
+// normalized and looked up again if it is not found as it is.
+preload_entry_t *preload_lookup(preload_index_t *index, const char *file_path) {
+    preload_entry_t *entry = find_entry(index, file_path);
+    // Any such component starts after a '/' or at the start. Names that merely start with a dot, like .well-known,
+    // come out of normalizing unchanged.
+    if(entry != NULL || (file_path[0] != '.' && strstr(file_path, "/.") == NULL && strstr(file_path, "//") == NULL)) {
+        return entry;
+    }
+    char normalized[PATH_MAX];
+    return normalize_path(file_path, normalized) ? find_entry(index, normalized) : NULL;
+}
+
+// Hands back a reference obtained from preload_acquire, freeing the index if it was the last one and the index has
+// been replaced.
+void preload_release(preload_index_t *index) {
+    if(index != NULL && __atomic_sub_fetch(&index->references, 1, __ATOMIC_ACQ_REL) == 0) {
+        free_index(index);
+    }
+}
@@ -0,0 +1,112 @@
+//
+// Created by User on 14/10/2026.
+//
+
+#ifndef COMP30023_2022_PROJECT_2_PRELOAD_H
+#define COMP30023_2022_PROJECT_2_PRELOAD_H
+
+// For O_DIRECTORY and O_NOFOLLOW with openat().
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <time.h>
+
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "config.h"
+#include "arena.h"
+#include "cache.h"
+#include "validators.h"
+#include "resolve.h"
+#include "bundle.h"
+
+// Directories deeper than this under the web root are not indexed, which also keeps a directory that somehow
+// contains itself from being walked forever.
+#define PRELOAD_MAX_DEPTH 32
+// The path list grows by doubling from this many.
+#define PRELOAD_INITIAL_PATHS 256
+// The hash table of even an empty index has this many slots. A power of two, as are all bigger sizes.
+#define PRELOAD_MIN_SLOTS 256
+#define PRELOAD_NO_FILE (-1)
+#define PRELOAD_EMPTY_SLOT (-1)
+
+// One file of the web root as it was when the index was built. Small files are held in data, which points into the
+// memory of the index, bigger ones stay open in fd to be sent with sendfile(); either way headers already holds what
+// format_file_headers would make of it.
+typedef struct preload_entry preload_entry_t;
+struct preload_entry {
+    // Relative to the web root, as get_file_path makes it.
+    char *path;
+    uint64_t hash;
+    char *data;
+    int fd;
+    // Where the file starts in fd, which is the bundle's descriptor for a file inside one and the file's own otherwise.
+    off_t offset;
+    off_t size;
+    file_validators_t validators;
+    char headers[CACHE_HEADER_MAX_SIZE];
+};
+
+// An index of every regular file under the web root. It is never changed once built, so lookups take no lock; a
+// reload builds a new one and swaps it in, and the old one is freed when the last response that uses it is done.
+// Lookups are by open addressing: slots maps hash & mask to an entry, probing linearly from there.
+typedef struct preload_index preload_index_t;
+struct preload_index {
+    preload_entry_t *entries;
+    int num_entries;
+    int *slots;
+    uint64_t mask;
+    // One mapping holding every small file back to back, so it can be mlock()ed and unmapped as a whole. Memory locks
+    // do not nest, so locking each file's own allocation would leave pages another index still uses unlocked when
+    // this one is freed. https://man7.org/linux/man-pages/man2/mlock.2.html
+    char *memory;
+    size_t memory_size;
+    // An index of a bundle has the bundle mapped instead, and every entry points into it.
+    bool from_bundle;
+    bundle_t bundle;
+    // Responses still using the index, plus one while it is the current one.
+    int references;
+};
+
+typedef struct preload preload_t;
+struct preload {
+    bool enabled;
+    // Held for reading while a reference to index is taken, and for writing while index is replaced, so an index is
+    // never freed between a worker finding it and taking its reference.
+    pthread_rwlock_t lock;
+    preload_index_t *index;
+    // Only one reload runs at a time.
+    pthread_mutex_t reload_lock;
+    const char *web_root_path;
+    // The bundle served instead of the web root, or NULL.
+    const char *bundle_path;
+    int threads;
+    size_t memory_max_file_size;
+    bool mlock;
+};
+
+bool preload_init(preload_t *preload, server_config_t *config);
+
+bool preload_reload(preload_t *preload);
+
+preload_index_t *preload_acquire(preload_t *preload);
+
+preload_entry_t *preload_lookup(preload_index_t *index, const char *file_path);
+
+void preload_release(preload_index_t *index);
+
+#endif //COMP30023_2022_PROJECT_2_PRELOAD_H
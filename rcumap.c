@@ -0,0 +1,45 @@
+//
+// Created by User on 14/10/2026.
+//
+#include "rcumap.h"
+
+static rcu_map_node_t **bucket_of(rcu_map_t *map, uint64_t hash) {
+    return &map->buckets[hash % map->num_buckets];
+}
+
+// Sets up an empty map over num_buckets buckets.
+void rcu_map_init(rcu_map_t *map, rcu_map_node_t **buckets, size_t num_buckets) {
+    memset(buckets, 0, num_buckets * sizeof(rcu_map_node_t *));
+    map->buckets = buckets;
+    map->num_buckets = num_buckets;
+}
+
+// Returns the first node in the chain hash falls into, or NULL. The loads are acquire loads, pairing with the
+// release stores that publish nodes, so everything written to a node before it was inserted is visible through them.
+// Readers must be between ebr_enter and ebr_exit; writers holding their lock may call it too.
+rcu_map_node_t *rcu_map_first(rcu_map_t *map, uint64_t hash) {
+    return __atomic_load_n(bucket_of(map, hash), __ATOMIC_ACQUIRE);
+}
+
+// Returns the node after node in its chain, or NULL.
+rcu_map_node_t *rcu_map_next(rcu_map_node_t *node) {
+    return __atomic_load_n(&node->next, __ATOMIC_ACQUIRE);
+}
+
+// Publishes node at the head of its chain. Everything the readers will look at in it must be set up beforehand.
+// Must be called with the writers' lock held.
+void rcu_map_insert(rcu_map_t *map, rcu_map_node_t *node, uint64_t hash) {
+    rcu_map_node_t **bucket = bucket_of(map, hash);
+    node->next = *bucket;
+    __atomic_store_n(bucket, node, __ATOMIC_RELEASE);
+}
+
+// Unlinks node, which must be in the map, from its chain. Readers may still be on it until the next grace period,
+// so it stays untouched until it is handed to ebr_retire and reclaimed. Must be called with the writers' lock held.
+void rcu_map_remove(rcu_map_t *map, rcu_map_node_t *node, uint64_t hash) {
+    rcu_map_node_t **link = bucket_of(map, hash);
+    while(*link != node) {
+        link = &(*link)->next;
+    }
+    __atomic_store_n(link, node->next, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,45 @@
+//
+// Created by User on 14/10/2026.
+//
+
+#ifndef COMP30023_2022_PROJECT_2_RCUMAP_H
+#define COMP30023_2022_PROJECT_2_RCUMAP_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "ebr.h"
+
+// The link in a bucket's chain, embedded as the first member of whatever is kept in the map, so a node found in it
+// can be cast back to the entry it belongs to.
+typedef struct rcu_map_node rcu_map_node_t;
+struct rcu_map_node {
+    rcu_map_node_t *next;
+};
+
+// A chained hash table that is read without locks, in the manner of read-copy-update: writers (who exclude each other
+// with a lock of their own) only ever publish a fully set up node with a single release store, and unlink one with
+// another, leaving its own next pointer alone so a reader standing on it still finds the rest of the chain. Readers
+// walk the chains between ebr_enter and ebr_exit, and whatever is unlinked is only freed through ebr_retire once none
+// of them can still be looking at it. The buckets belong to the caller (usually an array inside the structure the
+// map is part of), so the map itself never allocates.
+typedef struct rcu_map rcu_map_t;
+struct rcu_map {
+    rcu_map_node_t **buckets;
+    size_t num_buckets;
+};
+
+void rcu_map_init(rcu_map_t *map, rcu_map_node_t **buckets, size_t num_buckets);
+
+rcu_map_node_t *rcu_map_first(rcu_map_t *map, uint64_t hash);
+
+rcu_map_node_t *rcu_map_next(rcu_map_node_t *node);
+
+void rcu_map_insert(rcu_map_t *map, rcu_map_node_t *node, uint64_t hash);
+
+void rcu_map_remove(rcu_map_t *map, rcu_map_node_t *node, uint64_t hash);
+
+#endif //COMP30023_2022_PROJECT_2_RCUMAP_H
@@ -0,0 +1,88 @@
+//
+// Created by User on 14/10/2026.
+//
+#include "resolve.h"
+
+// The web root, opened once at startup. Every file is looked up relative to it, so the kernel starts each lookup from
+// the web root's dentry instead of walking every component of an absolute path from "/" again.
+static int root_fd = NO_ROOT;
+
+// Cleared the first time openat2() turns out not to exist (Linux before 5.6).
+static bool openat2_available = true;
+
+// Opens the web root at web_root_path as the directory every path is resolved from. Returns false (after printing the
+// reason) if it is not a directory that can be opened.
+bool resolve_init(const char *web_root_path) {
+    root_fd = open(web_root_path, O_PATH | O_DIRECTORY | O_CLOEXEC);
+    if(root_fd < 0) {
+        perror(web_root_path);
+        return false;
+    }
+    return true;
+}
+
+// Opens web_root_path again and makes it the directory every path is resolved from from now on. dup3() puts the new
+// directory in place of the old one atomically, so lookups running at the same time use one or the other but never a
+// closed descriptor. https://man7.org/linux/man-pages/man2/dup.2.html Returns false (after printing the reason) if it
+// could not be opened, in which case the old web root stays.
+bool resolve_reload(const char *web_root_path) {
+    int fd = open(web_root_path, O_PATH | O_DIRECTORY | O_CLOEXEC);
+    if(fd < 0) {
+        perror(web_root_path);
+        return false;
+    }
+    if(dup3(fd, root_fd, O_CLOEXEC) < 0) {
+        perror("dup3");
+        close(fd);
+        return false;
+    }
+    close(fd);
+    return true;
+}
+
+// Returns true if path (relative to the web root) has a ".." component that could take it out of the web root: at
+// the start, after a '/', or on its own. Only needed when openat2() is not there to refuse such paths itself.
+bool path_escapes_root(const char *path) {
+    for(const char *component = path; component != NULL; component = strchr(component, '/')) {
+        if(*component == '/') {
+            component++;
+        }
+        if(component[0] == '.' && component[1] == '.' && (component[2] == '/' || component[2] == '\0')) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Opens path, relative to the web root, for reading. openat2() with RESOLVE_BENEATH makes the kernel refuse (with
+// EXDEV) any lookup that would leave the web root, whether through "..", an absolute path or a symbolic link pointing
+// outside it, which is a stronger check than any scan of the path could be. RESOLVE_NO_MAGICLINKS also refuses the
+// /proc style links that lead to open files. https://man7.org/linux/man-pages/man2/openat2.2.html On kernels without
+// openat2() the path is checked for ".." components instead, which is all the server ever checked before. Returns the
+// descriptor, or -1 with errno set.
+int resolve_open(const char *path) {
+#ifdef SYS_openat2
+    if(__atomic_load_n(&openat2_available, __ATOMIC_RELAXED)) {
+        struct open_how how;
+        memset(&how, 0, sizeof(how));
+        how.flags = O_RDONLY | O_CLOEXEC;
+        how.resolve = RESOLVE_BENEATH | RESOLVE_NO_MAGICLINKS;
+        int fd = (int) syscall(SYS_openat2, root_fd, path, &how, sizeof(how));
+        if(fd >= 0 || errno != ENOSYS) {
+            return fd;
+        }
+        __atomic_store_n(&openat2_available, false, __ATOMIC_RELAXED);
+    }
+#endif
+    if(path[0] == '/' || path_escapes_root(path)) {
+        errno = EXDEV;
+        return -1;
+    }
+    return openat(root_fd, path, O_RDONLY | O_CLOEXEC);
+}
+
+// stat() of path relative to the web root, for checking that a file opened with resolve_open is still the one at
+// path. Nothing is opened, so the result is only ever compared against a file that was.
+int resolve_stat(const char *path, struct stat *file_stat) {
+    return fstatat(root_fd, path, file_stat, 0);
+}
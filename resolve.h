@@ -0,0 +1,40 @@
+//
+// Created by User on 14/10/2026.
+//
+
+#ifndef COMP30023_2022_PROJECT_2_RESOLVE_H
+#define COMP30023_2022_PROJECT_2_RESOLVE_H
+
+// For O_PATH and dup3().
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#ifdef SYS_openat2
+#include <linux/openat2.h>
+#endif
+
+#define NO_ROOT (-1)
+
+bool resolve_init(const char *web_root_path);
+
+bool resolve_reload(const char *web_root_path);
+
+int resolve_open(const char *path);
+
+int resolve_stat(const char *path, struct stat *file_stat);
+
+bool path_escapes_root(const char *path);
+
+#endif //COMP30023_2022_PROJECT_2_RESOLVE_H
@@ -1,152 +1,704 @@
-//
-// Created by User on 14/5/2022.
-//
-#include "respond.h"
-
-// A function which has an argument representing the socket to send a message to and the message. Calls syscall write()
-// to send the message to the socket. Returns false in the case of an error; returns true otherwise.
-// The if(write_message() == WRITE_ERROR) statement is used across functions in this module to check if an error
-// occurred in write_message. In which case, the thread returns immediately back up to the serve_connection() function
-// which will then close the socket (drop the connection), free all memory and terminate itself.
-bool write_message(int sockfd_to_send, char *message) {
-    // Write message back
-    int n = write(sockfd_to_send, message, strlen(message));
-    if (n < 0) {
-        perror("write");
-        return WRITE_ERROR;
-    }
-    return WRITE_SUCCESSFUL;
-}
-
-// Function which has an argument representing the socket to send the HTTP response back to as well as the file_path
-// derived from the incoming HTTP request. This function does several checks to determine that the file_path is
-// valid and then writes an appropriate HTTP response depending on the circumstances. If a write error occurs or a
-// sendfile error occurs, this function will immediately exit by returning and have serve_connection close the socket
-// and free the memory as usual.
-void send_http_response(int sockfd_to_send, char *file_path) {
-    int file_path_fd;
-
-    // stat struct from standard library which will allow access to the file size
-    struct stat file_stat;
-
-    // If the file we're trying to read from does not exist, open will return -1 as per the linux manual located at
-    // https://man7.org/linux/man-pages/man2/open.2.html. Hence, if we cannot open what is located at the file path
-    // then we return a 404.
-    if((file_path_fd = open(file_path, O_RDONLY)) < 0 ) {
-        if(write_message(sockfd_to_send, "HTTP/1.0 404 Not Found\r\n\r\n") == WRITE_ERROR) {
-            return;
-        }
-        // Otherwise, the file exists, and we can use fstat to get the statistics of it.
-    } else {
-        /* Call fstat on file_path to get the statistics of the file located at file_path and then store it in the
-           stat struct file_stat declared earlier. */
-        fstat(file_path_fd, &file_stat);
-
-        // Test that the file_path leads to a regular file and not something else like a directory. The S_ISREG macro
-        // comes from the linux manual page, https://man7.org/linux/man-pages/man7/inode.7.html
-        if(S_ISREG(file_stat.st_mode)) {
-            // Write to indicate a successful get response.
-            if(write_message(sockfd_to_send, "HTTP/1.0 200 OK\r\n") == WRITE_ERROR) {
-                return;
-            }
-
-            // Write the Content-Type header first without sending the actual MIME content type
-            if(write_message(sockfd_to_send, "Content-Type: ") == WRITE_ERROR) {
-                return;
-            }
-
-            if(write_content_type(sockfd_to_send, file_path) == WRITE_ERROR) {
-                return;
-            }
-
-            // CRLF to terminate the Content-Type header line and then another CRLF to indicate the end of the headers.
-            if(write_message(sockfd_to_send, "\r\n\r\n") == WRITE_ERROR) {
-                return;
-            }
-
-            off_t file_to_send_size = file_stat.st_size;
-            off_t total_num_bytes_sent = 0;
-            off_t bytes_successfully_sent = 0;
-
-            // Benefits of sendfile(): sendfile() does it's copying from file to file in the kernel instead of the user
-            // space which is more efficient. User space operations such as read() and write() are I/O operations which
-            // require a system call as we were taught in the earlier weeks of the subject. Furthermore, as we were
-            // taught before (or explored during a tute with the tutor), doing a system call is quite expensive and
-            // hence why sendfile() is faster. This is reflected in the Linux manual page
-            // https://man7.org/linux/man-pages/man2/sendfile.2.html. Furthermore, in terms of code
-            // simplicity, there is no need to do separate calls to read the file and write the contents to the socket.
-            // There would also be no need to declare or size a buffer with consideration of the file size and to
-            // concatenate the file contents to the buffer if the approach was to have everything in a buffer and
-            // write it all at once.
-
-            // Track the bytes sent by sendfile() and make sure that all bytes are sent.
-            while(total_num_bytes_sent < file_to_send_size) {
-                // sendfile returns -1 in the case of an error or the number of bytes successfully sent as per the
-                // linux manual located at https://man7.org/linux/man-pages/man2/sendfile.2.html.
-                bytes_successfully_sent = sendfile(sockfd_to_send, file_path_fd,
-                                                   &total_num_bytes_sent, file_to_send_size);
-                // If there was no error, then we increment the total number of bytes sent.
-                if(bytes_successfully_sent >= 0) {
-                    total_num_bytes_sent += bytes_successfully_sent;
-                } else if (bytes_successfully_sent < 0) {
-                    return;
-                }
-            }
-        // Otherwise, we send back a 404 not found response as well if the file_path does not lead to a regular file.
-        } else {
-            if(write_message(sockfd_to_send, "HTTP/1.0 404 Not Found\r\n\r\n") == WRITE_ERROR) {
-                return;
-            }
-        }
-
-    }
-
-}
-
-// A function that is responsible for determining the content type and calling write_message to write it. If at any
-// point a write error occurs, then the function propagates the write error up the call stack to send_http_response.
-bool write_content_type(int sockfd_to_send, char *file_path) {
-    char *extension;
-
-    // Use strrchr to get the last occurrence of the FILE_EXTENSION_DELIMITER which is the '.' character. This deals
-    // with "false" extensions in the file_path. Handling '.' characters that are not associated with an extension
-    // is handled below.
-    extension = strrchr(file_path, FILE_EXTENSION_DELIMITER);
-
-    // If there is a '.' character found in the file_path
-    if(extension != NULL) {
-        // Among the four MIME content type the server identifies, if any of them are found, then return the MIME
-        // content type as specified by https://mimetype.io/all-types/.
-        if(strcmp(extension, HTML_EXTENSION) == SAME_STRING) {
-            if(write_message(sockfd_to_send, "text/html") == WRITE_ERROR) {
-                return WRITE_ERROR;
-            }
-        } else if (strcmp(extension, JPEG_EXTENSION) == SAME_STRING) {
-            if(write_message(sockfd_to_send, "image/jpeg") == WRITE_ERROR) {
-                return WRITE_ERROR;
-            }
-        } else if (strcmp(extension, JAVA_SCRIPT_EXTENSION) == SAME_STRING) {
-            if(write_message(sockfd_to_send, "text/javascript") == WRITE_ERROR) {
-                return WRITE_ERROR;
-            }
-        } else if (strcmp(extension, CSS_EXTENSION) == SAME_STRING) {
-            if(write_message(sockfd_to_send, "text/css") == WRITE_ERROR) {
-                return WRITE_ERROR;
-            }
-        // If there is a '.' character found in the file path, but it's either a file extension not part of
-        // the four or part of something else in the file path which is not
-        // a file extension (which we don't care about).
-        } else {
-            if(write_message(sockfd_to_send, "application/octet-stream") == WRITE_ERROR) {
-                return WRITE_ERROR;
-            }
-        }
-    // If there is no '.' character found which means no file extension.
-    } else {
-        if(write_message(sockfd_to_send, "application/octet-stream") == WRITE_ERROR) {
-            return WRITE_ERROR;
-        }
-    }
-    return WRITE_SUCCESSFUL;
-}
-
+//
+// Created by User on 14/5/2022.
+//
+#include "respond.h"
+
+// A function which has an argument representing the socket to send a message to and the message. Calls syscall write()
+// to send the message to the socket. Returns false in the case of an error; returns true otherwise.
+// Responses to requests are built in one buffer and sent by continue_http_response instead; write_message is left for
+// fixed messages such as the 404 serve_connection sends for a request it could not parse.
+bool write_message(int sockfd_to_send, char *message) {
+    // Write message back
+    int n = write(sockfd_to_send, message, strlen(message));
+    if (n < 0) {
+        perror("write");
+        return WRITE_ERROR;
+    }
+    return WRITE_SUCCESSFUL;
+}
+
+// Returns the Connection header line (including its CRLF) a response needs so the client knows whether the connection
+// stays open, or an empty string when the protocol version's default already says so. HTTP/1.1 connections are
+// persistent unless told otherwise, HTTP/1.0 ones are closed unless told otherwise.
+const char *get_connection_header(int minor_version, bool keep_alive) {
+    if(minor_version == 0 && keep_alive) {
+        return CONNECTION_KEEP_ALIVE_HEADER;
+    }
+    if(minor_version == 1 && !keep_alive) {
+        return CONNECTION_CLOSE_HEADER;
+    }
+    return "";
+}
+
+// Every 404 the server sends, by HTTP/1.0 or 1.1 and by whether the connection is kept alive. They never change, so
+// they are sent straight from here without being formatted or copied anywhere. Responses to HTTP/1.0 requests that
+// are not kept alive are exactly NOT_FOUND_RESPONSE as they always were.
+#define STATIC_RESPONSE(text) {text, sizeof(text) - NULL_TERMINATOR_SPACE}
+static const struct {
+    const char *data;
+    size_t length;
+} not_found_responses[2][2] = {
+    {STATIC_RESPONSE(NOT_FOUND_RESPONSE), STATIC_RESPONSE(NOT_FOUND_KEEP_ALIVE_1_0_RESPONSE)},
+    {STATIC_RESPONSE(NOT_FOUND_CLOSE_1_1_RESPONSE), STATIC_RESPONSE(NOT_FOUND_KEEP_ALIVE_1_1_RESPONSE)}
+};
+
+// Returns the 404 response for a request and stores its length in length.
+const char *get_not_found_response(int minor_version, bool keep_alive, size_t *length) {
+    int version = minor_version == 0 ? 0 : 1;
+    *length = not_found_responses[version][keep_alive].length;
+    return not_found_responses[version][keep_alive].data;
+}
+
+// Formats the headers that only depend on the file being sent, Content-Type, Content-Length, the Accept-Ranges that
+// tells clients they may ask for parts of it and the ETag and Last-Modified validators they can make their next
+// request conditional on, into buffer and returns their length. This is the one place these headers are written,
+// whether the body then comes from the file cache or from sendfile().
+size_t format_file_headers(char *buffer, size_t buffer_size, char *file_path, off_t file_size,
+                           file_validators_t *validators) {
+    return snprintf(buffer, buffer_size, "%sContent-Length: %lld\r\nAccept-Ranges: bytes\r\nETag: %s\r\n"
+                    "Last-Modified: %s\r\n", mime_lookup(file_path)->header, (long long) file_size,
+                    validators->etag, validators->last_modified);
+}
+
+// Formats the complete head of a 200 response into buffer and returns its length: the status line, the file headers
+// from format_file_headers, the Content-Encoding and Vary headers of a text file, the Connection header if one is
+// needed and the CRLF that ends the headers. Building the whole head in one buffer means it can be sent with a single
+// system call instead of one write() per piece.
+static size_t format_ok_response(char *buffer, size_t buffer_size, int minor_version, const char *file_headers,
+                                 const char *encoding_headers, bool keep_alive) {
+    return snprintf(buffer, buffer_size, "HTTP/1.%d 200 OK\r\n%s%s%s\r\n", minor_version, file_headers,
+                    encoding_headers, get_connection_header(minor_version, keep_alive));
+}
+
+// Adds length bytes of memory at data to the end of a response.
+static void add_memory_chunk(http_response_t *response, const char *data, size_t length) {
+    response_chunk_t *chunk = &response->chunks[response->num_chunks++];
+    chunk->data = data;
+    chunk->offset = 0;
+    chunk->length = length;
+}
+
+// Adds bytes first to last (both included) of the body being sent to the end of a response. They are sent from
+// body_data if the body is in memory and from file_fd with sendfile() otherwise.
+static void add_body_chunk(http_response_t *response, off_t first, off_t last) {
+    if(response->body_data != NULL) {
+        add_memory_chunk(response, response->body_data + first, last - first + 1);
+        return;
+    }
+    response_chunk_t *chunk = &response->chunks[response->num_chunks++];
+    chunk->data = NULL;
+    chunk->offset = response->file_offset + first;
+    chunk->length = last - first + 1;
+}
+
+// Fills in the 500 response sent in place of one whose head does not fit into RESPONSE_HEADER_MAX_SIZE, such as for a
+// file with a very long type, so a head cut short is never sent. Whatever chunks the response had are dropped.
+static void prepare_internal_error_response(http_response_t *response, int minor_version, bool keep_alive) {
+    response->num_chunks = 0;
+    size_t length = snprintf(response->headers, RESPONSE_HEADER_MAX_SIZE,
+                             "HTTP/1.%d 500 Internal Server Error\r\nContent-Length: 0\r\n%s\r\n", minor_version,
+                             get_connection_header(minor_version, keep_alive));
+    add_memory_chunk(response, response->headers, length);
+    response->status = HTTP_STATUS_INTERNAL_SERVER_ERROR;
+}
+
+// Fills in a 200 response with the whole file as its body. A file cache or preload entry already has its Content-Type
+// and Content-Length headers formatted, so only the status line and Connection header have to be put around them.
+static void prepare_full_response(http_response_t *response, char *file_path, off_t file_size, int minor_version,
+                                  bool keep_alive) {
+    char formatted_headers[RESPONSE_HEADER_MAX_SIZE];
+    const char *file_headers = formatted_headers;
+    if(response->cache_entry != NULL) {
+        file_headers = response->cache_entry->headers;
+    } else if(response->preload_entry != NULL) {
+        file_headers = response->preload_entry->headers;
+    } else if(format_file_headers(formatted_headers, RESPONSE_HEADER_MAX_SIZE, file_path, file_size,
+                                  response->validators) >= RESPONSE_HEADER_MAX_SIZE) {
+        prepare_internal_error_response(response, minor_version, keep_alive);
+        return;
+    }
+    size_t length = format_ok_response(response->headers, RESPONSE_HEADER_MAX_SIZE, minor_version, file_headers,
+                                       response->encoding_headers, keep_alive);
+    if(length >= RESPONSE_HEADER_MAX_SIZE) {
+        prepare_internal_error_response(response, minor_version, keep_alive);
+        return;
+    }
+    add_memory_chunk(response, response->headers, length);
+    add_body_chunk(response, 0, file_size - 1);
+    response->status = HTTP_STATUS_OK;
+}
+
+// Fills in the 304 response telling a client that the copy it already has is still current. It has no body, but
+// carries the validators again so the client can keep using them. https://www.rfc-editor.org/rfc/rfc9110#section-15.4.5
+static void prepare_not_modified_response(http_response_t *response, int minor_version, bool keep_alive) {
+    size_t length = snprintf(response->headers, RESPONSE_HEADER_MAX_SIZE,
+                             "HTTP/1.%d 304 Not Modified\r\nETag: %s\r\nLast-Modified: %s\r\n%s%s\r\n",
+                             minor_version, response->validators->etag, response->validators->last_modified,
+                             response->encoding_headers, get_connection_header(minor_version, keep_alive));
+    if(length >= RESPONSE_HEADER_MAX_SIZE) {
+        prepare_internal_error_response(response, minor_version, keep_alive);
+        return;
+    }
+    add_memory_chunk(response, response->headers, length);
+    response->status = HTTP_STATUS_NOT_MODIFIED;
+}
+
+// Fills in the 416 response for a Range header none of whose ranges overlap the file. Content-Range tells the client
+// how long the file really is. https://www.rfc-editor.org/rfc/rfc9110#section-15.5.17
+static void prepare_unsatisfiable_response(http_response_t *response, off_t file_size, int minor_version,
+                                           bool keep_alive) {
+    size_t length = snprintf(response->headers, RESPONSE_HEADER_MAX_SIZE,
+                             "HTTP/1.%d 416 Range Not Satisfiable\r\nContent-Range: bytes */%lld\r\n"
+                             "Content-Length: 0\r\n%s\r\n", minor_version, (long long) file_size,
+                             get_connection_header(minor_version, keep_alive));
+    if(length >= RESPONSE_HEADER_MAX_SIZE) {
+        prepare_internal_error_response(response, minor_version, keep_alive);
+        return;
+    }
+    add_memory_chunk(response, response->headers, length);
+    response->status = HTTP_STATUS_RANGE_NOT_SATISFIABLE;
+}
+
+// Fills in a 206 response with a single range of the file as its body, which is sent exactly like a whole file but
+// starting from range->first. https://www.rfc-editor.org/rfc/rfc9110#section-15.3.7
+static void prepare_single_range_response(http_response_t *response, char *file_path, off_t file_size,
+                                          byte_range_t *range, int minor_version, bool keep_alive) {
+    char file_headers[RESPONSE_HEADER_MAX_SIZE];
+    if(format_file_headers(file_headers, RESPONSE_HEADER_MAX_SIZE, file_path, range->last - range->first + 1,
+                           response->validators) >= RESPONSE_HEADER_MAX_SIZE) {
+        prepare_internal_error_response(response, minor_version, keep_alive);
+        return;
+    }
+    size_t length = snprintf(response->headers, RESPONSE_HEADER_MAX_SIZE,
+                             "HTTP/1.%d 206 Partial Content\r\n%sContent-Range: bytes %lld-%lld/%lld\r\n%s%s\r\n",
+                             minor_version, file_headers, (long long) range->first, (long long) range->last,
+                             (long long) file_size, response->encoding_headers,
+                             get_connection_header(minor_version, keep_alive));
+    if(length >= RESPONSE_HEADER_MAX_SIZE) {
+        prepare_internal_error_response(response, minor_version, keep_alive);
+        return;
+    }
+    add_memory_chunk(response, response->headers, length);
+    add_body_chunk(response, range->first, range->last);
+    response->status = HTTP_STATUS_PARTIAL_CONTENT;
+}
+
+// Fills in a 206 response with several ranges of the file as a multipart/byteranges body. Every part has a header of
+// its own naming the range it holds, and the parts are separated by boundary lines; all of these are formatted into
+// one block, response->part_headers, with the body chunks in between pointing into it. Returns false, leaving the
+// response alone, if the block could not be allocated, a part header does not fit into PART_HEADER_MAX_SIZE or the
+// head of the response does not fit into RESPONSE_HEADER_MAX_SIZE.
+// https://www.rfc-editor.org/rfc/rfc9110#section-14.6
+static bool prepare_multiple_range_response(http_response_t *response, char *file_path, off_t file_size,
+                                            byte_range_t *ranges, int num_ranges, int minor_version,
+                                            bool keep_alive) {
+    // One part header per range and the closing boundary.
+    char *part_headers = (char *) counted_malloc((num_ranges + 1) * PART_HEADER_MAX_SIZE);
+    if(part_headers == NULL) {
+        perror("malloc");
+        return false;
+    }
+
+    // The headers come first in the response, but the Content-Length in them is only known once every part header
+    // has been formatted, so the first chunk is left for them.
+    response->num_chunks = 1;
+    off_t content_length = 0;
+    for(int i = 0; i <= num_ranges; i++) {
+        char *part_header = part_headers + i * PART_HEADER_MAX_SIZE;
+        // Each boundary line is preceded by the CRLF that ends the previous part's body.
+        size_t length;
+        if(i < num_ranges) {
+            length = snprintf(part_header, PART_HEADER_MAX_SIZE,
+                              "%s--%s\r\nContent-Type: %s\r\nContent-Range: bytes %lld-%lld/%lld\r\n\r\n",
+                              i == 0 ? "" : "\r\n", MULTIPART_BOUNDARY, get_content_type(file_path),
+                              (long long) ranges[i].first, (long long) ranges[i].last, (long long) file_size);
+        } else {
+            length = snprintf(part_header, PART_HEADER_MAX_SIZE, "\r\n--%s--\r\n", MULTIPART_BOUNDARY);
+        }
+        if(length >= PART_HEADER_MAX_SIZE) {
+            free(part_headers);
+            response->num_chunks = 0;
+            return false;
+        }
+        add_memory_chunk(response, part_header, length);
+        content_length += length;
+        if(i < num_ranges) {
+            add_body_chunk(response, ranges[i].first, ranges[i].last);
+            content_length += ranges[i].last - ranges[i].first + 1;
+        }
+    }
+
+    size_t length = snprintf(response->headers, RESPONSE_HEADER_MAX_SIZE,
+                             "HTTP/1.%d 206 Partial Content\r\nContent-Type: multipart/byteranges; boundary=%s\r\n"
+                             "Content-Length: %lld\r\nAccept-Ranges: bytes\r\nETag: %s\r\nLast-Modified: %s\r\n"
+                             "%s%s\r\n", minor_version, MULTIPART_BOUNDARY, (long long) content_length,
+                             response->validators->etag, response->validators->last_modified,
+                             response->encoding_headers, get_connection_header(minor_version, keep_alive));
+    if(length >= RESPONSE_HEADER_MAX_SIZE) {
+        free(part_headers);
+        response->num_chunks = 0;
+        return false;
+    }
+    response->chunks[0].data = response->headers;
+    response->chunks[0].offset = 0;
+    response->chunks[0].length = length;
+    response->part_headers = part_headers;
+    response->status = HTTP_STATUS_PARTIAL_CONTENT;
+    return true;
+}
+
+// Counts sent bytes of a response against its chunks in order, moving current_chunk past every chunk that has now
+// been sent completely, and past empty ones (such as the body of an empty file).
+void advance_response(http_response_t *response, size_t sent) {
+    response->bytes_sent += sent;
+    while(response->current_chunk < response->num_chunks) {
+        size_t left = response->chunks[response->current_chunk].length - response->chunk_sent;
+        if(sent < left) {
+            response->chunk_sent += sent;
+            return;
+        }
+        sent -= left;
+        response->current_chunk++;
+        response->chunk_sent = 0;
+    }
+}
+
+// Finds the body for a response to file_path. With preloading on, the index of the web root is all there is to it:
+// a file is either in preload_index, returned in *preload_entry, or the response is a 404, and nothing is looked up
+// on the filesystem. Otherwise files in the file cache are returned in *cache_entry. Anything else is
+// looked up in the fd cache, which saves the open() and fstat() of a file that was sent recently, and then offered to
+// the file cache from the descriptor the fd cache already holds, so a newly cached file is not opened twice. A file
+// that is too big for the file cache is returned in *fd_entry, to be sent from the shared descriptor with sendfile().
+// Returns false if there is no regular file at file_path, in which case the response is a 404.
+static bool find_response_body(server_context_t *context, preload_index_t *preload_index, char *file_path,
+                               cache_entry_t **cache_entry, fd_cache_entry_t **fd_entry,
+                               preload_entry_t **preload_entry) {
+    *preload_entry = NULL;
+    if(preload_index != NULL) {
+        return (*preload_entry = preload_lookup(preload_index, file_path)) != NULL;
+    }
+    *cache_entry = NULL;
+    *fd_entry = NULL;
+    if((*cache_entry = file_cache_lookup(&context->file_cache, file_path)) != NULL) {
+        return true;
+    }
+
+    // If the file we're trying to read from does not exist, open will return -1 as per the linux manual located at
+    // https://man7.org/linux/man-pages/man2/open.2.html, and fd_cache_acquire returns NULL. Hence, if we cannot open
+    // what is located at the file path then we return a 404.
+    fd_cache_entry_t *opened = fd_cache_acquire(&context->fd_cache, file_path);
+    if(opened == NULL) {
+        return false;
+    }
+
+    // Test that the file_path leads to a regular file and not something else like a directory. The S_ISREG macro
+    // comes from the linux manual page, https://man7.org/linux/man-pages/man7/inode.7.html
+    // Otherwise, we send back a 404 not found response as well if the file_path does not lead to a regular file.
+    if(!S_ISREG(opened->file_stat.st_mode)) {
+        fd_cache_release(&context->fd_cache, opened);
+        return false;
+    }
+
+    if((*cache_entry = file_cache_insert(&context->file_cache, file_path, opened->fd, &opened->file_stat)) != NULL) {
+        fd_cache_release(&context->fd_cache, opened);
+        return true;
+    }
+    *fd_entry = opened;
+    return true;
+}
+
+// Function which has an argument representing the socket to send the HTTP response back to as well as the file_path
+// derived from the incoming HTTP request, the request's protocol version and whether the connection will be kept
+// open afterwards. This function does several checks to determine that the file_path is valid and then writes an
+// appropriate HTTP response depending on the circumstances, prepared in response. Returns RESPONSE_COMPLETE if the
+// whole response was sent. If a write error occurs or a sendfile error occurs, this function will immediately exit by
+// returning RESPONSE_FAILED and have serve_connection close the socket and free the memory as usual. A response of at
+// least large_size bytes is not sent at all: RESPONSE_LARGE leaves it prepared in response for the caller to send
+// (or hand on) and release. ssl is the connection's TLS session, or NULL. The response is recorded in metrics, once
+// it has been sent.
+int send_http_response(int sockfd_to_send, SSL *ssl, server_context_t *context, http_response_t *response,
+                       char *file_path, int minor_version, bool keep_alive, const char *request_buffer,
+                       http_request_t *request, request_metrics_t *metrics, size_t large_size) {
+    // The blocking path builds exactly the same response as the event loop. On a blocking socket
+    // continue_response only returns once everything has been sent (or failed), or once the send timeout
+    // (SO_SNDTIMEO) has gone by without the client taking any more of it.
+    prepare_http_response(response, context, file_path, minor_version, keep_alive, request_buffer, request);
+    metrics_start_response(metrics);
+    if(response_length(response) >= large_size) {
+        return RESPONSE_LARGE;
+    }
+    return finish_http_response(sockfd_to_send, ssl, response, metrics);
+}
+
+// Sends the whole of a prepared response, records it in metrics and releases it. Returns RESPONSE_COMPLETE or
+// RESPONSE_FAILED.
+int finish_http_response(int sockfd_to_send, SSL *ssl, http_response_t *response, request_metrics_t *metrics) {
+    int progress = continue_response(sockfd_to_send, ssl, response);
+    if(progress == RESPONSE_WOULD_BLOCK) {
+        admission_record(ADMISSION_SEND_TIMEOUT);
+    }
+    metrics_record_response(metrics, response, progress == RESPONSE_COMPLETE);
+    release_http_response(response);
+    return progress == RESPONSE_COMPLETE ? RESPONSE_COMPLETE : RESPONSE_FAILED;
+}
+
+// Returns the number of bytes of a prepared response still to be sent, headers included.
+size_t response_length(http_response_t *response) {
+    size_t length = 0;
+    for(int chunk = response->current_chunk; chunk < response->num_chunks; chunk++) {
+        length += response->chunks[chunk].length;
+    }
+    return length - response->chunk_sent;
+}
+
+// A function that is responsible for determining the MIME content type of the file at file_path, from the MIME table
+// built at startup. The returned string is never freed.
+const char *get_content_type(char *file_path) {
+    return mime_lookup(file_path)->name;
+}
+
+// Hands back whatever the body of a response comes from: a shared file descriptor, a file cache entry or a compressed
+// copy. A preload entry needs nothing handing back, as the index it is in is held until the response is released.
+static void release_body(http_response_t *response) {
+    if(response->fd_entry != NULL) {
+        fd_cache_release(response->fd_cache, response->fd_entry);
+        response->fd_entry = NULL;
+        response->file_fd = NO_FILE;
+    }
+    if(response->cache_entry != NULL) {
+        file_cache_release(response->cache, response->cache_entry);
+        response->cache_entry = NULL;
+    }
+    if(response->compressed_entry != NULL) {
+        compress_cache_release(response->compress_cache, response->compressed_entry);
+        response->compressed_entry = NULL;
+    }
+    if(response->preload_entry != NULL) {
+        response->preload_entry = NULL;
+        response->file_fd = NO_FILE;
+    }
+    response->file_offset = 0;
+    response->body_data = NULL;
+}
+
+// Makes the body of a response the file of a preload entry, from memory or from the descriptor the index keeps open.
+// The entry stays valid for as long as the response holds the index.
+static void use_preloaded_body(http_response_t *response, preload_entry_t *entry, off_t *file_size) {
+    response->body_data = entry->data;
+    response->file_fd = entry->data == NULL ? entry->fd : NO_FILE;
+    response->file_offset = entry->offset;
+    response->validators = &entry->validators;
+    *file_size = entry->size;
+}
+
+// Switches the body of a response from the file itself to an encoded copy of it, if the client accepts one and there
+// is one: a precompressed sibling such as file_path.br that is at least as new as the file, sent with sendfile(), or
+// a copy in the compress cache. Brotli is preferred to gzip as it gives smaller files. A file with neither is queued
+// to be compressed in the background and sent as it is this time. *file_size becomes the size of the new body.
+static void select_encoded_body(http_response_t *response, server_context_t *context, char *file_path,
+                                int accepted_encodings, off_t *file_size) {
+    const int encodings[] = {ENCODING_BROTLI, ENCODING_GZIP};
+    const char *suffixes[] = {BROTLI_SUFFIX, GZIP_SUFFIX};
+    const char *headers[] = {BROTLI_ENCODING_HEADERS, GZIP_ENCODING_HEADERS};
+    for(int i = 0; i < (int) (sizeof(encodings) / sizeof(encodings[0])); i++) {
+        if((accepted_encodings & encodings[i]) == 0) {
+            continue;
+        }
+        char sibling_path[PATH_MAX];
+        if(response->preload_index != NULL &&
+           snprintf(sibling_path, PATH_MAX, "%s%s", file_path, suffixes[i]) < PATH_MAX) {
+            preload_entry_t *sibling = preload_lookup(response->preload_index, sibling_path);
+            if(sibling != NULL && sibling->validators.modified_time >= response->validators->modified_time) {
+                release_body(response);
+                use_preloaded_body(response, sibling, file_size);
+                response->encoding_headers = headers[i];
+                return;
+            }
+        } else if(snprintf(sibling_path, PATH_MAX, "%s%s", file_path, suffixes[i]) < PATH_MAX) {
+            fd_cache_entry_t *sibling = fd_cache_acquire(&context->fd_cache, sibling_path);
+            if(sibling != NULL && S_ISREG(sibling->file_stat.st_mode) &&
+               sibling->file_stat.st_mtim.tv_sec >= response->validators->modified_time) {
+                release_body(response);
+                response->fd_entry = sibling;
+                response->file_fd = sibling->fd;
+                response->validators = &sibling->validators;
+                response->encoding_headers = headers[i];
+                *file_size = sibling->file_stat.st_size;
+                return;
+            }
+            if(sibling != NULL) {
+                fd_cache_release(&context->fd_cache, sibling);
+            }
+        }
+        compressed_entry_t *compressed = compress_cache_lookup(&context->compress_cache, file_path, encodings[i],
+                                                               response->validators, *file_size);
+        if(compressed != NULL) {
+            release_body(response);
+            response->compressed_entry = compressed;
+            response->body_data = compressed->data;
+            response->validators = &compressed->validators;
+            response->encoding_headers = headers[i];
+            *file_size = compressed->size;
+            return;
+        }
+    }
+}
+
+// Evaluates the If-None-Match and If-Modified-Since preconditions of a request against the validators of the file it
+// asks for. Returns true if the client's copy is still current, so the response is a 304 without a body. As RFC 9110
+// section 13.2.2 orders them, If-Modified-Since is only looked at when there is no If-None-Match, and a date that
+// cannot be parsed is ignored. https://www.rfc-editor.org/rfc/rfc9110#section-13.2.2
+static bool is_not_modified(file_validators_t *validators, const char *request_buffer, http_request_t *request) {
+    http_span_t value;
+    if(find_request_header(request, request_buffer, IF_NONE_MATCH_HEADER, &value)) {
+        return etag_list_matches(request_buffer, value, validators->etag);
+    }
+    time_t date;
+    if(find_request_header(request, request_buffer, IF_MODIFIED_SINCE_HEADER, &value) &&
+       parse_http_date(request_buffer, value, &date)) {
+        return validators->modified_time <= date;
+    }
+    return false;
+}
+
+// Returns true if the Range header of a request should be acted on. With an If-Range, that is only if the client's
+// partial copy is of exactly the current file: otherwise the ranges it wants would be spliced into a different
+// version of it, so the whole file is sent instead. If-Range holds either an entity tag or a date, which has to be
+// the file's Last-Modified exactly. https://www.rfc-editor.org/rfc/rfc9110#section-13.1.5
+static bool if_range_allows(file_validators_t *validators, const char *request_buffer, http_request_t *request) {
+    http_span_t value;
+    if(!find_request_header(request, request_buffer, IF_RANGE_HEADER, &value)) {
+        return true;
+    }
+    // Dates start with the name of a day, and "Wed" with the same letter as a weak tag's "W/", so only a quote or the
+    // whole prefix makes it a tag.
+    size_t prefix_length = strlen(WEAK_ETAG_PREFIX);
+    if((value.length > 0 && request_buffer[value.offset] == '"') ||
+       (value.length >= prefix_length &&
+        memcmp(request_buffer + value.offset, WEAK_ETAG_PREFIX, prefix_length) == SAME_STRING)) {
+        return etag_matches_strongly(request_buffer, value, validators->etag);
+    }
+    time_t date;
+    return parse_http_date(request_buffer, value, &date) && date == validators->modified_time;
+}
+
+// Non-blocking counterpart of send_http_response used by the event loop. Does everything send_http_response does up
+// to the first write (finding the file, choosing the status line and headers), but records the headers in
+// response->headers and keeps hold of the file so the bytes can be sent later, possibly over several calls to
+// continue_http_response. request is looked at for conditional and Range headers and may be NULL. Always succeeds; a
+// missing file simply becomes a 404 response without a body.
+void prepare_http_response(http_response_t *response, server_context_t *context, char *file_path, int minor_version,
+                           bool keep_alive, const char *request_buffer, http_request_t *request) {
+    cache_entry_t *cache_entry = NULL;
+    fd_cache_entry_t *fd_entry = NULL;
+    preload_entry_t *preload_entry = NULL;
+
+    response->num_chunks = 0;
+    response->current_chunk = 0;
+    response->chunk_sent = 0;
+    response->file_fd = NO_FILE;
+    response->file_offset = 0;
+    response->part_headers = NULL;
+    response->cache = &context->file_cache;
+    response->cache_entry = NULL;
+    response->fd_cache = &context->fd_cache;
+    response->fd_entry = NULL;
+    response->compress_cache = &context->compress_cache;
+    response->compressed_entry = NULL;
+    response->preload_index = preload_acquire(&context->preload);
+    response->preload_entry = NULL;
+    response->body_data = NULL;
+    response->validators = NULL;
+    response->encoding_headers = "";
+    response->bytes_sent = 0;
+
+    // A NULL file_path means get_file_path already rejected the request.
+    long long lookup_started = metrics_now();
+    bool found = file_path != NULL && find_response_body(context, response->preload_index, file_path, &cache_entry,
+                                                         &fd_entry, &preload_entry);
+    response->lookup_started = lookup_started;
+    response->lookup_time = metrics_now() - lookup_started;
+    if(!found) {
+        size_t length;
+        const char *not_found = get_not_found_response(minor_version, keep_alive, &length);
+        add_memory_chunk(response, not_found, length);
+        response->status = HTTP_STATUS_NOT_FOUND;
+        return;
+    }
+
+    // Small files that are in (or could be loaded into) the file cache are sent from memory instead.
+    off_t file_size;
+    response->cache_entry = cache_entry;
+    response->fd_entry = fd_entry;
+    if(preload_entry != NULL) {
+        response->preload_entry = preload_entry;
+        use_preloaded_body(response, preload_entry, &file_size);
+    } else if(cache_entry != NULL) {
+        file_size = cache_entry->size;
+        response->body_data = cache_entry->data;
+        response->validators = &cache_entry->validators;
+    } else {
+        response->file_fd = fd_entry->fd;
+        file_size = fd_entry->file_stat.st_size;
+        response->validators = &fd_entry->validators;
+    }
+
+    // Text files go to clients that accept it gzip or brotli compressed. This has to be settled first, since each
+    // encoding has validators (and ranges) of its own.
+    if(mime_lookup(file_path)->compressible) {
+        response->encoding_headers = VARY_HEADER;
+        http_span_t accept_encoding;
+        if(request != NULL && find_request_header(request, request_buffer, ACCEPT_ENCODING_HEADER, &accept_encoding)) {
+            select_encoded_body(response, context, file_path, parse_accept_encoding(request_buffer, accept_encoding),
+                                &file_size);
+        }
+    }
+
+    // A browser revisiting a page asks whether the copies of its files it already has are still current. If they are,
+    // a 304 with no body saves sending the file again.
+    if(request != NULL && is_not_modified(response->validators, request_buffer, request)) {
+        prepare_not_modified_response(response, minor_version, keep_alive);
+        return;
+    }
+
+    // Clients that seek in a video or resume an interrupted download ask for the part they are missing with a Range
+    // header. A Range header the server does not understand is ignored, as if it had not been sent.
+    byte_range_t ranges[MAX_BYTE_RANGES];
+    int num_ranges = RANGES_IGNORED;
+    http_span_t range_value;
+    if(request != NULL && find_request_header(request, request_buffer, RANGE_HEADER, &range_value) &&
+       if_range_allows(response->validators, request_buffer, request)) {
+        num_ranges = parse_byte_ranges(request_buffer, range_value, file_size, ranges);
+    }
+
+    if(num_ranges == RANGES_UNSATISFIABLE) {
+        prepare_unsatisfiable_response(response, file_size, minor_version, keep_alive);
+    } else if(num_ranges == 1) {
+        prepare_single_range_response(response, file_path, file_size, &ranges[0], minor_version, keep_alive);
+    } else if(num_ranges == RANGES_IGNORED ||
+              !prepare_multiple_range_response(response, file_path, file_size, ranges, num_ranges, minor_version,
+                                               keep_alive)) {
+        prepare_full_response(response, file_path, file_size, minor_version, keep_alive);
+    }
+}
+
+// Points iov at the memory chunks of a response from current_chunk up to the next file chunk (or the end), leaving
+// out whatever was already sent of the first one, and returns how many there are. *more is set if a file chunk
+// follows them.
+int gather_memory_chunks(http_response_t *response, struct iovec *iov, bool *more) {
+    int iov_count = 0;
+    int chunk = response->current_chunk;
+    size_t already_sent = response->chunk_sent;
+    for(; chunk < response->num_chunks && response->chunks[chunk].data != NULL; chunk++) {
+        iov[iov_count].iov_base = (char *) response->chunks[chunk].data + already_sent;
+        iov[iov_count].iov_len = response->chunks[chunk].length - already_sent;
+        iov_count++;
+        already_sent = 0;
+    }
+    *more = chunk < response->num_chunks;
+    return iov_count;
+}
+
+// Sends the memory chunks of a response from current_chunk up to the next file chunk (or the end) with a single
+// sendmsg(), so the head and body of a cached file, or the parts of a multipart body held in memory, normally go out
+// in one system call. When a file chunk follows, MSG_MORE tells TCP to hold the bytes back until sendfile() supplies
+// the first bytes of the file, so the two share a segment instead of the headers going out as a tiny packet of their
+// own. No more than limit bytes are sent, and when that cuts the chunks short nothing is held back, since the rest
+// may not be sent for a while. https://man7.org/linux/man-pages/man2/sendmsg.2.html
+// https://man7.org/linux/man-pages/man2/send.2.html
+static ssize_t send_memory_chunks(int sockfd_to_send, http_response_t *response, size_t limit) {
+    struct iovec iov[RESPONSE_MAX_CHUNKS];
+    bool more;
+    struct msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = iov;
+    message.msg_iovlen = gather_memory_chunks(response, iov, &more);
+    for(size_t i = 0; i < message.msg_iovlen; i++) {
+        if(iov[i].iov_len >= limit) {
+            iov[i].iov_len = limit;
+            message.msg_iovlen = i + 1;
+            return sendmsg(sockfd_to_send, &message, 0);
+        }
+        limit -= iov[i].iov_len;
+    }
+    return sendmsg(sockfd_to_send, &message, more ? MSG_MORE : 0);
+}
+
+// Sends as much of a prepared response as the socket will currently accept. Intended for non-blocking sockets: when
+// sendmsg() or sendfile() would block, the progress made so far is kept in response so the next call (after EPOLLOUT)
+// carries on from the same byte of the same chunk. No more than quantum bytes are sent (NO_QUANTUM for no limit).
+// Returns RESPONSE_COMPLETE once everything has been sent, RESPONSE_WOULD_BLOCK if the caller should wait for the
+// socket to become writable, RESPONSE_QUANTUM_USED if quantum bytes were sent and there are more, or RESPONSE_FAILED
+// if the connection should be dropped.
+int continue_http_response(int sockfd_to_send, http_response_t *response, size_t quantum) {
+    advance_response(response, 0);
+    while(response->current_chunk < response->num_chunks) {
+        if(quantum == 0) {
+            return RESPONSE_QUANTUM_USED;
+        }
+        response_chunk_t *chunk = &response->chunks[response->current_chunk];
+        size_t left = chunk->length - response->chunk_sent;
+        ssize_t n;
+        if(chunk->data != NULL) {
+            n = send_memory_chunks(sockfd_to_send, response, quantum);
+            if(n < 0) {
+                if(errno == EAGAIN || errno == EWOULDBLOCK) {
+                    return RESPONSE_WOULD_BLOCK;
+                }
+                perror("sendmsg");
+                return RESPONSE_FAILED;
+            }
+        } else {
+            // Benefits of sendfile(): sendfile() does it's copying from file to file in the kernel instead of the user
+            // space which is more efficient. User space operations such as read() and write() are I/O operations which
+            // require a system call as we were taught in the earlier weeks of the subject. Furthermore, as we were
+            // taught before (or explored during a tute with the tutor), doing a system call is quite expensive and
+            // hence why sendfile() is faster. This is reflected in the Linux manual page
+            // https://man7.org/linux/man-pages/man2/sendfile.2.html. Furthermore, in terms of code
+            // simplicity, there is no need to do separate calls to read the file and write the contents to the socket.
+            // There would also be no need to declare or size a buffer with consideration of the file size and to
+            // concatenate the file contents to the buffer if the approach was to have everything in a buffer and
+            // write it all at once.
+
+            // sendfile() starts at whatever offset it is given, so a range, or a transfer that was cut short, is sent
+            // by starting further into the file. https://man7.org/linux/man-pages/man2/sendfile.2.html
+            off_t offset = chunk->offset + response->chunk_sent;
+            n = sendfile(sockfd_to_send, response->file_fd, &offset, left < quantum ? left : quantum);
+            if(n < 0) {
+                if(errno == EAGAIN || errno == EWOULDBLOCK) {
+                    return RESPONSE_WOULD_BLOCK;
+                }
+                perror("sendfile");
+                return RESPONSE_FAILED;
+            }
+            // The file shrank while we were sending it, so the Content-Length already sent can no longer be met.
+            if(n == 0) {
+                return RESPONSE_FAILED;
+            }
+        }
+        advance_response(response, n);
+        quantum -= quantum == NO_QUANTUM ? 0 : (size_t) n;
+    }
+    return RESPONSE_COMPLETE;
+}
+
+// Sends as much of a response as the connection will take, over TLS if ssl is not NULL. Once the kernel does the
+// encryption (kTLS) the socket takes the response as it is, so it is sent with sendmsg() and sendfile() exactly as
+// over plain TCP, and only sessions without kTLS are encrypted by OpenSSL.
+int continue_response(int sockfd_to_send, SSL *ssl, http_response_t *response) {
+    if(ssl != NULL && !tls_kernel_send(ssl)) {
+        return continue_tls_response(ssl, response);
+    }
+    return continue_http_response(sockfd_to_send, response, NO_QUANTUM);
+}
+
+// Hands back the shared file descriptor, file cache entry, compressed copy or preload index held by
+// prepare_http_response, and frees the part headers of a multipart response, whether or not the response was ever
+// fully sent.
+void release_http_response(http_response_t *response) {
+    free(response->part_headers);
+    response->part_headers = NULL;
+    release_body(response);
+    preload_release(response->preload_index);
+    response->preload_index = NULL;
+}
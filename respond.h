@@ -1,40 +1,170 @@
-//
-// Created by User on 14/5/2022.
-//
-
-#ifndef COMP30023_2022_PROJECT_2_RESPOND_H
-#define COMP30023_2022_PROJECT_2_RESPOND_H
-
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-#include <unistd.h>
-#include <stdbool.h>
-
-#include <sys/sendfile.h>
-#include <sys/stat.h>
-#include <sys/types.h>
-#include <fcntl.h>
-#include <pthread.h>
-
-#define FILE_EXTENSION_DELIMITER '.'
-#define HTML_EXTENSION ".html"
-#define JPEG_EXTENSION ".jpg"
-#define CSS_EXTENSION ".css"
-#define JAVA_SCRIPT_EXTENSION ".js"
-
-#define ZERO_OFFSET 1
-#define NULL_TERMINATOR_SPACE 1
-
-#define WRITE_ERROR 0
-#define WRITE_SUCCESSFUL 1
-
-#define SAME_STRING 0
-
-bool write_message(int sockfd_to_send, char *message);
-
-void send_http_response(int sockfd_to_send, char *file_path);
-
-bool write_content_type(int sockfd_to_send, char *file_path);
-
-#endif //COMP30023_2022_PROJECT_2_RESPOND_H
+//
+// Created by User on 14/5/2022.
+//
+
+#ifndef COMP30023_2022_PROJECT_2_RESPOND_H
+#define COMP30023_2022_PROJECT_2_RESPOND_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include <limits.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+
+#include "context.h"
+#include "parse.h"
+#include "mime.h"
+#include "tls.h"
+#include "metrics.h"
+#include "admission.h"
+
+// Responses for text files, which may be compressed, say that they depend on Accept-Encoding so shared caches keep the
+// encodings apart. https://www.rfc-editor.org/rfc/rfc9110#section-12.5.5
+#define VARY_HEADER "Vary: Accept-Encoding\r\n"
+#define GZIP_ENCODING_HEADERS "Content-Encoding: gzip\r\n" VARY_HEADER
+#define BROTLI_ENCODING_HEADERS "Content-Encoding: br\r\n" VARY_HEADER
+
+#define NOT_FOUND_RESPONSE "HTTP/1.0 404 Not Found\r\n\r\n"
+#define CONNECTION_KEEP_ALIVE_HEADER "Connection: keep-alive\r\n"
+#define CONNECTION_CLOSE_HEADER "Connection: close\r\n"
+// The other 404s also need a Content-Length of 0, so a client whose connection stays open knows where the (empty) body
+// ends.
+#define NOT_FOUND_HEADERS "404 Not Found\r\nContent-Length: 0\r\n"
+#define NOT_FOUND_KEEP_ALIVE_1_0_RESPONSE "HTTP/1.0 " NOT_FOUND_HEADERS CONNECTION_KEEP_ALIVE_HEADER "\r\n"
+#define NOT_FOUND_CLOSE_1_1_RESPONSE "HTTP/1.1 " NOT_FOUND_HEADERS CONNECTION_CLOSE_HEADER "\r\n"
+#define NOT_FOUND_KEEP_ALIVE_1_1_RESPONSE "HTTP/1.1 " NOT_FOUND_HEADERS "\r\n"
+
+#define ZERO_OFFSET 1
+#define NULL_TERMINATOR_SPACE 1
+
+#define WRITE_ERROR 0
+#define WRITE_SUCCESSFUL 1
+
+#define SAME_STRING 0
+
+#define RESPONSE_HEADER_MAX_SIZE 512
+#define NO_FILE (-1)
+
+// The status codes of the responses the server sends.
+#define HTTP_STATUS_OK 200
+#define HTTP_STATUS_PARTIAL_CONTENT 206
+#define HTTP_STATUS_NOT_MODIFIED 304
+#define HTTP_STATUS_NOT_FOUND 404
+#define HTTP_STATUS_RANGE_NOT_SATISFIABLE 416
+#define HTTP_STATUS_INTERNAL_SERVER_ERROR 500
+
+// Separates the parts of a multipart/byteranges response. It only has to be a string that does not turn up in the
+// files being served. https://www.rfc-editor.org/rfc/rfc9110#section-14.6
+#define MULTIPART_BOUNDARY "COMP30023_BYTERANGES_BOUNDARY"
+// Room for the boundary line, Content-Type and Content-Range of one part.
+#define PART_HEADER_MAX_SIZE 192
+// The headers, then a part header and a body chunk for each range, then the closing boundary.
+#define RESPONSE_MAX_CHUNKS (2 * MAX_BYTE_RANGES + 2)
+
+#define RESPONSE_COMPLETE 0
+#define RESPONSE_WOULD_BLOCK 1
+#define RESPONSE_FAILED 2
+// Only returned when the bytes a call may send are limited, or the response is too large to be sent where it was
+// prepared.
+#define RESPONSE_QUANTUM_USED 3
+#define RESPONSE_LARGE 4
+// The quantum of a call that may send everything.
+#define NO_QUANTUM SIZE_MAX
+
+// One piece of a response body: length bytes of memory at data or, if data is NULL, length bytes of the response's
+// file starting at offset, which are sent with sendfile().
+typedef struct response_chunk response_chunk_t;
+struct response_chunk {
+    const char *data;
+    off_t offset;
+    size_t length;
+};
+
+// A response that can be sent in several goes on a non-blocking socket. The status line and headers are formatted
+// up front into headers, and the response is then a list of chunks: the headers, followed by the body, or by each
+// part of a multipart/byteranges body with its own part header. The body comes either straight from file_fd (the
+// descriptor of fd_entry, shared through the fd cache, which may be a precompressed sibling of the file) with
+// sendfile() or from body_data, the memory of a file cache entry or of a compressed copy in the compress cache.
+// current_chunk and chunk_sent record how far the transfer got, so it can be resumed when the socket becomes writable
+// again.
+typedef struct http_response http_response_t;
+struct http_response {
+    char headers[RESPONSE_HEADER_MAX_SIZE];
+    response_chunk_t chunks[RESPONSE_MAX_CHUNKS];
+    int num_chunks;
+    int current_chunk;
+    size_t chunk_sent;
+    int file_fd;
+    // Where the body starts in file_fd, which is only ever not 0 for a file inside a bundle.
+    off_t file_offset;
+    // The part headers of a multipart/byteranges response, or NULL.
+    char *part_headers;
+    file_cache_t *cache;
+    cache_entry_t *cache_entry;
+    fd_cache_t *fd_cache;
+    fd_cache_entry_t *fd_entry;
+    compress_cache_t *compress_cache;
+    compressed_entry_t *compressed_entry;
+    // With preloading on, the index held for the whole response, and the entry of it whose body is being sent, or
+    // NULL once the body comes from elsewhere (a compressed copy).
+    preload_index_t *preload_index;
+    preload_entry_t *preload_entry;
+    const char *body_data;
+    // The validators of the body being sent, held by whichever of the entries above it comes from.
+    file_validators_t *validators;
+    // Content-Encoding and Vary for text files, or an empty string.
+    const char *encoding_headers;
+
+    // What the metrics record about the response: its status code, the bytes sent so far, and when finding the file
+    // started and the nanoseconds it took (0 unless metrics are turned on).
+    int status;
+    size_t bytes_sent;
+    long long lookup_started;
+    long long lookup_time;
+};
+
+bool write_message(int sockfd_to_send, char *message);
+
+int send_http_response(int sockfd_to_send, SSL *ssl, server_context_t *context, http_response_t *response,
+                       char *file_path, int minor_version, bool keep_alive, const char *request_buffer,
+                       http_request_t *request, request_metrics_t *metrics, size_t large_size);
+
+int finish_http_response(int sockfd_to_send, SSL *ssl, http_response_t *response, request_metrics_t *metrics);
+
+size_t response_length(http_response_t *response);
+
+const char *get_connection_header(int minor_version, bool keep_alive);
+
+const char *get_not_found_response(int minor_version, bool keep_alive, size_t *length);
+
+size_t format_file_headers(char *buffer, size_t buffer_size, char *file_path, off_t file_size,
+                           file_validators_t *validators);
+
+const char *get_content_type(char *file_path);
+
+void prepare_http_response(http_response_t *response, server_context_t *context, char *file_path, int minor_version,
+                           bool keep_alive, const char *request_buffer, http_request_t *request);
+
+void advance_response(http_response_t *response, size_t sent);
+
+int gather_memory_chunks(http_response_t *response, struct iovec *iov, bool *more);
+
+int continue_http_response(int sockfd_to_send, http_response_t *response, size_t quantum);
+
+int continue_response(int sockfd_to_send, SSL *ssl, http_response_t *response);
+
+void release_http_response(http_response_t *response);
+
+#endif //COMP30023_2022_PROJECT_2_RESPOND_H
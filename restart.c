@@ -0,0 +1,314 @@
+//
+// Created by User on 15/10/2026.
+//
+#include "restart.h"
+
+// A server stops accepting connections and drains the ones it has either when it gets SIGTERM or when a successor
+// started with the same --handoff path has taken over its listening sockets. Every engine watches drain_fd, an
+// eventfd that becomes readable (and stays readable) once draining starts, so none of them has to check anything
+// while it is not.
+static struct {
+    bool draining;
+    int drain_fd;
+    pthread_mutex_t lock;
+    pthread_cond_t drain_started;
+    // The connection to the server whose listening sockets this one took over, until it is told this one is ready,
+    // or -1.
+    int predecessor;
+    // The Unix socket successors connect to, and the sockets they are handed.
+    int handoff_fd;
+    int *listenfds;
+    int num_listeners;
+    pthread_t handoff_thread;
+} restart = {false, -1, PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, -1, -1, NULL, 0, 0};
+
+// CLOCK_MONOTONIC in milliseconds.
+static long long monotonic_ms(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000LL + now.tv_nsec / 1000000;
+}
+
+static void sleep_ms(int milliseconds) {
+    struct timespec interval = {milliseconds / 1000, (milliseconds % 1000) * 1000000L};
+    nanosleep(&interval, NULL);
+}
+
+// Fills in the address of the --handoff socket at path. Returns false if the path does not fit.
+static bool handoff_address(const char *path, struct sockaddr_un *address) {
+    memset(address, 0, sizeof(*address));
+    address->sun_family = AF_UNIX;
+    if(strlen(path) >= sizeof(address->sun_path)) {
+        fprintf(stderr, "ERROR, the handoff socket path is too long: %s\n", path);
+        return false;
+    }
+    strcpy(address->sun_path, path);
+    return true;
+}
+
+// With --handoff, asks the server already running with the same path for its listening sockets and stores them in
+// listenfds, setting inherited. If no server is listening on the path, inherited is cleared and the sockets have to
+// be created as usual. The connection is kept open until restart_ready tells the old server to drain, so if this one
+// fails to start the old one simply carries on. Returns false if a server was found but its sockets could not be
+// taken over, such as when it has a different number of listeners.
+// https://man7.org/linux/man-pages/man7/unix.7.html
+bool restart_inherit_listeners(server_config_t *config, int *listenfds, bool *inherited) {
+    *inherited = false;
+    if(config->handoff_path == NULL) {
+        return true;
+    }
+    struct sockaddr_un address;
+    if(!handoff_address(config->handoff_path, &address)) {
+        return false;
+    }
+    int sockfd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if(sockfd < 0) {
+        perror("socket");
+        return false;
+    }
+    // A socket file left behind by a server that is no longer running refuses the connection.
+    if(connect(sockfd, (struct sockaddr *) &address, sizeof(address)) < 0) {
+        close(sockfd);
+        if(errno == ENOENT || errno == ECONNREFUSED) {
+            return true;
+        }
+        perror(config->handoff_path);
+        return false;
+    }
+
+    // The old server sends how many sockets it has, with the sockets themselves attached.
+    uint32_t num_listeners;
+    struct iovec iov = {&num_listeners, sizeof(num_listeners)};
+    size_t control_size = CMSG_SPACE(RESTART_MAX_LISTENERS * sizeof(int));
+    char *control = (char *) malloc(control_size);
+    if(control == NULL) {
+        perror("malloc");
+        close(sockfd);
+        return false;
+    }
+    struct msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = control_size;
+    ssize_t received = recvmsg(sockfd, &message, MSG_CMSG_CLOEXEC | MSG_WAITALL);
+    struct cmsghdr *header = CMSG_FIRSTHDR(&message);
+    int num_received = 0;
+    int *received_fds = NULL;
+    if(header != NULL && header->cmsg_level == SOL_SOCKET && header->cmsg_type == SCM_RIGHTS) {
+        num_received = (int) ((header->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+        received_fds = (int *) CMSG_DATA(header);
+    }
+    bool usable = received == sizeof(num_listeners) && num_received == (int) num_listeners &&
+                  num_received == config->listeners;
+    if(usable) {
+        memcpy(listenfds, received_fds, num_received * sizeof(int));
+        restart.predecessor = sockfd;
+        *inherited = true;
+    } else {
+        if(received < 0) {
+            perror("recvmsg");
+        } else {
+            fprintf(stderr, "ERROR, the server on %s has %d listening sockets, but --listeners is %d.\n",
+                    config->handoff_path, num_received, config->listeners);
+        }
+        for(int i = 0; i < num_received; i++) {
+            close(received_fds[i]);
+        }
+        close(sockfd);
+    }
+    free(control);
+    return usable;
+}
+
+// Creates the eventfd the engines watch to know when to stop accepting. Has to be called before any engine starts.
+// Returns false if it could not be created.
+bool restart_init(void) {
+    if((restart.drain_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)) < 0) {
+        perror("eventfd");
+        return false;
+    }
+    return true;
+}
+
+// Starts draining: the engines stop accepting, close their idle connections and stop keeping connections alive, and
+// restart_wait returns once the rest have closed. Called from the signal thread on SIGTERM and from the handoff
+// thread once a successor is ready. Draining more than once changes nothing.
+void restart_drain(void) {
+    pthread_mutex_lock(&restart.lock);
+    if(!restart.draining) {
+        __atomic_store_n(&restart.draining, true, __ATOMIC_RELAXED);
+        uint64_t one = 1;
+        if(write(restart.drain_fd, &one, sizeof(one)) < 0) {
+            perror("write");
+        }
+        pthread_cond_broadcast(&restart.drain_started);
+    }
+    pthread_mutex_unlock(&restart.lock);
+}
+
+bool restart_draining(void) {
+    return __atomic_load_n(&restart.draining, __ATOMIC_RELAXED);
+}
+
+int restart_drain_fd(void) {
+    return restart.drain_fd;
+}
+
+// Hands the listening sockets to a successor connected to the handoff socket. Returns false if they could not be
+// sent.
+static bool send_listeners(int sockfd) {
+    uint32_t num_listeners = (uint32_t) restart.num_listeners;
+    struct iovec iov = {&num_listeners, sizeof(num_listeners)};
+    size_t control_size = CMSG_SPACE(restart.num_listeners * sizeof(int));
+    char *control = (char *) calloc(1, control_size);
+    if(control == NULL) {
+        perror("calloc");
+        return false;
+    }
+    struct msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = control_size;
+    struct cmsghdr *header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(restart.num_listeners * sizeof(int));
+    memcpy(CMSG_DATA(header), restart.listenfds, restart.num_listeners * sizeof(int));
+    bool sent = sendmsg(sockfd, &message, MSG_NOSIGNAL) == sizeof(num_listeners);
+    if(!sent) {
+        perror("sendmsg");
+    }
+    free(control);
+    return sent;
+}
+
+// Whether the process on the other end of sockfd belongs to the user the server runs as (or the server runs as root),
+// since whoever takes the listening sockets also stops this server.
+static bool trusted_peer(int sockfd) {
+    struct ucred credentials;
+    socklen_t length = sizeof(credentials);
+    if(getsockopt(sockfd, SOL_SOCKET, SO_PEERCRED, &credentials, &length) < 0) {
+        perror("getsockopt");
+        return false;
+    }
+    return credentials.uid == geteuid() || geteuid() == 0;
+}
+
+// Waits for the successor on sockfd to say it is accepting on the sockets it was handed. Returns false if it closes
+// the connection, sends anything else or has not said so within RESTART_READY_TIMEOUT seconds, so a successor that
+// hangs while starting cannot keep the handoff socket from taking the next one.
+static bool successor_ready(int sockfd) {
+    struct timeval timeout = {RESTART_READY_TIMEOUT, 0};
+    if(setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) < 0) {
+        perror("setsockopt");
+        return false;
+    }
+    char ready;
+    ssize_t received = read(sockfd, &ready, 1);
+    if(received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        fprintf(stderr, "The successor was not ready within %d seconds, keeping the listening sockets.\n",
+                RESTART_READY_TIMEOUT);
+    } else if(received < 0) {
+        perror("read");
+    }
+    return received == 1 && ready == RESTART_READY_BYTE;
+}
+
+// The body of the handoff thread. Each successor that connects is sent the listening sockets, and the server drains
+// once one says it is accepting on them. The old server keeps accepting alongside it until then, so connections keep
+// being served however long the successor takes to start (preloading the web root, for one). A successor that exits
+// without saying so, or does not say so in time, leaves the server running as if nothing happened.
+static void *hand_off_listeners(void *unused) {
+    while(true) {
+        int sockfd = accept4(restart.handoff_fd, NULL, NULL, SOCK_CLOEXEC);
+        if(sockfd < 0) {
+            if(errno != EINTR) {
+                perror("accept");
+            }
+            continue;
+        }
+        if(trusted_peer(sockfd) && send_listeners(sockfd) && successor_ready(sockfd)) {
+            close(sockfd);
+            // The successor has put its own socket at the path by now, so it is left alone.
+            close(restart.handoff_fd);
+            fprintf(stderr, "Listening sockets handed over, draining.\n");
+            restart_drain();
+            return NULL;
+        }
+        close(sockfd);
+    }
+    return NULL;
+}
+
+// Called once the engines are accepting connections. Tells the server these listening sockets were taken over from
+// (if any) to drain, and with --handoff puts a socket at the path for the next successor and starts the thread that
+// waits for it. The successor binds the path only now, so until it is ready the old server can still be restarted.
+// Returns false if the handoff socket could not be set up.
+bool restart_ready(server_config_t *config, int *listenfds) {
+    if(restart.predecessor >= 0) {
+        char ready = RESTART_READY_BYTE;
+        if(write(restart.predecessor, &ready, 1) != 1) {
+            perror("write");
+        }
+        close(restart.predecessor);
+        restart.predecessor = -1;
+    }
+    if(config->handoff_path == NULL) {
+        return true;
+    }
+    if(config->listeners > RESTART_MAX_LISTENERS) {
+        fprintf(stderr, "ERROR, no more than %d listening sockets can be handed over.\n", RESTART_MAX_LISTENERS);
+        return false;
+    }
+    restart.listenfds = listenfds;
+    restart.num_listeners = config->listeners;
+
+    struct sockaddr_un address;
+    if(!handoff_address(config->handoff_path, &address)) {
+        return false;
+    }
+    if((restart.handoff_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0) {
+        perror("socket");
+        return false;
+    }
+    // Whatever is at the path belongs to the server that was just told to drain, or to one that is gone.
+    if(unlink(config->handoff_path) < 0 && errno != ENOENT) {
+        perror(config->handoff_path);
+        return false;
+    }
+    if(bind(restart.handoff_fd, (struct sockaddr *) &address, sizeof(address)) < 0 ||
+       listen(restart.handoff_fd, 1) < 0) {
+        perror(config->handoff_path);
+        return false;
+    }
+    int error = pthread_create(&restart.handoff_thread, NULL, hand_off_listeners, NULL);
+    if(error != 0) {
+        fprintf(stderr, "pthread_create: %s\n", strerror(error));
+        return false;
+    }
+    return true;
+}
+
+// Parks the main thread until the server has drained: until draining has started and every connection has closed, or
+// --drain-timeout seconds after it started, whichever comes first. The server exits once this returns.
+void restart_wait(server_config_t *config) {
+    pthread_mutex_lock(&restart.lock);
+    while(!restart.draining) {
+        pthread_cond_wait(&restart.drain_started, &restart.lock);
+    }
+    pthread_mutex_unlock(&restart.lock);
+
+    long long deadline = monotonic_ms() + config->drain_timeout * 1000LL;
+    while(admission_open_connections() > 0 && monotonic_ms() < deadline) {
+        sleep_ms(RESTART_DRAIN_CHECK_MS);
+    }
+    int open_connections = admission_open_connections();
+    if(open_connections > 0) {
+        fprintf(stderr, "Drain timeout passed, closing %d connections.\n", open_connections);
+    }
+    sleep_ms(RESTART_FLUSH_WAIT_MS);
+}
@@ -0,0 +1,58 @@
+//
+// Created by User on 15/10/2026.
+//
+
+#ifndef COMP30023_2022_PROJECT_2_RESTART_H
+#define COMP30023_2022_PROJECT_2_RESTART_H
+
+// accept4() and SO_PEERCRED are Linux extensions.
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <errno.h>
+#include <pthread.h>
+#include <poll.h>
+#include <time.h>
+
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "config.h"
+#include "admission.h"
+
+// How often a draining server checks whether its last connection has closed.
+#define RESTART_DRAIN_CHECK_MS 50
+// How long a drained server waits before exiting, so the access log and trace writers (which wake up every 10 and
+// 100 milliseconds) get to write out the last responses.
+#define RESTART_FLUSH_WAIT_MS 200
+// The most descriptors the kernel passes in one SCM_RIGHTS message (SCM_MAX_FD).
+// https://man7.org/linux/man-pages/man7/unix.7.html
+#define RESTART_MAX_LISTENERS 253
+// What the successor sends back once it is accepting connections on the sockets it was handed.
+#define RESTART_READY_BYTE 'R'
+// How long, in seconds, a successor has to send it before the old server stops waiting and carries on as if it had
+// never connected. Generous, since a successor preloads the web root before it is ready.
+#define RESTART_READY_TIMEOUT 300
+
+bool restart_inherit_listeners(server_config_t *config, int *listenfds, bool *inherited);
+
+bool restart_init(void);
+
+bool restart_ready(server_config_t *config, int *listenfds);
+
+void restart_drain(void);
+
+bool restart_draining(void);
+
+int restart_drain_fd(void);
+
+void restart_wait(server_config_t *config);
+
+#endif //COMP30023_2022_PROJECT_2_RESTART_H
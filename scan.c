@@ -0,0 +1,166 @@
+//
+// Created by User on 14/10/2026.
+//
+#include "scan.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SCAN_X86
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define SCAN_NEON_AVAILABLE
+#endif
+
+// Returns the offset of the first byte in buffer that is below min_byte or is DEL, or length if there is none. With a
+// min_byte of '!' this finds the end of a request path (a space, or a control character that is not allowed in it),
+// and with ' ' the end of a header value (the CR, or a tab or control character the parser has to look at itself).
+// min_byte has to be at least 1.
+static size_t to_delimiter_scalar(const char *buffer, size_t length, unsigned char min_byte) {
+    for(size_t i = 0; i < length; i++) {
+        unsigned char c = buffer[i];
+        if(c < min_byte || c == DELETE_CHAR) {
+            return i;
+        }
+    }
+    return length;
+}
+
+static bool always_supported(void) {
+    return true;
+}
+
+#ifdef SCAN_X86
+// The SSE2 and AVX2 kernels compare 16 or 32 bytes at once and turn the comparison into a bit mask with movemask, so
+// the first match is the lowest set bit. Unsigned "c < min_byte" is done as "min(c, min_byte - 1) == c" since there
+// is no unsigned byte comparison. Whatever is left over at the end of the buffer goes through the scalar kernel.
+// https://www.intel.com/content/www/us/en/docs/intrinsics-guide/index.html
+
+static bool sse2_supported(void) {
+    return __builtin_cpu_supports("sse2");
+}
+
+__attribute__((target("sse2")))
+static size_t to_delimiter_sse2(const char *buffer, size_t length, unsigned char min_byte) {
+    const __m128i below = _mm_set1_epi8((char) (min_byte - 1));
+    const __m128i delete = _mm_set1_epi8(DELETE_CHAR);
+    size_t i = 0;
+    for(; i + sizeof(__m128i) <= length; i += sizeof(__m128i)) {
+        __m128i bytes = _mm_loadu_si128((const __m128i *) (buffer + i));
+        __m128i hits = _mm_or_si128(_mm_cmpeq_epi8(_mm_min_epu8(bytes, below), bytes),
+                                    _mm_cmpeq_epi8(bytes, delete));
+        unsigned int mask = _mm_movemask_epi8(hits);
+        if(mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return i + to_delimiter_scalar(buffer + i, length - i, min_byte);
+}
+
+static bool avx2_supported(void) {
+    return __builtin_cpu_supports("avx2");
+}
+
+__attribute__((target("avx2")))
+static size_t to_delimiter_avx2(const char *buffer, size_t length, unsigned char min_byte) {
+    const __m256i below = _mm256_set1_epi8((char) (min_byte - 1));
+    const __m256i delete = _mm256_set1_epi8(DELETE_CHAR);
+    size_t i = 0;
+    for(; i + sizeof(__m256i) <= length; i += sizeof(__m256i)) {
+        __m256i bytes = _mm256_loadu_si256((const __m256i *) (buffer + i));
+        __m256i hits = _mm256_or_si256(_mm256_cmpeq_epi8(_mm256_min_epu8(bytes, below), bytes),
+                                       _mm256_cmpeq_epi8(bytes, delete));
+        unsigned int mask = _mm256_movemask_epi8(hits);
+        if(mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    // Most request paths and header values are shorter than 32 bytes, so the tail is worth doing 16 bytes at a time.
+    // This is done here rather than by calling to_delimiter_sse2: code compiled for SSE2 alone uses the legacy
+    // encoding, and running it while the upper halves of the AVX registers are in use is heavily penalised.
+    // https://www.intel.com/content/www/us/en/developer/articles/technical/avoiding-avx-sse-transition-penalties.html
+    if(i + sizeof(__m128i) <= length) {
+        __m128i bytes = _mm_loadu_si128((const __m128i *) (buffer + i));
+        __m128i hits = _mm_or_si128(_mm_cmpeq_epi8(_mm_min_epu8(bytes, _mm256_castsi256_si128(below)), bytes),
+                                    _mm_cmpeq_epi8(bytes, _mm256_castsi256_si128(delete)));
+        unsigned int mask = _mm_movemask_epi8(hits);
+        if(mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+        i += sizeof(__m128i);
+    }
+    return i + to_delimiter_scalar(buffer + i, length - i, min_byte);
+}
+#endif
+
+#ifdef SCAN_NEON_AVAILABLE
+// NEON has no movemask. Narrowing each 16 bit lane of the comparison result by 4 bits packs it into a 64 bit value
+// with 4 bits per byte, so the first match is the lowest set bit divided by 4.
+// https://community.arm.com/arm-community-blogs/b/infrastructure-solutions-blog/posts/porting-x86-vector-bitmask-optimizations-to-arm-neon
+
+static uint64_t neon_mask(uint8x16_t hits) {
+    return vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(hits), 4)), 0);
+}
+
+static size_t to_delimiter_neon(const char *buffer, size_t length, unsigned char min_byte) {
+    const uint8x16_t minimum = vdupq_n_u8(min_byte);
+    const uint8x16_t delete = vdupq_n_u8(DELETE_CHAR);
+    size_t i = 0;
+    for(; i + sizeof(uint8x16_t) <= length; i += sizeof(uint8x16_t)) {
+        uint8x16_t bytes = vld1q_u8((const uint8_t *) (buffer + i));
+        uint64_t mask = neon_mask(vorrq_u8(vcltq_u8(bytes, minimum), vceqq_u8(bytes, delete)));
+        if(mask != 0) {
+            return i + (__builtin_ctzll(mask) >> 2);
+        }
+    }
+    return i + to_delimiter_scalar(buffer + i, length - i, min_byte);
+}
+#endif
+
+// Every implementation built into this binary, from the slowest to the fastest. NEON is part of every AArch64 CPU,
+// so it needs no run time check.
+static const scan_implementation_t implementations[] = {
+    {SCAN_SCALAR, always_supported, to_delimiter_scalar},
+#ifdef SCAN_X86
+    {SCAN_SSE2, sse2_supported, to_delimiter_sse2},
+    {SCAN_AVX2, avx2_supported, to_delimiter_avx2},
+#endif
+#ifdef SCAN_NEON_AVAILABLE
+    {SCAN_NEON, always_supported, to_delimiter_neon},
+#endif
+};
+
+#define NUM_IMPLEMENTATIONS (sizeof(implementations) / sizeof(implementations[0]))
+
+// The scalar kernels are used until scan_init has run.
+static const scan_implementation_t *current_implementation = &implementations[0];
+
+// Picks the fastest implementation the CPU supports. Called once at start up before any threads are created, since
+// the choice is not protected by a lock.
+void scan_init(void) {
+    for(size_t i = 0; i < NUM_IMPLEMENTATIONS; i++) {
+        if(implementations[i].supported()) {
+            current_implementation = &implementations[i];
+        }
+    }
+}
+
+// Switches to the implementation called name, for comparing them against each other. Returns false, leaving the
+// current implementation alone, if there is no such implementation or the CPU does not support it.
+bool scan_select(const char *name) {
+    for(size_t i = 0; i < NUM_IMPLEMENTATIONS; i++) {
+        if(strcmp(implementations[i].name, name) == SAME_STRING && implementations[i].supported()) {
+            current_implementation = &implementations[i];
+            return true;
+        }
+    }
+    return false;
+}
+
+const char *scan_implementation_name(void) {
+    return current_implementation->name;
+}
+
+// Returns the offset of the first byte in buffer that is below min_byte or is DEL, or length if there is none.
+size_t scan_to_delimiter(const char *buffer, size_t length, unsigned char min_byte) {
+    return current_implementation->to_delimiter(buffer, length, min_byte);
+}
@@ -0,0 +1,40 @@
+//
+// Created by User on 14/10/2026.
+//
+
+#ifndef COMP30023_2022_PROJECT_2_SCAN_H
+#define COMP30023_2022_PROJECT_2_SCAN_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define SAME_STRING 0
+
+// The DEL character, which is a control character even though it is above the space.
+#define DELETE_CHAR 0x7f
+
+#define SCAN_SCALAR "scalar"
+#define SCAN_SSE2 "sse2"
+#define SCAN_AVX2 "avx2"
+#define SCAN_NEON "neon"
+
+// One way of running the scanning kernels. Every implementation gives exactly the same answers; they only differ in
+// how many bytes they look at per instruction.
+typedef struct scan_implementation scan_implementation_t;
+struct scan_implementation {
+    const char *name;
+    bool (*supported)(void);
+    size_t (*to_delimiter)(const char *buffer, size_t length, unsigned char min_byte);
+};
+
+void scan_init(void);
+
+bool scan_select(const char *name);
+
+const char *scan_implementation_name(void);
+
+size_t scan_to_delimiter(const char *buffer, size_t length, unsigned char min_byte);
+
+#endif //COMP30023_2022_PROJECT_2_SCAN_H
@@ -7,171 +7,508 @@
 // found at https://gitlab.eng.unimelb.edu.au/comp30023-2022-projects/practicals/-/blob/main/week9-sockets/server.c.
 #include "server.h"
 
-int main(int argc, char** argv) {
-	int sockfd, newsockfd, s;
-	struct addrinfo hints, *res, *p;
+// Waits until the acceptor's listening socket has a connection to accept or the server starts draining.
+static void wait_for_connection(acceptor_t *acceptor) {
+    struct pollfd fds[2] = {{acceptor->listenfd, POLLIN, 0}, {restart_drain_fd(), POLLIN, 0}};
+    if (poll(fds, 2, -1) < 0 && errno != EINTR) {
+        perror("poll");
+    }
+}
+
+// Body of each acceptor thread. Accepts connections on one listening socket and hands them to the shared worker
+// pool, until the server starts draining. With several listeners (SO_REUSEPORT), every listener has its own acceptor
+// so accept() throughput is no longer limited to a single thread. The listening socket is non-blocking, so an acceptor
+// only waits in poll() when there is nothing to accept, where it also notices the server draining, and a connection
+// taken first by another process sharing the socket (see restart.c) is not waited for in accept().
+static void *accept_connections(void *acceptor_arg) {
+    acceptor_t *acceptor = (acceptor_t *)acceptor_arg;
+    int newsockfd;
     struct sockaddr_storage client_addr;
     socklen_t client_addr_size;
 
-	if (argc < 4) {
-		fprintf(stderr, "ERROR, not enough arguments provided.\n");
-		exit(EXIT_FAILURE);
-	}
-
-    char *web_root_path = argv[3];
-
-	// Create address we're going to listen on (with given port number)
-	memset(&hints, 0, sizeof hints);
-
-    if(strcmp(argv[1], IPV4_ARG) == SAME_STRING) {
-        hints.ai_family = AF_INET; // IPv4
-    } else if (strcmp(argv[1], IPV6_ARG) == SAME_STRING) {
-        hints.ai_family = AF_INET6; // IPv6
-    }
-	hints.ai_socktype = SOCK_STREAM; // TCP
-	hints.ai_flags = AI_PASSIVE;     // for bind, listen, accept
-
-	// node (NULL means any interface), service (port), hints, res. Note: argv[2] is the port_number
-	s = getaddrinfo(NULL, argv[2], &hints, &res);
-	if (s != 0) {
-		fprintf(stderr, "getaddrinfo: %s\n", gai_strerror(s));
-		exit(EXIT_FAILURE);
-	}
-
-    // The code used in the if statement was referenced and modified from COMP30023 Week 8 Lecture 2 Lecture Slide 13
-    // "Create IPv6 Socket". getaddrinfo returns multiple addresses in a linked list as mentioned in COMP30023
-    // Week 8 Lecture 2. Hence, if we want a IPv6 address, we need to use a for loop to step through the
-    // linked list returned (res) and find a valid IPv6 address to use to create a socket.
-    for (p = res; p != NULL; p = p->ai_next) {
-        // hints.ai_family contains the IP address type that we want (AF_INET or AF_INET6). Check that the current
-        // address in this node of the linked list corresponds to the address family stored in hints.ai_family.
-        if (p->ai_family == hints.ai_family) {
-            // We attempt to create a socket from this address. If socket creation was successful, we can use
-            // this socket, so we break out of the loop. Otherwise, we keep trying with remaining addresses until
-            // we run out.
-            if ((sockfd = socket(p->ai_family, p->ai_socktype, p->ai_protocol)) >= 0) {
-                break;
+    if (acceptor->cpu != NO_CPU) {
+        pin_thread_to_cpu(acceptor->cpu);
+    }
+
+    while(!restart_draining()) {
+        // Accept a connection, getting back a new file descriptor to communicate on. It does not inherit O_NONBLOCK
+        // from the listening socket. https://man7.org/linux/man-pages/man2/accept.2.html
+        client_addr_size = sizeof client_addr;
+        newsockfd =
+                accept(acceptor->listenfd, (struct sockaddr*)&client_addr, &client_addr_size);
+        if (newsockfd < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                wait_for_connection(acceptor);
+            } else {
+                perror("accept");
             }
+            continue;
+        }
+        address_count_t *address;
+        int verdict = admission_admit(newsockfd, &client_addr, &address);
+        if (verdict != ADMISSION_ACCEPTED) {
+            admission_reject(newsockfd, verdict, acceptor->tls);
+            continue;
         }
+
+        // Blocks while the queue is full, which in turn leaves new clients waiting in the listen backlog until a
+        // worker catches up.
+        worker_pool_submit(acceptor->pool, newsockfd, metrics_now(), address);
     }
+    return NULL;
+}
+
+// The signals the signal thread waits for, blocked in every other thread.
+static sigset_t handled_signals;
 
-    // If no sockets were successfully created (either IPv6 or IPv4)
-    if (sockfd < 0) {
-        perror("socket");
+// The body of the thread that waits for SIGUSR1 and writes the allocation counters to stderr each time it arrives,
+// with --preload for SIGHUP, which indexes the web root again and swaps the new index in, and for SIGTERM, which
+// drains the server. Doing the printing (and the reloading) here rather than in a signal handler means it can safely
+// use stdio and take locks.
+static void *handle_signals(void *context_arg) {
+    server_context_t *context = (server_context_t *)context_arg;
+    int signal_number;
+    while (true) {
+        if (sigwait(&handled_signals, &signal_number) != 0) {
+            continue;
+        }
+        if (signal_number == SIGUSR1) {
+            print_allocation_counters(stderr);
+        } else if (signal_number == SIGHUP) {
+            preload_reload(&context->preload);
+        } else if (signal_number == SIGTERM) {
+            restart_drain();
+        }
+    }
+    return NULL;
+}
+
+// Blocks SIGUSR1 and SIGTERM (and SIGHUP if the web root is preloaded, which otherwise still ends the server as it
+// always did) in the calling thread, and so in every thread created after it, and starts handle_signals. Returns false
+// if the thread could not be created.
+static bool start_signal_thread(server_context_t *context) {
+    pthread_t handler;
+    sigemptyset(&handled_signals);
+    sigaddset(&handled_signals, SIGUSR1);
+    sigaddset(&handled_signals, SIGTERM);
+    if (context->preload.enabled) {
+        sigaddset(&handled_signals, SIGHUP);
+    }
+    pthread_sigmask(SIG_BLOCK, &handled_signals, NULL);
+    int error = pthread_create(&handler, NULL, handle_signals, (void *)context);
+    if (error != 0) {
+        fprintf(stderr, "pthread_create: %s\n", strerror(error));
+        return false;
+    }
+    return true;
+}
+
+// Called by the main thread once the engine is accepting connections. Lets the server these listening sockets were
+// taken over from know it can drain, and keeps the main thread parked until this server has drained in turn. Returns
+// the exit status.
+static int serve_until_drained(server_config_t *config, int *listenfds) {
+    if (!restart_ready(config, listenfds)) {
+        return EXIT_FAILURE;
+    }
+    restart_wait(config);
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char** argv) {
+    server_config_t config;
+
+    if (!parse_server_config(argc, argv, &config)) {
         exit(EXIT_FAILURE);
     }
 
-	// Reuse port if possible. This piece of code was provided in COMP30023 Project 2 Spec. Similar code was included
-    // in server.c from COMP30023 Week 9 Practicals but was replaced with this.
-    int enable = 1;
-    if (setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(int)) < 0) {
-        perror("setsockopt");
+    // Create every listening socket before starting any threads, so a port that is already in use is reported
+    // straight away. With --handoff they are taken over from the server already running instead, if there is one,
+    // which carries on accepting on them until this one is ready.
+    int *listenfds = (int *)malloc(config.listeners * sizeof(int));
+    bool inherited;
+    if (listenfds == NULL || !restart_inherit_listeners(&config, listenfds, &inherited) ||
+        (!inherited && !create_listening_sockets(&config, listenfds))) {
         exit(EXIT_FAILURE);
     }
 
-    // Bind address to the socket
-	if (bind(sockfd, res->ai_addr, res->ai_addrlen) < 0) {
-		perror("bind");
-		exit(EXIT_FAILURE);
-	}
-	freeaddrinfo(res);
+    // The MIME types are looked up by every response and never change afterwards, so the table is built before
+    // anything else.
+    if (!mime_init(config.mime_types_path)) {
+        exit(EXIT_FAILURE);
+    }
 
-    // Listen on socket - means we're ready to accept connections,
-    // incoming connection requests will be queued, man 3 listen
-    if (listen(sockfd, 5) < 0) {
-        perror("listen");
+    // Every file is opened relative to the web root, so it is opened once up front and a web root that does not exist
+    // is reported before the server starts.
+    if (!resolve_init(config.web_root_path)) {
         exit(EXIT_FAILURE);
     }
 
-    while(true) {
-        // Accept a connection - blocks until a connection is ready to be accepted
-        // Get back a new file descriptor to communicate on
-        client_addr_size = sizeof client_addr;
-        newsockfd =
-                accept(sockfd, (struct sockaddr*)&client_addr, &client_addr_size);
-        if (newsockfd < 0) {
-            perror("accept");
-            close(newsockfd);
+    // Everything the workers or event loops share.
+    server_context_t context;
+    context.config = &config;
+    context.large_lane = NULL;
+    file_cache_init(&context.file_cache, (size_t)config.cache_size_mb * BYTES_PER_MB,
+                    (size_t)config.cache_max_file_kb * BYTES_PER_KB, config.cache_revalidate);
+    fd_cache_init(&context.fd_cache, config.fd_cache_entries, config.fd_cache_ttl, config.negative_cache_ttl);
+    if (!tls_server_init(&context.tls, &config)) {
+        exit(EXIT_FAILURE);
+    }
+
+    // Writing to a socket whose client has gone away raises SIGPIPE, which would kill the whole server. Ignore it so
+    // the write()/sendfile() simply fails with EPIPE and only that connection is dropped.
+    signal(SIGPIPE, SIG_IGN);
+
+    // Pick the fastest request scanning kernels this CPU supports.
+    scan_init();
+
+    // With --preload every file is indexed before the first connection is accepted. The threads doing it are all done
+    // by the time this returns.
+    if (!preload_init(&context.preload, &config)) {
+        exit(EXIT_FAILURE);
+    }
+
+    // Every engine watches the drain eventfd, so it is created before any of them starts, and before SIGTERM can
+    // be taken by the signal thread.
+    if (!restart_init()) {
+        exit(EXIT_FAILURE);
+    }
+
+    // SIGUSR1 prints the allocation counters, SIGTERM drains the server (and SIGHUP reloads the index). They are
+    // blocked here, before any other thread exists, so every thread inherits the blocked mask and the signals are only
+    // ever picked up by the signal thread's sigwait().
+    if (!start_signal_thread(&context)) {
+        exit(EXIT_FAILURE);
+    }
+
+    // The compression threads are started after SIGUSR1 is blocked for the same reason.
+    if (!compress_cache_init(&context.compress_cache, (size_t)config.compress_cache_size_mb * BYTES_PER_MB,
+                             (size_t)config.compress_max_file_kb * BYTES_PER_KB, config.compress_threads)) {
+        exit(EXIT_FAILURE);
+    }
+
+    // Files created under the web root end what the fd cache remembers as missing. A web root that cannot be watched
+    // in full only means missing paths are tried again more often.
+    if (!watch_init(config.web_root_path)) {
+        fprintf(stderr, "Could not watch %s for new files, missing paths are tried again every %d seconds.\n",
+                config.web_root_path, config.fd_cache_ttl < config.negative_cache_ttl ? config.fd_cache_ttl
+                                                                                       : config.negative_cache_ttl);
+    }
+
+    // Every engine counts its connections against the limits from the first one it accepts.
+    if (!admission_init(&config)) {
+        exit(EXIT_FAILURE);
+    }
+
+    // The admin port is opened (and its thread started) before any engine starts, so every worker finds metrics
+    // already turned on when it registers.
+    if (!metrics_init(&config)) {
+        exit(EXIT_FAILURE);
+    }
+
+    // The io_uring loops need a kernel that has every operation they use, and the epoll loops do the same job on any
+    // other kernel.
+    if (config.mode == MODE_URING && !uring_supported()) {
+        fprintf(stderr, "io_uring is not available, falling back to epoll.\n");
+        config.mode = MODE_EPOLL;
+    }
+    // The io_uring loops only speak plain HTTP, since every read and write of theirs bypasses OpenSSL.
+    if (config.mode == MODE_URING && context.tls.enabled) {
+        fprintf(stderr, "HTTPS is not supported by the io_uring loops, falling back to epoll.\n");
+        config.mode = MODE_EPOLL;
+    }
+    if (config.mode == MODE_URING) {
+        if (!run_uring_loops(listenfds, &context)) {
+            exit(EXIT_FAILURE);
+        }
+        return serve_until_drained(&config, listenfds);
+    }
+
+    // In epoll mode the event loops take over the listening sockets.
+    if (config.mode == MODE_EPOLL) {
+        if (!run_event_loops(listenfds, &context)) {
+            exit(EXIT_FAILURE);
         }
+        return serve_until_drained(&config, listenfds);
+    }
 
-        // Create a struct that contains the arguments needed to run the serve_connection function as per linux
-        // manual and Ed thread #845 https://edstem.org/au/courses/7916/discussion/857869.
-        serve_connection_args_t *serve_connection_args =
-                (serve_connection_args_t *)malloc(sizeof (serve_connection_args_t));
-        serve_connection_args->newsockfd = newsockfd;
-        serve_connection_args->web_root_path = web_root_path;
+    // Spawn the workers up front. Every accepted socket is handed to them through a bounded queue instead of
+    // getting a thread of its own, so a burst of clients costs queue slots rather than thread stacks.
+    worker_pool_t pool;
+    if (!worker_pool_init(&pool, config.worker_threads, config.queue_capacity, init_worker_state, serve_connection,
+                          (void *)&context)) {
+        exit(EXIT_FAILURE);
+    }
 
-        // Create a pthread_t variable which is used to identify the thread.
-        // https://man7.org/linux/man-pages/man3/pthread_create.3.html
-        pthread_t thread_id;
+    // Large responses get senders of their own, which hand their connections back to the same pool. The lane is set
+    // up before any connection is accepted, so every worker sees it.
+    large_lane_t large_lane;
+    if (config.large_transfers > 0) {
+        if (!large_lane_init(&large_lane, &config, &pool)) {
+            exit(EXIT_FAILURE);
+        }
+        context.large_lane = &large_lane;
+    }
 
-        pthread_create(&thread_id, NULL, serve_connection, (void *)serve_connection_args);
+    // One acceptor thread per listening socket, all feeding the same pool.
+    if (!make_listening_sockets_nonblocking(listenfds, config.listeners)) {
+        exit(EXIT_FAILURE);
+    }
+    acceptor_t *acceptors = (acceptor_t *)malloc(config.listeners * sizeof(acceptor_t));
+    if (acceptors == NULL) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
     }
-	return 0;
+    for (int i = 0; i < config.listeners; i++) {
+        acceptors[i].listenfd = listenfds[i];
+        acceptors[i].pool = &pool;
+        acceptors[i].tls = context.tls.enabled;
+        acceptors[i].cpu = listener_cpu(&config, i);
+        int error = pthread_create(&acceptors[i].thread, NULL, accept_connections, (void *)&acceptors[i]);
+        if (error != 0) {
+            fprintf(stderr, "pthread_create: %s\n", strerror(error));
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    return serve_until_drained(&config, listenfds);
 }
-// Function that is passed into pthread_create. This function takes a struct which contains the socket the thread
-// is supposed to serve as well as the web root path. It repeatedly reads packets from the socket and places it in a
-// buffer until the request ends. After reading the request, it then calls helper functions to send an appropriate
-// HTTP response.
-void *serve_connection(void *serve_connection_args) {
-    // pthread_create causes memory leaks. Call pthread_detach pthread_self (this thread) in order to mark the thread
-    // automatically as detached which will automatically free the resources once it terminates. Idea was initially
-    // seen at the stackoverflow post:
-    // https://stackoverflow.com/questions/5610677/valgrind-memory-leak-errors-when-using-pthread-create.
-    // Then, research into the linux manual was done to obtain full understanding of the context:
-    // https://man7.org/linux/man-pages/man3/pthread_detach.3.html and
-    // https://man7.org/linux/man-pages/man3/pthread_self.3.html
-    pthread_detach(pthread_self());
-
-    int n, bytes_read_so_far = 0;
-    // Use calloc to initialise the buffer so strstr can be called on it.
-    char *buffer = (char *) calloc ((REQUEST_MAX_BUFFER_SIZE + NULL_TERMINATOR_SPACE), sizeof(char));
-
-    // Type cast the struct containing the arguments for the function and then extract them and store them in variables.
-    int newsockfd = ((serve_connection_args_t *)serve_connection_args)->newsockfd;
-    char *web_root_path = ((serve_connection_args_t *)serve_connection_args)->web_root_path;
-
-    // Read characters from the connection, then process them until we encounter "\r\n\r\n" which we check using
-    // the strstr() function. "\r\n\r\n" means end of HTTP request.
-    do {
+
+// Sets how long a read() of sockfd waits for bytes to arrive before giving up with EAGAIN (SO_RCVTIMEO).
+// https://man7.org/linux/man-pages/man7/socket.7.html
+static void set_receive_timeout(int sockfd, int seconds) {
+    struct timeval timeout = {seconds, 0};
+    if (setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof timeout) < 0) {
+        perror("setsockopt");
+    }
+}
+
+// Called before every read of the rest of a request that has not arrived in one go. The first call starts the clock
+// on the request, which then has to be complete by the header timeout however often bytes of it trickle in, and every
+// call makes the read wait no longer than what is left of it. Returns false once there is nothing left. Only requests
+// that arrive in pieces ever get here, so the rest pay for neither the clock nor the setsockopt().
+static bool shorten_receive_timeout(int sockfd, time_t *deadline, server_config_t *config) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (*deadline == 0) {
+        *deadline = now.tv_sec + config->header_timeout;
+    }
+    time_t left = *deadline - now.tv_sec;
+    if (left <= 0) {
+        return false;
+    }
+    set_receive_timeout(sockfd, (int)left);
+    return true;
+}
+
+// Reads from the connection until the buffer holds a complete request, which may already be the case if the client
+// pipelined several requests and an earlier read() picked them up. Returns the result of http_parser_execute:
+// PARSE_COMPLETE, PARSE_ERROR as soon as the request is known to be malformed, or PARSE_INCOMPLETE if the connection
+// should be dropped instead (read error, the client closed the connection, the idle or header timeout expired, or the
+// buffer filled up without a complete request). HTTPS connections read through their TLS session ssl, which is NULL
+// otherwise. The parsing is timed in metrics.
+static int read_request(int newsockfd, SSL *ssl, char *buffer, int *bytes_read_so_far, http_parser_t *parser,
+                        request_metrics_t *metrics, server_config_t *config) {
+    int n;
+    int status;
+    // When the request has to be complete by, once part of it has arrived. 0 until then.
+    time_t header_deadline = 0;
+
+    // Read characters from the connection and let the parser look at each new batch until it has seen the empty line
+    // that ends the request. The parser remembers where it got to, so the bytes of a request that trickles in are
+    // only looked at once.
+    while((status = metrics_parse_request(metrics, parser, buffer, *bytes_read_so_far)) == PARSE_INCOMPLETE) {
+        if (*bytes_read_so_far > 0 && !shorten_receive_timeout(newsockfd, &header_deadline, config)) {
+            admission_record(ADMISSION_HEADER_TIMEOUT);
+            return PARSE_INCOMPLETE;
+        }
         // Pass in buffer + bytes_read_so_far to read() which tells read the offset to begin reading at as per
         // https://man7.org/linux/man-pages/man2/read.2.html. In the case of multi-packet request, read() will continue
         // reading from where it left off at before. n is number of characters read
-        n = read(newsockfd, buffer + bytes_read_so_far, REQUEST_MAX_BUFFER_SIZE - bytes_read_so_far);
-        // If there is a read error, free everything and drop the connection by closing the socket.
-        if (n < 0) {
-            perror("read");
-            // Since we can free everything here and just return and the thread will terminate, just do that instead.
-            free(serve_connection_args);
-            free(buffer);
-            close(newsockfd);
-            return NULL;
+        if (ssl != NULL) {
+            n = tls_read(ssl, buffer + *bytes_read_so_far, REQUEST_MAX_BUFFER_SIZE - *bytes_read_so_far);
+        } else {
+            n = read(newsockfd, buffer + *bytes_read_so_far, REQUEST_MAX_BUFFER_SIZE - *bytes_read_so_far);
+        }
+        // If there is a read error, drop the connection. A return value of 0 means the client closed the connection
+        // (or the buffer filled up without a complete request), and with a fixed number of workers we cannot afford
+        // to spin on it forever, so it is dropped as well. EAGAIN means SO_RCVTIMEO expired, which is not an error
+        // worth reporting, only counting.
+        if (n <= 0) {
+            if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+                perror("read");
+            } else if (n < 0) {
+                admission_record(*bytes_read_so_far > 0 ? ADMISSION_HEADER_TIMEOUT : ADMISSION_IDLE_TIMEOUT);
+            }
+            return PARSE_INCOMPLETE;
         }
         // Track the bytes read so far into the buffer.
-        bytes_read_so_far += n;
-    } while(strstr(buffer, "\r\n\r\n") == NULL);
-
-    // Null-terminate string
-    buffer[bytes_read_so_far] = '\0';
-
-    char *file_path;
-    // If the program successfully creates a file_path, then we continue as usual
-    if(get_file_path(&file_path, web_root_path, buffer)) {
-        // This function may terminate (return) early if there is an error with write() or sendfile() that occurs
-        // which prompts the server to drop the connection. In those cases, the thread will simply move on to free
-        // all the memory used and close the socket before terminating.
-        send_http_response(newsockfd, file_path);
-        free(file_path);
-        // Otherwise, the program will send a generic 404 Not Found response to the socket
+        *bytes_read_so_far += n;
+    }
+    // The wait for the next request is an idle one again.
+    if (header_deadline != 0) {
+        set_receive_timeout(newsockfd, config->keepalive_timeout);
+    }
+    return status;
+}
+
+// Called by every worker thread when it starts. Gives the worker its own arena and read buffer pool, allocated from its
+// own thread, so serving a request never has to go to the shared heap, and its own metrics counters. With
+// --pin-workers the worker is pinned to a CPU of its own first, so under the default (local) NUMA policy all of it is
+// allocated from the memory of that CPU's node, which is where the pages end up when they are first touched.
+// https://man7.org/linux/man-pages/man7/numa.7.html
+void *init_worker_state(void *server_context) {
+    server_context_t *context = (server_context_t *)server_context;
+    if (context->config->pin_workers) {
+        pin_worker_thread(context->config);
+    }
+    worker_state_t *state = (worker_state_t *)malloc(sizeof(worker_state_t));
+    if (state == NULL || !worker_memory_init(&state->memory, REQUEST_MAX_BUFFER_SIZE + NULL_TERMINATOR_SPACE)) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    state->metrics = metrics_register_worker();
+    if ((state->transfer = large_transfer_new()) == NULL) {
+        exit(EXIT_FAILURE);
+    }
+    return state;
+}
+
+// Hands the large response prepared in the worker's transfer to the large lane, which sends it and then gives the
+// connection back to the workers or closes it. The worker gets a new transfer to prepare its next response in. Returns
+// false, and leaves the response for the worker to send itself, if there is no memory for one.
+static bool hand_to_large_lane(large_lane_t *lane, worker_state_t *state, queued_connection_t *connection,
+                               int requests_served, bool keep_alive, request_metrics_t *metrics) {
+    large_transfer_t *replacement = large_transfer_new();
+    if (replacement == NULL) {
+        return false;
+    }
+    large_transfer_t *transfer = state->transfer;
+    transfer->connection = *connection;
+    transfer->connection.requests_served = requests_served;
+    transfer->keep_alive = keep_alive;
+    transfer->metrics = *metrics;
+    state->transfer = replacement;
+    large_lane_submit(lane, transfer);
+    return true;
+}
+
+// Function that is run by a worker thread for every socket taken off the worker pool's queue. It takes the connection
+// the worker is supposed to serve (its socket, when it was accepted and what it counts against in admission_admit,
+// released once it is closed), the server configuration and the worker's own state. It
+// repeatedly reads packets from the socket and places it in a buffer until a request ends. After reading the request,
+// it then calls helper functions to send an appropriate HTTP response. Persistent (keep-alive) connections go round
+// again for the next request until the client or the server decides to close the connection, or until a large
+// response is handed to the large lane, which hands the connection back to the queue once it has been sent.
+void serve_connection(queued_connection_t *connection, void *server_context, void *worker_state) {
+    int newsockfd = connection->sockfd;
+    int bytes_read_so_far = 0, requests_served = connection->requests_served;
+    bool keep_alive = true;
+    // The worker only ever serves one connection at a time, so after its first connection this reuses the same
+    // buffer every time.
+    worker_state_t *state = (worker_state_t *)worker_state;
+    worker_memory_t *memory = &state->memory;
+    char *buffer = buffer_pool_acquire(&memory->buffers);
+    http_parser_t parser;
+    http_parser_init(&parser);
+    request_metrics_t metrics;
+    if (requests_served == 0) {
+        metrics_start_connection(&metrics, state->metrics, connection->accepted_at);
     } else {
-        // If the write function fails here, then the thread will still just drop the connection and free memory as
-        // usual, so no need to check whether it's successful or not.
-        write_message(newsockfd, "HTTP/1.0 404 Not Found\r\n\r\n");
+        metrics_resume_connection(&metrics, state->metrics);
+    }
+
+    // The configuration and caches are shared by every worker and passed through the pool as an opaque pointer.
+    server_context_t *context = (server_context_t *)server_context;
+    server_config_t *config = context->config;
+
+    // A client that goes quiet (between requests or in the middle of one) would otherwise hold this worker forever.
+    // With SO_RCVTIMEO, read() gives up with EAGAIN once the idle timeout passes without any bytes arriving, and with
+    // SO_SNDTIMEO, sendmsg() and sendfile() give up once the send timeout passes without the client taking any of the
+    // response. https://man7.org/linux/man-pages/man7/socket.7.html
+    // A connection coming back from the large lane still has both set.
+    struct timeval send_timeout = {config->send_timeout, 0};
+    if (requests_served == 0) {
+        set_receive_timeout(newsockfd, config->keepalive_timeout);
+        if (setsockopt(newsockfd, SOL_SOCKET, SO_SNDTIMEO, &send_timeout, sizeof send_timeout) < 0) {
+            perror("setsockopt");
+        }
     }
 
-    // Close the connection, free everything and thread terminates.
+    // HTTPS connections do the TLS handshake first, which the receive timeout bounds as well.
+    SSL *ssl = NULL;
+    if (context->tls.enabled &&
+        ((ssl = tls_new_session(&context->tls, newsockfd)) == NULL || tls_handshake(ssl) != TLS_HANDSHAKE_DONE)) {
+        keep_alive = false;
+    }
+
+    while (keep_alive && buffer != NULL) {
+        int status = read_request(newsockfd, ssl, buffer, &bytes_read_so_far, &parser, &metrics, config);
+        if (status == PARSE_INCOMPLETE) {
+            break;
+        }
+        requests_served++;
+        count_allocation_event(&allocation_counters.requests);
+        metrics_start_request(&metrics, buffer, status == PARSE_COMPLETE ? &parser.request : NULL);
+        // Everything the previous request allocated is thrown away in one go.
+        arena_reset(&memory->arena);
+
+        char *file_path;
+        http_request_t *request = &parser.request;
+        // If the program successfully creates a file_path, then we continue as usual.
+        if(status == PARSE_COMPLETE && metrics_get_file_path(&metrics, &file_path, buffer, request, &memory->arena)) {
+            // The server closes the connection itself once it has served max_requests requests on it, and when it is
+            // close to --max-connections, since a worker waiting for the next request on this one could be serving
+            // one of the connections queued behind it instead.
+            keep_alive = request->keep_alive && requests_served < config->max_requests && !restart_draining();
+            if (keep_alive && admission_under_pressure()) {
+                admission_record(ADMISSION_EVICTED);
+                keep_alive = false;
+            }
+            // A large response is only handed to the large lane with nothing else to do on the connection until it
+            // has been sent: no TLS session, which belongs to this worker, and no pipelined request behind it.
+            size_t large_size = SIZE_MAX;
+            if (context->large_lane != NULL && ssl == NULL && (size_t)bytes_read_so_far == parser.request_length) {
+                large_size = context->large_lane->threshold;
+            }
+            // This function may terminate (return) early if there is an error with write() or sendfile() that occurs
+            // which prompts the server to drop the connection. In those cases, the worker will simply move on to free
+            // all the memory used and close the socket before taking the next connection.
+            http_response_t *response = &state->transfer->response;
+            int progress = send_http_response(newsockfd, ssl, context, response, file_path, request->minor_version,
+                                              keep_alive, buffer, request, &metrics, large_size);
+            // Remove the request from the buffer, leaving any pipelined requests behind it for the next time round.
+            consume_request(buffer, &bytes_read_so_far, &parser);
+            if (progress == RESPONSE_LARGE) {
+                if (hand_to_large_lane(context->large_lane, state, connection, requests_served, keep_alive,
+                                       &metrics)) {
+                    buffer_pool_release(&memory->buffers, buffer);
+                    return;
+                }
+                progress = finish_http_response(newsockfd, ssl, response, &metrics);
+            }
+            if (progress != RESPONSE_COMPLETE) {
+                keep_alive = false;
+            }
+        // Otherwise, the program will send a generic 404 Not Found response to the socket. The request could not be
+        // understood, so there is no telling where the next one would start and the connection is closed.
+        } else {
+            // If the write function fails here, then the worker will still just drop the connection and free memory
+            // as usual, so it only matters to the metrics.
+            metrics_start_response(&metrics);
+            bool sent = ssl != NULL ? tls_write_message(ssl, NOT_FOUND_RESPONSE)
+                                    : write_message(newsockfd, NOT_FOUND_RESPONSE);
+            metrics_record_message(&metrics, HTTP_STATUS_NOT_FOUND, strlen(NOT_FOUND_RESPONSE), sent);
+            keep_alive = false;
+        }
+    }
+
+    // Close the connection, hand the buffer back and the worker goes back to waiting on the queue.
+    if (ssl != NULL) {
+        tls_close_session(ssl);
+    }
     close(newsockfd);
-    free(serve_connection_args);
-    free(buffer);
-    return NULL;
-}
\ No newline at end of file
+    admission_release(connection->address);
+    if (buffer != NULL) {
+        buffer_pool_release(&memory->buffers, buffer);
+    }
+}
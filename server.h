@@ -1,42 +1,75 @@
-//
-// Created by User on 12/5/2022.
-//
-
-#ifndef COMP30023_2022_PROJECT_2_SERVER_H
-#define COMP30023_2022_PROJECT_2_SERVER_H
-
-#define _POSIX_C_SOURCE 200112L
-#include <netdb.h>
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-#include <unistd.h>
-
-#include <stdbool.h>
-#include <assert.h>
-#include <pthread.h>
-
-#include "parse.h"
-#include "respond.h"
-
-#define IMPLEMENTS_IPV6
-#define MULTITHREADED
-
-#define REQUEST_MAX_BUFFER_SIZE 2000
-#define IPV4_ARG "4"
-#define IPV6_ARG "6"
-
-#define NULL_TERMINATOR_SPACE 1
-#define ZERO_OFFSET 1
-
-// A struct which contains the arguments needed for the serve_connection function. Used in conjunction with
-// pthread_create.
-typedef struct serve_connection_args serve_connection_args_t;
-struct serve_connection_args {
-    int newsockfd;
-    char *web_root_path;
-};
-
-void *serve_connection(void *serve_connection_args);
-
-#endif //COMP30023_2022_PROJECT_2_SERVER_H
+//
+// Created by User on 12/5/2022.
+//
+
+#ifndef COMP30023_2022_PROJECT_2_SERVER_H
+#define COMP30023_2022_PROJECT_2_SERVER_H
+
+#define _GNU_SOURCE
+#include <netdb.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <stdbool.h>
+#include <assert.h>
+#include <pthread.h>
+#include <signal.h>
+#include <errno.h>
+#include <poll.h>
+
+#include <sys/time.h>
+
+#include "config.h"
+#include "context.h"
+#include "pool.h"
+#include "event.h"
+#include "uring.h"
+#include "tls.h"
+#include "listener.h"
+#include "parse.h"
+#include "respond.h"
+#include "scan.h"
+#include "arena.h"
+#include "mime.h"
+#include "resolve.h"
+#include "watch.h"
+#include "metrics.h"
+#include "admission.h"
+#include "lane.h"
+#include "restart.h"
+
+#define IMPLEMENTS_IPV6
+#define MULTITHREADED
+
+#define NULL_TERMINATOR_SPACE 1
+#define ZERO_OFFSET 1
+
+// The arguments of an acceptor thread: the listening socket it accepts on and the pool it hands connections to.
+typedef struct acceptor acceptor_t;
+struct acceptor {
+    int listenfd;
+    worker_pool_t *pool;
+    // Whether connections are HTTPS, which are turned away without a 503.
+    bool tls;
+    // CPU the acceptor is pinned to, or NO_CPU if it may run anywhere.
+    int cpu;
+    pthread_t thread;
+};
+
+// What each worker thread has to itself: the memory its requests are served from, its metrics counters (NULL if
+// metrics are turned off) and the transfer its next response is prepared in, replaced whenever one is handed to the
+// large lane.
+typedef struct worker_state worker_state_t;
+struct worker_state {
+    worker_memory_t memory;
+    worker_metrics_t *metrics;
+    large_transfer_t *transfer;
+};
+
+void *init_worker_state(void *server_context);
+
+void serve_connection(queued_connection_t *connection, void *server_context, void *worker_state);
+
+#endif //COMP30023_2022_PROJECT_2_SERVER_H
@@ -0,0 +1,241 @@
+//
+// Created by User on 14/10/2026.
+//
+#include "tls.h"
+#include "respond.h"
+
+#ifdef WITH_TLS
+
+// Sets up the SSL_CTX every HTTPS connection is made from, if a certificate was configured. The handshake is done by
+// OpenSSL in user space, and SSL_OP_ENABLE_KTLS then hands the negotiated keys to the kernel's TLS layer, so the
+// socket encrypts whatever is written to it and responses can go out with sendmsg() and sendfile() exactly as they
+// do over plain TCP. https://docs.kernel.org/networking/tls.html Kernels without kTLS (or ciphers it does not
+// support) still work, with the encryption done by SSL_write() instead. Returns false (after printing the reason) if
+// the certificate or key could not be loaded.
+bool tls_server_init(tls_server_t *tls, server_config_t *config) {
+    tls->ctx = NULL;
+    tls->enabled = false;
+    if(config->tls_cert_path == NULL) {
+        return true;
+    }
+
+    SSL_CTX *ctx = SSL_CTX_new(TLS_server_method());
+    if(ctx == NULL) {
+        fprintf(stderr, "ERROR, could not set up TLS.\n");
+        ERR_print_errors_fp(stderr);
+        return false;
+    }
+    SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
+    SSL_CTX_set_options(ctx, SSL_OP_ENABLE_KTLS | SSL_OP_NO_RENEGOTIATION | SSL_OP_CIPHER_SERVER_PREFERENCE);
+    // A non-blocking SSL_write() that only got part of the way is retried by continue_tls_response from a buffer it
+    // fills again, which may be at another address. https://www.openssl.org/docs/man3.0/man3/SSL_CTX_set_mode.html
+    SSL_CTX_set_mode(ctx, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+
+    if(SSL_CTX_use_certificate_chain_file(ctx, config->tls_cert_path) != 1 ||
+       SSL_CTX_use_PrivateKey_file(ctx, config->tls_key_path, SSL_FILETYPE_PEM) != 1 ||
+       SSL_CTX_check_private_key(ctx) != 1) {
+        fprintf(stderr, "ERROR, could not load the TLS certificate %s and key %s\n", config->tls_cert_path,
+                config->tls_key_path);
+        ERR_print_errors_fp(stderr);
+        SSL_CTX_free(ctx);
+        return false;
+    }
+
+    // Resuming a session skips the key exchange and certificate signature, which is most of the CPU a handshake
+    // costs. TLS 1.2 clients resume from the session cache by session ID, TLS 1.3 clients from the session tickets
+    // sent after each full handshake. The tickets are encrypted with keys OpenSSL makes when the SSL_CTX is created,
+    // so every worker and loop can resume every ticket. https://www.rfc-editor.org/rfc/rfc8446#section-2.2
+    if(config->tls_session_cache > 0) {
+        SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+        SSL_CTX_sess_set_cache_size(ctx, config->tls_session_cache);
+    } else {
+        SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_OFF);
+    }
+    SSL_CTX_set_session_id_context(ctx, (const unsigned char *) TLS_SESSION_ID_CONTEXT,
+                                   strlen(TLS_SESSION_ID_CONTEXT));
+    SSL_CTX_set_timeout(ctx, TLS_SESSION_LIFETIME);
+    SSL_CTX_set_num_tickets(ctx, TLS_TICKETS_PER_HANDSHAKE);
+
+    tls->ctx = ctx;
+    tls->enabled = true;
+    return true;
+}
+
+// Returns a new server side TLS session on the accepted socket sockfd, or NULL if one could not be made.
+SSL *tls_new_session(tls_server_t *tls, int sockfd) {
+    SSL *ssl = SSL_new(tls->ctx);
+    if(ssl == NULL || SSL_set_fd(ssl, sockfd) != 1) {
+        fprintf(stderr, "ERROR, could not start a TLS session.\n");
+        ERR_print_errors_fp(stderr);
+        SSL_free(ssl);
+        return NULL;
+    }
+    SSL_set_accept_state(ssl);
+    return ssl;
+}
+
+// Moves the handshake of ssl forward as far as it can go. Returns TLS_HANDSHAKE_DONE once it has finished,
+// TLS_HANDSHAKE_WANT_IO if a non-blocking socket (or one whose receive timeout expired) has to become readable or
+// writable first, or TLS_HANDSHAKE_FAILED if the connection should be dropped. Clients that give up on a handshake
+// are common enough that the reason is not printed.
+int tls_handshake(SSL *ssl) {
+    int result = SSL_do_handshake(ssl);
+    if(result == 1) {
+        return TLS_HANDSHAKE_DONE;
+    }
+    int error = SSL_get_error(ssl, result);
+    if(error == SSL_ERROR_WANT_READ || error == SSL_ERROR_WANT_WRITE) {
+        return TLS_HANDSHAKE_WANT_IO;
+    }
+    ERR_clear_error();
+    return TLS_HANDSHAKE_FAILED;
+}
+
+// read() for a TLS session: returns the number of bytes decrypted into buffer, 0 once the client has closed the
+// connection, or -1 with errno set to EAGAIN if the socket has nothing to read yet (or the receive timeout expired),
+// and to anything else on an error.
+ssize_t tls_read(SSL *ssl, char *buffer, size_t length) {
+    int result = SSL_read(ssl, buffer, (int) length);
+    if(result > 0) {
+        return result;
+    }
+    int error = SSL_get_error(ssl, result);
+    if(error == SSL_ERROR_WANT_READ || error == SSL_ERROR_WANT_WRITE) {
+        errno = EAGAIN;
+        return -1;
+    }
+    ERR_clear_error();
+    // A client that closes the connection without a close_notify alert is treated like one that sends it.
+    if(error == SSL_ERROR_ZERO_RETURN || (error == SSL_ERROR_SYSCALL && errno == 0) || length == 0) {
+        return 0;
+    }
+    if(error != SSL_ERROR_SYSCALL) {
+        errno = EPROTO;
+    }
+    return -1;
+}
+
+// Returns true if the kernel encrypts what is written to the socket of ssl, in which case the response can be
+// written to the socket directly.
+bool tls_kernel_send(SSL *ssl) {
+    return BIO_get_ktls_send(SSL_get_wbio(ssl)) == 1;
+}
+
+// Copies the next bytes of a response, from current_chunk on and up to one TLS record's worth, into buffer and
+// returns how many there are, or -1 if the file could not be read. The same bytes are copied until the response
+// moves on, which is what SSL_write() needs when it is retried.
+static ssize_t fill_tls_record(http_response_t *response, char *buffer, size_t buffer_size) {
+    size_t filled = 0;
+    int chunk_index = response->current_chunk;
+    size_t already_sent = response->chunk_sent;
+    for(; chunk_index < response->num_chunks && filled < buffer_size; chunk_index++) {
+        response_chunk_t *chunk = &response->chunks[chunk_index];
+        size_t length = chunk->length - already_sent;
+        if(length > buffer_size - filled) {
+            length = buffer_size - filled;
+        }
+        if(chunk->data != NULL) {
+            memcpy(buffer + filled, chunk->data + already_sent, length);
+        } else {
+            ssize_t n = pread(response->file_fd, buffer + filled, length, chunk->offset + already_sent);
+            if(n < 0) {
+                perror("pread");
+                return -1;
+            }
+            // The file shrank while it was being sent, so send what there is and fail on the next call.
+            if((size_t) n < length) {
+                return filled + n > 0 ? (ssize_t) (filled + n) : -1;
+            }
+        }
+        filled += length;
+        already_sent = 0;
+    }
+    return (ssize_t) filled;
+}
+
+// continue_http_response for a TLS session whose socket does not encrypt by itself: the response is copied into
+// records of up to TLS_RECORD_MAX_SIZE bytes, headers and body together, and encrypted by SSL_write(). Returns
+// RESPONSE_COMPLETE, RESPONSE_WOULD_BLOCK or RESPONSE_FAILED as continue_http_response does.
+int continue_tls_response(SSL *ssl, http_response_t *response) {
+    char record[TLS_RECORD_MAX_SIZE];
+    advance_response(response, 0);
+    while(response->current_chunk < response->num_chunks) {
+        ssize_t length = fill_tls_record(response, record, TLS_RECORD_MAX_SIZE);
+        if(length < 0) {
+            return RESPONSE_FAILED;
+        }
+        int n = SSL_write(ssl, record, (int) length);
+        if(n <= 0) {
+            int error = SSL_get_error(ssl, n);
+            if(error == SSL_ERROR_WANT_WRITE || error == SSL_ERROR_WANT_READ) {
+                return RESPONSE_WOULD_BLOCK;
+            }
+            ERR_clear_error();
+            return RESPONSE_FAILED;
+        }
+        advance_response(response, n);
+    }
+    return RESPONSE_COMPLETE;
+}
+
+// write_message for a TLS session.
+bool tls_write_message(SSL *ssl, char *message) {
+    if(SSL_write(ssl, message, (int) strlen(message)) <= 0) {
+        ERR_clear_error();
+        return false;
+    }
+    return true;
+}
+
+// Sends the close_notify alert if the handshake got that far, and frees the session. Must be called before the
+// socket is closed.
+void tls_close_session(SSL *ssl) {
+    if(SSL_is_init_finished(ssl)) {
+        SSL_shutdown(ssl);
+    }
+    ERR_clear_error();
+    SSL_free(ssl);
+}
+
+#else
+
+// Built without OpenSSL ("make WITH_TLS=0"), so asking for HTTPS is an error.
+bool tls_server_init(tls_server_t *tls, server_config_t *config) {
+    tls->ctx = NULL;
+    tls->enabled = false;
+    if(config->tls_cert_path != NULL) {
+        fprintf(stderr, "ERROR, this server was built without TLS support.\n");
+        return false;
+    }
+    return true;
+}
+
+SSL *tls_new_session(tls_server_t *tls, int sockfd) {
+    return NULL;
+}
+
+int tls_handshake(SSL *ssl) {
+    return TLS_HANDSHAKE_FAILED;
+}
+
+ssize_t tls_read(SSL *ssl, char *buffer, size_t length) {
+    errno = ENOTSUP;
+    return -1;
+}
+
+bool tls_kernel_send(SSL *ssl) {
+    return false;
+}
+
+int continue_tls_response(SSL *ssl, http_response_t *response) {
+    return RESPONSE_FAILED;
+}
+
+bool tls_write_message(SSL *ssl, char *message) {
+    return false;
+}
+
+void tls_close_session(SSL *ssl) {
+}
+
+#endif
@@ -0,0 +1,69 @@
+//
+// Created by User on 14/10/2026.
+//
+
+#ifndef COMP30023_2022_PROJECT_2_TLS_H
+#define COMP30023_2022_PROJECT_2_TLS_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include <errno.h>
+
+#include <sys/types.h>
+
+#ifdef WITH_TLS
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+#else
+// Everything outside tls.c only ever holds pointers to these, so they do not need to be complete without OpenSSL.
+typedef struct ssl_st SSL;
+typedef struct ssl_ctx_st SSL_CTX;
+#endif
+
+#include "config.h"
+
+// The results of tls_handshake.
+#define TLS_HANDSHAKE_DONE 0
+#define TLS_HANDSHAKE_WANT_IO 1
+#define TLS_HANDSHAKE_FAILED 2
+
+// Identifies this server's sessions in the session cache, so a session is only resumed by the server that made it.
+#define TLS_SESSION_ID_CONTEXT "COMP30023_2022_PROJECT_2"
+// Seconds a session (cached or in a ticket) can be resumed for.
+#define TLS_SESSION_LIFETIME 7200
+// Tickets sent to a client after a full TLS 1.3 handshake, so a browser opening several connections can resume each
+// of them.
+#define TLS_TICKETS_PER_HANDSHAKE 2
+// Bytes of a file read at a time when it has to be encrypted in user space, the most one TLS record can hold.
+#define TLS_RECORD_MAX_SIZE 16384
+
+// The TLS configuration shared by every connection: one SSL_CTX, which OpenSSL lets every thread use at the same
+// time, so the session cache and the keys that encrypt session tickets are shared by every worker and loop as well.
+typedef struct tls_server tls_server_t;
+struct tls_server {
+    SSL_CTX *ctx;
+    bool enabled;
+};
+
+struct http_response;
+
+bool tls_server_init(tls_server_t *tls, server_config_t *config);
+
+SSL *tls_new_session(tls_server_t *tls, int sockfd);
+
+int tls_handshake(SSL *ssl);
+
+ssize_t tls_read(SSL *ssl, char *buffer, size_t length);
+
+bool tls_kernel_send(SSL *ssl);
+
+int continue_tls_response(SSL *ssl, struct http_response *response);
+
+bool tls_write_message(SSL *ssl, char *message);
+
+void tls_close_session(SSL *ssl);
+
+#endif //COMP30023_2022_PROJECT_2_TLS_H
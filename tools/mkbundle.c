@@ -0,0 +1,280 @@
+//
+// Created by User on 14/10/2026.
+//
+// Packs a web root into a single bundle file for the server's --bundle mode. Built with "make mkbundle" and run as
+//
+//     ./mkbundle [--compress] web_root bundle
+//
+// Every regular file under web_root (through symbolic links that stay inside it, as the server would serve them) is
+// copied into the bundle in the layout bundle.h describes. --compress also adds a gzip and a brotli copy of every text
+// file that does not have a precompressed .gz or .br sibling already, as long as the copy comes out smaller, which the
+// server then sends to clients that accept them just like precompressed siblings.
+//
+// The bundle is written under a temporary name next to bundle and renamed over it once complete, so a server mapping
+// the old bundle keeps serving it undisturbed until it is told to reload with SIGHUP.
+
+// For nftw() and FTW_PHYS.
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <ftw.h>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "../bundle.h"
+#include "../resolve.h"
+#include "../mime.h"
+#include "../compress.h"
+
+#define BUNDLE_FILE_MODE 0644
+#define INITIAL_CAPACITY 256
+// How many directories nftw() keeps open at once while walking the web root.
+#define MAX_OPEN_DIRECTORIES 16
+// The paths and records are aligned for the records' 64 bit fields.
+#define RECORD_ALIGNMENT 8
+
+// A file to be packed, with the path the record will have until the paths are written out.
+typedef struct packed_file packed_file_t;
+struct packed_file {
+    char *path;
+    bundle_record_t record;
+};
+
+// Everything the walk collects and the packing adds to. nftw has no way to pass state to its callback, hence the
+// globals.
+static struct {
+    char **paths;
+    int num_paths;
+    int paths_capacity;
+    size_t root_length;
+    packed_file_t *files;
+    int num_files;
+    int files_capacity;
+    int out_fd;
+    uint64_t offset;
+} packer = {NULL, 0, 0, 0, NULL, 0, 0, -1, sizeof(bundle_header_t)};
+
+static int compare_strings(const void *a, const void *b) {
+    return strcmp(*(char *const *) a, *(char *const *) b);
+}
+
+static int compare_files(const void *a, const void *b) {
+    return strcmp(((const packed_file_t *) a)->path, ((const packed_file_t *) b)->path);
+}
+
+static void out_of_memory(void) {
+    fprintf(stderr, "ERROR, out of memory.\n");
+    exit(EXIT_FAILURE);
+}
+
+// Called by nftw for everything under the web root. Regular files and symbolic links are noted down by their path
+// relative to the web root; whether a link leads to a file the server would serve is only found out when it is opened.
+static int collect_path(const char *path, const struct stat *file_stat, int type, struct FTW *ftw) {
+    (void) file_stat;
+    (void) ftw;
+    if((type != FTW_F && type != FTW_SL) || strlen(path) <= packer.root_length) {
+        return 0;
+    }
+    if(packer.num_paths == packer.paths_capacity) {
+        packer.paths_capacity = packer.paths_capacity > 0 ? packer.paths_capacity * 2 : INITIAL_CAPACITY;
+        if((packer.paths = (char **) realloc(packer.paths, packer.paths_capacity * sizeof(char *))) == NULL) {
+            out_of_memory();
+        }
+    }
+    if((packer.paths[packer.num_paths++] = strdup(path + packer.root_length)) == NULL) {
+        out_of_memory();
+    }
+    return 0;
+}
+
+static bool has_path(const char *path) {
+    return bsearch(&path, packer.paths, packer.num_paths, sizeof(char *), compare_strings) != NULL;
+}
+
+// Writes length bytes at data to the bundle at offset, all of them or exits.
+static void write_at(const void *data, size_t length, uint64_t offset) {
+    size_t written = 0;
+    while(written < length) {
+        ssize_t n = pwrite(packer.out_fd, (const char *) data + written, length - written, offset + written);
+        if(n < 0) {
+            perror("pwrite");
+            exit(EXIT_FAILURE);
+        }
+        written += n;
+    }
+}
+
+// Writes the contents of a file to the next place its alignment allows, and adds its record. The gap before it is
+// never written, so it reads as zeros.
+static void pack_contents(const char *path, const char *data, size_t size, struct stat *file_stat, uint32_t flags) {
+    uint64_t offset = bundle_align(packer.offset, size);
+    write_at(data, size, offset);
+    packer.offset = offset + size;
+
+    if(packer.num_files == packer.files_capacity) {
+        packer.files_capacity = packer.files_capacity > 0 ? packer.files_capacity * 2 : INITIAL_CAPACITY;
+        if((packer.files = (packed_file_t *) realloc(packer.files,
+                                                     packer.files_capacity * sizeof(packed_file_t))) == NULL) {
+            out_of_memory();
+        }
+    }
+    packed_file_t *file = &packer.files[packer.num_files++];
+    if((file->path = strdup(path)) == NULL) {
+        out_of_memory();
+    }
+    memset(&file->record, 0, sizeof(file->record));
+    file->record.data_offset = offset;
+    file->record.size = size;
+    file->record.inode = file_stat->st_ino;
+    file->record.modified_seconds = file_stat->st_mtim.tv_sec;
+    file->record.modified_nanoseconds = file_stat->st_mtim.tv_nsec;
+    file->record.path_length = strlen(path);
+    file->record.flags = flags;
+}
+
+// Adds a compressed copy of a text file as path + suffix, if it has no precompressed sibling already and compressing
+// it makes it smaller. The copy keeps the file's modification time, so the server knows it is as new as the file.
+static void pack_compressed(const char *path, const char *data, size_t size, struct stat *file_stat, int encoding,
+                            const char *suffix) {
+    char sibling_path[PATH_MAX];
+    char *compressed;
+    size_t compressed_size;
+    if(snprintf(sibling_path, sizeof(sibling_path), "%s%s", path, suffix) >= (int) sizeof(sibling_path) ||
+       has_path(sibling_path) || !compress_data(encoding, data, size, &compressed, &compressed_size)) {
+        return;
+    }
+    pack_contents(sibling_path, compressed, compressed_size, file_stat, BUNDLE_GENERATED);
+    free(compressed);
+}
+
+// Reads the file at path (relative to the web root) and packs it, along with its compressed copies if compress is
+// set. Anything that is not a regular file the server would serve is left out. Returns false if it was.
+static bool pack_file(const char *path, bool compress) {
+    int fd = resolve_open(path);
+    struct stat file_stat;
+    if(fd < 0 || fstat(fd, &file_stat) < 0 || !S_ISREG(file_stat.st_mode)) {
+        if(fd >= 0) {
+            close(fd);
+        }
+        return false;
+    }
+    char *data = (char *) malloc(file_stat.st_size > 0 ? file_stat.st_size : 1);
+    if(data == NULL) {
+        out_of_memory();
+    }
+    off_t bytes_read = 0;
+    while(bytes_read < file_stat.st_size) {
+        ssize_t n = pread(fd, data + bytes_read, file_stat.st_size - bytes_read, bytes_read);
+        if(n <= 0) {
+            break;
+        }
+        bytes_read += n;
+    }
+    close(fd);
+    if(bytes_read < file_stat.st_size) {
+        fprintf(stderr, "ERROR, could not read %s, leaving it out.\n", path);
+        free(data);
+        return false;
+    }
+    pack_contents(path, data, file_stat.st_size, &file_stat, 0);
+    if(compress && file_stat.st_size > 0 && mime_lookup(path)->compressible) {
+        pack_compressed(path, data, file_stat.st_size, &file_stat, ENCODING_GZIP, GZIP_SUFFIX);
+        pack_compressed(path, data, file_stat.st_size, &file_stat, ENCODING_BROTLI, BROTLI_SUFFIX);
+    }
+    free(data);
+    return true;
+}
+
+// Writes the paths and the sorted records after the contents, and then the header at the start, which only now knows
+// where they are.
+static void write_index(void) {
+    qsort(packer.files, packer.num_files, sizeof(packed_file_t), compare_files);
+    bundle_header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, BUNDLE_MAGIC, BUNDLE_MAGIC_SIZE);
+    header.version = BUNDLE_VERSION;
+    header.num_records = packer.num_files;
+
+    header.strings_offset = packer.offset;
+    for(int i = 0; i < packer.num_files; i++) {
+        packed_file_t *file = &packer.files[i];
+        file->record.path_offset = packer.offset - header.strings_offset;
+        write_at(file->path, file->record.path_length + 1, packer.offset);
+        packer.offset += file->record.path_length + 1;
+    }
+    header.strings_size = packer.offset - header.strings_offset;
+
+    header.records_offset = (packer.offset + RECORD_ALIGNMENT - 1) / RECORD_ALIGNMENT * RECORD_ALIGNMENT;
+    packer.offset = header.records_offset;
+    for(int i = 0; i < packer.num_files; i++) {
+        write_at(&packer.files[i].record, sizeof(bundle_record_t), packer.offset);
+        packer.offset += sizeof(bundle_record_t);
+    }
+    header.file_size = packer.offset;
+    // A bundle with no records would otherwise end at its header, short of where the offsets say it does.
+    if(ftruncate(packer.out_fd, (off_t) header.file_size) < 0) {
+        perror("ftruncate");
+        exit(EXIT_FAILURE);
+    }
+    write_at(&header, sizeof(header), 0);
+}
+
+int main(int argc, char **argv) {
+    bool compress = argc > 1 && strcmp(argv[1], "--compress") == SAME_STRING;
+    if(argc != 3 + compress) {
+        fprintf(stderr, "Usage: %s [--compress] web_root bundle\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    const char *web_root_path = argv[1 + compress];
+    const char *bundle_path = argv[2 + compress];
+    if(!resolve_init(web_root_path) || !mime_init(NULL)) {
+        exit(EXIT_FAILURE);
+    }
+
+    // nftw hands over paths starting with web_root_path and a '/'.
+    packer.root_length = strlen(web_root_path);
+    while(packer.root_length > 1 && web_root_path[packer.root_length - 1] == '/') {
+        packer.root_length--;
+    }
+    packer.root_length++;
+    if(nftw(web_root_path, collect_path, MAX_OPEN_DIRECTORIES, FTW_PHYS) != 0) {
+        perror(web_root_path);
+        exit(EXIT_FAILURE);
+    }
+    qsort(packer.paths, packer.num_paths, sizeof(char *), compare_strings);
+
+    char temporary_path[PATH_MAX];
+    snprintf(temporary_path, sizeof(temporary_path), "%s.tmp.%d", bundle_path, (int) getpid());
+    packer.out_fd = open(temporary_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, BUNDLE_FILE_MODE);
+    if(packer.out_fd < 0) {
+        perror(temporary_path);
+        exit(EXIT_FAILURE);
+    }
+    int num_packed = 0;
+    for(int i = 0; i < packer.num_paths; i++) {
+        num_packed += pack_file(packer.paths[i], compress);
+    }
+    write_index();
+
+    // The bundle has to be on disk before it replaces the old one, or a crash could leave a bundle that is cut short
+    // under the real name.
+    if(fsync(packer.out_fd) < 0 || close(packer.out_fd) < 0 || rename(temporary_path, bundle_path) < 0) {
+        perror(bundle_path);
+        unlink(temporary_path);
+        exit(EXIT_FAILURE);
+    }
+    fprintf(stderr, "Packed %d files (and %d compressed copies) from %s into %s, %llu KB.\n", num_packed,
+            packer.num_files - num_packed, web_root_path, bundle_path,
+            (unsigned long long) packer.offset / 1024);
+    return 0;
+}
@@ -0,0 +1,291 @@
+//
+// Created by User on 14/10/2026.
+//
+#include "trace.h"
+
+static const char *stage_names[TRACE_NUM_STAGES] = {"queue", "read", "parse", "path", "open", "send"};
+
+// Everything the writer thread needs. As with the access log, rings are only ever added at the front of the list,
+// so the writer walks it from whatever head it sees without the lock.
+static struct {
+    bool enabled;
+    // One request in sample_every is traced, and written out if it took at least slow nanoseconds.
+    int sample_every;
+    long long slow;
+    // Where traces go: a Chrome trace file, or stderr as text lines.
+    int fd;
+    bool json;
+    pid_t pid;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    trace_ring_t *rings;
+    int num_rings;
+    // Drops already reported.
+    uint64_t dropped_reported;
+} trace = {false, 0, 0, STDERR_FILENO, false, 0, 0, PTHREAD_MUTEX_INITIALIZER, NULL, 0, 0};
+
+// CLOCK_MONOTONIC in nanoseconds, for the timestamps the writer makes up itself.
+static long long monotonic_now(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * NANOSECONDS_PER_SECOND + now.tv_nsec;
+}
+
+// Writes out the length bytes of batch.
+static void flush_batch(const char *batch, size_t length) {
+    size_t written = 0;
+    while(written < length) {
+        ssize_t n = write(trace.fd, batch + written, length - written);
+        if(n < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            perror("write");
+            return;
+        }
+        written += n;
+    }
+}
+
+// Copies the length bytes of string into output as the inside of a JSON string, and returns how many bytes that took
+// (at most six per byte). https://www.rfc-editor.org/rfc/rfc8259#section-7
+static size_t escape_json(char *output, const char *string, size_t length) {
+    size_t used = 0;
+    for(size_t i = 0; i < length; i++) {
+        unsigned char c = (unsigned char) string[i];
+        if(c == '"' || c == '\\') {
+            output[used++] = '\\';
+            output[used++] = (char) c;
+        } else if(c < 0x20) {
+            used += sprintf(output + used, "\\u%04x", c);
+        } else {
+            output[used++] = (char) c;
+        }
+    }
+    return used;
+}
+
+// Adds a Chrome trace event that takes the time span covers to output, and returns its length. Timestamps are in
+// microseconds, which may have a fractional part. The format is described in "Trace Event Format",
+// https://docs.google.com/document/d/1CvAClvFfyA5R-PhYUmn5OOQtYMH4h6I0nSsKchNAySU
+static size_t format_event(char *output, const char *name, const char *category, const trace_span_t *span,
+                           int thread, const char *args) {
+    return sprintf(output, "{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,"
+                           "\"tid\":%d%s},\n", name, category, span->start / 1000.0, span->duration / 1000.0,
+                   (int) trace.pid, thread, args);
+}
+
+// Formats a finished trace into output: in a trace file, an event for the whole request (named after its method and
+// path) with an event inside it for every stage it went through; otherwise one line listing how long each stage took.
+// Returns the length.
+static size_t format_record(char *output, const trace_record_t *record, int thread) {
+    char name[ACCESS_LOG_METHOD_MAX + 1 + 6 * ACCESS_LOG_PATH_MAX + 1];
+    size_t name_length = escape_json(name, record->method, record->method_length);
+    name[name_length++] = ' ';
+    name_length += escape_json(name + name_length, record->path, record->path_length);
+    name[name_length] = '\0';
+
+    size_t length = 0;
+    if(trace.json) {
+        char args[64];
+        snprintf(args, sizeof(args), ",\"args\":{\"status\":%d,\"completed\":%s}", record->status,
+                 record->completed ? "true" : "false");
+        length += format_event(output, name, "request", &record->request, thread, args);
+        for(int stage = 0; stage < TRACE_NUM_STAGES; stage++) {
+            if(record->spans[stage].start != 0) {
+                length += format_event(output + length, stage_names[stage], "stage", &record->spans[stage], thread,
+                                       "");
+            }
+        }
+        return length;
+    }
+    length += sprintf(output, "trace: thread %d %s %d%s %.1fus", thread, name, record->status,
+                      record->completed ? "" : " (failed)", record->request.duration / 1000.0);
+    for(int stage = 0; stage < TRACE_NUM_STAGES; stage++) {
+        if(record->spans[stage].start != 0) {
+            length += sprintf(output + length, " %s=%.1fus", stage_names[stage],
+                              record->spans[stage].duration / 1000.0);
+        }
+    }
+    output[length++] = '\n';
+    return length;
+}
+
+// Makes room for one more trace in the batch, writing it out first if need be.
+static void reserve_batch(char *batch, size_t *length) {
+    if(*length + TRACE_OUTPUT_MAX_SIZE > TRACE_BATCH_SIZE) {
+        flush_batch(batch, *length);
+        *length = 0;
+    }
+}
+
+// Takes every trace the threads have finished since the last time out of their rings and writes them out, naming a
+// thread in the trace file the first time it has traces to show. Drops since the last time are reported as well.
+static void drain_rings(char *batch) {
+    size_t length = 0;
+    uint64_t dropped = 0;
+    for(trace_ring_t *ring = __atomic_load_n(&trace.rings, __ATOMIC_ACQUIRE); ring != NULL; ring = ring->next) {
+        // The acquire load of tail pairs with the release store in trace_finish, so the records before it are all
+        // there.
+        uint64_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+        if(trace.json && !ring->named && ring->head != tail) {
+            reserve_batch(batch, &length);
+            length += sprintf(batch + length, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,"
+                                              "\"args\":{\"name\":\"worker %d\"}},\n", (int) trace.pid,
+                              ring->thread, ring->thread);
+            ring->named = true;
+        }
+        for(uint64_t position = ring->head; position != tail; position++) {
+            reserve_batch(batch, &length);
+            length += format_record(batch + length, &ring->records[position & (TRACE_RING_RECORDS - 1)],
+                                    ring->thread);
+        }
+        // The slots go back to the thread only once they have been copied out.
+        __atomic_store_n(&ring->head, tail, __ATOMIC_RELEASE);
+        dropped += __atomic_load_n(&ring->dropped, __ATOMIC_RELAXED);
+    }
+
+    if(dropped > trace.dropped_reported) {
+        reserve_batch(batch, &length);
+        unsigned long long newly_dropped = dropped - trace.dropped_reported;
+        if(trace.json) {
+            length += sprintf(batch + length, "{\"name\":\"traces dropped\",\"ph\":\"i\",\"s\":\"g\",\"ts\":%.3f,"
+                                              "\"pid\":%d,\"tid\":0,\"args\":{\"traces\":%llu}},\n",
+                              monotonic_now() / 1000.0, (int) trace.pid, newly_dropped);
+        } else {
+            length += sprintf(batch + length, "trace: %llu traces dropped\n", newly_dropped);
+        }
+        trace.dropped_reported = dropped;
+    }
+    if(length > 0) {
+        flush_batch(batch, length);
+    }
+}
+
+// The body of the writer thread, which wakes up on a timer like the access log's so tracing never makes a thread
+// that serves requests enter the kernel.
+static void *write_traces(void *batch) {
+    struct timespec interval = {0, TRACE_FLUSH_INTERVAL_MS * 1000000L};
+    while(true) {
+        nanosleep(&interval, NULL);
+        drain_rings((char *) batch);
+    }
+    return NULL;
+}
+
+// Turns tracing on if config asks for it, creating the trace file (if there is one) and starting the writer thread.
+// Has to be called before any worker or loop starts. Returns false if the trace file could not be created.
+bool trace_init(server_config_t *config) {
+    if(config->trace_sample == 0) {
+        return true;
+    }
+    trace.sample_every = config->trace_sample;
+    trace.slow = (long long) config->trace_slow_us * NANOSECONDS_PER_MICROSECOND;
+    trace.pid = getpid();
+    if(config->trace_path != NULL) {
+        // The JSON Array Format, with the closing bracket left off: the viewers accept a trace that ends without one,
+        // which is what a server that is killed leaves behind anyway.
+        if((trace.fd = open(config->trace_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, TRACE_FILE_MODE)) < 0) {
+            perror(config->trace_path);
+            return false;
+        }
+        trace.json = true;
+        flush_batch("[\n", 2);
+    }
+    char *batch = (char *) malloc(TRACE_BATCH_SIZE);
+    if(batch == NULL) {
+        perror("malloc");
+        return false;
+    }
+    trace.enabled = true;
+    int error = pthread_create(&trace.thread, NULL, write_traces, (void *) batch);
+    if(error != 0) {
+        fprintf(stderr, "pthread_create: %s\n", strerror(error));
+        return false;
+    }
+    return true;
+}
+
+bool trace_enabled(void) {
+    return trace.enabled;
+}
+
+// Gives the calling thread a ring of its own. Returns NULL if tracing is off (or the memory could not be allocated),
+// in which case none of the thread's requests are sampled.
+trace_ring_t *trace_register_ring(void) {
+    if(!trace.enabled) {
+        return NULL;
+    }
+    void *memory;
+    if(posix_memalign(&memory, TRACE_CACHE_LINE_SIZE, sizeof(trace_ring_t)) != 0) {
+        fprintf(stderr, "ERROR, could not allocate the trace ring of a worker.\n");
+        return NULL;
+    }
+    trace_ring_t *ring = (trace_ring_t *) memory;
+    ring->head = ring->tail = ring->dropped = 0;
+    ring->named = false;
+    // Each thread's first request is traced.
+    ring->countdown = 1;
+    pthread_mutex_lock(&trace.lock);
+    ring->thread = trace.num_rings++;
+    ring->next = trace.rings;
+    // Released so the writer never sees the ring before its fields are set.
+    __atomic_store_n(&trace.rings, ring, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&trace.lock);
+    return ring;
+}
+
+// Decides whether the next request on a connection served by the thread that owns ring is traced, and clears its
+// trace if it is. ring is NULL when tracing is off. Returns whether it is.
+bool trace_sample(trace_ring_t *ring, request_trace_t *request_trace) {
+    request_trace->sampled = false;
+    if(ring == NULL || --ring->countdown > 0) {
+        return false;
+    }
+    ring->countdown = trace.sample_every;
+    memset(request_trace->spans, 0, sizeof(request_trace->spans));
+    request_trace->sampled = true;
+    return true;
+}
+
+// Adds the time from start to end to a stage of a sampled request. A stage gone through more than once (parsing each
+// read) starts when it first did and lasts as long as all of them together.
+void trace_add_span(request_trace_t *request_trace, int stage, long long start, long long end) {
+    trace_span_t *span = &request_trace->spans[stage];
+    if(span->start == 0) {
+        span->start = start;
+    }
+    span->duration += end - start;
+}
+
+// Hands the trace of a sampled request, whose response was done with at end, to the writer if it took at least the
+// --trace-slow threshold. record has the request's method and path, and its status and whether it was sent in full.
+void trace_finish(trace_ring_t *ring, request_trace_t *request_trace, const access_log_record_t *record,
+                  long long end) {
+    long long start = 0;
+    for(int stage = 0; stage < TRACE_NUM_STAGES; stage++) {
+        long long stage_start = request_trace->spans[stage].start;
+        if(stage_start != 0 && (start == 0 || stage_start < start)) {
+            start = stage_start;
+        }
+    }
+    if(start == 0 || end - start < trace.slow) {
+        return;
+    }
+    uint64_t tail = ring->tail;
+    if(tail - __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == TRACE_RING_RECORDS) {
+        __atomic_store_n(&ring->dropped, ring->dropped + 1, __ATOMIC_RELAXED);
+        return;
+    }
+    trace_record_t *trace_record = &ring->records[tail & (TRACE_RING_RECORDS - 1)];
+    memcpy(trace_record->spans, request_trace->spans, sizeof(trace_record->spans));
+    trace_record->request.start = start;
+    trace_record->request.duration = end - start;
+    trace_record->status = record->status;
+    trace_record->completed = record->completed;
+    trace_record->method_length = record->method_length;
+    trace_record->path_length = record->path_length;
+    memcpy(trace_record->method, record->method, record->method_length);
+    memcpy(trace_record->path, record->path, record->path_length);
+    __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,106 @@
+//
+// Created by User on 14/10/2026.
+//
+
+#ifndef COMP30023_2022_PROJECT_2_TRACE_H
+#define COMP30023_2022_PROJECT_2_TRACE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "config.h"
+#include "accesslog.h"
+
+// The stages a traced request is split into: waiting in the worker pool's queue after accept() (only for the first
+// request on a connection), reading it (from the connection being accepted, or the first byte of a later request
+// arriving, until the whole request is there), parsing it (every call to the parser added up), building its file
+// path, finding the file (the caches, open() and fstat()) and sending the response.
+#define TRACE_STAGE_QUEUE 0
+#define TRACE_STAGE_READ 1
+#define TRACE_STAGE_PARSE 2
+#define TRACE_STAGE_PATH 3
+#define TRACE_STAGE_OPEN 4
+#define TRACE_STAGE_SEND 5
+#define TRACE_NUM_STAGES 6
+
+// Finished traces each thread's ring holds. A power of two, so a position is turned into a slot with a mask.
+#define TRACE_RING_RECORDS 256
+// The writer thread wakes up this often to drain the rings, and writes whenever its batch fills up.
+#define TRACE_FLUSH_INTERVAL_MS 100
+#define TRACE_BATCH_SIZE (64 * 1024)
+// Longest output one trace becomes (an event per stage and one for the whole request), which is how much room the
+// batch must have left before one is added. A path can take up to six times its length once escaped for JSON.
+#define TRACE_OUTPUT_MAX_SIZE (2048 + 6 * ACCESS_LOG_PATH_MAX)
+#define TRACE_FILE_MODE 0644
+#define TRACE_CACHE_LINE_SIZE 64
+
+// One stage of a traced request: when it started and how long it took, in nanoseconds of CLOCK_MONOTONIC. A start of
+// 0 means the request never went through it.
+typedef struct trace_span trace_span_t;
+struct trace_span {
+    int64_t start;
+    int64_t duration;
+};
+
+// The trace of the request a connection is on, kept with its request metrics. The instrumented steps only look at
+// sampled, so a request that is not traced costs each of them a single branch.
+typedef struct request_trace request_trace_t;
+struct request_trace {
+    bool sampled;
+    trace_span_t spans[TRACE_NUM_STAGES];
+};
+
+// A traced request that has been responded to, on its way from the thread that served it to the writer thread. The
+// method and path are copied from its access log record.
+typedef struct trace_record trace_record_t;
+struct trace_record {
+    trace_span_t spans[TRACE_NUM_STAGES];
+    // The whole request, from the start of its first stage until the response was done with.
+    trace_span_t request;
+    uint16_t status;
+    uint8_t completed;
+    uint8_t method_length;
+    uint16_t path_length;
+    char method[ACCESS_LOG_METHOD_MAX];
+    char path[ACCESS_LOG_PATH_MAX];
+};
+
+// A single producer, single consumer ring of finished traces, like the access log's rings. Only the thread that owns
+// it moves tail, decides which of its requests are sampled and counts drops; only the writer thread moves head.
+typedef struct trace_ring trace_ring_t;
+struct trace_ring {
+    uint64_t tail;
+    uint64_t dropped;
+    // Requests left until the next one is sampled.
+    int countdown;
+    // Which thread the traces are from, as the tid of their events.
+    int thread;
+    uint64_t head __attribute__((aligned(TRACE_CACHE_LINE_SIZE)));
+    // Whether the writer has named the thread in the trace file yet. Only the writer looks at it.
+    bool named;
+    trace_ring_t *next;
+    trace_record_t records[TRACE_RING_RECORDS] __attribute__((aligned(TRACE_CACHE_LINE_SIZE)));
+};
+
+bool trace_init(server_config_t *config);
+
+bool trace_enabled(void);
+
+trace_ring_t *trace_register_ring(void);
+
+bool trace_sample(trace_ring_t *ring, request_trace_t *trace);
+
+void trace_add_span(request_trace_t *trace, int stage, long long start, long long end);
+
+void trace_finish(trace_ring_t *ring, request_trace_t *trace, const access_log_record_t *record, long long end);
+
+#endif //COMP30023_2022_PROJECT_2_TRACE_H
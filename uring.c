@@ -0,0 +1,779 @@
+//
+// Created by User on 14/10/2026.
+//
+#include "uring.h"
+
+#ifdef WITH_URING
+
+// glibc has no wrappers for the io_uring system calls, so they are made directly.
+// https://man7.org/linux/man-pages/man7/io_uring.7.html
+static int io_uring_setup(unsigned entries, struct io_uring_params *params) {
+    return (int) syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags, void *arg,
+                          size_t arg_size) {
+    return (int) syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, arg_size);
+}
+
+static int io_uring_register(int fd, unsigned opcode, void *arg, unsigned num_args) {
+    return (int) syscall(__NR_io_uring_register, fd, opcode, arg, num_args);
+}
+
+// Unmaps and closes everything uring_init set up.
+static void uring_destroy(uring_t *ring) {
+    if(ring->sqes != NULL && ring->sqes != MAP_FAILED) {
+        munmap(ring->sqes, ring->sqes_size);
+    }
+    if(ring->rings != NULL && ring->rings != MAP_FAILED) {
+        munmap(ring->rings, ring->rings_size);
+    }
+    close(ring->fd);
+}
+
+// Sets up an io_uring instance with room for entries submissions and maps its rings. The ring is only ever used by
+// the thread that creates it, and completion work is left for that thread to pick up the next time it enters the
+// kernel instead of interrupting it (IORING_SETUP_SINGLE_ISSUER and IORING_SETUP_COOP_TASKRUN, from Linux 6.0).
+// IORING_SETUP_DEFER_TASKRUN goes a step further, but held completions back until the wait timed out often enough
+// to cost more than it saved. Older kernels reject the flags and get a plain ring instead. Returns false if io_uring
+// cannot be used at all, or lacks the features needed here (one mapping for both rings, and timeouts on
+// io_uring_enter, both from Linux 5.11).
+static bool uring_init(uring_t *ring, unsigned entries) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_SUBMIT_ALL | IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_COOP_TASKRUN;
+    if((ring->fd = io_uring_setup(entries, &params)) < 0 && errno == EINVAL) {
+        memset(&params, 0, sizeof(params));
+        ring->fd = io_uring_setup(entries, &params);
+    }
+    if(ring->fd < 0) {
+        return false;
+    }
+    ring->rings = ring->sqes = NULL;
+    if(!(params.features & IORING_FEAT_SINGLE_MMAP) || !(params.features & IORING_FEAT_EXT_ARG) ||
+       !(params.features & IORING_FEAT_NODROP)) {
+        uring_destroy(ring);
+        errno = ENOSYS;
+        return false;
+    }
+
+    size_t sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    size_t cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    ring->rings_size = sq_size > cq_size ? sq_size : cq_size;
+    ring->rings = mmap(NULL, ring->rings_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd,
+                       IORING_OFF_SQ_RING);
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = (struct io_uring_sqe *) mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+                                              MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if(ring->rings == MAP_FAILED || ring->sqes == MAP_FAILED) {
+        uring_destroy(ring);
+        return false;
+    }
+
+    char *rings = (char *) ring->rings;
+    ring->sq_head = (unsigned *) (rings + params.sq_off.head);
+    ring->sq_tail = (unsigned *) (rings + params.sq_off.tail);
+    ring->sq_array = (unsigned *) (rings + params.sq_off.array);
+    ring->sq_mask = *(unsigned *) (rings + params.sq_off.ring_mask);
+    ring->sq_entries = params.sq_entries;
+    ring->sq_local_tail = *ring->sq_tail;
+    ring->cq_head = (unsigned *) (rings + params.cq_off.head);
+    ring->cq_tail = (unsigned *) (rings + params.cq_off.tail);
+    ring->cq_mask = *(unsigned *) (rings + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *) (rings + params.cq_off.cqes);
+    return true;
+}
+
+// Tells the kernel about every entry filled in since the last call, and if wait_ms is not 0 waits up to that long
+// for at least one completion. This is the only system call the loop makes for most requests: one call submits the
+// operations of every connection that made progress and collects the completions of all of them.
+static void uring_submit(uring_t *ring, int wait_ms) {
+    unsigned to_submit = ring->sq_local_tail - *ring->sq_tail;
+    // The kernel reads the entries after it sees the new tail, so the tail is stored with release ordering.
+    __atomic_store_n(ring->sq_tail, ring->sq_local_tail, __ATOMIC_RELEASE);
+    if(wait_ms == 0) {
+        if(to_submit > 0 && io_uring_enter(ring->fd, to_submit, 0, 0, NULL, 0) < 0 && errno != EINTR) {
+            perror("io_uring_enter");
+        }
+        return;
+    }
+    struct __kernel_timespec timeout = {wait_ms / 1000, (wait_ms % 1000) * 1000000LL};
+    struct io_uring_getevents_arg arg;
+    memset(&arg, 0, sizeof(arg));
+    arg.ts = (uint64_t) (uintptr_t) &timeout;
+    if(io_uring_enter(ring->fd, to_submit, 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg,
+                      sizeof(arg)) < 0 && errno != ETIME && errno != EINTR) {
+        perror("io_uring_enter");
+    }
+}
+
+// Returns a cleared submission queue entry, submitting the entries filled in so far first if the queue is full.
+static struct io_uring_sqe *uring_get_sqe(uring_t *ring) {
+    while(ring->sq_local_tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) >= ring->sq_entries) {
+        uring_submit(ring, 0);
+    }
+    unsigned index = ring->sq_local_tail & ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    ring->sq_array[index] = index;
+    ring->sq_local_tail++;
+    return sqe;
+}
+
+// Returns true if this kernel supports every operation the io_uring loops use, which is asked through
+// IORING_REGISTER_PROBE (Linux 5.6). Called once at startup, before deciding between the io_uring and epoll loops.
+bool uring_supported(void) {
+    uring_t ring;
+    if(!uring_init(&ring, 8)) {
+        return false;
+    }
+    size_t probe_size = sizeof(struct io_uring_probe) + IORING_OP_LAST * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe *probe = (struct io_uring_probe *) calloc(1, probe_size);
+    bool supported = probe != NULL && io_uring_register(ring.fd, IORING_REGISTER_PROBE, probe, IORING_OP_LAST) == 0;
+    int needed[] = {IORING_OP_ACCEPT, IORING_OP_RECV, IORING_OP_SENDMSG, IORING_OP_SPLICE, IORING_OP_POLL_ADD,
+                    IORING_OP_ASYNC_CANCEL};
+    for(size_t i = 0; supported && i < sizeof(needed) / sizeof(needed[0]); i++) {
+        supported = needed[i] <= probe->last_op && (probe->ops[needed[i]].flags & IO_URING_OP_SUPPORTED);
+    }
+    free(probe);
+    uring_destroy(&ring);
+    return supported;
+}
+
+// Hands provided buffer id back to the kernel so it can be picked for another read.
+static void recycle_provided_buffer(uring_loop_t *loop, int id) {
+    struct io_uring_buf *buffer = &loop->buffer_ring->bufs[loop->buffer_ring_tail & (URING_PROVIDED_BUFFERS - 1)];
+    buffer->addr = (uint64_t) (uintptr_t) (loop->provided_buffers +
+                                           (size_t) id * (REQUEST_MAX_BUFFER_SIZE + NULL_TERMINATOR_SPACE));
+    buffer->len = REQUEST_MAX_BUFFER_SIZE;
+    buffer->bid = (unsigned short) id;
+    loop->buffer_ring_tail++;
+    __atomic_store_n(&loop->buffer_ring->tail, loop->buffer_ring_tail, __ATOMIC_RELEASE);
+}
+
+// Registers a ring of URING_PROVIDED_BUFFERS read buffers with the kernel (Linux 5.19). A read submitted with
+// IOSQE_BUFFER_SELECT then takes one only when data arrives, and the completion says which. Leaves
+// loop->buffer_ring NULL if the kernel cannot do this.
+static void provide_buffers(uring_loop_t *loop) {
+    loop->buffer_ring = NULL;
+    loop->buffer_ring_tail = 0;
+    // The ring has to be page aligned, which mmap() guarantees.
+    loop->buffer_ring_size = URING_PROVIDED_BUFFERS * sizeof(struct io_uring_buf);
+    void *buffer_ring = mmap(NULL, loop->buffer_ring_size, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1,
+                             0);
+    loop->provided_buffers = (char *) malloc((size_t) URING_PROVIDED_BUFFERS *
+                                             (REQUEST_MAX_BUFFER_SIZE + NULL_TERMINATOR_SPACE));
+    if(buffer_ring == MAP_FAILED || loop->provided_buffers == NULL) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    struct io_uring_buf_reg registration;
+    memset(&registration, 0, sizeof(registration));
+    registration.ring_addr = (uint64_t) (uintptr_t) buffer_ring;
+    registration.ring_entries = URING_PROVIDED_BUFFERS;
+    registration.bgid = URING_BUFFER_GROUP;
+    if(io_uring_register(loop->ring.fd, IORING_REGISTER_PBUF_RING, &registration, 1) < 0) {
+        munmap(buffer_ring, loop->buffer_ring_size);
+        free(loop->provided_buffers);
+        loop->provided_buffers = NULL;
+        return;
+    }
+    loop->buffer_ring = (struct io_uring_buf_ring *) buffer_ring;
+    for(int id = 0; id < URING_PROVIDED_BUFFERS; id++) {
+        recycle_provided_buffer(loop, id);
+    }
+}
+
+// Gives a connection's read buffer back to wherever it came from.
+static void release_connection_buffer(uring_loop_t *loop, uring_connection_t *connection) {
+    if(connection->buffer == NULL) {
+        return;
+    }
+    if(connection->buffer_id != NO_BUFFER_ID) {
+        recycle_provided_buffer(loop, connection->buffer_id);
+    } else {
+        buffer_pool_release(&loop->memory.buffers, connection->buffer);
+    }
+    connection->buffer = NULL;
+    connection->buffer_id = NO_BUFFER_ID;
+}
+
+static time_t monotonic_seconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec;
+}
+
+// Removes a connection from its loop's idle list, if it is on it.
+static void unlink_idle_connection(uring_loop_t *loop, uring_connection_t *connection) {
+    if(connection->idle_prev == NULL && loop->idle_head != connection) {
+        return;
+    }
+    if(connection->idle_prev != NULL) {
+        connection->idle_prev->idle_next = connection->idle_next;
+    } else {
+        loop->idle_head = connection->idle_next;
+    }
+    if(connection->idle_next != NULL) {
+        connection->idle_next->idle_prev = connection->idle_prev;
+    } else {
+        loop->idle_tail = connection->idle_prev;
+    }
+    connection->idle_prev = connection->idle_next = NULL;
+}
+
+// Moves a connection to the back of the idle list, which is kept ordered by last activity as in the event loops.
+static void touch_connection(uring_loop_t *loop, uring_connection_t *connection) {
+    if(loop->idle_tail != connection) {
+        unlink_idle_connection(loop, connection);
+        connection->idle_prev = loop->idle_tail;
+        if(loop->idle_tail != NULL) {
+            loop->idle_tail->idle_next = connection;
+        } else {
+            loop->idle_head = connection;
+        }
+        loop->idle_tail = connection;
+    }
+    connection->last_active = monotonic_seconds();
+}
+
+// Gives a connection a new deadline, as set_deadline does in the event loops. A connection that is closing has no
+// deadline any more, even if its last operations still complete with progress.
+static void set_deadline(uring_loop_t *loop, uring_connection_t *connection, int deadline, int timeout) {
+    if(connection->closing) {
+        return;
+    }
+    connection->deadline = deadline;
+    wheel_schedule(&loop->timers, &connection->timer, connection->last_active + timeout);
+}
+
+// Gives the connection's pipe back to the loop for the next file transfer. A pipe that still holds part of a file
+// (the transfer failed half way) would hand it to the next connection, so it is closed instead, as are pipes beyond
+// what the loop keeps spare.
+static void release_pipe(uring_loop_t *loop, uring_connection_t *connection) {
+    if(connection->pipefds[0] == NO_PIPE) {
+        return;
+    }
+    if(connection->pipe_pending == 0 && loop->num_spare_pipes < URING_SPARE_PIPES) {
+        int *spare = loop->spare_pipes[loop->num_spare_pipes++];
+        spare[0] = connection->pipefds[0];
+        spare[1] = connection->pipefds[1];
+    } else {
+        close(connection->pipefds[0]);
+        close(connection->pipefds[1]);
+    }
+    connection->pipefds[0] = connection->pipefds[1] = NO_PIPE;
+    connection->pipe_pending = 0;
+}
+
+// Closes a connection. If the kernel still has operations of the connection in hand, its socket is shut down instead,
+// which makes them complete straight away, and the connection is closed for real when the last of them does.
+static void close_uring_connection(uring_loop_t *loop, uring_connection_t *connection) {
+    unlink_idle_connection(loop, connection);
+    wheel_cancel(&connection->timer);
+    if(connection->in_flight > 0) {
+        if(!connection->closing) {
+            connection->closing = true;
+            shutdown(connection->sockfd, SHUT_RDWR);
+        }
+        return;
+    }
+    // A response still being written when the connection is closed was never sent in full.
+    if(connection->state == CONNECTION_WRITING) {
+        metrics_record_response(&connection->metrics, &connection->response, false);
+        release_http_response(&connection->response);
+    }
+    release_connection_buffer(loop, connection);
+    release_pipe(loop, connection);
+    admission_release(connection->address);
+    close(connection->sockfd);
+    if(loop->num_free_connections < CONNECTION_POOL_CAPACITY) {
+        connection->idle_next = loop->free_connections;
+        loop->free_connections = connection;
+        loop->num_free_connections++;
+    } else {
+        free(connection);
+    }
+}
+
+static uint64_t user_data_for(uring_connection_t *connection, int op) {
+    return (uint64_t) (uintptr_t) connection | op;
+}
+
+// Submits the next read of a connection. A connection without a buffer lets the ring pick one of its provided buffers
+// when data arrives. One that has part of a request already reads the rest into the same buffer.
+static void submit_read(uring_loop_t *loop, uring_connection_t *connection) {
+    struct io_uring_sqe *sqe;
+    if(connection->buffer == NULL && loop->buffer_ring != NULL) {
+        sqe = uring_get_sqe(&loop->ring);
+        sqe->opcode = IORING_OP_RECV;
+        sqe->fd = connection->sockfd;
+        sqe->len = REQUEST_MAX_BUFFER_SIZE;
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = URING_BUFFER_GROUP;
+    } else {
+        if(connection->buffer == NULL &&
+           (connection->buffer = buffer_pool_acquire(&loop->memory.buffers)) == NULL) {
+            perror("malloc");
+            close_uring_connection(loop, connection);
+            return;
+        }
+        // The buffer filled up without a complete request, where read() would have returned 0.
+        if(connection->bytes_read_so_far == REQUEST_MAX_BUFFER_SIZE) {
+            close_uring_connection(loop, connection);
+            return;
+        }
+        sqe = uring_get_sqe(&loop->ring);
+        sqe->opcode = IORING_OP_RECV;
+        sqe->fd = connection->sockfd;
+        sqe->addr = (uint64_t) (uintptr_t) (connection->buffer + connection->bytes_read_so_far);
+        sqe->len = REQUEST_MAX_BUFFER_SIZE - connection->bytes_read_so_far;
+    }
+    sqe->user_data = user_data_for(connection, URING_OP_RECV);
+    connection->in_flight++;
+}
+
+// Gives the connection a pipe for the response it is sending, a spare one of the loop's if there is one, and finds out
+// how big it is. New pipes are made as big as they will go up to URING_PIPE_SIZE. Returns false if no pipe could be
+// made.
+static bool acquire_pipe(uring_loop_t *loop, uring_connection_t *connection) {
+    if(connection->pipefds[0] != NO_PIPE) {
+        return true;
+    }
+    if(loop->num_spare_pipes > 0) {
+        int *spare = loop->spare_pipes[--loop->num_spare_pipes];
+        connection->pipefds[0] = spare[0];
+        connection->pipefds[1] = spare[1];
+    } else if(pipe2(connection->pipefds, O_CLOEXEC) < 0) {
+        perror("pipe2");
+        connection->pipefds[0] = connection->pipefds[1] = NO_PIPE;
+        return false;
+    } else {
+        fcntl(connection->pipefds[1], F_SETPIPE_SZ, URING_PIPE_SIZE);
+    }
+    int pipe_size = fcntl(connection->pipefds[1], F_GETPIPE_SZ);
+    connection->pipe_size = pipe_size > 0 ? (size_t) pipe_size : (size_t) getpagesize();
+    return true;
+}
+
+// Submits a splice of length bytes from the connection's pipe to its socket. SPLICE_F_MORE is the splice()
+// counterpart of MSG_MORE.
+static struct io_uring_sqe *submit_splice_out(uring_loop_t *loop, uring_connection_t *connection, size_t length,
+                                              bool more) {
+    struct io_uring_sqe *sqe = uring_get_sqe(&loop->ring);
+    sqe->opcode = IORING_OP_SPLICE;
+    sqe->fd = connection->sockfd;
+    sqe->off = (uint64_t) -1;
+    sqe->splice_fd_in = connection->pipefds[0];
+    sqe->splice_off_in = (uint64_t) -1;
+    sqe->len = length;
+    sqe->splice_flags = more ? SPLICE_F_MORE : 0;
+    sqe->user_data = user_data_for(connection, URING_OP_SPLICE_OUT);
+    connection->in_flight++;
+    return sqe;
+}
+
+static void continue_connection(uring_loop_t *loop, uring_connection_t *connection);
+
+// Submits whatever comes next in the connection's response. The memory chunks up to the next file chunk go in one
+// IORING_OP_SENDMSG, just as continue_http_response sends them with one sendmsg(), and file chunks replace sendfile()
+// with a splice from the file into the pipe linked to a splice from the pipe into the socket, so the second only
+// starts once the first has finished and both are submitted together. Once the response has been sent the connection
+// goes back to reading, or is closed.
+static void submit_write(uring_loop_t *loop, uring_connection_t *connection) {
+    http_response_t *response = &connection->response;
+    advance_response(response, 0);
+    if(response->current_chunk == response->num_chunks) {
+        metrics_record_response(&connection->metrics, response, true);
+        release_http_response(response);
+        release_pipe(loop, connection);
+        connection->state = CONNECTION_READING;
+        if(!connection->keep_alive || (loop->draining && connection->bytes_read_so_far == 0)) {
+            close_uring_connection(loop, connection);
+            return;
+        }
+        if(connection->bytes_read_so_far == 0) {
+            release_connection_buffer(loop, connection);
+            set_deadline(loop, connection, ADMISSION_IDLE_TIMEOUT, loop->config->keepalive_timeout);
+        } else {
+            set_deadline(loop, connection, ADMISSION_HEADER_TIMEOUT, loop->config->header_timeout);
+        }
+        continue_connection(loop, connection);
+        return;
+    }
+
+    response_chunk_t *chunk = &response->chunks[response->current_chunk];
+    if(chunk->data != NULL) {
+        bool more;
+        memset(&connection->message, 0, sizeof(connection->message));
+        connection->message.msg_iov = connection->iov;
+        connection->message.msg_iovlen = gather_memory_chunks(response, connection->iov, &more);
+        struct io_uring_sqe *sqe = uring_get_sqe(&loop->ring);
+        sqe->opcode = IORING_OP_SENDMSG;
+        sqe->fd = connection->sockfd;
+        sqe->addr = (uint64_t) (uintptr_t) &connection->message;
+        sqe->len = 1;
+        sqe->msg_flags = more ? MSG_MORE : 0;
+        sqe->user_data = user_data_for(connection, URING_OP_SEND);
+        connection->in_flight++;
+        return;
+    }
+
+    if(!acquire_pipe(loop, connection)) {
+        close_uring_connection(loop, connection);
+        return;
+    }
+    size_t left = chunk->length - response->chunk_sent;
+    size_t length = left < connection->pipe_size ? left : connection->pipe_size;
+    bool more = length < left || response->current_chunk + 1 < response->num_chunks;
+    struct io_uring_sqe *sqe = uring_get_sqe(&loop->ring);
+    sqe->opcode = IORING_OP_SPLICE;
+    sqe->fd = connection->pipefds[1];
+    sqe->off = (uint64_t) -1;
+    sqe->splice_fd_in = response->file_fd;
+    sqe->splice_off_in = (uint64_t) (chunk->offset + response->chunk_sent);
+    sqe->len = length;
+    sqe->flags = IOSQE_IO_LINK;
+    sqe->user_data = user_data_for(connection, URING_OP_SPLICE_IN);
+    connection->in_flight++;
+    submit_splice_out(loop, connection, length, more);
+}
+
+// Goes through the same steps as start_response in the event loops for the request the parser has just completed (or
+// rejected), and starts sending the response.
+static void start_response(uring_loop_t *loop, uring_connection_t *connection, int status) {
+    char *file_path;
+    http_request_t *request = &connection->parser.request;
+
+    connection->requests_served++;
+    count_allocation_event(&allocation_counters.requests);
+    metrics_start_request(&connection->metrics, connection->buffer, status == PARSE_COMPLETE ? request : NULL);
+    arena_reset(&loop->memory.arena);
+    if(status == PARSE_COMPLETE && metrics_get_file_path(&connection->metrics, &file_path, connection->buffer, request,
+                                                         &loop->memory.arena)) {
+        connection->keep_alive = request->keep_alive && connection->requests_served < loop->config->max_requests &&
+                                 !restart_draining();
+        prepare_http_response(&connection->response, loop->context, file_path, request->minor_version,
+                              connection->keep_alive, connection->buffer, request);
+        consume_request(connection->buffer, &connection->bytes_read_so_far, &connection->parser);
+    } else {
+        connection->keep_alive = false;
+        prepare_http_response(&connection->response, loop->context, NULL, 0, false, NULL, NULL);
+    }
+    metrics_start_response(&connection->metrics);
+    connection->state = CONNECTION_WRITING;
+    connection->sent_at_deadline = 0;
+    set_deadline(loop, connection, ADMISSION_SEND_TIMEOUT, loop->config->send_timeout);
+    submit_write(loop, connection);
+}
+
+// Responds to the next request if the buffer already holds one, or reads more of it otherwise.
+static void continue_connection(uring_loop_t *loop, uring_connection_t *connection) {
+    int status = metrics_parse_request(&connection->metrics, &connection->parser, connection->buffer,
+                                       connection->bytes_read_so_far);
+    if(status != PARSE_INCOMPLETE) {
+        start_response(loop, connection, status);
+    } else {
+        submit_read(loop, connection);
+    }
+}
+
+// Submits an accept on the loop's listening socket. A multishot accept (Linux 5.19) stays armed and completes once
+// for every new connection, so it is only submitted again if the kernel ends it.
+static void submit_accept(uring_loop_t *loop) {
+    struct io_uring_sqe *sqe = uring_get_sqe(&loop->ring);
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = loop->listenfd;
+    sqe->ioprio = loop->multishot_accept ? IORING_ACCEPT_MULTISHOT : 0;
+    sqe->user_data = URING_OP_ACCEPT;
+}
+
+// Makes room for a new connection by closing the loop's slowest one, as evict_slowest_connections does in the event
+// loops. Unlike there it can be done straight away: the connection always has an operation in flight, so it is only
+// marked closing and its memory stays put until the last of its completions has been handled.
+static void evict_slowest_connection(uring_loop_t *loop) {
+    uring_connection_t *slowest = loop->idle_head;
+    if(slowest != NULL && monotonic_seconds() - slowest->last_active >= ADMISSION_EVICT_MIN_IDLE) {
+        admission_record(ADMISSION_EVICTED);
+        close_uring_connection(loop, slowest);
+    }
+}
+
+// Submits a poll of the drain eventfd, which completes once the server starts draining.
+static void submit_drain_poll(uring_loop_t *loop) {
+    struct io_uring_sqe *sqe = uring_get_sqe(&loop->ring);
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = restart_drain_fd();
+    sqe->poll32_events = POLLIN;
+    sqe->user_data = URING_OP_DRAIN;
+}
+
+// Stops the loop accepting connections by cancelling its accept, and closes the connections waiting for their next
+// request, as start_draining does in the event loops. A connection the accept completes with before it is cancelled
+// is still served.
+static void start_draining(uring_loop_t *loop) {
+    loop->draining = true;
+    struct io_uring_sqe *sqe = uring_get_sqe(&loop->ring);
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->addr = URING_OP_ACCEPT;
+    sqe->user_data = URING_OP_CANCEL;
+    uring_connection_t *connection = loop->idle_head;
+    while(connection != NULL) {
+        uring_connection_t *next = connection->idle_next;
+        if(connection->state == CONNECTION_READING && connection->requests_served > 0 &&
+           connection->bytes_read_so_far == 0 && !connection->closing) {
+            close_uring_connection(loop, connection);
+        }
+        connection = next;
+    }
+}
+
+// Sets up a connection for a socket the ring accepted and submits its first read. The socket is left blocking: the
+// ring never blocks on it, and would give up with EAGAIN instead of waiting for data on a non-blocking one. A
+// multishot accept has nowhere to put the address of each client, so admission_admit asks for it if it needs it.
+static void handle_accept(uring_loop_t *loop, struct io_uring_cqe *cqe) {
+    if(!(cqe->flags & IORING_CQE_F_MORE) && !loop->draining) {
+        if(cqe->res == -EINVAL && loop->multishot_accept) {
+            loop->multishot_accept = false;
+        }
+        submit_accept(loop);
+    }
+    if(cqe->res < 0) {
+        if(cqe->res != -EINVAL && cqe->res != -ECANCELED) {
+            fprintf(stderr, "accept: %s\n", strerror(-cqe->res));
+        }
+        return;
+    }
+    address_count_t *address;
+    int verdict = admission_admit(cqe->res, NULL, &address);
+    if(verdict != ADMISSION_ACCEPTED) {
+        admission_reject(cqe->res, verdict, false);
+        return;
+    }
+    if(admission_under_pressure()) {
+        evict_slowest_connection(loop);
+    }
+
+    uring_connection_t *connection = loop->free_connections;
+    if(connection != NULL) {
+        loop->free_connections = connection->idle_next;
+        loop->num_free_connections--;
+    } else if((connection = (uring_connection_t *) counted_malloc(sizeof(uring_connection_t))) == NULL) {
+        perror("malloc");
+        admission_release(address);
+        close(cqe->res);
+        return;
+    }
+    connection->sockfd = cqe->res;
+    connection->state = CONNECTION_READING;
+    connection->bytes_read_so_far = 0;
+    connection->buffer = NULL;
+    connection->buffer_id = NO_BUFFER_ID;
+    http_parser_init(&connection->parser);
+    metrics_start_connection(&connection->metrics, loop->metrics, metrics_now());
+    connection->requests_served = 0;
+    connection->keep_alive = false;
+    connection->in_flight = 0;
+    connection->closing = false;
+    connection->failed = false;
+    connection->pipefds[0] = connection->pipefds[1] = NO_PIPE;
+    connection->pipe_pending = 0;
+    connection->idle_prev = connection->idle_next = NULL;
+    connection->address = address;
+    wheel_timer_init(&connection->timer);
+    touch_connection(loop, connection);
+    set_deadline(loop, connection, ADMISSION_HEADER_TIMEOUT, loop->config->header_timeout);
+    submit_read(loop, connection);
+}
+
+// Handles the completion of a read.
+static void handle_recv(uring_loop_t *loop, uring_connection_t *connection, struct io_uring_cqe *cqe) {
+    if(cqe->flags & IORING_CQE_F_BUFFER) {
+        connection->buffer_id = (int) (cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+        connection->buffer = loop->provided_buffers +
+                             (size_t) connection->buffer_id * (REQUEST_MAX_BUFFER_SIZE + NULL_TERMINATOR_SPACE);
+    }
+    if(connection->closing) {
+        return;
+    }
+    // Every provided buffer is in use, so this connection gets one from the pool and reads again.
+    if(cqe->res == -ENOBUFS && connection->buffer == NULL) {
+        if((connection->buffer = buffer_pool_acquire(&loop->memory.buffers)) == NULL) {
+            perror("malloc");
+            close_uring_connection(loop, connection);
+            return;
+        }
+        submit_read(loop, connection);
+        return;
+    }
+    // The client went away before sending a complete request, or the read failed.
+    if(cqe->res <= 0) {
+        if(cqe->res < 0 && cqe->res != -ECONNRESET) {
+            fprintf(stderr, "recv: %s\n", strerror(-cqe->res));
+        }
+        close_uring_connection(loop, connection);
+        return;
+    }
+    connection->bytes_read_so_far += cqe->res;
+    if(connection->deadline == ADMISSION_IDLE_TIMEOUT) {
+        set_deadline(loop, connection, ADMISSION_HEADER_TIMEOUT, loop->config->header_timeout);
+    }
+    continue_connection(loop, connection);
+}
+
+// Handles the completion of a send or of either splice. A splice into the pipe that comes up short (the file
+// shrank, or the pipe had less room) breaks the link, so the splice out of the pipe is cancelled and whatever did
+// go into the pipe is sent by a splice of its own before the response moves on.
+static void handle_write(uring_loop_t *loop, uring_connection_t *connection, struct io_uring_cqe *cqe, int op) {
+    if(cqe->res > 0 && op == URING_OP_SPLICE_IN) {
+        connection->pipe_pending += cqe->res;
+    } else if(cqe->res > 0) {
+        if(op == URING_OP_SPLICE_OUT) {
+            connection->pipe_pending -= cqe->res;
+        }
+        advance_response(&connection->response, cqe->res);
+        // Every bit of the response the client takes gives it another send timeout to take the next.
+        if(connection->response.bytes_sent != connection->sent_at_deadline) {
+            connection->sent_at_deadline = connection->response.bytes_sent;
+            set_deadline(loop, connection, ADMISSION_SEND_TIMEOUT, loop->config->send_timeout);
+        }
+    } else if(!(op == URING_OP_SPLICE_OUT && cqe->res == -ECANCELED)) {
+        // A splice of 0 bytes out of the file means the file shrank and the Content-Length cannot be met.
+        if(cqe->res < 0 && cqe->res != -EPIPE && cqe->res != -ECONNRESET) {
+            fprintf(stderr, "%s: %s\n", op == URING_OP_SEND ? "sendmsg" : "splice", strerror(-cqe->res));
+        }
+        connection->failed = true;
+    }
+
+    if(connection->in_flight > 0 || connection->closing) {
+        return;
+    }
+    if(connection->failed) {
+        close_uring_connection(loop, connection);
+    } else if(connection->pipe_pending > 0) {
+        submit_splice_out(loop, connection, connection->pipe_pending, true);
+    } else {
+        submit_write(loop, connection);
+    }
+}
+
+// Dispatches every completion that has arrived to the operation it finishes.
+static void handle_completions(uring_loop_t *loop) {
+    uring_t *ring = &loop->ring;
+    unsigned head = *ring->cq_head;
+    unsigned tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+    for(; head != tail; head++) {
+        struct io_uring_cqe *cqe = &ring->cqes[head & ring->cq_mask];
+        int op = (int) (cqe->user_data & URING_OP_MASK);
+        uint64_t address = cqe->user_data & ~(uint64_t) URING_OP_MASK;
+        uring_connection_t *connection = (uring_connection_t *) (uintptr_t) address;
+        if(op == URING_OP_ACCEPT) {
+            handle_accept(loop, cqe);
+            continue;
+        }
+        if(op == URING_OP_DRAIN || op == URING_OP_CANCEL) {
+            if(op == URING_OP_DRAIN && !loop->draining) {
+                start_draining(loop);
+            }
+            continue;
+        }
+        connection->in_flight--;
+        if(!connection->closing) {
+            touch_connection(loop, connection);
+        }
+        if(op == URING_OP_RECV) {
+            handle_recv(loop, connection, cqe);
+        } else {
+            handle_write(loop, connection, cqe, op);
+        }
+        if(connection->closing && connection->in_flight == 0) {
+            close_uring_connection(loop, connection);
+        }
+    }
+    // The slots can be reused by the kernel once the new head is visible.
+    __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+}
+
+// Closes every connection whose deadline has passed, counting which deadline it missed.
+static void expire_connections(uring_loop_t *loop) {
+    time_t now = monotonic_seconds();
+    wheel_timer_t *timer;
+    while((timer = wheel_expire(&loop->timers, now)) != NULL) {
+        uring_connection_t *connection = (uring_connection_t *) ((char *) timer - offsetof(uring_connection_t, timer));
+        admission_record(connection->deadline);
+        close_uring_connection(loop, connection);
+    }
+}
+
+// The body of every io_uring loop thread. The ring is created here, since only the thread that creates it may
+// submit to it, and waits for completions for at most a second at a time so connections that miss their deadline get
+// closed on time.
+static void *uring_loop_main(void *uring_loop) {
+    uring_loop_t *loop = (uring_loop_t *) uring_loop;
+    if(loop->cpu != NO_CPU) {
+        pin_thread_to_cpu(loop->cpu);
+    }
+    if(!worker_memory_init(&loop->memory, REQUEST_MAX_BUFFER_SIZE + NULL_TERMINATOR_SPACE)) {
+        exit(EXIT_FAILURE);
+    }
+    loop->metrics = metrics_register_worker();
+    if(!uring_init(&loop->ring, URING_ENTRIES)) {
+        perror("io_uring_setup");
+        exit(EXIT_FAILURE);
+    }
+    provide_buffers(loop);
+    submit_accept(loop);
+    submit_drain_poll(loop);
+
+    while(true) {
+        uring_submit(&loop->ring, IDLE_CHECK_INTERVAL_MS);
+        handle_completions(loop);
+        expire_connections(loop);
+    }
+    return NULL;
+}
+
+// Runs config->event_loops io_uring loops, one per thread, over the listening sockets in the same way as
+// run_event_loops. The listening sockets stay blocking, unless they were taken over from a server in another mode
+// that made them non-blocking, which the ring's accept waits on all the same. Returns false if the loops could not be
+// started.
+bool run_uring_loops(int *listenfds, server_context_t *context) {
+    server_config_t *config = context->config;
+    uring_loop_t *loops = (uring_loop_t *) malloc(config->event_loops * sizeof(uring_loop_t));
+    if(loops == NULL) {
+        perror("malloc");
+        return false;
+    }
+    for(int i = 0; i < config->event_loops; i++) {
+        loops[i].listenfd = listenfds[i % config->listeners];
+        loops[i].context = context;
+        loops[i].config = config;
+        loops[i].cpu = listener_cpu(config, i);
+        loops[i].multishot_accept = true;
+        loops[i].draining = false;
+        loops[i].idle_head = loops[i].idle_tail = NULL;
+        wheel_init(&loops[i].timers, monotonic_seconds());
+        loops[i].free_connections = NULL;
+        loops[i].num_free_connections = 0;
+        loops[i].num_spare_pipes = 0;
+        int error = pthread_create(&loops[i].thread, NULL, uring_loop_main, (void *) &loops[i]);
+        if(error != 0) {
+            fprintf(stderr, "pthread_create: %s\n", strerror(error));
+            return false;
+        }
+    }
+    return true;
+}
+
+#else
+
+// Built without io_uring ("make WITH_URING=0"), so --mode=uring always falls back to epoll.
+bool uring_supported(void) {
+    return false;
+}
+
+bool run_uring_loops(int *listenfds, server_context_t *context) {
+    return false;
+}
+
+#endif
@@ -0,0 +1,184 @@
+//
+// Created by User on 14/10/2026.
+//
+
+#ifndef COMP30023_2022_PROJECT_2_URING_H
+#define COMP30023_2022_PROJECT_2_URING_H
+
+// splice(), pipe2() and F_SETPIPE_SZ are Linux extensions.
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+
+#ifdef WITH_URING
+#include <linux/io_uring.h>
+#endif
+
+#include "parse.h"
+#include "respond.h"
+#include "listener.h"
+#include "config.h"
+#include "context.h"
+#include "arena.h"
+#include "event.h"
+#include "admission.h"
+#include "wheel.h"
+#include "restart.h"
+
+// Submission queue entries per ring. The completion queue is twice as big, and completions that do not fit are kept
+// by the kernel rather than lost (IORING_FEAT_NODROP), so this only limits how many operations go in per system call.
+#define URING_ENTRIES 1024
+// Read buffers a ring hands out itself, as the data arrives, to connections that have none, so an idle keep-alive
+// connection does not hold a buffer while it waits. A power of two, as the buffer ring requires.
+#define URING_PROVIDED_BUFFERS 256
+#define URING_BUFFER_GROUP 0
+// Bytes of a file moved through a connection's pipe by each pair of splices.
+#define URING_PIPE_SIZE (256 * 1024)
+// Pipes a loop keeps for the next file transfers once the transfers they were made for have finished.
+#define URING_SPARE_PIPES 16
+
+// What a completion is for, kept in the low bits of its user_data next to the connection it belongs to.
+// Connections are allocated by malloc(), so those bits of their address are always 0.
+#define URING_OP_ACCEPT 0
+#define URING_OP_RECV 1
+#define URING_OP_SEND 2
+#define URING_OP_SPLICE_IN 3
+#define URING_OP_SPLICE_OUT 4
+// The poll of the drain eventfd and the cancellation of the accept it leads to, which belong to no connection either.
+#define URING_OP_DRAIN 5
+#define URING_OP_CANCEL 6
+#define URING_OP_MASK 7
+
+#define NO_BUFFER_ID (-1)
+#define NO_PIPE (-1)
+
+#ifdef WITH_URING
+
+// The memory an io_uring instance shares with the kernel, mapped as described in io_uring_setup(2). The submission
+// and completion rings are one mapping (IORING_FEAT_SINGLE_MMAP) and the submission queue entries another.
+// https://man7.org/linux/man-pages/man2/io_uring_setup.2.html
+typedef struct uring uring_t;
+struct uring {
+    int fd;
+    void *rings;
+    size_t rings_size;
+    struct io_uring_sqe *sqes;
+    size_t sqes_size;
+
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_array;
+    unsigned sq_mask;
+    unsigned sq_entries;
+    // Entries filled in up to here, which the kernel is told about by the next io_uring_enter().
+    unsigned sq_local_tail;
+
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned cq_mask;
+    struct io_uring_cqe *cqes;
+};
+
+// The io_uring counterpart of event_connection_t. Nothing is done on the socket directly: every read and write is an
+// operation submitted to the loop's ring, and in_flight counts those whose completion has not arrived yet. The kernel
+// may still be using the buffer, pipe and message of a connection until then, so a connection that has to be closed
+// early is only marked closing (and its socket shut down, which ends the operations) until the count gets back to 0.
+typedef struct uring_connection uring_connection_t;
+struct uring_connection {
+    int sockfd;
+    int state;
+    int bytes_read_so_far;
+    // Either one of the ring's provided buffers (buffer_id is its index) or one from the loop's buffer pool
+    // (buffer_id is NO_BUFFER_ID).
+    char *buffer;
+    int buffer_id;
+    http_parser_t parser;
+    http_response_t response;
+    request_metrics_t metrics;
+    int requests_served;
+    bool keep_alive;
+
+    int in_flight;
+    bool closing;
+    // Set when an operation failed, so the connection is closed once the others have completed.
+    bool failed;
+
+    // File chunks are spliced from the file into this pipe and from the pipe into the socket, without being copied
+    // to user space. The connection only has a pipe while it is sending a response with a file chunk in it.
+    // pipe_pending counts bytes that went into the pipe and have not come out yet.
+    int pipefds[2];
+    size_t pipe_size;
+    size_t pipe_pending;
+    // Memory chunks are sent with IORING_OP_SENDMSG, which reads the message when it runs rather than when it is
+    // submitted, so it is kept here rather than on the stack.
+    struct iovec iov[RESPONSE_MAX_CHUNKS];
+    struct msghdr message;
+
+    // The connection's deadline, as in event_connection_t.
+    wheel_timer_t timer;
+    int deadline;
+    size_t sent_at_deadline;
+    address_count_t *address;
+    time_t last_active;
+    uring_connection_t *idle_prev;
+    uring_connection_t *idle_next;
+};
+
+// One ring and the thread that drives it. Like an event loop, each watches one of the listening sockets and keeps the
+// connections it accepts.
+typedef struct uring_loop uring_loop_t;
+struct uring_loop {
+    uring_t ring;
+    int listenfd;
+    server_context_t *context;
+    server_config_t *config;
+    int cpu;
+    pthread_t thread;
+    // Cleared if the kernel does not support IORING_ACCEPT_MULTISHOT, in which case accept is submitted again after
+    // every connection.
+    bool multishot_accept;
+    // Set once the server has started draining and the loop has stopped accepting.
+    bool draining;
+
+    uring_connection_t *idle_head;
+    uring_connection_t *idle_tail;
+    timer_wheel_t timers;
+    uring_connection_t *free_connections;
+    int num_free_connections;
+    worker_memory_t memory;
+    // The loop's metrics counters, or NULL if metrics are turned off.
+    worker_metrics_t *metrics;
+    int spare_pipes[URING_SPARE_PIPES][2];
+    int num_spare_pipes;
+
+    // The ring of provided buffers (IORING_REGISTER_PBUF_RING), or NULL if the kernel does not support it and
+    // connections take their buffers from the pool before every read instead.
+    struct io_uring_buf_ring *buffer_ring;
+    size_t buffer_ring_size;
+    char *provided_buffers;
+    unsigned short buffer_ring_tail;
+};
+
+#endif
+
+bool uring_supported(void);
+
+bool run_uring_loops(int *listenfds, server_context_t *context);
+
+#endif //COMP30023_2022_PROJECT_2_URING_H
@@ -0,0 +1,126 @@
+//
+// Created by User on 14/10/2026.
+//
+#include "validators.h"
+
+static const char *day_names[] = {"Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"};
+static const char *month_names[] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+
+// Formats time as the IMF-fixdate HTTP uses for dates, always in GMT. The names are written out here rather than with
+// strftime(), whose %a and %b depend on the locale. https://www.rfc-editor.org/rfc/rfc9110#section-5.6.7
+static void format_http_date(char *buffer, size_t buffer_size, time_t time) {
+    struct tm date;
+    gmtime_r(&time, &date);
+    snprintf(buffer, buffer_size, "%s, %02d %s %04d %02d:%02d:%02d GMT", day_names[date.tm_wday], date.tm_mday,
+             month_names[date.tm_mon], date.tm_year + 1900, date.tm_hour, date.tm_min, date.tm_sec);
+}
+
+// Works out the validators of the file described by file_stat. The ETag follows the inode, size and modification
+// time (to the nanosecond) of the file, which is what the caches also compare to see if it changed.
+void file_validators_init(file_validators_t *validators, struct stat *file_stat) {
+    snprintf(validators->etag, ETAG_MAX_SIZE, "\"%llx-%llx-%llx\"", (unsigned long long) file_stat->st_ino,
+             (unsigned long long) file_stat->st_size,
+             (unsigned long long) file_stat->st_mtim.tv_sec * 1000000000ULL + file_stat->st_mtim.tv_nsec);
+    validators->modified_time = file_stat->st_mtim.tv_sec;
+    format_http_date(validators->last_modified, HTTP_DATE_SIZE, validators->modified_time);
+}
+
+// Returns the month (0 for January) called name, or -1 if there is no such month.
+static int find_month(const char *name) {
+    for(int i = 0; i < (int) (sizeof(month_names) / sizeof(month_names[0])); i++) {
+        if(strcmp(month_names[i], name) == SAME_STRING) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Parses a date in any of the three formats HTTP recipients have to accept: the IMF-fixdate every current client
+// sends, and the obsolete RFC 850 and asctime() formats. https://www.rfc-editor.org/rfc/rfc9110#section-5.6.7
+// Returns false if value is none of them.
+bool parse_http_date(const char *buffer, http_span_t value, time_t *date) {
+    // sscanf() needs a string, and the value is only a span of the request buffer.
+    char text[HTTP_DATE_MAX_LENGTH + NULL_TERMINATOR_SPACE];
+    if(value.length > HTTP_DATE_MAX_LENGTH) {
+        return false;
+    }
+    memcpy(text, buffer + value.offset, value.length);
+    text[value.length] = '\0';
+
+    struct tm fields;
+    memset(&fields, 0, sizeof(fields));
+    char day_name[10];
+    char month_name[4];
+    // %n only records how far sscanf() got if everything before it matched, so a date with anything after it, or one
+    // that stops short, is rejected.
+    int consumed = 0;
+    if(sscanf(text, "%3[A-Za-z], %2d %3[A-Za-z] %4d %2d:%2d:%2d GMT%n", day_name, &fields.tm_mday, month_name,
+              &fields.tm_year, &fields.tm_hour, &fields.tm_min, &fields.tm_sec, &consumed) == 7 &&
+       consumed == (int) value.length) {
+        fields.tm_year -= 1900;
+    } else if(sscanf(text, "%9[A-Za-z], %2d-%3[A-Za-z]-%2d %2d:%2d:%2d GMT%n", day_name, &fields.tm_mday,
+                     month_name, &fields.tm_year, &fields.tm_hour, &fields.tm_min, &fields.tm_sec, &consumed) == 7 &&
+              consumed == (int) value.length) {
+        // RFC 850 dates only have two digits for the year. As in most servers, 70 to 99 are taken to be 1970 to 1999
+        // and the rest 2000 to 2069.
+        if(fields.tm_year < 70) {
+            fields.tm_year += 100;
+        }
+    } else if(sscanf(text, "%3[A-Za-z] %3[A-Za-z] %2d %2d:%2d:%2d %4d%n", day_name, month_name, &fields.tm_mday,
+                     &fields.tm_hour, &fields.tm_min, &fields.tm_sec, &fields.tm_year, &consumed) == 7 &&
+              consumed == (int) value.length) {
+        fields.tm_year -= 1900;
+    } else {
+        return false;
+    }
+    if((fields.tm_mon = find_month(month_name)) < 0) {
+        return false;
+    }
+    // timegm() is mktime() for a time in UTC rather than in the local time zone.
+    // https://man7.org/linux/man-pages/man3/timegm.3.html
+    *date = timegm(&fields);
+    return *date != (time_t) -1;
+}
+
+// Returns true if the value of an If-None-Match header, a comma separated list of entity tags, lists etag or is "*",
+// which stands for any tag. The comparison is weak, so a tag the client has as W/"..." still matches: the body is not
+// going to be sent either way. Anything in the list that is not an entity tag ends the search.
+// https://www.rfc-editor.org/rfc/rfc9110#section-13.1.2
+bool etag_list_matches(const char *buffer, http_span_t value, const char *etag) {
+    size_t end = value.offset + value.length;
+    size_t position = value.offset;
+    size_t etag_length = strlen(etag);
+    size_t prefix_length = strlen(WEAK_ETAG_PREFIX);
+    while(position < end) {
+        if(buffer[position] == ',' || buffer[position] == ' ' || buffer[position] == '\t') {
+            position++;
+            continue;
+        }
+        if(buffer[position] == '*') {
+            return true;
+        }
+        if(end - position >= prefix_length && memcmp(buffer + position, WEAK_ETAG_PREFIX, prefix_length) == 0) {
+            position += prefix_length;
+        }
+        if(position == end || buffer[position] != '"') {
+            return false;
+        }
+        const char *closing_quote = memchr(buffer + position + 1, '"', end - position - 1);
+        if(closing_quote == NULL) {
+            return false;
+        }
+        size_t tag_length = closing_quote + 1 - (buffer + position);
+        if(tag_length == etag_length && memcmp(buffer + position, etag, etag_length) == 0) {
+            return true;
+        }
+        position += tag_length;
+    }
+    return false;
+}
+
+// Returns true if the value of an If-Range header is exactly etag. If-Range uses the strong comparison, since the
+// client is about to splice the range into the bytes it already has, so a weak tag never matches.
+// https://www.rfc-editor.org/rfc/rfc9110#section-13.1.5
+bool etag_matches_strongly(const char *buffer, http_span_t value, const char *etag) {
+    return value.length == strlen(etag) && memcmp(buffer + value.offset, etag, value.length) == 0;
+}
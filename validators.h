@@ -0,0 +1,48 @@
+//
+// Created by User on 14/10/2026.
+//
+
+#ifndef COMP30023_2022_PROJECT_2_VALIDATORS_H
+#define COMP30023_2022_PROJECT_2_VALIDATORS_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "parse.h"
+
+// Three numbers of up to 16 hex digits each, two dashes and the quotes.
+#define ETAG_MAX_SIZE 64
+// An IMF-fixdate such as "Sun, 06 Nov 1994 08:49:37 GMT" and its null terminator.
+#define HTTP_DATE_SIZE 30
+// Longer than any of the three date formats, so anything longer is not a date.
+#define HTTP_DATE_MAX_LENGTH 40
+#define WEAK_ETAG_PREFIX "W/"
+
+// What a client can send back in If-None-Match, If-Modified-Since or If-Range to ask whether its copy of a file is
+// still current. Both are worked out once from the stat() of the file, whenever a cache opens or loads it, rather than
+// per request. https://www.rfc-editor.org/rfc/rfc9110#section-8.8
+typedef struct file_validators file_validators_t;
+struct file_validators {
+    // The entity tag, quotes included, made from the file's inode, size and modification time, so it changes whenever
+    // the file is rewritten or replaced.
+    char etag[ETAG_MAX_SIZE];
+    // The Last-Modified date as an IMF-fixdate, and the time it stands for.
+    char last_modified[HTTP_DATE_SIZE];
+    time_t modified_time;
+};
+
+void file_validators_init(file_validators_t *validators, struct stat *file_stat);
+
+bool parse_http_date(const char *buffer, http_span_t value, time_t *date);
+
+bool etag_list_matches(const char *buffer, http_span_t value, const char *etag);
+
+bool etag_matches_strongly(const char *buffer, http_span_t value, const char *etag);
+
+#endif //COMP30023_2022_PROJECT_2_VALIDATORS_H
@@ -0,0 +1,153 @@
+//
+// Created by User on 14/10/2026.
+//
+#include "watch.h"
+
+// The inotify instance watching every directory under the web root, and the path each of its watch descriptors
+// stands for, so a directory created in one of them can be found and watched in turn.
+// https://man7.org/linux/man-pages/man7/inotify.7.html
+static struct {
+    int fd;
+    char **paths;
+    int num_paths;
+    pthread_t thread;
+} watch = {NO_WATCH, NULL, 0, 0};
+
+// Moved on every time something that could be a path which was missing shows up under the web root. A path found
+// missing before the generation moved on may be there now.
+static uint64_t generation = 0;
+
+// False until the whole web root is watched, and again as soon as any directory in it could not be. Until then
+// nothing is known to move the generation on, so what was missing is only trusted for as long as the fd cache TTL.
+static bool complete = false;
+
+// Adds a watch for the directory at path. Returns false (after printing the reason) if it could not be watched, which
+// is usually because the web root has more directories than fs.inotify.max_user_watches allows.
+static bool watch_directory(const char *path) {
+    int wd = inotify_add_watch(watch.fd, path, WATCH_EVENTS);
+    if(wd < 0) {
+        // The directory was removed (or renamed) again before it could be watched.
+        if(errno == ENOENT) {
+            return true;
+        }
+        perror(path);
+        return false;
+    }
+    if(wd >= watch.num_paths) {
+        int num_paths = watch.num_paths > 0 ? watch.num_paths : WATCH_MAX_OPEN_DIRECTORIES;
+        while(num_paths <= wd) {
+            num_paths *= 2;
+        }
+        char **paths = (char **) realloc(watch.paths, num_paths * sizeof(char *));
+        if(paths == NULL) {
+            perror("realloc");
+            return false;
+        }
+        memset(paths + watch.num_paths, 0, (num_paths - watch.num_paths) * sizeof(char *));
+        watch.paths = paths;
+        watch.num_paths = num_paths;
+    }
+    // A directory that is already watched gets the same descriptor back.
+    free(watch.paths[wd]);
+    if((watch.paths[wd] = strdup(path)) == NULL) {
+        perror("strdup");
+        return false;
+    }
+    return true;
+}
+
+// Called by nftw for everything under the directory being walked. Stops the walk at the first directory that could
+// not be watched.
+static int watch_walked_directory(const char *path, const struct stat *file_stat, int type, struct FTW *ftw) {
+    (void) file_stat;
+    (void) ftw;
+    if(type == FTW_D && !watch_directory(path)) {
+        return 1;
+    }
+    return 0;
+}
+
+// Watches the directory at path and every directory below it. Symbolic links are not followed, so a file created
+// in a directory the web root only links to is not noticed, and is served once the TTL runs out instead.
+static bool watch_tree(const char *path) {
+    return nftw(path, watch_walked_directory, WATCH_MAX_OPEN_DIRECTORIES, FTW_PHYS) == 0;
+}
+
+// Handles one event: a directory that appeared is watched along with everything in it, and the path of a watch
+// that went away (because its directory was removed) is forgotten.
+static void handle_event(struct inotify_event *event) {
+    if(event->wd < 0 || event->wd >= watch.num_paths || watch.paths[event->wd] == NULL) {
+        return;
+    }
+    if(event->mask & IN_IGNORED) {
+        free(watch.paths[event->wd]);
+        watch.paths[event->wd] = NULL;
+        return;
+    }
+    if((event->mask & IN_ISDIR) && (event->mask & (IN_CREATE | IN_MOVED_TO))) {
+        char path[PATH_MAX];
+        int length = snprintf(path, sizeof(path), "%s/%s", watch.paths[event->wd], event->name);
+        if(length >= (int) sizeof(path) || !watch_tree(path)) {
+            __atomic_store_n(&complete, false, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+// The body of the watching thread. The generation only moves on once every event read has been handled, so that
+// files created in a new directory before it was watched are covered by it as well. A queue overflow (IN_Q_OVERFLOW)
+// loses events, but moving the generation on forgets everything that was missing anyway.
+static void *watch_web_root(void *arg) {
+    (void) arg;
+    char buffer[WATCH_BUFFER_SIZE] __attribute__((aligned(__alignof__(struct inotify_event))));
+    while(true) {
+        ssize_t n = read(watch.fd, buffer, sizeof(buffer));
+        if(n < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            perror("read");
+            __atomic_store_n(&complete, false, __ATOMIC_RELAXED);
+            return NULL;
+        }
+        for(char *next = buffer; next < buffer + n;) {
+            struct inotify_event *event = (struct inotify_event *) next;
+            handle_event(event);
+            next += sizeof(struct inotify_event) + event->len;
+        }
+        __atomic_add_fetch(&generation, 1, __ATOMIC_RELEASE);
+    }
+    return NULL;
+}
+
+// Watches every directory under the web root for new files, and starts the thread that reads the events. Has to be
+// called after SIGUSR1 is blocked, as with metrics_init. Returns false (after printing the reason) if the web root
+// could not be watched in full, in which case the server still runs but trusts missing paths for less long.
+bool watch_init(const char *web_root_path) {
+    if((watch.fd = inotify_init1(IN_CLOEXEC)) < 0) {
+        perror("inotify_init1");
+        return false;
+    }
+    if(!watch_tree(web_root_path)) {
+        return false;
+    }
+    // Set before the thread starts, since the thread may find a directory it cannot watch straight away.
+    __atomic_store_n(&complete, true, __ATOMIC_RELAXED);
+    int error = pthread_create(&watch.thread, NULL, watch_web_root, NULL);
+    if(error != 0) {
+        fprintf(stderr, "pthread_create: %s\n", strerror(error));
+        __atomic_store_n(&complete, false, __ATOMIC_RELAXED);
+        return false;
+    }
+    return true;
+}
+
+// Returns true while every directory under the web root is being watched, so that watch_generation moving on is the
+// only way something missing can appear.
+bool watch_complete(void) {
+    return __atomic_load_n(&complete, __ATOMIC_RELAXED);
+}
+
+// The current generation. A path has to be found missing after this is read for the two to be remembered together.
+uint64_t watch_generation(void) {
+    return __atomic_load_n(&generation, __ATOMIC_ACQUIRE);
+}
@@ -0,0 +1,41 @@
+//
+// Created by User on 14/10/2026.
+//
+
+#ifndef COMP30023_2022_PROJECT_2_WATCH_H
+#define COMP30023_2022_PROJECT_2_WATCH_H
+
+// For nftw's FTW_PHYS.
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <ftw.h>
+
+#include <sys/inotify.h>
+#include <sys/stat.h>
+
+// Events that can turn a path that could not be opened into one that can: something created in or moved into a
+// directory, or a change of permissions.
+#define WATCH_EVENTS (IN_CREATE | IN_MOVED_TO | IN_ATTRIB | IN_ONLYDIR)
+// How many directories nftw keeps open at once while walking the web root.
+#define WATCH_MAX_OPEN_DIRECTORIES 16
+// Room for a few events at a time. Each one may carry a name of up to NAME_MAX bytes.
+#define WATCH_BUFFER_SIZE (16 * (sizeof(struct inotify_event) + NAME_MAX + 1))
+#define NO_WATCH (-1)
+
+bool watch_init(const char *web_root_path);
+
+bool watch_complete(void);
+
+uint64_t watch_generation(void);
+
+#endif //COMP30023_2022_PROJECT_2_WATCH_H
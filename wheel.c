@@ -0,0 +1,53 @@
+//
+// Created by User on 14/10/2026.
+//
+#include "wheel.h"
+
+void wheel_init(timer_wheel_t *wheel, time_t now) {
+    wheel->current = now;
+    for(int i = 0; i < WHEEL_SLOTS; i++) {
+        wheel_timer_init(&wheel->slots[i]);
+    }
+}
+
+void wheel_timer_init(wheel_timer_t *timer) {
+    timer->prev = timer->next = timer;
+}
+
+// Takes a timer out of whichever slot it is in, if any.
+void wheel_cancel(wheel_timer_t *timer) {
+    timer->prev->next = timer->next;
+    timer->next->prev = timer->prev;
+    timer->prev = timer->next = timer;
+}
+
+// Sets a timer to go off at deadline, replacing whatever deadline it had. One that has already passed goes off the
+// next time the wheel is expired.
+void wheel_schedule(timer_wheel_t *wheel, wheel_timer_t *timer, time_t deadline) {
+    wheel_cancel(timer);
+    timer->deadline = deadline;
+    wheel_timer_t *slot = &wheel->slots[(deadline > wheel->current ? deadline : wheel->current) & (WHEEL_SLOTS - 1)];
+    timer->prev = slot->prev;
+    timer->next = slot;
+    slot->prev->next = timer;
+    slot->prev = timer;
+}
+
+// Returns a timer whose deadline is now or earlier, taken out of the wheel, or NULL once there are none left. The
+// caller keeps calling it until it returns NULL, and may schedule or cancel other timers in between.
+wheel_timer_t *wheel_expire(timer_wheel_t *wheel, time_t now) {
+    while(true) {
+        wheel_timer_t *slot = &wheel->slots[wheel->current & (WHEEL_SLOTS - 1)];
+        for(wheel_timer_t *timer = slot->next; timer != slot; timer = timer->next) {
+            if(timer->deadline <= now) {
+                wheel_cancel(timer);
+                return timer;
+            }
+        }
+        // Deadlines can still be scheduled for the current second, so the wheel stays on it.
+        if(wheel->current >= now) {
+            return NULL;
+        }
+        wheel->current++;
+    }
+}
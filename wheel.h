@@ -0,0 +1,47 @@
+//
+// Created by User on 14/10/2026.
+//
+
+#ifndef COMP30023_2022_PROJECT_2_WHEEL_H
+#define COMP30023_2022_PROJECT_2_WHEEL_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
+
+// One slot per second, so a deadline up to this many seconds away is found when its own slot comes round; later ones
+// share a slot with earlier deadlines and are skipped over until their round. A power of two.
+#define WHEEL_SLOTS 128
+
+// A deadline, embedded in whatever it belongs to. The slots are circular lists through prev and next, and a timer
+// that is not scheduled points at itself.
+typedef struct wheel_timer wheel_timer_t;
+struct wheel_timer {
+    time_t deadline;
+    wheel_timer_t *prev;
+    wheel_timer_t *next;
+};
+
+// A hashed timing wheel (Varghese and Lauck, "Hashed and Hierarchical Timing Wheels", scheme 6) of CLOCK_MONOTONIC
+// seconds: scheduling, moving and cancelling a deadline are all O(1), and expiring them only looks at the slots of the
+// seconds that have gone by. It belongs to one loop and is only used from that loop's thread.
+typedef struct timer_wheel timer_wheel_t;
+struct timer_wheel {
+    // Every second up to (but not including) current has been expired.
+    time_t current;
+    wheel_timer_t slots[WHEEL_SLOTS];
+};
+
+void wheel_init(timer_wheel_t *wheel, time_t now);
+
+void wheel_timer_init(wheel_timer_t *timer);
+
+void wheel_schedule(timer_wheel_t *wheel, wheel_timer_t *timer, time_t deadline);
+
+void wheel_cancel(wheel_timer_t *timer);
+
+wheel_timer_t *wheel_expire(timer_wheel_t *wheel, time_t now);
+
+#endif //COMP30023_2022_PROJECT_2_WHEEL_H